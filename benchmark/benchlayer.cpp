@@ -0,0 +1,387 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpu.h"
+#include "layer.h"
+#include "testutil.h"
+
+static int g_warmup_loop_count = 4;
+static int g_loop_count = 8;
+static int g_num_threads = 1;
+
+struct BenchmarkVariant
+{
+    const char* name;
+    bool use_packing_layout;
+    bool use_winograd_convolution;
+    bool use_winograd23_convolution;
+    bool use_winograd43_convolution;
+    bool use_winograd63_convolution;
+    bool use_sgemm_convolution;
+    bool use_bf16_storage;
+    bool int8;
+    bool winograd_only;
+};
+
+// name, packing, winograd, 23, 43, 63, sgemm, bf16, int8, winograd only
+static const BenchmarkVariant g_variants[] = {
+    {"pack1", false, true, true, true, true, true, false, false, false},
+    {"packed", true, true, true, true, true, true, false, false, false},
+    {"direct", true, false, false, false, false, false, false, false, false},
+    {"sgemm", true, false, false, false, false, true, false, false, false},
+    {"winograd23", true, true, true, false, false, false, false, false, true},
+    {"winograd43", true, true, false, true, false, false, false, false, true},
+    {"winograd63", true, true, false, false, true, false, false, false, true},
+    {"bf16", true, true, true, true, true, true, true, false, false},
+    {"int8", true, true, true, true, true, true, false, true, false},
+};
+
+static const int g_variant_count = sizeof(g_variants) / sizeof(g_variants[0]);
+
+static ncnn::Option get_variant_option(const BenchmarkVariant& v)
+{
+    ncnn::Option opt;
+    opt.num_threads = g_num_threads;
+    opt.lightmode = true;
+    opt.use_packing_layout = v.use_packing_layout;
+    opt.use_winograd_convolution = v.use_winograd_convolution;
+    opt.use_winograd23_convolution = v.use_winograd23_convolution;
+    opt.use_winograd43_convolution = v.use_winograd43_convolution;
+    opt.use_winograd63_convolution = v.use_winograd63_convolution;
+    opt.use_sgemm_convolution = v.use_sgemm_convolution;
+    opt.use_bf16_storage = v.use_bf16_storage;
+    opt.use_fp16_packed = false;
+    opt.use_fp16_storage = false;
+    opt.use_fp16_arithmetic = false;
+    opt.use_int8_inference = v.int8;
+    return opt;
+}
+
+static void report(const char* comment, const char* variant, int ret, double time_min, double time_avg, double flops)
+{
+    if (ret == 233)
+    {
+        fprintf(stderr, "%-40s  %-10s  unsupported\n", comment, variant);
+        return;
+    }
+    if (ret != 0)
+    {
+        fprintf(stderr, "%-40s  %-10s  failed\n", comment, variant);
+        return;
+    }
+
+    // time in ms, flops per ms * 1e-6 is gflop/s
+    fprintf(stderr, "%-40s  %-10s  min = %8.3f  avg = %8.3f  GFLOP/s = %8.2f\n", comment, variant, time_min, time_avg, time_min > 0 ? flops / time_min * 1e-6 : 0);
+}
+
+// input shapes of convolutions in squeezenet, mobilenet, mobilenet_v2, resnet50, vgg16 and yolov4-tiny from benchmark/
+struct ConvolutionShape
+{
+    int w;
+    int h;
+    int c;
+    int outch;
+    int kernel;
+    int dilation;
+    int stride;
+    int pad;
+};
+
+static const ConvolutionShape g_convolution_shapes[] = {
+    {224, 224, 3, 32, 3, 1, 2, 1},
+    {224, 224, 3, 64, 3, 1, 1, 1},
+    {224, 224, 64, 64, 3, 1, 1, 1},
+    {112, 112, 32, 64, 1, 1, 1, 0},
+    {112, 112, 64, 128, 3, 1, 1, 1},
+    {104, 104, 32, 32, 3, 1, 1, 1},
+    {56, 56, 16, 64, 1, 1, 1, 0},
+    {56, 56, 16, 64, 3, 1, 1, 1},
+    {56, 56, 24, 144, 1, 1, 1, 0},
+    {56, 56, 64, 64, 3, 1, 1, 1},
+    {56, 56, 64, 256, 1, 1, 1, 0},
+    {56, 56, 256, 256, 3, 1, 1, 1},
+    {52, 52, 64, 64, 3, 1, 1, 1},
+    {28, 28, 32, 192, 1, 1, 1, 0},
+    {28, 28, 128, 128, 3, 1, 1, 1},
+    {28, 28, 128, 512, 1, 1, 1, 0},
+    {28, 28, 512, 512, 3, 1, 1, 1},
+    {26, 26, 256, 256, 3, 1, 1, 1},
+    {14, 14, 64, 384, 1, 1, 1, 0},
+    {14, 14, 256, 256, 3, 1, 1, 1},
+    {14, 14, 256, 1024, 1, 1, 1, 0},
+    {14, 14, 512, 512, 1, 1, 1, 0},
+    {14, 14, 1024, 256, 1, 1, 1, 0},
+    {7, 7, 160, 960, 1, 1, 1, 0},
+    {7, 7, 512, 512, 3, 1, 1, 1},
+    {7, 7, 1024, 1024, 1, 1, 1, 0},
+};
+
+static void benchmark_convolution(const ConvolutionShape& s)
+{
+    const int kernel_extent = s.dilation * (s.kernel - 1) + 1;
+    const int outw = (s.w + s.pad * 2 - kernel_extent) / s.stride + 1;
+    const int outh = (s.h + s.pad * 2 - kernel_extent) / s.stride + 1;
+    const double flops = 2.0 * outw * outh * s.outch * s.c * s.kernel * s.kernel;
+
+    const bool winograd_able = s.kernel == 3 && s.dilation == 1 && s.stride == 1;
+
+    char comment[256];
+    sprintf(comment, "conv %dx%dx%d o=%d k=%d d=%d s=%d p=%d", s.w, s.h, s.c, s.outch, s.kernel, s.dilation, s.stride, s.pad);
+
+    ncnn::Mat a = RandomMat(s.w, s.h, s.c);
+
+    for (int i = 0; i < g_variant_count; i++)
+    {
+        const BenchmarkVariant& v = g_variants[i];
+        if (v.winograd_only && !winograd_able)
+            continue;
+
+        ncnn::ParamDict pd;
+        pd.set(0, s.outch);
+        pd.set(1, s.kernel);
+        pd.set(2, s.dilation);
+        pd.set(3, s.stride);
+        pd.set(4, s.pad);
+        pd.set(5, 1);
+        pd.set(6, s.outch * s.c * s.kernel * s.kernel);
+        pd.set(8, v.int8 ? 1 : 0); // int8_scale_term
+
+        std::vector<ncnn::Mat> weights(v.int8 ? 4 : 2);
+        weights[0] = RandomMat(s.outch * s.c * s.kernel * s.kernel);
+        weights[1] = RandomMat(s.outch);
+        if (v.int8)
+        {
+            weights[2] = scales_mat(weights[0], s.outch, s.c * s.kernel * s.kernel, s.c * s.kernel * s.kernel);
+            weights[3] = scales_mat(a, 1, s.w * s.h * s.c, a.cstep);
+        }
+
+        std::vector<ncnn::Mat> inputs(1, a);
+
+        double time_min = 0;
+        double time_avg = 0;
+        int ret = benchmark_layer_cpu(ncnn::layer_to_index("Convolution"), pd, weights, get_variant_option(v), inputs, 1, g_warmup_loop_count, g_loop_count, time_min, time_avg);
+
+        report(comment, v.name, ret, time_min, time_avg, flops);
+    }
+}
+
+static void benchmark_gemm(int M, int N, int K)
+{
+    const double flops = 2.0 * M * N * K;
+
+    char comment[256];
+    sprintf(comment, "gemm M=%d N=%d K=%d", M, N, K);
+
+    // A input, B constant as linear layer
+    ncnn::ParamDict pd;
+    pd.set(2, 0); // transA
+    pd.set(3, 1); // transB
+    pd.set(4, 0); // constantA
+    pd.set(5, 1); // constantB
+    pd.set(6, 1); // constantC
+    pd.set(7, M);
+    pd.set(8, N);
+    pd.set(9, K);
+    pd.set(10, -1); // no C
+
+    std::vector<ncnn::Mat> weights(1);
+    weights[0] = RandomMat(K, N);
+
+    std::vector<ncnn::Mat> inputs(1);
+    inputs[0] = RandomMat(K, M);
+
+    for (int i = 0; i < g_variant_count; i++)
+    {
+        const BenchmarkVariant& v = g_variants[i];
+        if (v.winograd_only || v.int8 || strcmp(v.name, "direct") == 0 || strcmp(v.name, "sgemm") == 0)
+            continue;
+
+        double time_min = 0;
+        double time_avg = 0;
+        int ret = benchmark_layer_cpu(ncnn::layer_to_index("Gemm"), pd, weights, get_variant_option(v), inputs, 1, g_warmup_loop_count, g_loop_count, time_min, time_avg);
+
+        report(comment, v.name, ret, time_min, time_avg, flops);
+    }
+}
+
+static void benchmark_gemm_weightquant(int M, int N, int K, int bits)
+{
+    const double flops = 2.0 * M * N * K;
+
+    char comment[256];
+    sprintf(comment, "gemm int%d weight M=%d N=%d K=%d", bits, M, N, K);
+
+    const int group_size = 32;
+
+    ncnn::ParamDict pd;
+    pd.set(2, 0); // transA
+    pd.set(3, 1); // transB
+    pd.set(4, 0); // constantA
+    pd.set(5, 1); // constantB
+    pd.set(6, 1); // constantC
+    pd.set(7, M);
+    pd.set(8, N);
+    pd.set(9, K);
+    pd.set(10, -1); // no C
+    pd.set(15, bits);
+    pd.set(16, group_size);
+
+    std::vector<ncnn::Mat> weights(2);
+    weights[0] = RandomS8Mat((bits == 4 ? (K + 1) / 2 : K) * N);
+    weights[1] = RandomMat((K + group_size - 1) / group_size * N, 0.001f, 0.02f);
+
+    std::vector<ncnn::Mat> inputs(1);
+    inputs[0] = RandomMat(K, M);
+
+    // quantized weight is consumed in fp32 row-major layout only
+    const BenchmarkVariant& v = g_variants[0];
+
+    double time_min = 0;
+    double time_avg = 0;
+    int ret = benchmark_layer_cpu(ncnn::layer_to_index("Gemm"), pd, weights, get_variant_option(v), inputs, 1, g_warmup_loop_count, g_loop_count, time_min, time_avg);
+
+    report(comment, v.name, ret, time_min, time_avg, flops);
+}
+
+static void benchmark_multiheadattention(int seqlen, int embed_dim, int num_heads)
+{
+    // q k v and out projections, q * k and attention * v
+    const double flops = 2.0 * (4.0 * seqlen * embed_dim * embed_dim + 2.0 * seqlen * seqlen * embed_dim);
+
+    char comment[256];
+    sprintf(comment, "mha L=%d E=%d heads=%d", seqlen, embed_dim, num_heads);
+
+    ncnn::ParamDict pd;
+    pd.set(0, embed_dim);
+    pd.set(1, num_heads);
+    pd.set(2, embed_dim * embed_dim);
+    pd.set(3, embed_dim);
+    pd.set(4, embed_dim);
+
+    std::vector<ncnn::Mat> weights(8);
+    for (int i = 0; i < 4; i++)
+    {
+        weights[i * 2] = RandomMat(embed_dim * embed_dim);
+        weights[i * 2 + 1] = RandomMat(embed_dim);
+    }
+
+    // self attention
+    std::vector<ncnn::Mat> inputs(1);
+    inputs[0] = RandomMat(embed_dim, seqlen);
+
+    for (int i = 0; i < g_variant_count; i++)
+    {
+        const BenchmarkVariant& v = g_variants[i];
+        if (v.winograd_only || v.int8 || strcmp(v.name, "direct") == 0 || strcmp(v.name, "sgemm") == 0)
+            continue;
+
+        double time_min = 0;
+        double time_avg = 0;
+        int ret = benchmark_layer_cpu(ncnn::layer_to_index("MultiHeadAttention"), pd, weights, get_variant_option(v), inputs, 1, g_warmup_loop_count, g_loop_count, time_min, time_avg);
+
+        report(comment, v.name, ret, time_min, time_avg, flops);
+    }
+}
+
+static void show_usage()
+{
+    fprintf(stderr, "Usage: benchlayer [loop count] [num threads] [conv/gemm/mha]\n");
+}
+
+int main(int argc, char** argv)
+{
+    const char* suite = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0)
+        {
+            show_usage();
+            return -1;
+        }
+    }
+
+    g_num_threads = ncnn::get_physical_big_cpu_count();
+
+    if (argc >= 2)
+    {
+        g_loop_count = atoi(argv[1]);
+    }
+    if (argc >= 3)
+    {
+        g_num_threads = atoi(argv[2]);
+    }
+    if (argc >= 4)
+    {
+        suite = argv[3];
+    }
+
+    ncnn::set_omp_dynamic(0);
+    ncnn::set_omp_num_threads(g_num_threads);
+
+    fprintf(stderr, "loop_count = %d\n", g_loop_count);
+    fprintf(stderr, "num_threads = %d\n", g_num_threads);
+
+    SRAND(7767517);
+
+    if (!suite || strcmp(suite, "conv") == 0)
+    {
+        const int shape_count = sizeof(g_convolution_shapes) / sizeof(g_convolution_shapes[0]);
+        for (int i = 0; i < shape_count; i++)
+        {
+            benchmark_convolution(g_convolution_shapes[i]);
+        }
+    }
+
+    if (!suite || strcmp(suite, "gemm") == 0)
+    {
+        static const int sizes[] = {64, 256, 1024};
+        for (int i = 0; i < 3; i++)
+        {
+            for (int j = 0; j < 3; j++)
+            {
+                for (int k = 0; k < 3; k++)
+                {
+                    benchmark_gemm(sizes[i], sizes[j], sizes[k]);
+                }
+            }
+        }
+
+        // skinny matrices of single token inference
+        benchmark_gemm(1, 4096, 4096);
+        benchmark_gemm(8, 4096, 4096);
+
+        // weight-only quantized linear layer from decode to prefill
+        static const int rows[] = {1, 8, 32, 256};
+        for (int i = 0; i < 4; i++)
+        {
+            benchmark_gemm_weightquant(rows[i], 4096, 4096, 4);
+            benchmark_gemm_weightquant(rows[i], 4096, 4096, 8);
+        }
+    }
+
+    if (!suite || strcmp(suite, "mha") == 0)
+    {
+        benchmark_multiheadattention(64, 256, 4);
+        benchmark_multiheadattention(197, 768, 12);
+        benchmark_multiheadattention(256, 512, 8);
+        benchmark_multiheadattention(1024, 512, 8);
+    }
+
+    return 0;
+}
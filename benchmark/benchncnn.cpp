@@ -13,23 +13,39 @@
 // specific language governing permissions and limitations under the License.
 
 #include <float.h>
+#include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #ifdef __EMSCRIPTEN__
 #include <emscripten.h>
 #endif
 
+#if defined __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#elif defined __APPLE__
+#include <sys/resource.h>
+#endif
+
 #include "benchmark.h"
 #include "cpu.h"
 #include "datareader.h"
 #include "net.h"
+#include "profiler.h"
 #include "gpu.h"
 
 #ifndef NCNN_SIMPLESTL
 #include <vector>
 #endif
 
+#ifdef __EMSCRIPTEN__
+#define MODEL_DIR "/working/"
+#else
+#define MODEL_DIR ""
+#endif
+
 class DataReaderFromEmpty : public ncnn::DataReader
 {
 public:
@@ -47,9 +63,46 @@ public:
 static int g_warmup_loop_count = 8;
 static int g_loop_count = 4;
 static bool g_enable_cooling_down = true;
+static bool g_load_report = false;
+static bool g_profile = false;
+static bool g_roofline = false;
+static bool g_perf = false;
+static bool g_memory = false;
+static double g_duration = 0;
+static int g_stream_count = 1;
+static int g_stream_threads = 1;
+static bool g_stream_share_model = true;
+static bool g_coldstart = false;
+static bool g_evict_cache = true;
+static bool g_use_mmap = false;
+static bool g_streaming_load = false;
+static const char* g_binpath = 0;
+
+struct BenchmarkStats
+{
+    char model[256];
+    int count;
+    double min;
+    double max;
+    double avg;
+    double stddev;
+    double p50;
+    double p90;
+    double p99;
+};
+
+static std::vector<BenchmarkStats> g_results;
+static std::vector<BenchmarkStats> g_baseline;
+static double g_regression_threshold = 0.05;
+static int g_regression_count = 0;
 
 static ncnn::UnlockedPoolAllocator g_blob_pool_allocator;
 static ncnn::PoolAllocator g_workspace_pool_allocator;
+static ncnn::BinnedPoolAllocator g_binned_pool_allocator;
+static bool g_binned_pool = false;
+
+static ncnn::HugePageAllocator g_huge_page_allocator;
+static bool g_huge_page = false;
 
 #if NCNN_VULKAN
 static ncnn::VulkanDevice* g_vkdev = 0;
@@ -57,10 +110,834 @@ static ncnn::VkAllocator* g_blob_vkallocator = 0;
 static ncnn::VkAllocator* g_staging_vkallocator = 0;
 #endif // NCNN_VULKAN
 
+static int compare_double(const void* a, const void* b)
+{
+    const double da = *(const double*)a;
+    const double db = *(const double*)b;
+    return da < db ? -1 : da > db ? 1 : 0;
+}
+
+// linear interpolation between closest ranks of sorted times
+static double get_percentile(const std::vector<double>& sorted_times, double q)
+{
+    const double pos = q * (sorted_times.size() - 1);
+    const int i = (int)pos;
+    if (i + 1 >= (int)sorted_times.size())
+        return sorted_times[sorted_times.size() - 1];
+
+    return sorted_times[i] + (sorted_times[i + 1] - sorted_times[i]) * (pos - i);
+}
+
+static BenchmarkStats get_stats(const char* comment, std::vector<double>& times)
+{
+    BenchmarkStats stats;
+    memset(&stats, 0, sizeof(stats));
+    strncpy(stats.model, comment, sizeof(stats.model) - 1);
+    stats.count = (int)times.size();
+    if (times.empty())
+        return stats;
+
+    qsort(&times[0], times.size(), sizeof(double), compare_double);
+
+    double sum = 0;
+    for (size_t i = 0; i < times.size(); i++)
+    {
+        sum += times[i];
+    }
+    stats.avg = sum / times.size();
+
+    // sample standard deviation
+    double sqsum = 0;
+    for (size_t i = 0; i < times.size(); i++)
+    {
+        sqsum += (times[i] - stats.avg) * (times[i] - stats.avg);
+    }
+    stats.stddev = times.size() > 1 ? sqrt(sqsum / (times.size() - 1)) : 0;
+
+    stats.min = times[0];
+    stats.max = times[times.size() - 1];
+    stats.p50 = get_percentile(times, 0.50);
+    stats.p90 = get_percentile(times, 0.90);
+    stats.p99 = get_percentile(times, 0.99);
+
+    return stats;
+}
+
+static void write_json_string(FILE* fp, const char* s)
+{
+    fputc('"', fp);
+    for (; *s; s++)
+    {
+        if (*s == '"' || *s == '\\')
+            fputc('\\', fp);
+        fputc(*s, fp);
+    }
+    fputc('"', fp);
+}
+
+// one result per line, so that load_baseline does not need a json parser
+static int save_results(const char* path, int num_threads)
+{
+    FILE* fp = fopen(path, "wb");
+    if (!fp)
+    {
+        fprintf(stderr, "fopen %s failed\n", path);
+        return -1;
+    }
+
+    fprintf(fp, "{\"num_threads\":%d,\"results\":[\n", num_threads);
+    for (size_t i = 0; i < g_results.size(); i++)
+    {
+        const BenchmarkStats& r = g_results[i];
+        fprintf(fp, "{\"model\":");
+        write_json_string(fp, r.model);
+        fprintf(fp, ",\"count\":%d,\"min\":%.4f,\"max\":%.4f,\"avg\":%.4f,\"std\":%.4f,\"p50\":%.4f,\"p90\":%.4f,\"p99\":%.4f}%s\n", r.count, r.min, r.max, r.avg, r.stddev, r.p50, r.p90, r.p99, i + 1 == g_results.size() ? "" : ",");
+    }
+    fprintf(fp, "]}\n");
+
+    fclose(fp);
+
+    return 0;
+}
+
+static double find_json_number(const char* line, const char* key)
+{
+    const char* p = strstr(line, key);
+    return p ? atof(p + strlen(key)) : 0;
+}
+
+// read results written by save_results
+static int load_baseline(const char* path)
+{
+    FILE* fp = fopen(path, "rb");
+    if (!fp)
+    {
+        fprintf(stderr, "fopen %s failed\n", path);
+        return -1;
+    }
+
+    char line[1024];
+    while (fgets(line, sizeof(line), fp))
+    {
+        const char* p = strstr(line, "{\"model\":\"");
+        if (!p)
+            continue;
+
+        BenchmarkStats stats;
+        memset(&stats, 0, sizeof(stats));
+
+        p += strlen("{\"model\":\"");
+        for (int i = 0; *p && *p != '"' && i < (int)sizeof(stats.model) - 1; p++, i++)
+        {
+            if (*p == '\\' && p[1])
+                p++;
+            stats.model[i] = *p;
+        }
+
+        stats.count = (int)find_json_number(p, "\"count\":");
+        stats.min = find_json_number(p, "\"min\":");
+        stats.max = find_json_number(p, "\"max\":");
+        stats.avg = find_json_number(p, "\"avg\":");
+        stats.stddev = find_json_number(p, "\"std\":");
+        stats.p50 = find_json_number(p, "\"p50\":");
+        stats.p90 = find_json_number(p, "\"p90\":");
+        stats.p99 = find_json_number(p, "\"p99\":");
+
+        g_baseline.push_back(stats);
+    }
+
+    fclose(fp);
+
+    return 0;
+}
+
+// flag slowdown beyond threshold that welch's t-test finds significant at 95% one-sided
+static void compare_baseline(const BenchmarkStats& stats)
+{
+    const BenchmarkStats* base = 0;
+    for (size_t i = 0; i < g_baseline.size(); i++)
+    {
+        if (strcmp(g_baseline[i].model, stats.model) == 0)
+            base = &g_baseline[i];
+    }
+
+    if (!base || base->avg <= 0)
+    {
+        fprintf(stderr, "%20s  no baseline\n", stats.model);
+        return;
+    }
+
+    const double change = (stats.avg - base->avg) / base->avg;
+
+    const double v0 = base->count > 0 ? base->stddev * base->stddev / base->count : 0;
+    const double v1 = stats.count > 0 ? stats.stddev * stats.stddev / stats.count : 0;
+    const double se = sqrt(v0 + v1);
+
+    bool significant = true;
+    double t = 0;
+    if (se > 0)
+    {
+        t = fabs(stats.avg - base->avg) / se;
+
+        // welch-satterthwaite degrees of freedom, student t quantile by cornish-fisher expansion
+        const double dv0 = base->count > 1 ? v0 * v0 / (base->count - 1) : 0;
+        const double dv1 = stats.count > 1 ? v1 * v1 / (stats.count - 1) : 0;
+        const double df = dv0 + dv1 > 0 ? (v0 + v1) * (v0 + v1) / (dv0 + dv1) : 1;
+        const double z = 1.6449;
+        const double t_crit = z + (z * z * z + z) / (4 * df) + (5 * z * z * z * z * z + 16 * z * z * z + 3 * z) / (96 * df * df);
+
+        significant = t > t_crit;
+    }
+
+    const char* verdict = "unchanged";
+    if (significant && change > g_regression_threshold)
+    {
+        verdict = "REGRESSION";
+        g_regression_count++;
+    }
+    else if (significant && change < -g_regression_threshold)
+    {
+        verdict = "improved";
+    }
+
+    fprintf(stderr, "%20s  baseline avg = %7.2f  change = %+6.1f%%  t = %6.2f  %s\n", stats.model, base->avg, change * 100, t, verdict);
+}
+
+// per-layer achieved throughput from the fastest of the profiled runs
+static void print_roofline(const char* comment, const ncnn::Net& net, const std::vector<ncnn::LayerProfile>& records)
+{
+    const std::vector<ncnn::Layer*>& layers = net.layers();
+
+    std::vector<double> layer_times(layers.size(), DBL_MAX);
+    std::vector<ncnn::LayerCost> layer_costs(layers.size());
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        const ncnn::LayerProfile& r = records[i];
+        layer_times[r.layer_index] = std::min(layer_times[r.layer_index], r.end - r.start);
+        layer_costs[r.layer_index] = r.cost;
+    }
+
+    double time_sum = 0;
+    double flops_sum = 0;
+    double bytes_sum = 0;
+    for (size_t i = 0; i < layers.size(); i++)
+    {
+        if (layer_times[i] == DBL_MAX)
+            continue;
+
+        const double time = layer_times[i];
+        const double flops = layer_costs[i].flops;
+        const double bytes = layer_costs[i].bytes_read + layer_costs[i].bytes_written;
+
+        // time in ms, flops per ms * 1e-6 is gflop/s
+        const double gflops = time > 0 ? flops / time * 1e-6 : 0;
+        const double gbps = time > 0 ? bytes / time * 1e-6 : 0;
+        const double intensity = bytes > 0 ? flops / bytes : 0;
+
+        fprintf(stderr, "%20s  %-24s %-24s  time = %7.3f  MFLOP = %9.2f  MB = %8.2f  GFLOP/s = %7.2f  GB/s = %7.2f  FLOP/B = %7.2f\n", comment, layers[i]->type.c_str(), layers[i]->name.c_str(), time, flops * 1e-6, bytes * 1e-6, gflops, gbps, intensity);
+
+        time_sum += time;
+        flops_sum += flops;
+        bytes_sum += bytes;
+    }
+
+    fprintf(stderr, "%20s  layer time sum = %7.2f  MFLOP = %9.2f  MB = %8.2f  GFLOP/s = %7.2f  GB/s = %7.2f\n", comment, time_sum, flops_sum * 1e-6, bytes_sum * 1e-6, time_sum > 0 ? flops_sum / time_sum * 1e-6 : 0, time_sum > 0 ? bytes_sum / time_sum * 1e-6 : 0);
+}
+
+// per-layer hardware events of the fastest of the profiled runs
+static void print_hardware_counters(const char* comment, const ncnn::Net& net, const std::vector<ncnn::LayerProfile>& records)
+{
+    const std::vector<ncnn::Layer*>& layers = net.layers();
+
+    std::vector<double> layer_times(layers.size(), DBL_MAX);
+    std::vector<ncnn::HardwareCounters> layer_counters(layers.size());
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        const ncnn::LayerProfile& r = records[i];
+        if (r.end - r.start < layer_times[r.layer_index])
+        {
+            layer_times[r.layer_index] = r.end - r.start;
+            layer_counters[r.layer_index] = r.counters;
+        }
+    }
+
+    ncnn::HardwareCounters sum;
+    sum.cycles = 0;
+    sum.instructions = 0;
+    sum.l1d_read_misses = 0;
+    sum.llc_misses = 0;
+    sum.branch_misses = 0;
+    for (size_t i = 0; i < layers.size(); i++)
+    {
+        if (layer_times[i] == DBL_MAX)
+            continue;
+
+        const ncnn::HardwareCounters& c = layer_counters[i];
+
+        // -1 printed as unavailable
+        const double ipc = c.cycles > 0 && c.instructions >= 0 ? (double)c.instructions / c.cycles : -1;
+
+        fprintf(stderr, "%20s  %-24s %-24s  Mcycles = %9.3f  IPC = %5.2f  L1D miss = %9lld  LLC miss = %8lld  branch miss = %8lld\n", comment, layers[i]->type.c_str(), layers[i]->name.c_str(), c.cycles * 1e-6, ipc, (long long)c.l1d_read_misses, (long long)c.llc_misses, (long long)c.branch_misses);
+
+        sum.cycles += c.cycles > 0 ? c.cycles : 0;
+        sum.instructions += c.instructions > 0 ? c.instructions : 0;
+        sum.l1d_read_misses += c.l1d_read_misses > 0 ? c.l1d_read_misses : 0;
+        sum.llc_misses += c.llc_misses > 0 ? c.llc_misses : 0;
+        sum.branch_misses += c.branch_misses > 0 ? c.branch_misses : 0;
+    }
+
+    fprintf(stderr, "%20s  layer sum  Mcycles = %9.3f  IPC = %5.2f  L1D miss = %9lld  LLC miss = %8lld  branch miss = %8lld\n", comment, sum.cycles * 1e-6, sum.cycles > 0 ? (double)sum.instructions / sum.cycles : 0, (long long)sum.l1d_read_misses, (long long)sum.llc_misses, (long long)sum.branch_misses);
+}
+
+// per-layer live memory timeline and largest contributors at the peak
+static void print_memory_report(const char* comment, const ncnn::Net& net, const ncnn::TrackingAllocator& tracker)
+{
+    const std::vector<ncnn::Layer*>& layers = net.layers();
+
+    const std::vector<ncnn::LayerMemory> timeline = tracker.timeline();
+    for (size_t i = 0; i < timeline.size(); i++)
+    {
+        const ncnn::LayerMemory& m = timeline[i];
+        const ncnn::Layer* layer = layers[m.layer_index];
+
+        fprintf(stderr, "%20s  %-24s %-24s  allocated = %8.2f MB in %3d  peak = %8.2f MB  live = %8.2f MB\n", comment, layer->type.c_str(), layer->name.c_str(), m.allocated_bytes / 1024.0 / 1024.0, m.allocation_count, m.peak_bytes / 1024.0 / 1024.0, m.live_bytes / 1024.0 / 1024.0);
+    }
+
+    const size_t peak = tracker.peak_bytes();
+    fprintf(stderr, "%20s  peak memory = %8.2f MB\n", comment, peak / 1024.0 / 1024.0);
+
+    const std::vector<std::pair<int, size_t> > contributors = tracker.peak_contributors();
+    for (size_t i = 0; i < contributors.size() && i < 10; i++)
+    {
+        const int layer_index = contributors[i].first;
+        const size_t bytes = contributors[i].second;
+        const char* type = layer_index == -1 ? "-" : layers[layer_index]->type.c_str();
+        const char* name = layer_index == -1 ? "(outside layers)" : layers[layer_index]->name.c_str();
+
+        fprintf(stderr, "%20s  %-24s %-24s  live at peak = %8.2f MB  %5.1f%%\n", comment, type, name, bytes / 1024.0 / 1024.0, peak > 0 ? bytes * 100.0 / peak : 0);
+    }
+}
+
+// reuse of binned pool allocator since hits0 and misses0
+static void print_binned_pool_stats(const char* comment, size_t hits0, size_t misses0)
+{
+    const size_t hits = g_binned_pool_allocator.hits() - hits0;
+    const size_t misses = g_binned_pool_allocator.misses() - misses0;
+
+    fprintf(stderr, "%20s  binned pool  hits = %lu  misses = %lu  cached = %.2f MB\n", comment, (unsigned long)hits, (unsigned long)misses, g_binned_pool_allocator.bytes_cached() / 1024.0 / 1024.0);
+}
+
+// regions held by huge page allocator
+static void print_huge_page_stats(const char* comment)
+{
+    fprintf(stderr, "%20s  huge page  mapped = %.2f MB  hugetlb = %.2f MB\n", comment, g_huge_page_allocator.bytes_mapped() / 1024.0 / 1024.0, g_huge_page_allocator.bytes_hugetlb() / 1024.0 / 1024.0);
+}
+
+static void sum_layer_load_times(const char* comment, const ncnn::Net& net, bool print, double& load_sum, double& pipeline_sum)
+{
+    const std::vector<ncnn::Layer*>& layers = net.layers();
+    const std::vector<double>& load_times = net.layer_load_times();
+    const std::vector<double>& pipeline_times = net.layer_pipeline_times();
+
+    load_sum = 0;
+    pipeline_sum = 0;
+    for (size_t i = 0; i < layers.size() && i < load_times.size(); i++)
+    {
+        if (print)
+        {
+            fprintf(stderr, "%20s  %-24s %-24s  load = %7.2f  pipeline = %7.2f\n", comment, layers[i]->type.c_str(), layers[i]->name.c_str(), load_times[i], pipeline_times[i]);
+        }
+
+        load_sum += load_times[i];
+        pipeline_sum += pipeline_times[i];
+    }
+}
+
+// reset peak resident set size of this process, linux only
+static void reset_peak_rss()
+{
+#if defined __linux__
+    FILE* fp = fopen("/proc/self/clear_refs", "wb");
+    if (fp)
+    {
+        fputs("5", fp);
+        fclose(fp);
+    }
+#endif
+}
+
+// peak resident set size in MB since process start or reset_peak_rss, 0 if unknown
+static double get_peak_rss()
+{
+#if defined __linux__
+    double peak = 0;
+    FILE* fp = fopen("/proc/self/status", "rb");
+    if (fp)
+    {
+        char line[256];
+        while (fgets(line, sizeof(line), fp))
+        {
+            if (strncmp(line, "VmHWM:", 6) == 0)
+            {
+                peak = atof(line + 6) / 1024;
+                break;
+            }
+        }
+        fclose(fp);
+    }
+    return peak;
+#elif defined __APPLE__
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0 / 1024.0;
+#else
+    return 0;
+#endif
+}
+
+// drop cached pages of model file, so that load_model reads from storage
+static void evict_file_cache(const char* path)
+{
+#if defined __linux__
+    int fd = open(path, O_RDONLY);
+    if (fd != -1)
+    {
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+#else
+    (void)path;
+#endif
+}
+
+// time from nothing to the first inference, each loop on a fresh net
+static void benchmark_coldstart(const char* comment, const std::vector<ncnn::Mat>& _in, const ncnn::Option& opt, bool fixed_path)
+{
+    char parampath[256];
+    char binpath[256];
+    if (fixed_path)
+    {
+        sprintf(parampath, MODEL_DIR "%s.param", comment);
+        sprintf(binpath, MODEL_DIR "%s.bin", comment);
+    }
+    else
+    {
+        sprintf(parampath, "%s", comment);
+        if (g_binpath)
+        {
+            sprintf(binpath, "%s", g_binpath);
+        }
+        else
+        {
+            // model.param -> model.bin
+            sprintf(binpath, "%s", comment);
+            char* ext = strstr(binpath, ".param");
+            if (ext)
+                strcpy(ext, ".bin");
+        }
+    }
+
+    FILE* fp = fopen(binpath, "rb");
+    const bool has_bin = fp != 0;
+    if (fp)
+    {
+        fclose(fp);
+    }
+    else
+    {
+        fprintf(stderr, "%20s  %s not found, weights are zero filled without io\n", comment, binpath);
+    }
+
+    double param_time = 0;
+    double model_time = 0;
+    double read_time = 0;
+    double pipeline_time = 0;
+    double first_time = 0;
+    double total_time = 0;
+    double peak_rss = 0;
+
+    for (int i = 0; i < g_loop_count; i++)
+    {
+        if (has_bin && g_evict_cache)
+        {
+            evict_file_cache(binpath);
+        }
+
+        g_blob_pool_allocator.clear();
+        g_workspace_pool_allocator.clear();
+
+        reset_peak_rss();
+
+        double start = ncnn::get_current_time();
+
+        ncnn::Net net;
+        net.opt = opt;
+#if NCNN_VULKAN
+        if (net.opt.use_vulkan_compute)
+        {
+            net.set_vulkan_device(g_vkdev);
+        }
+#endif // NCNN_VULKAN
+
+        net.load_param(parampath);
+
+        double param_end = ncnn::get_current_time();
+
+        if (!has_bin)
+        {
+            DataReaderFromEmpty dr;
+            net.load_model(dr);
+        }
+        else if (g_use_mmap)
+        {
+            net.load_model_mmap(binpath);
+        }
+        else if (g_streaming_load)
+        {
+            net.load_model_async(binpath);
+        }
+        else
+        {
+            net.load_model(binpath);
+        }
+
+        double model_end = ncnn::get_current_time();
+
+        const std::vector<const char*>& input_names = net.input_names();
+        const std::vector<const char*>& output_names = net.output_names();
+
+        if (input_names.size() > _in.size())
+        {
+            fprintf(stderr, "input %ld tensors while model has %ld inputs\n", _in.size(), input_names.size());
+            return;
+        }
+
+        {
+            ncnn::Extractor ex = net.create_extractor();
+            for (size_t j = 0; j < input_names.size(); ++j)
+            {
+                ncnn::Mat in = _in[j];
+                ex.input(input_names[j], in);
+            }
+
+            for (size_t j = 0; j < output_names.size(); ++j)
+            {
+                ncnn::Mat out;
+                ex.extract(output_names[j], out);
+            }
+        }
+
+        double end = ncnn::get_current_time();
+
+        // loader may still be reading weights of layers not needed by outputs
+        net.wait_model_loaded();
+
+        // pipelines created lazily by the first inference are included
+        double load_sum = 0;
+        double pipeline_sum = 0;
+        sum_layer_load_times(comment, net, g_load_report && i == 0, load_sum, pipeline_sum);
+
+        param_time += param_end - start;
+        model_time += model_end - param_end;
+        read_time += load_sum;
+        pipeline_time += pipeline_sum;
+        first_time += end - model_end;
+        total_time += end - start;
+        peak_rss = std::max(peak_rss, get_peak_rss());
+    }
+
+    fprintf(stderr, "%20s  load_param = %7.2f  load_model = %7.2f  read = %7.2f  pipeline = %7.2f  first = %7.2f  total = %7.2f  peak_rss = %7.2f MB\n", comment, param_time / g_loop_count, model_time / g_loop_count, read_time / g_loop_count, pipeline_time / g_loop_count, first_time / g_loop_count, total_time / g_loop_count, peak_rss);
+}
+
+struct BenchmarkStream
+{
+    ncnn::Net net;
+    ncnn::UnlockedPoolAllocator blob_pool_allocator;
+    ncnn::PoolAllocator workspace_pool_allocator;
+#if NCNN_VULKAN
+    ncnn::VkAllocator* blob_vkallocator;
+    ncnn::VkAllocator* staging_vkallocator;
+#endif // NCNN_VULKAN
+
+    const std::vector<ncnn::Mat>* inputs;
+    std::vector<double> times;
+
+    // shared by all streams
+    ncnn::Mutex* lock;
+    ncnn::ConditionVariable* condition;
+    int* ready_count;
+    bool* started;
+    double* loop_start;
+};
+
+static void run_stream_once(const ncnn::Net& net, const std::vector<ncnn::Mat>& inputs)
+{
+    const std::vector<const char*>& input_names = net.input_names();
+    const std::vector<const char*>& output_names = net.output_names();
+
+    ncnn::Extractor ex = net.create_extractor();
+    for (size_t j = 0; j < input_names.size(); ++j)
+    {
+        ex.input(input_names[j], inputs[j]);
+    }
+
+    for (size_t j = 0; j < output_names.size(); ++j)
+    {
+        ncnn::Mat out;
+        ex.extract(output_names[j], out);
+    }
+}
+
+static void* benchmark_stream_worker(void* args)
+{
+    BenchmarkStream* stream = (BenchmarkStream*)args;
+
+    for (int i = 0; i < g_warmup_loop_count; i++)
+    {
+        run_stream_once(stream->net, *stream->inputs);
+    }
+
+    // all streams start timing together after warm up
+    stream->lock->lock();
+    *stream->ready_count -= 1;
+    if (*stream->ready_count == 0)
+    {
+        *stream->loop_start = ncnn::get_current_time();
+        *stream->started = true;
+        stream->condition->broadcast();
+    }
+    while (!*stream->started)
+    {
+        stream->condition->wait(*stream->lock);
+    }
+    const double loop_start = *stream->loop_start;
+    stream->lock->unlock();
+
+    for (int i = 0; i < g_loop_count || ncnn::get_current_time() - loop_start < g_duration * 1000; i++)
+    {
+        double start = ncnn::get_current_time();
+
+        run_stream_once(stream->net, *stream->inputs);
+
+        double end = ncnn::get_current_time();
+
+        stream->times.push_back(end - start);
+    }
+
+    return 0;
+}
+
+// run g_stream_count extractors concurrently, each on its own net with g_stream_threads threads
+static void benchmark_streams(const char* comment, const std::vector<ncnn::Mat>& _in, const ncnn::Option& opt, bool fixed_path)
+{
+#if NCNN_THREADS
+    char parampath[256];
+    if (fixed_path)
+    {
+        sprintf(parampath, MODEL_DIR "%s.param", comment);
+    }
+    else
+    {
+        sprintf(parampath, "%s", comment);
+    }
+
+    DataReaderFromEmpty dr;
+
+    // weights are loaded once and shared when share_model
+    ncnn::Net source;
+    if (g_stream_share_model)
+    {
+        source.opt = opt;
+        source.opt.num_threads = g_stream_threads;
+#if NCNN_VULKAN
+        if (source.opt.use_vulkan_compute)
+        {
+            source.set_vulkan_device(g_vkdev);
+        }
+#endif // NCNN_VULKAN
+        source.load_param(parampath);
+        source.load_model(dr);
+    }
+
+    g_binned_pool_allocator.clear();
+    const size_t binned_hits0 = g_binned_pool_allocator.hits();
+    const size_t binned_misses0 = g_binned_pool_allocator.misses();
+
+    std::vector<BenchmarkStream*> streams(g_stream_count);
+    for (int i = 0; i < g_stream_count; i++)
+    {
+        BenchmarkStream* stream = new BenchmarkStream;
+        stream->blob_pool_allocator.set_size_compare_ratio(0.f);
+        stream->workspace_pool_allocator.set_size_compare_ratio(0.f);
+
+        ncnn::Net& net = stream->net;
+        net.opt = opt;
+        net.opt.num_threads = g_stream_threads;
+        net.opt.blob_allocator = &stream->blob_pool_allocator;
+        net.opt.workspace_allocator = &stream->workspace_pool_allocator;
+        if (g_binned_pool)
+        {
+            // one allocator shared by all streams
+            net.opt.blob_allocator = &g_binned_pool_allocator;
+            net.opt.workspace_allocator = &g_binned_pool_allocator;
+        }
+        if (g_huge_page)
+        {
+            net.opt.blob_allocator = &g_huge_page_allocator;
+            net.opt.workspace_allocator = &g_huge_page_allocator;
+        }
+#if NCNN_VULKAN
+        stream->blob_vkallocator = 0;
+        stream->staging_vkallocator = 0;
+        if (net.opt.use_vulkan_compute)
+        {
+            stream->blob_vkallocator = new ncnn::VkBlobAllocator(g_vkdev);
+            stream->staging_vkallocator = new ncnn::VkStagingAllocator(g_vkdev);
+            net.opt.blob_vkallocator = stream->blob_vkallocator;
+            net.opt.workspace_vkallocator = stream->blob_vkallocator;
+            net.opt.staging_vkallocator = stream->staging_vkallocator;
+            net.set_vulkan_device(g_vkdev);
+        }
+#endif // NCNN_VULKAN
+
+        if (g_stream_share_model)
+        {
+            net.share_model(source);
+        }
+        else
+        {
+            net.load_param(parampath);
+            net.load_model(dr);
+        }
+
+        streams[i] = stream;
+    }
+
+    if (g_enable_cooling_down)
+    {
+        // sleep 10 seconds for cooling down SOC  :(
+        ncnn::sleep(10 * 1000);
+    }
+
+    if (streams[0]->net.input_names().size() > _in.size())
+    {
+        fprintf(stderr, "input %ld tensors while model has %ld inputs\n", _in.size(), streams[0]->net.input_names().size());
+    }
+    else
+    {
+        // initialize input
+        for (size_t j = 0; j < _in.size(); ++j)
+        {
+            ncnn::Mat in = _in[j];
+            in.fill(0.01f);
+        }
+
+        ncnn::Mutex lock;
+        ncnn::ConditionVariable condition;
+        int ready_count = g_stream_count;
+        bool started = false;
+        double loop_start = 0;
+
+        std::vector<ncnn::Thread*> threads(g_stream_count);
+        for (int i = 0; i < g_stream_count; i++)
+        {
+            BenchmarkStream* stream = streams[i];
+            stream->inputs = &_in;
+            stream->lock = &lock;
+            stream->condition = &condition;
+            stream->ready_count = &ready_count;
+            stream->started = &started;
+            stream->loop_start = &loop_start;
+            threads[i] = new ncnn::Thread(benchmark_stream_worker, stream);
+        }
+
+        for (int i = 0; i < g_stream_count; i++)
+        {
+            threads[i]->join();
+            delete threads[i];
+        }
+
+        const double wall_time = ncnn::get_current_time() - loop_start;
+
+        std::vector<double> all_times;
+        for (int i = 0; i < g_stream_count; i++)
+        {
+            std::vector<double>& times = streams[i]->times;
+            for (size_t j = 0; j < times.size(); j++)
+            {
+                all_times.push_back(times[j]);
+            }
+
+            BenchmarkStats stats = get_stats(comment, times);
+            fprintf(stderr, "%20s  stream %d  min = %7.2f  max = %7.2f  avg = %7.2f  std = %7.2f  p50 = %7.2f  p90 = %7.2f  p99 = %7.2f  count = %d\n", comment, i, stats.min, stats.max, stats.avg, stats.stddev, stats.p50, stats.p90, stats.p99, stats.count);
+        }
+
+        BenchmarkStats stats = get_stats(comment, all_times);
+        fprintf(stderr, "%20s  min = %7.2f  max = %7.2f  avg = %7.2f  std = %7.2f  p50 = %7.2f  p90 = %7.2f  p99 = %7.2f  count = %d\n", comment, stats.min, stats.max, stats.avg, stats.stddev, stats.p50, stats.p90, stats.p99, stats.count);
+        fprintf(stderr, "%20s  streams = %d  threads = %d  throughput = %.2f inferences/s\n", comment, g_stream_count, g_stream_threads, wall_time > 0 ? stats.count * 1000 / wall_time : 0);
+
+        if (g_binned_pool)
+        {
+            print_binned_pool_stats(comment, binned_hits0, binned_misses0);
+        }
+
+        if (g_huge_page)
+        {
+            print_huge_page_stats(comment);
+        }
+
+        g_results.push_back(stats);
+
+        if (!g_baseline.empty())
+        {
+            compare_baseline(stats);
+        }
+    }
+
+    // nets sharing source go first
+    for (int i = 0; i < g_stream_count; i++)
+    {
+        streams[i]->net.clear();
+#if NCNN_VULKAN
+        delete streams[i]->blob_vkallocator;
+        delete streams[i]->staging_vkallocator;
+#endif // NCNN_VULKAN
+        delete streams[i];
+    }
+#else  // NCNN_THREADS
+    (void)_in;
+    (void)opt;
+    (void)fixed_path;
+    fprintf(stderr, "%20s  streams need NCNN_THREADS\n", comment);
+#endif // NCNN_THREADS
+}
+
 void benchmark(const char* comment, const std::vector<ncnn::Mat>& _in, const ncnn::Option& opt, bool fixed_path = true)
 {
+    if (g_coldstart)
+    {
+        // initialize input
+        for (size_t j = 0; j < _in.size(); ++j)
+        {
+            ncnn::Mat in = _in[j];
+            in.fill(0.01f);
+        }
+
+        return benchmark_coldstart(comment, _in, opt, fixed_path);
+    }
+
+    if (g_stream_count > 1)
+    {
+        return benchmark_streams(comment, _in, opt, fixed_path);
+    }
+
     g_blob_pool_allocator.clear();
     g_workspace_pool_allocator.clear();
+    g_binned_pool_allocator.clear();
+
+    const size_t binned_hits0 = g_binned_pool_allocator.hits();
+    const size_t binned_misses0 = g_binned_pool_allocator.misses();
 
 #if NCNN_VULKAN
     if (opt.use_vulkan_compute)
@@ -81,12 +958,6 @@ void benchmark(const char* comment, const std::vector<ncnn::Mat>& _in, const ncn
     }
 #endif // NCNN_VULKAN
 
-#ifdef __EMSCRIPTEN__
-#define MODEL_DIR "/working/"
-#else
-#define MODEL_DIR ""
-#endif
-
     if (fixed_path)
     {
         char parampath[256];
@@ -99,8 +970,22 @@ void benchmark(const char* comment, const std::vector<ncnn::Mat>& _in, const ncn
     }
 
     DataReaderFromEmpty dr;
+
+    double load_start = ncnn::get_current_time();
+
     net.load_model(dr);
 
+    double load_end = ncnn::get_current_time();
+
+    if (g_load_report)
+    {
+        double load_sum = 0;
+        double pipeline_sum = 0;
+        sum_layer_load_times(comment, net, true, load_sum, pipeline_sum);
+
+        fprintf(stderr, "%20s  load_model = %7.2f  layer load sum = %7.2f  pipeline sum = %7.2f\n", comment, load_end - load_start, load_sum, pipeline_sum);
+    }
+
     const std::vector<const char*>& input_names = net.input_names();
     const std::vector<const char*>& output_names = net.output_names();
 
@@ -140,11 +1025,11 @@ void benchmark(const char* comment, const std::vector<ncnn::Mat>& _in, const ncn
         }
     }
 
-    double time_min = DBL_MAX;
-    double time_max = -DBL_MAX;
-    double time_avg = 0;
+    std::vector<double> times;
 
-    for (int i = 0; i < g_loop_count; i++)
+    // at least loop count runs, then until duration is reached
+    const double loop_start = ncnn::get_current_time();
+    for (int i = 0; i < g_loop_count || ncnn::get_current_time() - loop_start < g_duration * 1000; i++)
     {
         double start = ncnn::get_current_time();
         {
@@ -164,16 +1049,103 @@ void benchmark(const char* comment, const std::vector<ncnn::Mat>& _in, const ncn
 
         double end = ncnn::get_current_time();
 
-        double time = end - start;
+        times.push_back(end - start);
+    }
+
+    BenchmarkStats stats = get_stats(comment, times);
+
+    fprintf(stderr, "%20s  min = %7.2f  max = %7.2f  avg = %7.2f  std = %7.2f  p50 = %7.2f  p90 = %7.2f  p99 = %7.2f  count = %d\n", comment, stats.min, stats.max, stats.avg, stats.stddev, stats.p50, stats.p90, stats.p99, stats.count);
+
+    if (g_binned_pool)
+    {
+        print_binned_pool_stats(comment, binned_hits0, binned_misses0);
+    }
+
+    if (g_huge_page)
+    {
+        print_huge_page_stats(comment);
+    }
+
+    g_results.push_back(stats);
+
+    if (!g_baseline.empty())
+    {
+        compare_baseline(stats);
+    }
+
+    if (g_profile || g_roofline || g_perf)
+    {
+        // extra runs recorded, so that timing above is not affected
+        ncnn::Profiler profiler;
+        if (g_perf && profiler.enable_hardware_counters() != 0)
+        {
+            fprintf(stderr, "%20s  hardware counters not available, check /proc/sys/kernel/perf_event_paranoid\n", comment);
+        }
+
+        const int profile_loop_count = g_roofline || g_perf ? g_loop_count : 1;
+        for (int i = 0; i < profile_loop_count; i++)
+        {
+            ncnn::Extractor ex = net.create_extractor();
+            ex.set_profiler(&profiler);
+            for (size_t j = 0; j < input_names.size(); ++j)
+            {
+                ncnn::Mat in = _in[j];
+                ex.input(input_names[j], in);
+            }
+
+            for (size_t j = 0; j < output_names.size(); ++j)
+            {
+                ncnn::Mat out;
+                ex.extract(output_names[j], out);
+            }
+        }
+
+        const std::vector<ncnn::LayerProfile> records = profiler.records();
+
+        if (g_profile)
+        {
+            char tracepath[256];
+            sprintf(tracepath, "%s.trace.json", comment);
+            if (profiler.save_chrome_trace(tracepath) == 0)
+            {
+                fprintf(stderr, "%20s  %d layers traced to %s\n", comment, (int)records.size(), tracepath);
+            }
+        }
 
-        time_min = std::min(time_min, time);
-        time_max = std::max(time_max, time);
-        time_avg += time;
+        if (g_roofline)
+        {
+            print_roofline(comment, net, records);
+        }
+
+        if (profiler.hardware_counters_enabled())
+        {
+            print_hardware_counters(comment, net, records);
+        }
     }
 
-    time_avg /= g_loop_count;
+    if (g_memory && !opt.use_vulkan_compute)
+    {
+        // extra run tracked, with a fresh pool so that every blob and workspace is a new allocation
+        ncnn::PoolAllocator pool_allocator;
+        ncnn::TrackingAllocator tracker(&pool_allocator);
+        {
+            ncnn::Extractor ex = net.create_extractor();
+            ex.set_memory_tracker(&tracker);
+            for (size_t j = 0; j < input_names.size(); ++j)
+            {
+                ncnn::Mat in = _in[j];
+                ex.input(input_names[j], in);
+            }
 
-    fprintf(stderr, "%20s  min = %7.2f  max = %7.2f  avg = %7.2f\n", comment, time_min, time_max, time_avg);
+            for (size_t j = 0; j < output_names.size(); ++j)
+            {
+                ncnn::Mat out;
+                ex.extract(output_names[j], out);
+            }
+        }
+
+        print_memory_report(comment, net, tracker);
+    }
 }
 
 void benchmark(const char* comment, const ncnn::Mat& _in, const ncnn::Option& opt, bool fixed_path = true)
@@ -188,6 +1160,29 @@ void show_usage()
     fprintf(stderr, "Usage: benchncnn [loop count] [num threads] [powersave] [gpu device] [cooling down] [(key=value)...]\n");
     fprintf(stderr, "  param=model.param\n");
     fprintf(stderr, "  shape=[227,227,3],...\n");
+    fprintf(stderr, "  branch_parallel=0/1\n");
+    fprintf(stderr, "  parallel_load=0/1\n");
+    fprintf(stderr, "  load_report=0/1\n");
+    fprintf(stderr, "  profile=0/1\n");
+    fprintf(stderr, "  roofline=0/1\n");
+    fprintf(stderr, "  perf=0/1\n");
+    fprintf(stderr, "  memory=0/1\n");
+    fprintf(stderr, "  binned_pool=0/1\n");
+    fprintf(stderr, "  huge_page=0/1\n");
+    fprintf(stderr, "  duration=30\n");
+    fprintf(stderr, "  json=result.json\n");
+    fprintf(stderr, "  baseline=baseline.json\n");
+    fprintf(stderr, "  threshold=0.05\n");
+    fprintf(stderr, "  streams=1\n");
+    fprintf(stderr, "  stream_threads=N\n");
+    fprintf(stderr, "  share_model=0/1\n");
+    fprintf(stderr, "  coldstart=0/1\n");
+    fprintf(stderr, "  bin=model.bin\n");
+    fprintf(stderr, "  evict_cache=0/1\n");
+    fprintf(stderr, "  mmap=0/1\n");
+    fprintf(stderr, "  streaming_load=0/1\n");
+    fprintf(stderr, "  lazy_pipeline=0/1\n");
+    fprintf(stderr, "  fp16_weight=0/1\n");
 }
 
 static std::vector<ncnn::Mat> parse_shape_list(char* s)
@@ -259,6 +1254,28 @@ int main(int argc, char** argv)
     int powersave = 2;
     int gpu_device = -1;
     int cooling_down = 1;
+    int branch_parallel = 0;
+    int parallel_load = 0;
+    int load_report = 0;
+    int profile = 0;
+    int roofline = 0;
+    int perf = 0;
+    int memory = 0;
+    int binned_pool = 0;
+    int huge_page = 0;
+    double duration = 0;
+    const char* jsonpath = 0;
+    const char* baselinepath = 0;
+    double threshold = 0.05;
+    int streams = 1;
+    int stream_threads = 0;
+    int share_model = 1;
+    int coldstart = 0;
+    int evict_cache = 1;
+    int use_mmap = 0;
+    int streaming_load = 0;
+    int lazy_pipeline = 0;
+    int fp16_weight = 0;
     char* model = 0;
     std::vector<ncnn::Mat> inputs;
 
@@ -319,6 +1336,52 @@ int main(int argc, char** argv)
             model = value;
         if (strcmp(key, "shape") == 0)
             inputs = parse_shape_list(value);
+        if (strcmp(key, "branch_parallel") == 0)
+            branch_parallel = atoi(value);
+        if (strcmp(key, "parallel_load") == 0)
+            parallel_load = atoi(value);
+        if (strcmp(key, "load_report") == 0)
+            load_report = atoi(value);
+        if (strcmp(key, "profile") == 0)
+            profile = atoi(value);
+        if (strcmp(key, "roofline") == 0)
+            roofline = atoi(value);
+        if (strcmp(key, "perf") == 0)
+            perf = atoi(value);
+        if (strcmp(key, "memory") == 0)
+            memory = atoi(value);
+        if (strcmp(key, "binned_pool") == 0)
+            binned_pool = atoi(value);
+        if (strcmp(key, "huge_page") == 0)
+            huge_page = atoi(value);
+        if (strcmp(key, "duration") == 0)
+            duration = atof(value);
+        if (strcmp(key, "json") == 0)
+            jsonpath = value;
+        if (strcmp(key, "baseline") == 0)
+            baselinepath = value;
+        if (strcmp(key, "threshold") == 0)
+            threshold = atof(value);
+        if (strcmp(key, "streams") == 0)
+            streams = atoi(value);
+        if (strcmp(key, "stream_threads") == 0)
+            stream_threads = atoi(value);
+        if (strcmp(key, "share_model") == 0)
+            share_model = atoi(value);
+        if (strcmp(key, "coldstart") == 0)
+            coldstart = atoi(value);
+        if (strcmp(key, "bin") == 0)
+            g_binpath = value;
+        if (strcmp(key, "evict_cache") == 0)
+            evict_cache = atoi(value);
+        if (strcmp(key, "mmap") == 0)
+            use_mmap = atoi(value);
+        if (strcmp(key, "streaming_load") == 0)
+            streaming_load = atoi(value);
+        if (strcmp(key, "lazy_pipeline") == 0)
+            lazy_pipeline = atoi(value);
+        if (strcmp(key, "fp16_weight") == 0)
+            fp16_weight = atoi(value);
     }
 
     if (model && inputs.empty())
@@ -365,6 +1428,19 @@ int main(int argc, char** argv)
     opt.num_threads = num_threads;
     opt.blob_allocator = &g_blob_pool_allocator;
     opt.workspace_allocator = &g_workspace_pool_allocator;
+    if (binned_pool != 0)
+    {
+        opt.blob_allocator = &g_binned_pool_allocator;
+        opt.workspace_allocator = &g_binned_pool_allocator;
+    }
+    if (huge_page != 0)
+    {
+        // transformed weights, blobs and workspace on huge pages
+        g_huge_page_allocator.set_size_drop_threshold(64);
+        opt.blob_allocator = &g_huge_page_allocator;
+        opt.workspace_allocator = &g_huge_page_allocator;
+        opt.weight_allocator = &g_huge_page_allocator;
+    }
 #if NCNN_VULKAN
     opt.blob_vkallocator = g_blob_vkallocator;
     opt.workspace_vkallocator = g_blob_vkallocator;
@@ -382,12 +1458,56 @@ int main(int argc, char** argv)
     opt.use_packing_layout = true;
     opt.use_shader_pack8 = false;
     opt.use_image_storage = false;
+    opt.use_branch_parallel = branch_parallel != 0;
+    opt.use_parallel_load = parallel_load != 0;
+    opt.use_lazy_pipeline = lazy_pipeline != 0;
+    opt.use_fp16_weight = fp16_weight != 0;
+
+    g_load_report = load_report != 0;
+    g_profile = profile != 0;
+    g_roofline = roofline != 0;
+    g_perf = perf != 0;
+    g_memory = memory != 0;
+    g_binned_pool = binned_pool != 0;
+    g_huge_page = huge_page != 0;
+    g_duration = duration;
+    g_regression_threshold = threshold;
+    g_stream_count = streams > 1 ? streams : 1;
+    g_stream_threads = stream_threads > 0 ? stream_threads : std::max(num_threads / g_stream_count, 1);
+    g_stream_share_model = share_model != 0;
+    g_coldstart = coldstart != 0;
+    g_evict_cache = evict_cache != 0;
+    g_use_mmap = use_mmap != 0;
+    g_streaming_load = streaming_load != 0;
+
+    if (baselinepath && load_baseline(baselinepath) != 0)
+    {
+        return -1;
+    }
 
     fprintf(stderr, "loop_count = %d\n", g_loop_count);
+    fprintf(stderr, "duration = %.1f\n", g_duration);
     fprintf(stderr, "num_threads = %d\n", num_threads);
     fprintf(stderr, "powersave = %d\n", ncnn::get_cpu_powersave());
     fprintf(stderr, "gpu_device = %d\n", gpu_device);
     fprintf(stderr, "cooling_down = %d\n", (int)g_enable_cooling_down);
+    fprintf(stderr, "branch_parallel = %d\n", (int)opt.use_branch_parallel);
+    fprintf(stderr, "parallel_load = %d\n", (int)opt.use_parallel_load);
+    fprintf(stderr, "lazy_pipeline = %d\n", (int)opt.use_lazy_pipeline);
+    fprintf(stderr, "fp16_weight = %d\n", (int)opt.use_fp16_weight);
+    if (g_coldstart)
+    {
+        fprintf(stderr, "coldstart = %d\n", (int)g_coldstart);
+        fprintf(stderr, "evict_cache = %d\n", (int)g_evict_cache);
+        fprintf(stderr, "mmap = %d\n", (int)g_use_mmap);
+        fprintf(stderr, "streaming_load = %d\n", (int)g_streaming_load);
+    }
+    if (g_stream_count > 1)
+    {
+        fprintf(stderr, "streams = %d\n", g_stream_count);
+        fprintf(stderr, "stream_threads = %d\n", g_stream_threads);
+        fprintf(stderr, "share_model = %d\n", (int)g_stream_share_model);
+    }
 
     if (model != 0)
     {
@@ -474,5 +1594,16 @@ int main(int argc, char** argv)
     delete g_staging_vkallocator;
 #endif // NCNN_VULKAN
 
+    if (jsonpath)
+    {
+        save_results(jsonpath, num_threads);
+    }
+
+    if (g_regression_count)
+    {
+        fprintf(stderr, "%d models regressed\n", g_regression_count);
+        return 1;
+    }
+
     return 0;
 }
@@ -21,6 +21,15 @@
 #include <android/hardware_buffer.h>
 #endif // __ANDROID_API__ >= 26
 
+#if defined __linux__
+#include <stdio.h>
+#include <sys/mman.h>
+#endif
+
+#if defined _MSC_VER
+#include <intrin.h>
+#endif
+
 namespace ncnn {
 
 Allocator::~Allocator()
@@ -357,6 +366,1305 @@ void UnlockedPoolAllocator::fastFree(void* ptr)
     ncnn::fastFree(ptr);
 }
 
+// atomic add for the cached byte counter read without locks
+#if NCNN_THREADS && defined _MSC_VER
+static NCNN_FORCEINLINE void atomic_add_size(volatile size_t* ptr, size_t delta)
+{
+#if defined _WIN64
+    InterlockedExchangeAdd64((volatile LONG64*)ptr, (LONG64)delta);
+#else
+    InterlockedExchangeAdd((volatile LONG*)ptr, (LONG)delta);
+#endif
+}
+#elif NCNN_THREADS && defined __GNUC__
+static NCNN_FORCEINLINE void atomic_add_size(volatile size_t* ptr, size_t delta)
+{
+    __sync_fetch_and_add(ptr, delta);
+}
+#else
+// thread-unsafe branch
+static NCNN_FORCEINLINE void atomic_add_size(volatile size_t* ptr, size_t delta)
+{
+    *ptr += delta;
+}
+#endif
+
+struct BinnedBlock
+{
+    // next block of the same batch
+    BinnedBlock* next;
+    // next batch in the shared free list, set on the first block of a batch
+    BinnedBlock* next_batch;
+    // blocks in the batch, set on the first block of a batch
+    int batch_count;
+    int size_class;
+};
+
+// header in front of each block, padded to NCNN_MALLOC_ALIGN so that payload stays aligned
+#define BINNED_HEADER_SIZE ((sizeof(BinnedBlock) + NCNN_MALLOC_ALIGN - 1) / NCNN_MALLOC_ALIGN * NCNN_MALLOC_ALIGN)
+
+// 256 bytes, then 4 classes in each power of two up to 2G, larger sizes are not cached
+#define BINNED_CLASS_COUNT 93
+
+static NCNN_FORCEINLINE int get_binned_size_class(size_t size)
+{
+    if (size <= 256)
+        return 0;
+
+    const size_t n = size - 1;
+    int k = 8;
+    while (k < 30 && (n >> (k + 1)))
+        k++;
+
+    if (n >> (k + 1))
+        return -1;
+
+    // n in [2^k, 2^(k+1)), class sizes 5/4 6/4 7/4 8/4 of 2^k
+    return (k - 8) * 4 + (int)(n >> (k - 2)) - 4 + 1;
+}
+
+static NCNN_FORCEINLINE size_t get_binned_class_size(int size_class)
+{
+    if (size_class == 0)
+        return 256;
+
+    const int k = 8 + (size_class - 1) / 4;
+    const int j = (size_class - 1) % 4 + 1;
+    return (size_t)(4 + j) << (k - 2);
+}
+
+// blocks cached per size class in each thread, also the batch moved to or from the shared list
+static NCNN_FORCEINLINE int get_binned_thread_limit(int size_class)
+{
+    return get_binned_class_size(size_class) <= 1024 * 1024 ? 8 : 1;
+}
+
+// shared free lists are lock-free where a compare and swap covers both pointer and generation
+#if NCNN_THREADS && defined _MSC_VER && (defined _M_X64 || defined _M_ARM64 || defined _M_IX86 || defined _M_ARM)
+#define NCNN_BINNED_LOCKFREE 1
+#elif NCNN_THREADS && defined __GNUC__ && __SIZEOF_POINTER__ == 8 && (defined __x86_64__ || defined __GCC_HAVE_SYNC_COMPARE_AND_SWAP_16)
+#define NCNN_BINNED_LOCKFREE 1
+#elif NCNN_THREADS && defined __GNUC__ && __SIZEOF_POINTER__ == 4 && defined __GCC_HAVE_SYNC_COMPARE_AND_SWAP_8
+#define NCNN_BINNED_LOCKFREE 1
+#else
+#define NCNN_BINNED_LOCKFREE 0
+#endif
+
+#if NCNN_BINNED_LOCKFREE
+// free list head tagged with a generation bumped on every push and pop
+// a pop that raced with others popping and pushing back the same batch fails its compare and swap
+#if defined _MSC_VER
+union __declspec(align(16)) BinnedHead
+#else
+union __attribute__((aligned(2 * __SIZEOF_POINTER__))) BinnedHead
+#endif
+{
+    struct
+    {
+        BinnedBlock* volatile batch;
+        volatile size_t generation;
+    };
+#if defined _MSC_VER
+    __int64 value[2];
+#elif __SIZEOF_POINTER__ == 8
+    unsigned __int128 value;
+#else
+    unsigned long long value;
+#endif
+};
+
+static NCNN_FORCEINLINE bool binned_head_cas(BinnedHead* head, BinnedBlock* expected_batch, size_t expected_generation, BinnedBlock* batch)
+{
+    const size_t generation = expected_generation + 1;
+
+#if defined _MSC_VER && (defined _M_X64 || defined _M_ARM64)
+    __int64 comparand[2] = {(__int64)expected_batch, (__int64)expected_generation};
+    return _InterlockedCompareExchange128(head->value, (__int64)generation, (__int64)batch, comparand) != 0;
+#elif defined _MSC_VER
+    const __int64 comparand = (__int64)(size_t)expected_batch | ((__int64)expected_generation << 32);
+    const __int64 exchange = (__int64)(size_t)batch | ((__int64)generation << 32);
+    return _InterlockedCompareExchange64(head->value, exchange, comparand) == comparand;
+#elif __SIZEOF_POINTER__ == 8 && !defined __GCC_HAVE_SYNC_COMPARE_AND_SWAP_16
+    // x86_64 built without -mcx16
+    bool ok;
+    __asm__ __volatile__(
+        "lock cmpxchg16b %1\n"
+        "setz %0\n"
+        : "=q"(ok), "+m"(head->value), "+a"(expected_batch), "+d"(expected_generation)
+        : "b"(batch), "c"(generation)
+        : "cc", "memory");
+    return ok;
+#else
+    BinnedHead expected;
+    expected.batch = expected_batch;
+    expected.generation = expected_generation;
+    BinnedHead desired;
+    desired.batch = batch;
+    desired.generation = generation;
+    return __sync_bool_compare_and_swap(&head->value, expected.value, desired.value);
+#endif
+}
+#endif // NCNN_BINNED_LOCKFREE
+
+class BinnedPoolAllocatorPrivate;
+
+class BinnedThreadCache
+{
+public:
+    BinnedPoolAllocatorPrivate* owner;
+
+    BinnedBlock* blocks[BINNED_CLASS_COUNT];
+    int counts[BINNED_CLASS_COUNT];
+    size_t bytes;
+
+    size_t hits;
+    size_t misses;
+
+    // blocks allocated and freed by this thread, may be unbalanced across threads
+    size_t mallocs;
+    size_t frees;
+};
+
+// hands the thread cache back to its allocator when the thread exits
+#if NCNN_THREADS && (defined _WIN32 && !(defined __MINGW32__))
+static void WINAPI binned_thread_exit(void* ptr);
+#elif NCNN_THREADS
+static void binned_thread_exit(void* ptr);
+#endif
+
+// thread local storage calling binned_thread_exit on exit of each thread holding a value
+// fiber local storage on windows, as thread local storage has no exit callback there
+class BinnedThreadLocal
+{
+public:
+#if NCNN_THREADS && (defined _WIN32 && !(defined __MINGW32__))
+    BinnedThreadLocal() { key = FlsAlloc(binned_thread_exit); }
+    ~BinnedThreadLocal() { release(); }
+    void release()
+    {
+        if (key != FLS_OUT_OF_INDEXES)
+            FlsFree(key);
+        key = FLS_OUT_OF_INDEXES;
+    }
+    void set(void* value) { FlsSetValue(key, value); }
+    void* get() { return FlsGetValue(key); }
+private:
+    DWORD key;
+#elif NCNN_THREADS
+    BinnedThreadLocal() { valid = pthread_key_create(&key, binned_thread_exit) == 0; }
+    ~BinnedThreadLocal() { release(); }
+    void release()
+    {
+        if (valid)
+            pthread_key_delete(key);
+        valid = false;
+    }
+    void set(void* value) { pthread_setspecific(key, value); }
+    void* get() { return pthread_getspecific(key); }
+private:
+    pthread_key_t key;
+    bool valid;
+#else
+    BinnedThreadLocal() { data = 0; }
+    ~BinnedThreadLocal() {}
+    void release() {}
+    void set(void* value) { data = value; }
+    void* get() { return data; }
+private:
+    void* data;
+#endif
+};
+
+class BinnedPoolAllocatorPrivate
+{
+public:
+    BinnedThreadCache* get_thread_cache();
+
+    // push a batch of blocks chained by next, batch_count must be set on its first block
+    void push_shared(int size_class, BinnedBlock* batch);
+
+    // pop one batch from shared free list, null if empty
+    BinnedBlock* pop_shared(int size_class);
+
+    // move the cached blocks of an exiting thread to the shared free lists and drop its cache
+    void retire_thread_cache(BinnedThreadCache* cache);
+
+public:
+    BinnedThreadLocal thread_cache;
+
+    // every live thread cache, for stats and clear
+    Mutex caches_lock;
+    std::vector<BinnedThreadCache*> caches;
+
+    // stats of thread caches dropped at thread exit
+    size_t retired_hits;
+    size_t retired_misses;
+    size_t retired_mallocs;
+    size_t retired_frees;
+
+    // blocks move between thread caches and shared free lists in batches
+    // one compare and swap per batch, or one short lock hold where that is not available
+#if NCNN_BINNED_LOCKFREE
+    BinnedHead shared[BINNED_CLASS_COUNT];
+#else
+    Mutex shared_locks[BINNED_CLASS_COUNT];
+    BinnedBlock* shared[BINNED_CLASS_COUNT];
+#endif
+    volatile size_t shared_bytes;
+};
+
+#if NCNN_THREADS
+#if (defined _WIN32 && !(defined __MINGW32__))
+static void WINAPI binned_thread_exit(void* ptr)
+#else
+static void binned_thread_exit(void* ptr)
+#endif
+{
+    BinnedThreadCache* cache = (BinnedThreadCache*)ptr;
+    if (!cache)
+        return;
+
+    cache->owner->retire_thread_cache(cache);
+}
+#endif // NCNN_THREADS
+
+BinnedThreadCache* BinnedPoolAllocatorPrivate::get_thread_cache()
+{
+    BinnedThreadCache* cache = (BinnedThreadCache*)thread_cache.get();
+    if (cache)
+        return cache;
+
+    cache = new BinnedThreadCache;
+    cache->owner = this;
+    for (int i = 0; i < BINNED_CLASS_COUNT; i++)
+    {
+        cache->blocks[i] = 0;
+        cache->counts[i] = 0;
+    }
+    cache->bytes = 0;
+    cache->hits = 0;
+    cache->misses = 0;
+    cache->mallocs = 0;
+    cache->frees = 0;
+
+    thread_cache.set(cache);
+
+    MutexLockGuard lock(caches_lock);
+    caches.push_back(cache);
+
+    return cache;
+}
+
+void BinnedPoolAllocatorPrivate::push_shared(int size_class, BinnedBlock* batch)
+{
+#if NCNN_BINNED_LOCKFREE
+    BinnedHead* head = &shared[size_class];
+    for (;;)
+    {
+        const size_t generation = head->generation;
+        BinnedBlock* next_batch = head->batch;
+
+        batch->next_batch = next_batch;
+        if (binned_head_cas(head, next_batch, generation, batch))
+            break;
+    }
+#else
+    MutexLockGuard lock(shared_locks[size_class]);
+
+    batch->next_batch = shared[size_class];
+    shared[size_class] = batch;
+#endif
+}
+
+BinnedBlock* BinnedPoolAllocatorPrivate::pop_shared(int size_class)
+{
+#if NCNN_BINNED_LOCKFREE
+    BinnedHead* head = &shared[size_class];
+    for (;;)
+    {
+        const size_t generation = head->generation;
+        BinnedBlock* batch = head->batch;
+        if (!batch)
+            return 0;
+
+        // blocks are never returned to the system while the allocator is in use,
+        // so a stale batch is still readable here and the generation check rejects it
+        BinnedBlock* next_batch = batch->next_batch;
+        if (binned_head_cas(head, batch, generation, next_batch))
+            return batch;
+    }
+#else
+    MutexLockGuard lock(shared_locks[size_class]);
+
+    BinnedBlock* batch = shared[size_class];
+    if (batch)
+        shared[size_class] = batch->next_batch;
+
+    return batch;
+#endif
+}
+
+void BinnedPoolAllocatorPrivate::retire_thread_cache(BinnedThreadCache* cache)
+{
+    for (int i = 0; i < BINNED_CLASS_COUNT; i++)
+    {
+        BinnedBlock* batch = cache->blocks[i];
+        if (!batch)
+            continue;
+
+        batch->batch_count = cache->counts[i];
+        push_shared(i, batch);
+        atomic_add_size(&shared_bytes, get_binned_class_size(i) * cache->counts[i]);
+    }
+
+    MutexLockGuard lock(caches_lock);
+
+    retired_hits += cache->hits;
+    retired_misses += cache->misses;
+    retired_mallocs += cache->mallocs;
+    retired_frees += cache->frees;
+
+    for (size_t i = 0; i < caches.size(); i++)
+    {
+        if (caches[i] == cache)
+        {
+            caches.erase(caches.begin() + i);
+            break;
+        }
+    }
+
+    delete cache;
+}
+
+BinnedPoolAllocator::BinnedPoolAllocator()
+    : Allocator(), d(new BinnedPoolAllocatorPrivate)
+{
+    for (int i = 0; i < BINNED_CLASS_COUNT; i++)
+    {
+#if NCNN_BINNED_LOCKFREE
+        d->shared[i].batch = 0;
+        d->shared[i].generation = 0;
+#else
+        d->shared[i] = 0;
+#endif
+    }
+    d->shared_bytes = 0;
+    d->retired_hits = 0;
+    d->retired_misses = 0;
+    d->retired_mallocs = 0;
+    d->retired_frees = 0;
+}
+
+BinnedPoolAllocator::~BinnedPoolAllocator()
+{
+    clear();
+
+    // no thread exit callback may touch the caches freed below
+    d->thread_cache.release();
+
+    size_t mallocs = d->retired_mallocs;
+    size_t frees = d->retired_frees;
+    for (size_t i = 0; i < d->caches.size(); i++)
+    {
+        mallocs += d->caches[i]->mallocs;
+        frees += d->caches[i]->frees;
+        delete d->caches[i];
+    }
+
+    if (mallocs != frees)
+    {
+        NCNN_LOGE("FATAL ERROR! binned pool allocator destroyed too early, %d blocks still in use", (int)(mallocs - frees));
+    }
+
+    delete d;
+}
+
+BinnedPoolAllocator::BinnedPoolAllocator(const BinnedPoolAllocator&)
+    : d(0)
+{
+}
+
+BinnedPoolAllocator& BinnedPoolAllocator::operator=(const BinnedPoolAllocator&)
+{
+    return *this;
+}
+
+void BinnedPoolAllocator::clear()
+{
+    for (int i = 0; i < BINNED_CLASS_COUNT; i++)
+    {
+        BinnedBlock* batch = d->pop_shared(i);
+        while (batch)
+        {
+            BinnedBlock* block = batch;
+            while (block)
+            {
+                BinnedBlock* next = block->next;
+                ncnn::fastFree(block);
+                block = next;
+            }
+
+            batch = d->pop_shared(i);
+        }
+    }
+    d->shared_bytes = 0;
+
+    MutexLockGuard lock(d->caches_lock);
+
+    for (size_t i = 0; i < d->caches.size(); i++)
+    {
+        BinnedThreadCache* cache = d->caches[i];
+        for (int j = 0; j < BINNED_CLASS_COUNT; j++)
+        {
+            BinnedBlock* block = cache->blocks[j];
+            while (block)
+            {
+                BinnedBlock* next = block->next;
+                ncnn::fastFree(block);
+                block = next;
+            }
+
+            cache->blocks[j] = 0;
+            cache->counts[j] = 0;
+        }
+        cache->bytes = 0;
+    }
+}
+
+size_t BinnedPoolAllocator::hits() const
+{
+    MutexLockGuard lock(d->caches_lock);
+
+    size_t hits = d->retired_hits;
+    for (size_t i = 0; i < d->caches.size(); i++)
+    {
+        hits += d->caches[i]->hits;
+    }
+    return hits;
+}
+
+size_t BinnedPoolAllocator::misses() const
+{
+    MutexLockGuard lock(d->caches_lock);
+
+    size_t misses = d->retired_misses;
+    for (size_t i = 0; i < d->caches.size(); i++)
+    {
+        misses += d->caches[i]->misses;
+    }
+    return misses;
+}
+
+size_t BinnedPoolAllocator::bytes_cached() const
+{
+    MutexLockGuard lock(d->caches_lock);
+
+    size_t bytes = d->shared_bytes;
+    for (size_t i = 0; i < d->caches.size(); i++)
+    {
+        bytes += d->caches[i]->bytes;
+    }
+    return bytes;
+}
+
+void* BinnedPoolAllocator::fastMalloc(size_t size)
+{
+    BinnedThreadCache* cache = d->get_thread_cache();
+
+    const int size_class = get_binned_size_class(size);
+    if (size_class == -1)
+    {
+        // too large to cache
+        BinnedBlock* block = (BinnedBlock*)ncnn::fastMalloc(size + BINNED_HEADER_SIZE);
+        if (!block)
+            return 0;
+
+        cache->mallocs++;
+        cache->misses++;
+        block->size_class = -1;
+        return (unsigned char*)block + BINNED_HEADER_SIZE;
+    }
+
+    const size_t class_size = get_binned_class_size(size_class);
+
+    // thread cache
+    BinnedBlock* block = cache->blocks[size_class];
+    if (block)
+    {
+        cache->blocks[size_class] = block->next;
+        cache->counts[size_class]--;
+        cache->bytes -= class_size;
+        cache->mallocs++;
+        cache->hits++;
+        return (unsigned char*)block + BINNED_HEADER_SIZE;
+    }
+
+    // refill a batch from the shared list, keep the first block and cache the rest
+    block = d->pop_shared(size_class);
+    if (block)
+    {
+        const int taken = block->batch_count;
+        atomic_add_size(&d->shared_bytes, (size_t)0 - class_size * taken);
+
+        cache->blocks[size_class] = block->next;
+        cache->counts[size_class] = taken - 1;
+        cache->bytes += class_size * (taken - 1);
+        cache->mallocs++;
+        cache->hits++;
+        return (unsigned char*)block + BINNED_HEADER_SIZE;
+    }
+
+    // new
+    block = (BinnedBlock*)ncnn::fastMalloc(class_size + BINNED_HEADER_SIZE);
+    if (!block)
+        return 0;
+
+    cache->mallocs++;
+    cache->misses++;
+    block->size_class = size_class;
+    return (unsigned char*)block + BINNED_HEADER_SIZE;
+}
+
+void BinnedPoolAllocator::fastFree(void* ptr)
+{
+    if (!ptr)
+        return;
+
+    BinnedThreadCache* cache = d->get_thread_cache();
+    cache->frees++;
+
+    BinnedBlock* block = (BinnedBlock*)((unsigned char*)ptr - BINNED_HEADER_SIZE);
+
+    const int size_class = block->size_class;
+    if (size_class == -1)
+    {
+        ncnn::fastFree(block);
+        return;
+    }
+
+    const size_t class_size = get_binned_class_size(size_class);
+
+    const int thread_limit = get_binned_thread_limit(size_class);
+    if (cache->counts[size_class] == thread_limit)
+    {
+        // hand the full thread cache over as one batch
+        BinnedBlock* batch = cache->blocks[size_class];
+        batch->batch_count = thread_limit;
+
+        d->push_shared(size_class, batch);
+        atomic_add_size(&d->shared_bytes, class_size * thread_limit);
+
+        cache->blocks[size_class] = 0;
+        cache->counts[size_class] = 0;
+        cache->bytes -= class_size * thread_limit;
+    }
+
+    block->next = cache->blocks[size_class];
+    cache->blocks[size_class] = block;
+    cache->counts[size_class]++;
+    cache->bytes += class_size;
+}
+
+// blocks up to this size share regions
+#define HUGE_PAGE_SMALL_SIZE (256 * 1024)
+
+// default huge page size of the system, 2M if not known
+static size_t get_huge_page_size()
+{
+#if defined __linux__
+    FILE* fp = fopen("/proc/meminfo", "rb");
+    if (fp)
+    {
+        char line[256];
+        while (fgets(line, sizeof(line), fp))
+        {
+            unsigned long kb = 0;
+            if (sscanf(line, "Hugepagesize: %lu kB", &kb) == 1 && kb >= 4 && (kb & (kb - 1)) == 0)
+            {
+                fclose(fp);
+                return (size_t)kb * 1024;
+            }
+        }
+
+        fclose(fp);
+    }
+#endif
+
+    return 2 * 1024 * 1024;
+}
+
+class HugePageRegion
+{
+public:
+    unsigned char* data;
+    size_t size;
+    bool hugetlb;
+
+    // carved into small blocks
+    bool shared;
+    size_t used;
+    int live;
+};
+
+class HugePageAllocatorPrivate
+{
+public:
+    // return 0 if success
+    int map_region(size_t size, HugePageRegion& region);
+    void unmap_region(const HugePageRegion& region);
+
+    // take a free region of at least size or map a new one, return 0 if success
+    int acquire_region(size_t size, HugePageRegion& region);
+    void release_region(const HugePageRegion& region);
+
+    // index of the region in use that contains ptr, -1 if none
+    int find_region(const unsigned char* ptr) const;
+    void insert_region(const HugePageRegion& region);
+
+public:
+    Mutex lock;
+    size_t size_drop_threshold;
+    bool hugetlb_failed;
+
+    // regions are mapped and aligned in units of this
+    size_t huge_page_size;
+
+    // regions in use, sorted by start address for lookup on free
+    std::vector<HugePageRegion> regions;
+    std::list<HugePageRegion> budgets;
+
+    // start of the shared region small blocks are carved from
+    unsigned char* current;
+};
+
+int HugePageAllocatorPrivate::map_region(size_t size, HugePageRegion& region)
+{
+    region.size = size;
+    region.hugetlb = false;
+    region.shared = false;
+    region.used = 0;
+    region.live = 0;
+
+#if defined __linux__
+#ifdef MAP_HUGETLB
+    if (!hugetlb_failed)
+    {
+        void* ptr = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (ptr != MAP_FAILED)
+        {
+            region.data = (unsigned char*)ptr;
+            region.hugetlb = true;
+            return 0;
+        }
+
+        // no huge pages reserved, do not try again
+        hugetlb_failed = true;
+    }
+#endif // MAP_HUGETLB
+
+    // map one more huge page and trim to huge page boundary
+    void* ptr = mmap(0, size + huge_page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED)
+        return -1;
+
+    unsigned char* data = (unsigned char*)(((size_t)ptr + huge_page_size - 1) & ~(huge_page_size - 1));
+    const size_t head = data - (unsigned char*)ptr;
+    if (head > 0)
+        munmap(ptr, head);
+    if (huge_page_size - head > 0)
+        munmap(data + size, huge_page_size - head);
+
+#ifdef MADV_HUGEPAGE
+    madvise(data, size, MADV_HUGEPAGE);
+#endif
+
+    region.data = data;
+    return 0;
+#else
+    region.data = (unsigned char*)ncnn::fastMalloc(size);
+    return region.data ? 0 : -1;
+#endif
+}
+
+void HugePageAllocatorPrivate::unmap_region(const HugePageRegion& region)
+{
+#if defined __linux__
+    munmap(region.data, region.size);
+#else
+    ncnn::fastFree(region.data);
+#endif
+}
+
+int HugePageAllocatorPrivate::acquire_region(size_t size, HugePageRegion& region)
+{
+    // smallest free region that fits without wasting half
+    std::list<HugePageRegion>::iterator it_best = budgets.end();
+    std::list<HugePageRegion>::iterator it = budgets.begin();
+    for (; it != budgets.end(); ++it)
+    {
+        if (it->size < size || it->size / 2 > size)
+            continue;
+
+        if (it_best == budgets.end() || it->size < it_best->size)
+            it_best = it;
+    }
+
+    if (it_best != budgets.end())
+    {
+        region = *it_best;
+        budgets.erase(it_best);
+        return 0;
+    }
+
+    return map_region(size, region);
+}
+
+void HugePageAllocatorPrivate::release_region(const HugePageRegion& region)
+{
+    budgets.push_back(region);
+
+    HugePageRegion& r = budgets.back();
+    r.shared = false;
+    r.used = 0;
+    r.live = 0;
+
+    if (budgets.size() > size_drop_threshold)
+    {
+        // drop the oldest
+        unmap_region(budgets.front());
+        budgets.pop_front();
+    }
+}
+
+int HugePageAllocatorPrivate::find_region(const unsigned char* ptr) const
+{
+    // binary search the last region starting at or below ptr
+    int lo = 0;
+    int hi = (int)regions.size();
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (regions[mid].data <= ptr)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo == 0)
+        return -1;
+
+    const HugePageRegion& region = regions[lo - 1];
+    if (ptr >= region.data + region.size)
+        return -1;
+
+    return lo - 1;
+}
+
+void HugePageAllocatorPrivate::insert_region(const HugePageRegion& region)
+{
+    regions.push_back(region);
+
+    // keep sorted by start address
+    for (size_t i = regions.size() - 1; i > 0 && regions[i - 1].data > region.data; i--)
+    {
+        regions[i] = regions[i - 1];
+        regions[i - 1] = region;
+    }
+}
+
+HugePageAllocator::HugePageAllocator()
+    : Allocator(), d(new HugePageAllocatorPrivate)
+{
+    d->size_drop_threshold = 10;
+    d->hugetlb_failed = false;
+    d->huge_page_size = get_huge_page_size();
+    d->current = 0;
+}
+
+HugePageAllocator::~HugePageAllocator()
+{
+    clear();
+
+    // the shared region without live blocks is not in use
+    const int current_index = d->current ? d->find_region(d->current) : -1;
+    if (current_index != -1 && d->regions[current_index].live == 0)
+    {
+        d->unmap_region(d->regions[current_index]);
+        d->regions.erase(d->regions.begin() + current_index);
+    }
+
+    if (!d->regions.empty())
+    {
+        NCNN_LOGE("FATAL ERROR! huge page allocator destroyed too early");
+#if NCNN_STDIO
+        for (size_t i = 0; i < d->regions.size(); i++)
+        {
+            NCNN_LOGE("%p region of %d blocks still in use", d->regions[i].data, d->regions[i].live);
+        }
+#endif
+    }
+
+    delete d;
+}
+
+HugePageAllocator::HugePageAllocator(const HugePageAllocator&)
+    : d(0)
+{
+}
+
+HugePageAllocator& HugePageAllocator::operator=(const HugePageAllocator&)
+{
+    return *this;
+}
+
+void HugePageAllocator::set_size_drop_threshold(size_t threshold)
+{
+    d->size_drop_threshold = threshold;
+}
+
+void HugePageAllocator::clear()
+{
+    MutexLockGuard lock(d->lock);
+
+    std::list<HugePageRegion>::iterator it = d->budgets.begin();
+    for (; it != d->budgets.end(); ++it)
+    {
+        d->unmap_region(*it);
+    }
+    d->budgets.clear();
+}
+
+size_t HugePageAllocator::bytes_mapped() const
+{
+    MutexLockGuard lock(d->lock);
+
+    size_t bytes = 0;
+    for (size_t i = 0; i < d->regions.size(); i++)
+    {
+        bytes += d->regions[i].size;
+    }
+    std::list<HugePageRegion>::const_iterator it = d->budgets.begin();
+    for (; it != d->budgets.end(); ++it)
+    {
+        bytes += it->size;
+    }
+    return bytes;
+}
+
+size_t HugePageAllocator::bytes_hugetlb() const
+{
+    MutexLockGuard lock(d->lock);
+
+    size_t bytes = 0;
+    for (size_t i = 0; i < d->regions.size(); i++)
+    {
+        bytes += d->regions[i].hugetlb ? d->regions[i].size : 0;
+    }
+    std::list<HugePageRegion>::const_iterator it = d->budgets.begin();
+    for (; it != d->budgets.end(); ++it)
+    {
+        bytes += it->hugetlb ? it->size : 0;
+    }
+    return bytes;
+}
+
+void* HugePageAllocator::fastMalloc(size_t size)
+{
+    const size_t nbytes = alignSize(size + NCNN_MALLOC_OVERREAD, NCNN_MALLOC_ALIGN);
+
+    MutexLockGuard lock(d->lock);
+
+    if (nbytes <= HUGE_PAGE_SMALL_SIZE)
+    {
+        int current_index = d->current ? d->find_region(d->current) : -1;
+        if (current_index == -1 || d->regions[current_index].used + nbytes > d->regions[current_index].size)
+        {
+            if (current_index != -1 && d->regions[current_index].live == 0)
+            {
+                // nothing carved is alive, start over
+                d->regions[current_index].used = 0;
+            }
+            else
+            {
+                HugePageRegion region;
+                if (d->acquire_region(d->huge_page_size, region) != 0)
+                    return 0;
+
+                region.shared = true;
+                d->insert_region(region);
+                d->current = region.data;
+                current_index = d->find_region(d->current);
+            }
+        }
+
+        HugePageRegion& current = d->regions[current_index];
+        void* ptr = current.data + current.used;
+        current.used += nbytes;
+        current.live++;
+        return ptr;
+    }
+
+    HugePageRegion region;
+    const size_t region_size = (nbytes + d->huge_page_size - 1) & ~(d->huge_page_size - 1);
+    if (d->acquire_region(region_size, region) != 0)
+        return 0;
+
+    region.live = 1;
+    d->insert_region(region);
+    return region.data;
+}
+
+void HugePageAllocator::fastFree(void* ptr)
+{
+    MutexLockGuard lock(d->lock);
+
+    const int i = d->find_region((const unsigned char*)ptr);
+    if (i != -1)
+    {
+        HugePageRegion& region = d->regions[i];
+        region.live--;
+        if (region.live > 0 || region.data == d->current)
+            return;
+
+        d->release_region(region);
+        d->regions.erase(d->regions.begin() + i);
+        return;
+    }
+
+    NCNN_LOGE("FATAL ERROR! huge page allocator get wild %p", ptr);
+}
+
+LayerMemory::LayerMemory()
+{
+    layer_index = -1;
+    allocation_count = 0;
+    allocated_bytes = 0;
+    peak_bytes = 0;
+    live_bytes = 0;
+}
+
+// one live allocation seen by TrackingAllocator
+struct TrackingPayout
+{
+    void* ptr;
+    size_t size;
+    int layer_index;
+};
+
+class TrackingAllocatorPrivate
+{
+public:
+    // live bytes of layer_index, slot 0 for outside any layer
+    void add_live(int layer_index, size_t size);
+    void sub_live(int layer_index, size_t size);
+
+    // live allocations hashed by pointer
+    void insert_payout(const TrackingPayout& payout);
+    // return 0 if found and removed
+    int remove_payout(void* ptr, TrackingPayout& payout);
+
+public:
+    Allocator* allocator;
+    Mutex lock;
+
+    // layer_index + 1 of the calling thread, 0 if none
+    ThreadLocalStorage thread_layer;
+    // most recently started layer, for worker threads without their own
+    int last_layer;
+
+    // live allocations in power of two buckets, rehashed when twice as many
+    std::vector<std::vector<TrackingPayout> > payouts;
+    size_t payout_count;
+
+    size_t live;
+    size_t peak;
+    std::vector<size_t> live_per_layer;
+    std::vector<size_t> peak_per_layer;
+
+    // stats of running layers, by layer_index
+    std::vector<int> running;
+    std::vector<LayerMemory> layer_stats;
+
+    std::vector<LayerMemory> timeline;
+};
+
+void TrackingAllocatorPrivate::add_live(int layer_index, size_t size)
+{
+    if (live_per_layer.size() < (size_t)layer_index + 2)
+        live_per_layer.resize(layer_index + 2, 0);
+
+    live += size;
+    live_per_layer[layer_index + 1] += size;
+
+    if (live > peak)
+    {
+        peak = live;
+        peak_per_layer = live_per_layer;
+    }
+
+    for (size_t i = 0; i < running.size(); i++)
+    {
+        LayerMemory& stat = layer_stats[running[i]];
+        if (live > stat.peak_bytes)
+            stat.peak_bytes = live;
+    }
+}
+
+void TrackingAllocatorPrivate::sub_live(int layer_index, size_t size)
+{
+    live -= size;
+    live_per_layer[layer_index + 1] -= size;
+}
+
+static NCNN_FORCEINLINE size_t get_payout_bucket(const void* ptr, size_t bucket_count)
+{
+    // low bits are alignment zeros
+    size_t h = (size_t)ptr >> 4;
+    h ^= h >> 11;
+    h *= 0x9e3779b1u;
+    h ^= h >> 15;
+    return h & (bucket_count - 1);
+}
+
+void TrackingAllocatorPrivate::insert_payout(const TrackingPayout& payout)
+{
+    if (payout_count >= payouts.size() * 2)
+    {
+        std::vector<std::vector<TrackingPayout> > old_payouts;
+        old_payouts.swap(payouts);
+
+        payouts.resize(old_payouts.empty() ? 64 : old_payouts.size() * 2);
+        for (size_t i = 0; i < old_payouts.size(); i++)
+        {
+            for (size_t j = 0; j < old_payouts[i].size(); j++)
+            {
+                const TrackingPayout& p = old_payouts[i][j];
+                payouts[get_payout_bucket(p.ptr, payouts.size())].push_back(p);
+            }
+        }
+    }
+
+    payouts[get_payout_bucket(payout.ptr, payouts.size())].push_back(payout);
+    payout_count++;
+}
+
+int TrackingAllocatorPrivate::remove_payout(void* ptr, TrackingPayout& payout)
+{
+    if (payouts.empty())
+        return -1;
+
+    std::vector<TrackingPayout>& bucket = payouts[get_payout_bucket(ptr, payouts.size())];
+    for (size_t i = 0; i < bucket.size(); i++)
+    {
+        if (bucket[i].ptr == ptr)
+        {
+            payout = bucket[i];
+            bucket[i] = bucket[bucket.size() - 1];
+            bucket.pop_back();
+            payout_count--;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+TrackingAllocator::TrackingAllocator(Allocator* allocator)
+    : Allocator(), d(new TrackingAllocatorPrivate)
+{
+    d->allocator = allocator;
+    d->last_layer = -1;
+    d->payout_count = 0;
+    d->live = 0;
+    d->peak = 0;
+}
+
+TrackingAllocator::~TrackingAllocator()
+{
+    if (d->payout_count != 0)
+    {
+        NCNN_LOGE("FATAL ERROR! tracking allocator destroyed too early");
+#if NCNN_STDIO
+        for (size_t i = 0; i < d->payouts.size(); i++)
+        {
+            for (size_t j = 0; j < d->payouts[i].size(); j++)
+            {
+                NCNN_LOGE("%p still in use, allocated by layer %d", d->payouts[i][j].ptr, d->payouts[i][j].layer_index);
+            }
+        }
+#endif
+    }
+
+    delete d;
+}
+
+TrackingAllocator::TrackingAllocator(const TrackingAllocator&)
+    : d(0)
+{
+}
+
+TrackingAllocator& TrackingAllocator::operator=(const TrackingAllocator&)
+{
+    return *this;
+}
+
+void TrackingAllocator::begin_layer(int layer_index)
+{
+    d->thread_layer.set(reinterpret_cast<void*>((size_t)layer_index + 1));
+
+    MutexLockGuard lock(d->lock);
+
+    d->last_layer = layer_index;
+
+    if (d->layer_stats.size() < (size_t)layer_index + 1)
+        d->layer_stats.resize(layer_index + 1);
+
+    LayerMemory& stat = d->layer_stats[layer_index];
+    stat.layer_index = layer_index;
+    stat.allocation_count = 0;
+    stat.allocated_bytes = 0;
+    stat.peak_bytes = d->live;
+    stat.live_bytes = d->live;
+
+    d->running.push_back(layer_index);
+}
+
+void TrackingAllocator::end_layer(int layer_index)
+{
+    d->thread_layer.set(0);
+
+    MutexLockGuard lock(d->lock);
+
+    if (d->last_layer == layer_index)
+        d->last_layer = -1;
+
+    for (size_t i = 0; i < d->running.size(); i++)
+    {
+        if (d->running[i] == layer_index)
+        {
+            d->running.erase(d->running.begin() + i);
+            break;
+        }
+    }
+
+    LayerMemory& stat = d->layer_stats[layer_index];
+    stat.live_bytes = d->live;
+
+    d->timeline.push_back(stat);
+}
+
+void TrackingAllocator::clear()
+{
+    MutexLockGuard lock(d->lock);
+
+    d->timeline.clear();
+    d->peak = d->live;
+    d->peak_per_layer = d->live_per_layer;
+}
+
+size_t TrackingAllocator::live_bytes() const
+{
+    MutexLockGuard lock(d->lock);
+
+    return d->live;
+}
+
+size_t TrackingAllocator::peak_bytes() const
+{
+    MutexLockGuard lock(d->lock);
+
+    return d->peak;
+}
+
+std::vector<LayerMemory> TrackingAllocator::timeline() const
+{
+    MutexLockGuard lock(d->lock);
+
+    return d->timeline;
+}
+
+std::vector<std::pair<int, size_t> > TrackingAllocator::peak_contributors() const
+{
+    std::vector<std::pair<int, size_t> > contributors;
+
+    {
+        MutexLockGuard lock(d->lock);
+
+        for (size_t i = 0; i < d->peak_per_layer.size(); i++)
+        {
+            if (d->peak_per_layer[i] == 0)
+                continue;
+
+            contributors.push_back(std::make_pair((int)i - 1, d->peak_per_layer[i]));
+        }
+    }
+
+    // insertion sort, largest first
+    for (size_t i = 1; i < contributors.size(); i++)
+    {
+        std::pair<int, size_t> c = contributors[i];
+        size_t j = i;
+        for (; j > 0 && contributors[j - 1].second < c.second; j--)
+        {
+            contributors[j] = contributors[j - 1];
+        }
+        contributors[j] = c;
+    }
+
+    return contributors;
+}
+
+void* TrackingAllocator::fastMalloc(size_t size)
+{
+    const int thread_layer = (int)reinterpret_cast<size_t>(d->thread_layer.get()) - 1;
+
+    MutexLockGuard lock(d->lock);
+
+    // wrapped allocator called under lock, so that unlocked pool allocator works too
+    void* ptr = d->allocator ? d->allocator->fastMalloc(size) : ncnn::fastMalloc(size);
+    if (!ptr)
+        return ptr;
+
+    const int layer_index = thread_layer != -1 ? thread_layer : d->last_layer;
+
+    TrackingPayout payout;
+    payout.ptr = ptr;
+    payout.size = size;
+    payout.layer_index = layer_index;
+    d->insert_payout(payout);
+
+    d->add_live(layer_index, size);
+
+    if (layer_index != -1)
+    {
+        LayerMemory& stat = d->layer_stats[layer_index];
+        stat.allocation_count++;
+        stat.allocated_bytes += size;
+    }
+
+    return ptr;
+}
+
+void TrackingAllocator::fastFree(void* ptr)
+{
+    MutexLockGuard lock(d->lock);
+
+    TrackingPayout payout;
+    if (d->remove_payout(ptr, payout) == 0)
+    {
+        d->sub_live(payout.layer_index, payout.size);
+    }
+    else
+    {
+        NCNN_LOGE("FATAL ERROR! tracking allocator get wild %p", ptr);
+    }
+
+    if (d->allocator)
+        d->allocator->fastFree(ptr);
+    else
+        ncnn::fastFree(ptr);
+}
+
 #if NCNN_VULKAN
 VkAllocator::VkAllocator(const VulkanDevice* _vkdev)
     : vkdev(_vkdev)
@@ -216,6 +216,140 @@ private:
     UnlockedPoolAllocatorPrivate* const d;
 };
 
+class BinnedPoolAllocatorPrivate;
+// pool allocator binning sizes into geometric classes, four per power of two
+// freed blocks go to a per-thread cache first and move to shared free lists in small batches
+// shared free lists are lock-free on targets with a double word compare and swap
+// a thread cache is handed back to the shared free lists when its thread exits
+// suitable as blob and workspace allocator shared by many concurrent extractors
+class NCNN_EXPORT BinnedPoolAllocator : public Allocator
+{
+public:
+    BinnedPoolAllocator();
+    ~BinnedPoolAllocator();
+
+    // release all cached blocks immediately
+    // no other thread may allocate from or free to this allocator meanwhile
+    void clear();
+
+    // allocations served from cached blocks
+    // counted per thread, approximate while other threads are allocating
+    size_t hits() const;
+
+    // allocations served by ncnn::fastMalloc
+    size_t misses() const;
+
+    // bytes of blocks cached for reuse
+    size_t bytes_cached() const;
+
+    virtual void* fastMalloc(size_t size);
+    virtual void fastFree(void* ptr);
+
+private:
+    BinnedPoolAllocator(const BinnedPoolAllocator&);
+    BinnedPoolAllocator& operator=(const BinnedPoolAllocator&);
+
+private:
+    BinnedPoolAllocatorPrivate* const d;
+};
+
+class HugePageAllocatorPrivate;
+// allocator carving blocks from 2M huge pages, for fewer tlb misses on large weights and blobs
+// regions are mapped with MAP_HUGETLB when huge pages are reserved,
+// otherwise 2M aligned and advised with MADV_HUGEPAGE for transparent huge pages
+// small blocks share regions, large blocks get regions of their own kept for reuse
+// falls back to ncnn::fastMalloc on platforms other than linux
+class NCNN_EXPORT HugePageAllocator : public Allocator
+{
+public:
+    HugePageAllocator();
+    ~HugePageAllocator();
+
+    // budget drop threshold
+    // default threshold = 10
+    void set_size_drop_threshold(size_t);
+
+    // release all free regions immediately
+    void clear();
+
+    // bytes of regions mapped, in use or free
+    size_t bytes_mapped() const;
+
+    // bytes of regions mapped with MAP_HUGETLB
+    size_t bytes_hugetlb() const;
+
+    virtual void* fastMalloc(size_t size);
+    virtual void fastFree(void* ptr);
+
+private:
+    HugePageAllocator(const HugePageAllocator&);
+    HugePageAllocator& operator=(const HugePageAllocator&);
+
+private:
+    HugePageAllocatorPrivate* const d;
+};
+
+// memory stats of one layer forward, as seen by TrackingAllocator
+class NCNN_EXPORT LayerMemory
+{
+public:
+    LayerMemory();
+
+    int layer_index;
+
+    // allocations requested while the layer was running
+    int allocation_count;
+    size_t allocated_bytes;
+
+    // most bytes live at once while the layer was running
+    size_t peak_bytes;
+
+    // bytes live when the layer finished
+    size_t live_bytes;
+};
+
+class TrackingAllocatorPrivate;
+// allocator wrapper recording each allocation with the layer requesting it
+// byte counts are the requested sizes, budgets cached inside the wrapped pool allocator are not counted
+class NCNN_EXPORT TrackingAllocator : public Allocator
+{
+public:
+    // wrap allocator, or ncnn::fastMalloc if null
+    TrackingAllocator(Allocator* allocator = 0);
+    ~TrackingAllocator();
+
+    // attribute allocations of the calling thread to layer_index
+    // called by net around each layer forward when set by Extractor::set_memory_tracker
+    void begin_layer(int layer_index);
+    void end_layer(int layer_index);
+
+    // drop timeline and restart peak from the bytes live now
+    void clear();
+
+    // bytes allocated and not yet freed
+    size_t live_bytes() const;
+
+    // most bytes live at once since creation or last clear()
+    size_t peak_bytes() const;
+
+    // one entry per layer forward in order of layer finish
+    std::vector<LayerMemory> timeline() const;
+
+    // bytes live at the peak grouped by allocating layer, largest first
+    // allocations outside any layer, such as output conversion, go to layer_index -1
+    std::vector<std::pair<int, size_t> > peak_contributors() const;
+
+    virtual void* fastMalloc(size_t size);
+    virtual void fastFree(void* ptr);
+
+private:
+    TrackingAllocator(const TrackingAllocator&);
+    TrackingAllocator& operator=(const TrackingAllocator&);
+
+private:
+    TrackingAllocatorPrivate* const d;
+};
+
 #if NCNN_VULKAN
 
 class VulkanDevice;
@@ -16,6 +16,18 @@
 
 #include <string.h>
 
+#if NCNN_STDIO
+#if defined _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#endif // NCNN_STDIO
+
 namespace ncnn {
 
 DataReader::DataReader()
@@ -149,6 +161,162 @@ size_t DataReaderFromMemory::reference(size_t size, const void** buf) const
     return size;
 }
 
+#if NCNN_STDIO
+class DataReaderFromMmapPrivate
+{
+public:
+    DataReaderFromMmapPrivate()
+    {
+        data = 0;
+        size = 0;
+        offset = 0;
+#if defined _WIN32
+        mapping = 0;
+#endif
+    }
+
+    const unsigned char* data;
+    size_t size;
+    mutable size_t offset;
+#if defined _WIN32
+    HANDLE mapping;
+#endif
+};
+
+DataReaderFromMmap::DataReaderFromMmap(const char* filepath)
+    : DataReader(), d(new DataReaderFromMmapPrivate)
+{
+#if defined _WIN32
+    HANDLE file = CreateFileA(filepath, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        NCNN_LOGE("open %s failed", filepath);
+        return;
+    }
+
+    LARGE_INTEGER filesize;
+    if (GetFileSizeEx(file, &filesize) && filesize.QuadPart > 0)
+    {
+        d->mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+        if (d->mapping)
+        {
+            d->data = (const unsigned char*)MapViewOfFile(d->mapping, FILE_MAP_READ, 0, 0, 0);
+            if (d->data)
+            {
+                d->size = (size_t)filesize.QuadPart;
+            }
+        }
+    }
+
+    CloseHandle(file);
+#else
+    int fd = open(filepath, O_RDONLY);
+    if (fd == -1)
+    {
+        NCNN_LOGE("open %s failed", filepath);
+        return;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+        // private read-only mapping, clean pages are shared with other processes through page cache
+        void* ptr = mmap(0, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (ptr != MAP_FAILED)
+        {
+            d->data = (const unsigned char*)ptr;
+            d->size = (size_t)st.st_size;
+
+#ifdef MADV_SEQUENTIAL
+            // model data is consumed front to back while loading
+            madvise(ptr, d->size, MADV_SEQUENTIAL);
+#endif
+        }
+    }
+
+    close(fd);
+#endif
+
+    if (!d->data)
+    {
+        NCNN_LOGE("mmap %s failed", filepath);
+    }
+}
+
+DataReaderFromMmap::~DataReaderFromMmap()
+{
+#if defined _WIN32
+    if (d->data)
+        UnmapViewOfFile(d->data);
+    if (d->mapping)
+        CloseHandle(d->mapping);
+#else
+    if (d->data)
+        munmap((void*)d->data, d->size);
+#endif
+
+    delete d;
+}
+
+DataReaderFromMmap::DataReaderFromMmap(const DataReaderFromMmap&)
+    : d(0)
+{
+}
+
+DataReaderFromMmap& DataReaderFromMmap::operator=(const DataReaderFromMmap&)
+{
+    return *this;
+}
+
+size_t DataReaderFromMmap::size() const
+{
+    return d->size;
+}
+
+void DataReaderFromMmap::release_pages() const
+{
+    if (!d->data)
+        return;
+
+#if defined _WIN32
+    // drop the pages from working set, they stay in standby list
+    VirtualUnlock((LPVOID)d->data, d->size);
+#else
+#ifdef MADV_DONTNEED
+    // read-only private mapping is refilled from file on access
+    madvise((void*)d->data, d->size, MADV_DONTNEED);
+#endif
+#endif
+}
+
+size_t DataReaderFromMmap::read(void* buf, size_t size) const
+{
+    if (d->offset >= d->size)
+        return 0;
+
+    if (size > d->size - d->offset)
+        size = d->size - d->offset;
+
+    memcpy(buf, d->data + d->offset, size);
+    d->offset += size;
+    return size;
+}
+
+size_t DataReaderFromMmap::reference(size_t size, const void** buf) const
+{
+    if (d->offset >= d->size || size > d->size - d->offset)
+        return 0;
+
+    // weights are referenced as float, decline misaligned data so that caller falls back to read
+    if (((size_t)(d->data + d->offset) & 3) != 0)
+        return 0;
+
+    *buf = d->data + d->offset;
+    d->offset += size;
+    return size;
+}
+#endif // NCNN_STDIO
+
 #if NCNN_PLATFORM_API
 #if __ANDROID_API__ >= 9
 class DataReaderFromAndroidAssetPrivate
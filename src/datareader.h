@@ -93,6 +93,35 @@ private:
     DataReaderFromMemoryPrivate* const d;
 };
 
+#if NCNN_STDIO
+class DataReaderFromMmapPrivate;
+class NCNN_EXPORT DataReaderFromMmap : public DataReader
+{
+public:
+    // map the whole file read-only, pages are faulted in on demand
+    // data is referenced in place when 4-byte aligned, otherwise read() copies it
+    // mapping is released on destruction, so retain it while referenced data is used
+    explicit DataReaderFromMmap(const char* filepath);
+    virtual ~DataReaderFromMmap();
+
+    // return mapped bytes, 0 if mapping failed
+    size_t size() const;
+
+    // drop resident pages, referenced data is faulted in again when touched
+    void release_pages() const;
+
+    virtual size_t read(void* buf, size_t size) const;
+    virtual size_t reference(size_t size, const void** buf) const;
+
+private:
+    DataReaderFromMmap(const DataReaderFromMmap&);
+    DataReaderFromMmap& operator=(const DataReaderFromMmap&);
+
+private:
+    DataReaderFromMmapPrivate* const d;
+};
+#endif // NCNN_STDIO
+
 #if NCNN_PLATFORM_API
 #if __ANDROID_API__ >= 9
 class DataReaderFromAndroidAssetPrivate;
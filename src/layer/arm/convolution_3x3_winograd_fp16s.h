@@ -2115,7 +2115,7 @@ static void conv3x3s1_winograd23_transform_kernel_fp16sa(const Mat& kernel, Mat&
     const int B = 16;
 
     int TILE_M, TILE_N, TILE_K;
-    conv3x3s1_winograd_get_optimal_tile_mnk_fp16(M, 0, K, B, TILE_M, TILE_N, TILE_K, opt.num_threads);
+    conv3x3s1_winograd_get_optimal_tile_mnk_fp16(M, 0, K, B, TILE_M, TILE_N, TILE_K, get_plan_num_threads(opt));
 
     const int nn_M = (M + TILE_M - 1) / TILE_M;
 
@@ -2936,6 +2936,9 @@ static void conv3x3s1_winograd23_fp16sa(const Mat& bottom_blob, Mat& top_blob, c
     int TILE_M, TILE_N, TILE_K;
     conv3x3s1_winograd_get_optimal_tile_mnk_fp16(M, N, K, B, TILE_M, TILE_N, TILE_K, nT);
 
+    // tiles follow nT, the work may run on fewer threads
+    nT = std::min(nT, opt.num_threads);
+
     const int nn_M = (M + TILE_M - 1) / TILE_M;
     const int nn_N = (N + TILE_N - 1) / TILE_N;
     const int nn_K = (K + TILE_K - 1) / TILE_K;
@@ -3105,7 +3108,7 @@ static void conv3x3s1_winograd43_transform_kernel_fp16sa(const Mat& kernel, Mat&
     const int B = 36;
 
     int TILE_M, TILE_N, TILE_K;
-    conv3x3s1_winograd_get_optimal_tile_mnk_fp16(M, 0, K, B, TILE_M, TILE_N, TILE_K, opt.num_threads);
+    conv3x3s1_winograd_get_optimal_tile_mnk_fp16(M, 0, K, B, TILE_M, TILE_N, TILE_K, get_plan_num_threads(opt));
 
     const int nn_M = (M + TILE_M - 1) / TILE_M;
 
@@ -4282,6 +4285,9 @@ static void conv3x3s1_winograd43_fp16sa(const Mat& bottom_blob, Mat& top_blob, c
     int TILE_M, TILE_N, TILE_K;
     conv3x3s1_winograd_get_optimal_tile_mnk_fp16(M, N, K, B, TILE_M, TILE_N, TILE_K, nT);
 
+    // tiles follow nT, the work may run on fewer threads
+    nT = std::min(nT, opt.num_threads);
+
     const int nn_M = (M + TILE_M - 1) / TILE_M;
     const int nn_N = (N + TILE_N - 1) / TILE_N;
     const int nn_K = (K + TILE_K - 1) / TILE_K;
@@ -4458,7 +4464,7 @@ static void conv3x3s1_winograd63_transform_kernel_fp16sa(const Mat& kernel, Mat&
     const int B = 64;
 
     int TILE_M, TILE_N, TILE_K;
-    conv3x3s1_winograd_get_optimal_tile_mnk_fp16(M, 0, K, B, TILE_M, TILE_N, TILE_K, opt.num_threads);
+    conv3x3s1_winograd_get_optimal_tile_mnk_fp16(M, 0, K, B, TILE_M, TILE_N, TILE_K, get_plan_num_threads(opt));
 
     const int nn_M = (M + TILE_M - 1) / TILE_M;
 
@@ -5893,6 +5899,9 @@ static void conv3x3s1_winograd63_fp16sa(const Mat& bottom_blob, Mat& top_blob, c
     int TILE_M, TILE_N, TILE_K;
     conv3x3s1_winograd_get_optimal_tile_mnk_fp16(M, N, K, B, TILE_M, TILE_N, TILE_K, nT);
 
+    // tiles follow nT, the work may run on fewer threads
+    nT = std::min(nT, opt.num_threads);
+
     const int nn_M = (M + TILE_M - 1) / TILE_M;
     const int nn_N = (N + TILE_N - 1) / TILE_N;
     const int nn_K = (K + TILE_K - 1) / TILE_K;
@@ -3596,7 +3596,7 @@ static void conv3x3s1_winograd23_transform_kernel_int8(const Mat& kernel, Mat& A
     const int B = 16;
 
     int TILE_M, TILE_N, TILE_K;
-    get_optimal_tile_mnk_int8(M, 0, K, TILE_M, TILE_N, TILE_K, opt.num_threads);
+    get_optimal_tile_mnk_int8(M, 0, K, TILE_M, TILE_N, TILE_K, get_plan_num_threads(opt));
 
     const int nn_M = (M + TILE_M - 1) / TILE_M;
 
@@ -4277,6 +4277,9 @@ static void conv3x3s1_winograd23_int8(Mat& bottom_blob, Mat& top_blob, const Mat
     int TILE_M, TILE_N, TILE_K;
     get_optimal_tile_mnk_int8(M, N, K, TILE_M, TILE_N, TILE_K, nT);
 
+    // tiles follow nT, the work may run on fewer threads
+    nT = std::min(nT, opt.num_threads);
+
     const int nn_M = (M + TILE_M - 1) / TILE_M;
     const int nn_N = (N + TILE_N - 1) / TILE_N;
     const int nn_K = (K + TILE_K - 1) / TILE_K;
@@ -4442,7 +4445,7 @@ static void conv3x3s1_winograd43_transform_kernel_int8(const Mat& kernel, Mat& A
     const int B = 36;
 
     int TILE_M, TILE_N, TILE_K;
-    get_optimal_tile_mnk_int8(M, 0, K, TILE_M, TILE_N, TILE_K, opt.num_threads);
+    get_optimal_tile_mnk_int8(M, 0, K, TILE_M, TILE_N, TILE_K, get_plan_num_threads(opt));
 
     const int nn_M = (M + TILE_M - 1) / TILE_M;
 
@@ -5624,6 +5627,9 @@ static void conv3x3s1_winograd43_int8(Mat& bottom_blob, Mat& top_blob, const Mat
     int TILE_M, TILE_N, TILE_K;
     get_optimal_tile_mnk_int8(M, N, K, TILE_M, TILE_N, TILE_K, nT);
 
+    // tiles follow nT, the work may run on fewer threads
+    nT = std::min(nT, opt.num_threads);
+
     const int nn_M = (M + TILE_M - 1) / TILE_M;
     const int nn_N = (N + TILE_N - 1) / TILE_N;
     const int nn_K = (K + TILE_K - 1) / TILE_K;
@@ -14,6 +14,8 @@
 
 #include "gemm.h"
 
+#include "weight_quant.h"
+
 namespace ncnn {
 
 Gemm::Gemm()
@@ -39,6 +41,8 @@ int Gemm::load_param(const ParamDict& pd)
     output_elempack = pd.get(12, 0);
     output_elemtype = pd.get(13, 0);
     output_transpose = pd.get(14, 0);
+    weight_quant_bits = pd.get(15, 0);
+    weight_quant_group_size = pd.get(16, 32);
     constant_TILE_M = pd.get(20, 0);
     constant_TILE_N = pd.get(21, 0);
     constant_TILE_K = pd.get(22, 0);
@@ -61,6 +65,24 @@ int Gemm::load_param(const ParamDict& pd)
         return -1;
     }
 
+    if (weight_quant_bits)
+    {
+        if (weight_quant_bits != 4 && weight_quant_bits != 8)
+        {
+            NCNN_LOGE("weight_quant_bits must be 4 or 8");
+            return -1;
+        }
+
+        if (weight_quant_group_size <= 0 || constantA == 1 || constantB == 0)
+        {
+            NCNN_LOGE("weight_quant_group_size must be positive and only constant B can be quantized when weight_quant_bits enabled");
+            return -1;
+        }
+
+        // packed weight is consumed on cpu
+        support_vulkan = false;
+    }
+
     if (constantA == 0 && constantB == 1 && constantC == 1)
         one_blob_only = true;
 
@@ -85,7 +107,17 @@ int Gemm::load_model(const ModelBin& mb)
             return -100;
     }
 
-    if (constantB == 1)
+    if (constantB == 1 && weight_quant_bits)
+    {
+        B_data = mb.load(weight_quant_row_bytes(constantK, weight_quant_bits) * constantN, 0);
+        if (B_data.empty() || B_data.elemsize != 1)
+            return -100;
+
+        B_quant_scales = mb.load(weight_quant_group_count(constantK, weight_quant_group_size) * constantN, 1);
+        if (B_quant_scales.empty())
+            return -100;
+    }
+    else if (constantB == 1)
     {
         if (transB == 0)
             B_data = mb.load(constantN, constantK, 0);
@@ -153,7 +185,22 @@ int Gemm::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_bl
     }
 
     Mat B;
-    if (transB == 0)
+    if (constantB && weight_quant_bits)
+    {
+        // dequantize B to col-major
+        B.create(constantK, constantN, elemsize, opt.workspace_allocator);
+
+        const int row_bytes = weight_quant_row_bytes(constantK, weight_quant_bits);
+        const int group_count = weight_quant_group_count(constantK, weight_quant_group_size);
+
+        for (int i = 0; i < B.h; i++)
+        {
+            const unsigned char* kptr = (const unsigned char*)B_data + i * row_bytes;
+            const float* scales = (const float*)B_quant_scales + i * group_count;
+            weight_quant_dequantize_row(kptr, scales, B.row(i), constantK, weight_quant_bits, weight_quant_group_size);
+        }
+    }
+    else if (transB == 0)
     {
         // transpose B to col-major
         B.create((B0.dims == 3 ? B0.c : B0.h), B0.w, elemsize, opt.workspace_allocator);
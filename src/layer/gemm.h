@@ -54,10 +54,18 @@ public:
     int constant_TILE_N;
     int constant_TILE_K;
 
+    // group-wise weight-only quantization of constant B, 0=off 4=int4 8=int8
+    // quantized B is stored as N rows of K regardless of transB
+    int weight_quant_bits;
+    int weight_quant_group_size;
+
     // constant A / B / C
     Mat A_data;
     Mat B_data;
     Mat C_data;
+
+    // per group scales of quantized B
+    Mat B_quant_scales;
 };
 
 } // namespace ncnn
@@ -17,6 +17,7 @@
 #include "layer_type.h"
 
 #include "fused_activation.h"
+#include "weight_quant.h"
 
 namespace ncnn {
 
@@ -34,6 +35,8 @@ int InnerProduct::load_param(const ParamDict& pd)
     int8_scale_term = pd.get(8, 0);
     activation_type = pd.get(9, 0);
     activation_params = pd.get(10, Mat());
+    weight_quant_bits = pd.get(11, 0);
+    weight_quant_group_size = pd.get(12, 32);
 
     if (int8_scale_term)
     {
@@ -45,14 +48,47 @@ int InnerProduct::load_param(const ParamDict& pd)
 #endif
     }
 
+    if (weight_quant_bits)
+    {
+        if (weight_quant_bits != 4 && weight_quant_bits != 8)
+        {
+            NCNN_LOGE("weight_quant_bits must be 4 or 8");
+            return -1;
+        }
+
+        if (weight_quant_group_size <= 0 || int8_scale_term)
+        {
+            NCNN_LOGE("weight_quant_group_size must be positive and int8_scale_term disabled when weight_quant_bits enabled");
+            return -1;
+        }
+
+        // packed weight is consumed on cpu
+        support_vulkan = false;
+    }
+
     return 0;
 }
 
 int InnerProduct::load_model(const ModelBin& mb)
 {
-    weight_data = mb.load(weight_data_size, 0);
-    if (weight_data.empty())
-        return -100;
+    if (weight_quant_bits)
+    {
+        const int num_input = weight_data_size / num_output;
+
+        weight_data = mb.load(weight_quant_row_bytes(num_input, weight_quant_bits) * num_output, 0);
+        if (weight_data.empty() || weight_data.elemsize != 1)
+            return -100;
+
+        weight_quant_scales = mb.load(weight_quant_group_count(num_input, weight_quant_group_size) * num_output, 1);
+        if (weight_quant_scales.empty())
+            return -100;
+    }
+    else
+    {
+        weight_data = mb.load(weight_data_size, 0);
+        if (weight_data.empty())
+            return -100;
+    }
 
     if (bias_term)
     {
@@ -94,6 +130,11 @@ int InnerProduct::load_model(const ModelBin& mb)
 
 int InnerProduct::forward(const Mat& bottom_blob, Mat& top_blob, const Option& opt) const
 {
+    if (weight_quant_bits)
+    {
+        return forward_weight_quant(bottom_blob, top_blob, opt);
+    }
+
 #if NCNN_INT8
     if (opt.use_int8_inference && weight_data.elemsize == (size_t)1u)
     {
@@ -174,6 +215,73 @@ int InnerProduct::forward(const Mat& bottom_blob, Mat& top_blob, const Option& o
     return 0;
 }
 
+int InnerProduct::forward_weight_quant(const Mat& bottom_blob, Mat& top_blob, const Option& opt) const
+{
+    const int num_input = weight_data_size / num_output;
+
+    const int row_bytes = weight_quant_row_bytes(num_input, weight_quant_bits);
+    const int group_count = weight_quant_group_count(num_input, weight_quant_group_size);
+
+    int w = bottom_blob.w;
+    int h = bottom_blob.h;
+    size_t elemsize = bottom_blob.elemsize;
+
+    const int num_batch = bottom_blob.dims == 2 && w == num_input ? h : 1;
+
+    if (bottom_blob.dims == 2 && w == num_input)
+        top_blob.create(num_output, h, elemsize, opt.blob_allocator);
+    else
+        top_blob.create(num_output, elemsize, opt.blob_allocator);
+    if (top_blob.empty())
+        return -100;
+
+    // flatten input of any shape
+    Mat bottom_blob_flattened = bottom_blob;
+    if (num_batch == 1 && bottom_blob.dims != 1)
+    {
+        Option opt_flatten = opt;
+        opt_flatten.blob_allocator = opt.workspace_allocator;
+
+        flatten(bottom_blob, bottom_blob_flattened, opt_flatten);
+        if (bottom_blob_flattened.empty())
+            return -100;
+    }
+
+    #pragma omp parallel for num_threads(opt.num_threads)
+    for (int p = 0; p < num_output; p++)
+    {
+        const unsigned char* kptr = (const unsigned char*)weight_data + row_bytes * p;
+        const float* scales = (const float*)weight_quant_scales + group_count * p;
+
+        for (int j = 0; j < num_batch; j++)
+        {
+            const float* m = num_batch == 1 ? (const float*)bottom_blob_flattened : bottom_blob.row(j);
+
+            float sum = 0.f;
+
+            if (bias_term)
+                sum = bias_data[p];
+
+            for (int k0 = 0; k0 < num_input; k0 += weight_quant_group_size)
+            {
+                const int max_kk = std::min(num_input - k0, weight_quant_group_size);
+
+                float gsum = 0.f;
+                for (int kk = 0; kk < max_kk; kk++)
+                {
+                    gsum += m[k0 + kk] * weight_quant_value(kptr, k0 + kk, weight_quant_bits);
+                }
+
+                sum += gsum * scales[k0 / weight_quant_group_size];
+            }
+
+            top_blob.row(j)[p] = activation_ss(sum, activation_type, activation_params);
+        }
+    }
+
+    return 0;
+}
+
 #if NCNN_INT8
 int InnerProduct::forward_int8(const Mat& bottom_blob, Mat& top_blob, const Option& opt) const
 {
@@ -0,0 +1,95 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#ifndef WEIGHT_QUANT_H
+#define WEIGHT_QUANT_H
+
+#include "mat.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+// group-wise symmetric weight-only quantization
+//
+// weight is stored as rows of K, each row split into groups of group_size along K
+// every group owns one fp32 scale, w = q * scale
+// int8 stores q in [-127, 127] as signed char
+// int4 stores q in [-8, 7] as q + 8, two per byte, even k in the low nibble
+// rows are padded to whole bytes
+
+static inline int weight_quant_row_bytes(int K, int bits)
+{
+    return bits == 4 ? (K + 1) / 2 : K;
+}
+
+static inline int weight_quant_group_count(int K, int group_size)
+{
+    return (K + group_size - 1) / group_size;
+}
+
+static inline int weight_quant_value(const unsigned char* row, int k, int bits)
+{
+    if (bits == 4)
+        return ((row[k / 2] >> ((k & 1) * 4)) & 15) - 8;
+
+    return (signed char)row[k];
+}
+
+static inline void weight_quant_dequantize_row(const unsigned char* row, const float* scales, float* outptr, int K, int bits, int group_size)
+{
+    for (int k = 0; k < K; k++)
+    {
+        outptr[k] = weight_quant_value(row, k, bits) * scales[k / group_size];
+    }
+}
+
+static inline void weight_quant_quantize_row(const float* ptr, unsigned char* row, float* scales, int K, int bits, int group_size)
+{
+    const int qmax = bits == 4 ? 7 : 127;
+    const int qmin = bits == 4 ? -8 : -127;
+
+    memset(row, 0, weight_quant_row_bytes(K, bits));
+
+    for (int k0 = 0; k0 < K; k0 += group_size)
+    {
+        const int max_kk = std::min(K - k0, group_size);
+
+        float absmax = 0.f;
+        for (int kk = 0; kk < max_kk; kk++)
+        {
+            absmax = std::max(absmax, (float)fabs(ptr[k0 + kk]));
+        }
+
+        const float scale = absmax / qmax;
+        const float scale_inv = absmax == 0.f ? 0.f : qmax / absmax;
+
+        scales[k0 / group_size] = scale;
+
+        for (int kk = 0; kk < max_kk; kk++)
+        {
+            const int k = k0 + kk;
+
+            int q = (int)round(ptr[k] * scale_inv);
+            q = std::min(std::max(q, qmin), qmax);
+
+            if (bits == 4)
+                row[k / 2] |= (unsigned char)((q + 8) << ((k & 1) * 4));
+            else
+                row[k] = (unsigned char)(signed char)q;
+        }
+    }
+}
+
+#endif // WEIGHT_QUANT_H
@@ -32,6 +32,7 @@
 #include "benchmark.h"
 #include "cpu.h"
 #include "layer_type.h"
+#include "weightcache.h"
 
 namespace ncnn {
 
@@ -41,6 +42,8 @@ namespace ncnn {
 #include "convolution_3x3_winograd.h"
 #include "convolution_packed.h"
 
+#include "cast_fp16.h"
+
 #if NCNN_INT8
 #include "convolution_3x3_int8.h"
 
@@ -277,13 +280,57 @@ static bool test_prefer_winograd23(int num_input, int num_output, int w, int h)
     return false;
 }
 
+#if __F16C__
+static int convolution_packed_fp16w(const Mat& bottom_blob, Mat& top_blob, const Mat& weight_data_tm, const Mat& bias_data, int kernel_w, int kernel_h, int dilation_w, int dilation_h, int stride_w, int stride_h, int activation_type, const Mat& activation_params, const Option& opt)
+{
+    // one block of output channels per thread is unpacked to fp32 at a time
+#if __AVX512F__
+    const int outch_block = 16;
+#else
+    const int outch_block = 8;
+#endif
+
+    const int out_elempack = top_blob.elempack;
+    const int outch = top_blob.c * out_elempack;
+
+    const int TILE_OUTCH = outch_block * opt.num_threads;
+
+    for (int p0 = 0; p0 < outch; p0 += TILE_OUTCH)
+    {
+        const int max_pp = std::min(outch - p0, TILE_OUTCH);
+
+        // packed weight channels of whole blocks, the tail packs the remaining ones
+        const int c0 = p0 / outch_block;
+        const int c1 = p0 + max_pp < outch ? (p0 + max_pp) / outch_block : weight_data_tm.c;
+
+        Mat weight_data_tm_fp16 = weight_data_tm.channel_range(c0, c1 - c0);
+
+        Mat weight_data_tm_tile(weight_data_tm.w, weight_data_tm.h, c1 - c0, 4u, opt.workspace_allocator);
+        if (weight_data_tm_tile.empty())
+            return -100;
+
+        cast_fp16_to_fp32_sse(weight_data_tm_fp16, weight_data_tm_tile, opt);
+
+        Mat top_blob_tile = top_blob.channel_range(p0 / out_elempack, max_pp / out_elempack);
+
+        Mat bias_data_tile;
+        if (!bias_data.empty())
+            bias_data_tile = bias_data.range(p0, max_pp);
+
+        convolution_packed(bottom_blob, top_blob_tile, weight_data_tm_tile, bias_data_tile, kernel_w, kernel_h, dilation_w, dilation_h, stride_w, stride_h, activation_type, activation_params, opt);
+    }
+
+    return 0;
+}
+#endif // __F16C__
+
 int Convolution_x86::create_pipeline(const Option& opt)
 {
     if (dynamic_weight)
         return 0;
 
     activation = create_activation_layer(activation_type, activation_params, opt);
-    nT = opt.num_threads;
+    nT = get_plan_num_threads(opt);
 
 #if NCNN_INT8
     if (opt.use_int8_inference && weight_data.elemsize == (size_t)1u)
@@ -362,15 +409,19 @@ int Convolution_x86::create_pipeline(const Option& opt)
 
     if (opt.use_winograd_convolution && prefer_winograd && kernel_w == 3 && kernel_h == 3 && dilation_w == 1 && dilation_h == 1 && stride_w == 1 && stride_h == 1)
     {
+        bool prefer_winograd63 = false;
+        bool prefer_winograd43 = false;
+        bool prefer_winograd23 = false;
+
         if ((bottom_shapes.empty() || bottom_shapes[0].w == 0 || bottom_shapes[0].h == 0) && (top_shapes.empty() || top_shapes[0].w == 0 || top_shapes[0].h == 0))
         {
             // dynamic shape
             if ((opt.use_winograd63_convolution) && (num_input <= 32 && num_output <= 32))
-                conv3x3s1_winograd63_transform_kernel(weight_data, weight_winograd63_data, num_input, num_output, opt);
+                prefer_winograd63 = true;
             else if (opt.use_winograd43_convolution)
-                conv3x3s1_winograd43_transform_kernel(weight_data, weight_winograd43_data, num_input, num_output, opt);
+                prefer_winograd43 = true;
             else
-                conv3x3s1_winograd23_transform_kernel(weight_data, weight_winograd23_data, num_input, num_output, opt);
+                prefer_winograd23 = true;
         }
         else
         {
@@ -401,9 +452,9 @@ int Convolution_x86::create_pipeline(const Option& opt)
                 h = top_shapes[0].h + 2;
             }
 
-            bool prefer_winograd63 = test_prefer_winograd63(num_input, num_output, w, h);
-            bool prefer_winograd23 = test_prefer_winograd23(num_input, num_output, w, h);
-            bool prefer_winograd43 = !prefer_winograd63 && !prefer_winograd23;
+            prefer_winograd63 = test_prefer_winograd63(num_input, num_output, w, h);
+            prefer_winograd23 = test_prefer_winograd23(num_input, num_output, w, h);
+            prefer_winograd43 = !prefer_winograd63 && !prefer_winograd23;
 
             if (prefer_winograd23 && !opt.use_winograd23_convolution)
             {
@@ -432,23 +483,38 @@ int Convolution_x86::create_pipeline(const Option& opt)
                     prefer_winograd23 = true;
                 }
             }
+        }
 
-            if (prefer_winograd23)
+        if (prefer_winograd23)
+        {
+            WeightCacheKey key(opt, "convolution_x86_winograd23", weight_data, num_input, num_output);
+            if (key.lookup(weight_winograd23_data) != 0)
             {
                 conv3x3s1_winograd23_transform_kernel(weight_data, weight_winograd23_data, num_input, num_output, opt);
+                key.store(weight_winograd23_data);
             }
-            else if (prefer_winograd43)
+        }
+        else if (prefer_winograd43)
+        {
+            WeightCacheKey key(opt, "convolution_x86_winograd43", weight_data, num_input, num_output);
+            if (key.lookup(weight_winograd43_data) != 0)
             {
                 conv3x3s1_winograd43_transform_kernel(weight_data, weight_winograd43_data, num_input, num_output, opt);
+                key.store(weight_winograd43_data);
             }
-            else if (prefer_winograd63)
+        }
+        else if (prefer_winograd63)
+        {
+            WeightCacheKey key(opt, "convolution_x86_winograd63", weight_data, num_input, num_output);
+            if (key.lookup(weight_winograd63_data) != 0)
             {
                 conv3x3s1_winograd63_transform_kernel(weight_data, weight_winograd63_data, num_input, num_output, opt);
+                key.store(weight_winograd63_data);
             }
-            else
-            {
-                // should never reach here
-            }
+        }
+        else
+        {
+            // should never reach here
         }
 
         weight_data.release();
@@ -534,11 +600,38 @@ int Convolution_x86::create_pipeline(const Option& opt)
                 || (elempack == 1 && out_elempack == 4 && kernel_w == 3 && kernel_h == 3 && dilation_w == 1 && dilation_h == 1 && stride_w == 1 && stride_h == 1)
                 || (elempack == 1 && out_elempack == 4 && kernel_w == 3 && kernel_h == 3 && dilation_w == 1 && dilation_h == 1 && stride_w == 2 && stride_h == 2))
         {
-            convolution_transform_kernel_packed_sse(weight_data, weight_data_tm, num_input, num_output, kernel_w, kernel_h, elempack, out_elempack);
+            WeightCacheKey key(opt, "convolution_x86_packed_sse", weight_data, num_input, num_output, kernel_w * 256 + kernel_h, elempack * 256 + out_elempack);
+            if (key.lookup(weight_data_tm) != 0)
+            {
+                convolution_transform_kernel_packed_sse(weight_data, weight_data_tm, num_input, num_output, kernel_w, kernel_h, elempack, out_elempack);
+                key.store(weight_data_tm);
+            }
         }
         else
         {
-            convolution_transform_kernel_packed(weight_data, weight_data_tm, num_input, num_output, kernel_w, kernel_h);
+            WeightCacheKey key(opt, "convolution_x86_packed", weight_data, num_input, num_output, kernel_w, kernel_h);
+            if (key.lookup(weight_data_tm) != 0)
+            {
+                convolution_transform_kernel_packed(weight_data, weight_data_tm, num_input, num_output, kernel_w, kernel_h);
+
+#if __F16C__
+                if (opt.use_fp16_weight)
+                {
+                    // keep packed weight in fp16, unpacked by output channel tiles in forward
+                    Option opt_cast = opt;
+                    opt_cast.blob_allocator = opt.weight_allocator;
+
+                    Mat weight_data_tm_fp16;
+                    cast_float32_to_float16(weight_data_tm, weight_data_tm_fp16, opt_cast);
+                    if (weight_data_tm_fp16.empty())
+                        return -100;
+
+                    weight_data_tm = weight_data_tm_fp16;
+                }
+#endif // __F16C__
+
+                key.store(weight_data_tm);
+            }
         }
     }
 
@@ -707,10 +800,10 @@ int Convolution_x86::forward(const Mat& bottom_blob, Mat& top_blob, const Option
         }
 
         int _nT = nT ? nT : opt.num_threads;
-        if (nT != 0 && opt.num_threads != nT)
+        if (nT != 0 && opt.num_threads > nT)
         {
-            // force num_threads the same as in create_pipeline
-            // so we could use pre-packed A/B from the same tile config
+            // pre-packed A/B use the tile config of create_pipeline
+            // fewer threads share the same tiles, more threads can not be used
             NCNN_LOGE("opt.num_threads %d changed, convolution winograd will use load-time value %d", opt.num_threads, nT);
         }
 
@@ -1133,6 +1226,13 @@ int Convolution_x86::forward(const Mat& bottom_blob, Mat& top_blob, const Option
         }
 #endif // __SSE2__
 
+#if __F16C__
+        if (weight_data_tm.elemsize == 2u)
+        {
+            return convolution_packed_fp16w(bottom_blob_bordered, top_blob, weight_data_tm, bias_data, kernel_w, kernel_h, dilation_w, dilation_h, stride_w, stride_h, activation_type, activation_params, opt);
+        }
+#endif // __F16C__
+
         convolution_packed(bottom_blob_bordered, top_blob, weight_data_tm, bias_data, kernel_w, kernel_h, dilation_w, dilation_h, stride_w, stride_h, activation_type, activation_params, opt);
     }
 
@@ -1202,7 +1302,11 @@ int Convolution_x86::forward(const std::vector<Mat>& bottom_blobs, std::vector<M
 
     op->load_model(ncnn::ModelBinFromMatArray(weights));
 
-    op->create_pipeline(opt);
+    // weight transformed per forward gains nothing from fp16
+    Option opt_p = opt;
+    opt_p.use_fp16_weight = false;
+
+    op->create_pipeline(opt_p);
 
     op->forward(bottom_blob, top_blob, opt);
 
@@ -1322,10 +1426,10 @@ int Convolution_x86::forward_int8_x86(const Mat& bottom_blob, Mat& top_blob, con
     bool prefer_winograd = (opt.use_winograd23_convolution || opt.use_winograd43_convolution) && (num_input > 8 || num_output > 8);
 
     int _nT = nT ? nT : opt.num_threads;
-    if (nT != 0 && opt.num_threads != nT)
+    if (nT != 0 && opt.num_threads > nT)
     {
-        // force num_threads the same as in create_pipeline
-        // so we could use pre-packed A/B from the same tile config
+        // pre-packed A/B use the tile config of create_pipeline
+        // fewer threads share the same tiles, more threads can not be used
         NCNN_LOGE("opt.num_threads %d changed, convolution gemm will use load-time value %d", opt.num_threads, nT);
     }
 
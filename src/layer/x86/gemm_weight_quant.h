@@ -0,0 +1,324 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#if __AVX2__
+static NCNN_FORCEINLINE __m256 weight_quant_load8_int4(const unsigned char* p)
+{
+    // 8 nibbles from 4 bytes, even k in the low nibble
+    __m128i _p = _mm_cvtsi32_si128(*(const int*)p);
+    __m128i _lo = _mm_and_si128(_p, _mm_set1_epi8(15));
+    __m128i _hi = _mm_and_si128(_mm_srli_epi16(_p, 4), _mm_set1_epi8(15));
+    __m128i _q = _mm_sub_epi8(_mm_unpacklo_epi8(_lo, _hi), _mm_set1_epi8(8));
+    return _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_q));
+}
+
+static NCNN_FORCEINLINE __m256 weight_quant_load8_int8(const unsigned char* p)
+{
+    __m128i _p = _mm_loadl_epi64((const __m128i*)p);
+    return _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_p));
+}
+#endif // __AVX2__
+
+#if __AVX512F__
+static NCNN_FORCEINLINE __m512 weight_quant_load16_int4(const unsigned char* p)
+{
+    // 16 nibbles from 8 bytes, even k in the low nibble
+    __m128i _p = _mm_loadl_epi64((const __m128i*)p);
+    __m128i _lo = _mm_and_si128(_p, _mm_set1_epi8(15));
+    __m128i _hi = _mm_and_si128(_mm_srli_epi16(_p, 4), _mm_set1_epi8(15));
+    __m128i _q = _mm_sub_epi8(_mm_unpacklo_epi8(_lo, _hi), _mm_set1_epi8(8));
+    return _mm512_cvtepi32_ps(_mm512_cvtepi8_epi32(_q));
+}
+
+static NCNN_FORCEINLINE void weight_quant_load32_int4(const unsigned char* p, __m512& _w0, __m512& _w1)
+{
+    // 32 nibbles from 16 bytes, split once for both halves
+    __m128i _p = _mm_loadu_si128((const __m128i*)p);
+    __m128i _lo = _mm_and_si128(_p, _mm_set1_epi8(15));
+    __m128i _hi = _mm_and_si128(_mm_srli_epi16(_p, 4), _mm_set1_epi8(15));
+    __m128i _q0 = _mm_sub_epi8(_mm_unpacklo_epi8(_lo, _hi), _mm_set1_epi8(8));
+    __m128i _q1 = _mm_sub_epi8(_mm_unpackhi_epi8(_lo, _hi), _mm_set1_epi8(8));
+    _w0 = _mm512_cvtepi32_ps(_mm512_cvtepi8_epi32(_q0));
+    _w1 = _mm512_cvtepi32_ps(_mm512_cvtepi8_epi32(_q1));
+}
+
+static NCNN_FORCEINLINE __m512 weight_quant_load16_int8(const unsigned char* p)
+{
+    __m128i _p = _mm_loadu_si128((const __m128i*)p);
+    return _mm512_cvtepi32_ps(_mm512_cvtepi8_epi32(_p));
+}
+#endif // __AVX512F__
+
+// dot product of fp32 a and one quantized weight row, dequantized in register
+static float weight_quant_dot_x86(const float* a, const unsigned char* kptr, const float* scales, int K, int bits, int group_size)
+{
+    const float* sptr = scales;
+
+    float sum = 0.f;
+
+    int k0 = 0;
+#if __AVX512F__
+    if (group_size % 16 == 0)
+    {
+        // full groups of whole vectors
+        const int max_k0 = K / group_size * group_size;
+
+        __m512 _sum = _mm512_setzero_ps();
+        if (bits == 4)
+        {
+            for (; k0 < max_k0; k0 += group_size)
+            {
+                const float* ptr = a + k0;
+                const unsigned char* p = kptr + k0 / 2;
+
+                __m512 _gsum0 = _mm512_setzero_ps();
+                __m512 _gsum1 = _mm512_setzero_ps();
+                int kk = 0;
+                for (; kk + 31 < group_size; kk += 32)
+                {
+                    __m512 _w0;
+                    __m512 _w1;
+                    weight_quant_load32_int4(p + kk / 2, _w0, _w1);
+                    _gsum0 = _mm512_fmadd_ps(_mm512_loadu_ps(ptr + kk), _w0, _gsum0);
+                    _gsum1 = _mm512_fmadd_ps(_mm512_loadu_ps(ptr + kk + 16), _w1, _gsum1);
+                }
+                for (; kk < group_size; kk += 16)
+                {
+                    _gsum0 = _mm512_fmadd_ps(_mm512_loadu_ps(ptr + kk), weight_quant_load16_int4(p + kk / 2), _gsum0);
+                }
+                _sum = _mm512_fmadd_ps(_mm512_add_ps(_gsum0, _gsum1), _mm512_set1_ps(*sptr++), _sum);
+            }
+        }
+        else
+        {
+            for (; k0 < max_k0; k0 += group_size)
+            {
+                const float* ptr = a + k0;
+                const unsigned char* p = kptr + k0;
+
+                __m512 _gsum0 = _mm512_setzero_ps();
+                __m512 _gsum1 = _mm512_setzero_ps();
+                int kk = 0;
+                for (; kk + 31 < group_size; kk += 32)
+                {
+                    _gsum0 = _mm512_fmadd_ps(_mm512_loadu_ps(ptr + kk), weight_quant_load16_int8(p + kk), _gsum0);
+                    _gsum1 = _mm512_fmadd_ps(_mm512_loadu_ps(ptr + kk + 16), weight_quant_load16_int8(p + kk + 16), _gsum1);
+                }
+                for (; kk < group_size; kk += 16)
+                {
+                    _gsum0 = _mm512_fmadd_ps(_mm512_loadu_ps(ptr + kk), weight_quant_load16_int8(p + kk), _gsum0);
+                }
+                _sum = _mm512_fmadd_ps(_mm512_add_ps(_gsum0, _gsum1), _mm512_set1_ps(*sptr++), _sum);
+            }
+        }
+        sum += _mm512_comp_reduce_add_ps(_sum);
+    }
+    else
+#endif // __AVX512F__
+#if __AVX2__
+    if (group_size % 8 == 0)
+    {
+        // full groups of whole vectors
+        const int max_k0 = K / group_size * group_size;
+
+        __m256 _sum = _mm256_setzero_ps();
+        if (bits == 4)
+        {
+            for (; k0 < max_k0; k0 += group_size)
+            {
+                const float* ptr = a + k0;
+                const unsigned char* p = kptr + k0 / 2;
+
+                __m256 _gsum = _mm256_setzero_ps();
+                for (int kk = 0; kk < group_size; kk += 8)
+                {
+                    _gsum = _mm256_comp_fmadd_ps(_mm256_loadu_ps(ptr + kk), weight_quant_load8_int4(p + kk / 2), _gsum);
+                }
+                _sum = _mm256_comp_fmadd_ps(_gsum, _mm256_set1_ps(*sptr++), _sum);
+            }
+        }
+        else
+        {
+            for (; k0 < max_k0; k0 += group_size)
+            {
+                const float* ptr = a + k0;
+                const unsigned char* p = kptr + k0;
+
+                __m256 _gsum = _mm256_setzero_ps();
+                for (int kk = 0; kk < group_size; kk += 8)
+                {
+                    _gsum = _mm256_comp_fmadd_ps(_mm256_loadu_ps(ptr + kk), weight_quant_load8_int8(p + kk), _gsum);
+                }
+                _sum = _mm256_comp_fmadd_ps(_gsum, _mm256_set1_ps(*sptr++), _sum);
+            }
+        }
+        sum += _mm256_reduce_add_ps(_sum);
+    }
+#endif // __AVX2__
+
+    // vector loads need whole bytes at group start
+    const bool vector_aligned = bits == 8 || group_size % 2 == 0;
+
+#if __AVX512F__
+    __m512 _sum512 = _mm512_setzero_ps();
+#endif
+#if __AVX2__
+    __m256 _sum = _mm256_setzero_ps();
+#endif
+
+    for (; k0 < K; k0 += group_size)
+    {
+        const int max_kk = std::min(K - k0, group_size);
+        const float scale = *sptr++;
+
+        const float* ptr = a + k0;
+
+        int kk = 0;
+        if (vector_aligned)
+        {
+#if __AVX512F__
+            if (max_kk >= 16)
+            {
+                __m512 _gsum = _mm512_setzero_ps();
+                if (bits == 4)
+                {
+                    const unsigned char* p = kptr + k0 / 2;
+                    for (; kk + 15 < max_kk; kk += 16)
+                    {
+                        _gsum = _mm512_fmadd_ps(_mm512_loadu_ps(ptr + kk), weight_quant_load16_int4(p + kk / 2), _gsum);
+                    }
+                }
+                else
+                {
+                    const unsigned char* p = kptr + k0;
+                    for (; kk + 15 < max_kk; kk += 16)
+                    {
+                        _gsum = _mm512_fmadd_ps(_mm512_loadu_ps(ptr + kk), weight_quant_load16_int8(p + kk), _gsum);
+                    }
+                }
+                _sum512 = _mm512_fmadd_ps(_gsum, _mm512_set1_ps(scale), _sum512);
+            }
+#endif // __AVX512F__
+#if __AVX2__
+            if (kk + 7 < max_kk)
+            {
+                __m256 _gsum = _mm256_setzero_ps();
+                if (bits == 4)
+                {
+                    const unsigned char* p = kptr + k0 / 2;
+                    for (; kk + 7 < max_kk; kk += 8)
+                    {
+                        _gsum = _mm256_comp_fmadd_ps(_mm256_loadu_ps(ptr + kk), weight_quant_load8_int4(p + kk / 2), _gsum);
+                    }
+                }
+                else
+                {
+                    const unsigned char* p = kptr + k0;
+                    for (; kk + 7 < max_kk; kk += 8)
+                    {
+                        _gsum = _mm256_comp_fmadd_ps(_mm256_loadu_ps(ptr + kk), weight_quant_load8_int8(p + kk), _gsum);
+                    }
+                }
+                _sum = _mm256_comp_fmadd_ps(_gsum, _mm256_set1_ps(scale), _sum);
+            }
+#endif // __AVX2__
+        }
+
+        float gsum = 0.f;
+        for (; kk < max_kk; kk++)
+        {
+            gsum += ptr[kk] * weight_quant_value(kptr, k0 + kk, bits);
+        }
+        sum += gsum * scale;
+    }
+
+#if __AVX512F__
+    sum += _mm512_comp_reduce_add_ps(_sum512);
+#endif
+#if __AVX2__
+    sum += _mm256_reduce_add_ps(_sum);
+#endif
+
+    return sum;
+}
+
+// dequantize one weight row to fp32
+static void weight_quant_dequantize_row_x86(const unsigned char* kptr, const float* scales, float* outptr, int K, int bits, int group_size)
+{
+    const bool vector_aligned = bits == 8 || group_size % 2 == 0;
+
+    const float* sptr = scales;
+
+    for (int k0 = 0; k0 < K; k0 += group_size)
+    {
+        const int max_kk = std::min(K - k0, group_size);
+        const float scale = *sptr++;
+
+        float* ptr = outptr + k0;
+
+        int kk = 0;
+#if __AVX2__
+        if (vector_aligned)
+        {
+            __m256 _scale = _mm256_set1_ps(scale);
+            if (bits == 4)
+            {
+                const unsigned char* p = kptr + k0 / 2;
+                for (; kk + 7 < max_kk; kk += 8)
+                {
+                    _mm256_storeu_ps(ptr + kk, _mm256_mul_ps(weight_quant_load8_int4(p + kk / 2), _scale));
+                }
+            }
+            else
+            {
+                const unsigned char* p = kptr + k0;
+                for (; kk + 7 < max_kk; kk += 8)
+                {
+                    _mm256_storeu_ps(ptr + kk, _mm256_mul_ps(weight_quant_load8_int8(p + kk), _scale));
+                }
+            }
+        }
+#else
+        (void)vector_aligned;
+#endif // __AVX2__
+        for (; kk < max_kk; kk++)
+        {
+            ptr[kk] = weight_quant_value(kptr, k0 + kk, bits) * scale;
+        }
+    }
+}
+
+// C = A * W^T without bias, W is N quantized rows of K, for a few rows of A
+// A is M rows of K with row stride A_hstep
+// result of row i and column n goes to C[i * C_istep + n * C_nstep]
+static int weight_quant_gemm_x86(const float* A, int A_hstep, int M, const Mat& W, const Mat& W_scales, float* C, int C_istep, int C_nstep, int N, int K, int bits, int group_size, const Option& opt)
+{
+    const int row_bytes = weight_quant_row_bytes(K, bits);
+    const int group_count = weight_quant_group_count(K, group_size);
+
+    // memory bound, dequantize in register
+    #pragma omp parallel for num_threads(opt.num_threads)
+    for (int n = 0; n < N; n++)
+    {
+        const unsigned char* kptr = (const unsigned char*)W + n * row_bytes;
+        const float* scales = (const float*)W_scales + n * group_count;
+
+        for (int i = 0; i < M; i++)
+        {
+            C[i * C_istep + n * C_nstep] = weight_quant_dot_x86(A + i * A_hstep, kptr, scales, K, bits, group_size);
+        }
+    }
+
+    return 0;
+}
@@ -23,9 +23,13 @@
 #include "x86_usability.h"
 
 #include "cpu.h"
+#include "weight_quant.h"
+#include "weightcache.h"
 
 namespace ncnn {
 
+#include "gemm_weight_quant.h"
+
 Gemm_x86::Gemm_x86()
 {
 #if __SSE2__
@@ -6841,6 +6845,45 @@ static void get_optimal_tile_mnk(int M, int N, int K, int constant_TILE_M, int c
     }
 }
 
+static void unpack_fp16_weight_tile(const Mat& tile_fp16, Mat& tile)
+{
+    const unsigned short* ptr = tile_fp16;
+    float* outptr = tile;
+
+    const int size = tile_fp16.w * tile_fp16.h;
+
+    int i = 0;
+#if __F16C__
+#if __AVX512F__
+    for (; i + 31 < size; i += 32)
+    {
+        __m512 _p0 = _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i*)ptr));
+        __m512 _p1 = _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i*)(ptr + 16)));
+        _mm512_storeu_ps(outptr, _p0);
+        _mm512_storeu_ps(outptr + 16, _p1);
+        ptr += 32;
+        outptr += 32;
+    }
+    for (; i + 15 < size; i += 16)
+    {
+        _mm512_storeu_ps(outptr, _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i*)ptr)));
+        ptr += 16;
+        outptr += 16;
+    }
+#endif // __AVX512F__
+    for (; i + 7 < size; i += 8)
+    {
+        _mm256_storeu_ps(outptr, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)ptr)));
+        ptr += 8;
+        outptr += 8;
+    }
+#endif // __F16C__
+    for (; i < size; i++)
+    {
+        *outptr++ = float16_to_float32(*ptr++);
+    }
+}
+
 static int gemm_x86(const Mat& A, const Mat& B, const Mat& C, Mat& top_blob, int broadcast_type_C, int transA, int transB, int output_transpose, int constant_TILE_M, int constant_TILE_N, int constant_TILE_K, int nT, const Option& opt)
 {
     const int M = transA ? A.w : (A.dims == 3 ? A.c : A.h) * A.elempack;
@@ -6852,6 +6895,9 @@ static int gemm_x86(const Mat& A, const Mat& B, const Mat& C, Mat& top_blob, int
     int TILE_M, TILE_N, TILE_K;
     get_optimal_tile_mnk(M, N, K, constant_TILE_M, constant_TILE_N, constant_TILE_K, TILE_M, TILE_N, TILE_K, nT);
 
+    // tiles follow nT, the work may run on fewer threads
+    nT = std::min(nT, opt.num_threads);
+
     // NCNN_LOGE("TILE M/N/K = %d %d %d", TILE_M, TILE_N, TILE_K);
 
     int nn_M = (M + TILE_M - 1) / TILE_M;
@@ -6964,6 +7010,9 @@ static int gemm_AT_x86(const Mat& AT, const Mat& B, const Mat& C, Mat& top_blob,
     int TILE_M, TILE_N, TILE_K;
     get_optimal_tile_mnk(M, N, K, constant_TILE_M, constant_TILE_N, constant_TILE_K, TILE_M, TILE_N, TILE_K, nT);
 
+    // tiles follow nT, the work may run on fewer threads
+    nT = std::min(nT, opt.num_threads);
+
     // NCNN_LOGE("TILE M/N/K = %d %d %d", TILE_M, TILE_N, TILE_K);
 
     int nn_M = (M + TILE_M - 1) / TILE_M;
@@ -6999,6 +7048,11 @@ static int gemm_AT_x86(const Mat& AT, const Mat& B, const Mat& C, Mat& top_blob,
         }
     }
 
+    // fp16 A is unpacked once per row block, reused by every N tile
+    Mat ATX;
+    if (AT.elemsize == 2u)
+        ATX.create(TILE_K * TILE_M, nn_K, nT, 4u, opt.workspace_allocator);
+
     Mat topT;
     if (K > TILE_K || broadcast_type_C == 3 || output_transpose)
         topT.create(TILE_N * TILE_M, 1, nT, 4u, opt.workspace_allocator);
@@ -7014,6 +7068,14 @@ static int gemm_AT_x86(const Mat& AT, const Mat& B, const Mat& C, Mat& top_blob,
         if (K > TILE_K || broadcast_type_C == 3 || output_transpose)
             topT_tile = topT.channel(get_omp_thread_num());
 
+        Mat AT_block = AT.channel(i / TILE_M);
+        if (AT.elemsize == 2u)
+        {
+            Mat ATX_block = ATX.channel(get_omp_thread_num());
+            unpack_fp16_weight_tile(AT_block, ATX_block);
+            AT_block = ATX_block;
+        }
+
         for (int j = 0; j < N; j += TILE_N)
         {
             const int max_jj = std::min((N - j), TILE_N);
@@ -7031,7 +7093,7 @@ static int gemm_AT_x86(const Mat& AT, const Mat& B, const Mat& C, Mat& top_blob,
 
                 // NCNN_LOGE("max_ii/jj/kk = %d %d %d", max_ii, max_jj, max_kk);
 
-                Mat AT_tile = AT.channel(i / TILE_M).row_range(k / TILE_K, 1);
+                Mat AT_tile = AT_block.row_range(k / TILE_K, 1);
 
                 Mat BT_tile = BT.channel(j / TILE_N).row_range(k / TILE_K, 1);
 
@@ -7059,6 +7121,9 @@ static int gemm_BT_x86(const Mat& A, const Mat& BT, const Mat& C, Mat& top_blob,
     int TILE_M, TILE_N, TILE_K;
     get_optimal_tile_mnk(M, N, K, constant_TILE_M, constant_TILE_N, constant_TILE_K, TILE_M, TILE_N, TILE_K, nT);
 
+    // tiles follow nT, the work may run on fewer threads
+    nT = std::min(nT, opt.num_threads);
+
     // NCNN_LOGE("TILE M/N/K = %d %d %d", TILE_M, TILE_N, TILE_K);
 
     int nn_M = (M + TILE_M - 1) / TILE_M;
@@ -7066,6 +7131,11 @@ static int gemm_BT_x86(const Mat& A, const Mat& BT, const Mat& C, Mat& top_blob,
 
     Mat ATX(TILE_K * TILE_M, (K + TILE_K - 1) / TILE_K, nT, 4u, opt.workspace_allocator);
 
+    // fp16 B is unpacked per use into a cache resident tile
+    Mat BTX;
+    if (BT.elemsize == 2u)
+        BTX.create(TILE_K * TILE_N, 1, nT, 4u, opt.workspace_allocator);
+
     Mat topT;
     if (K > TILE_K || broadcast_type_C == 3 || output_transpose)
         topT.create(TILE_N * TILE_M, 1, nT, 4u, opt.workspace_allocator);
@@ -7118,6 +7188,13 @@ static int gemm_BT_x86(const Mat& A, const Mat& BT, const Mat& C, Mat& top_blob,
                     }
                 }
 
+                if (BT.elemsize == 2u)
+                {
+                    Mat BTX_tile = BTX.channel(get_omp_thread_num());
+                    unpack_fp16_weight_tile(BT_tile, BTX_tile);
+                    BT_tile = BTX_tile;
+                }
+
                 bool k_end = !output_transpose && k + TILE_K >= K;
 
                 gemm_transB_packed_tile(AT_tile, BT_tile, CT_tile, topT_tile, top_blob, broadcast_type_C, i, max_ii, j, max_jj, k, max_kk, k_end);
@@ -7140,11 +7217,24 @@ static int gemm_AT_BT_x86(const Mat& AT, const Mat& BT, const Mat& C, Mat& top_b
     int TILE_M, TILE_N, TILE_K;
     get_optimal_tile_mnk(M, N, K, constant_TILE_M, constant_TILE_N, constant_TILE_K, TILE_M, TILE_N, TILE_K, nT);
 
+    // tiles follow nT, the work may run on fewer threads
+    nT = std::min(nT, opt.num_threads);
+
     // NCNN_LOGE("TILE M/N/K = %d %d %d", TILE_M, TILE_N, TILE_K);
 
     int nn_M = (M + TILE_M - 1) / TILE_M;
     // int nn_N = (N + TILE_N - 1) / TILE_N;
 
+    // fp16 A is unpacked once per row block, reused by every N tile
+    Mat ATX;
+    if (AT.elemsize == 2u)
+        ATX.create(TILE_K * TILE_M, (K + TILE_K - 1) / TILE_K, nT, 4u, opt.workspace_allocator);
+
+    // fp16 B is unpacked per use into a cache resident tile
+    Mat BTX;
+    if (BT.elemsize == 2u)
+        BTX.create(TILE_K * TILE_N, 1, nT, 4u, opt.workspace_allocator);
+
     Mat topT;
     if (K > TILE_K || broadcast_type_C == 3 || output_transpose)
         topT.create(TILE_N * TILE_M, 1, nT, 4u, opt.workspace_allocator);
@@ -7160,6 +7250,14 @@ static int gemm_AT_BT_x86(const Mat& AT, const Mat& BT, const Mat& C, Mat& top_b
         if (K > TILE_K || broadcast_type_C == 3 || output_transpose)
             topT_tile = topT.channel(get_omp_thread_num());
 
+        Mat AT_block = AT.channel(i / TILE_M);
+        if (AT.elemsize == 2u)
+        {
+            Mat ATX_block = ATX.channel(get_omp_thread_num());
+            unpack_fp16_weight_tile(AT_block, ATX_block);
+            AT_block = ATX_block;
+        }
+
         for (int j = 0; j < N; j += TILE_N)
         {
             const int max_jj = std::min((N - j), TILE_N);
@@ -7177,10 +7275,17 @@ static int gemm_AT_BT_x86(const Mat& AT, const Mat& BT, const Mat& C, Mat& top_b
 
                 // NCNN_LOGE("max_ii/jj/kk = %d %d %d", max_ii, max_jj, max_kk);
 
-                Mat AT_tile = AT.channel(i / TILE_M).row_range(k / TILE_K, 1);
+                Mat AT_tile = AT_block.row_range(k / TILE_K, 1);
 
                 Mat BT_tile = BT.channel(j / TILE_N).row_range(k / TILE_K, 1);
 
+                if (BT.elemsize == 2u)
+                {
+                    Mat BTX_tile = BTX.channel(get_omp_thread_num());
+                    unpack_fp16_weight_tile(BT_tile, BTX_tile);
+                    BT_tile = BTX_tile;
+                }
+
                 bool k_end = !output_transpose && k + TILE_K >= K;
 
                 gemm_transB_packed_tile(AT_tile, BT_tile, CT_tile, topT_tile, top_blob, broadcast_type_C, i, max_ii, j, max_jj, k, max_kk, k_end);
@@ -7198,41 +7303,70 @@ static int gemm_AT_BT_x86(const Mat& AT, const Mat& BT, const Mat& C, Mat& top_b
 
 int Gemm_x86::create_pipeline(const Option& opt)
 {
+    if (weight_quant_bits)
+    {
+        // quantized B stays packed, consumed in row-major layout
+        support_packing = false;
+        return 0;
+    }
+
     if (constantA)
     {
         const int M = constantM;
         const int K = constantK;
 
         int TILE_M, TILE_N, TILE_K;
-        get_optimal_tile_mnk(M, 0, K, constant_TILE_M, constant_TILE_N, constant_TILE_K, TILE_M, TILE_N, TILE_K, opt.num_threads);
+        get_optimal_tile_mnk(M, 0, K, constant_TILE_M, constant_TILE_N, constant_TILE_K, TILE_M, TILE_N, TILE_K, get_plan_num_threads(opt));
 
         const int nn_M = (M + TILE_M - 1) / TILE_M;
 
-        AT_data.create(TILE_K * TILE_M, (K + TILE_K - 1) / TILE_K, (M + TILE_M - 1) / TILE_M, 4u, (Allocator*)0);
-        if (AT_data.empty())
-            return -100;
-
-        #pragma omp parallel for num_threads(opt.num_threads)
-        for (int ppj = 0; ppj < nn_M; ppj++)
+        WeightCacheKey key(opt, "gemm_x86_A", A_data, M, K, TILE_M, TILE_K * 2 + transA);
+        if (key.lookup(AT_data) != 0)
         {
-            const int i = ppj * TILE_M;
+            AT_data.create(TILE_K * TILE_M, (K + TILE_K - 1) / TILE_K, (M + TILE_M - 1) / TILE_M, 4u, opt.weight_allocator);
+            if (AT_data.empty())
+                return -100;
 
-            for (int k = 0; k < K; k += TILE_K)
+            #pragma omp parallel for num_threads(opt.num_threads)
+            for (int ppj = 0; ppj < nn_M; ppj++)
             {
-                const int max_ii = std::min((M - i), TILE_M);
-                const int max_kk = std::min((K - k), TILE_K);
-
-                Mat AT_tile = AT_data.channel(i / TILE_M).row_range(k / TILE_K, 1);
+                const int i = ppj * TILE_M;
 
-                if (transA)
-                {
-                    transpose_pack_A_tile(A_data, AT_tile, i, max_ii, k, max_kk);
-                }
-                else
+                for (int k = 0; k < K; k += TILE_K)
                 {
-                    pack_A_tile(A_data, AT_tile, i, max_ii, k, max_kk);
+                    const int max_ii = std::min((M - i), TILE_M);
+                    const int max_kk = std::min((K - k), TILE_K);
+
+                    Mat AT_tile = AT_data.channel(i / TILE_M).row_range(k / TILE_K, 1);
+
+                    if (transA)
+                    {
+                        transpose_pack_A_tile(A_data, AT_tile, i, max_ii, k, max_kk);
+                    }
+                    else
+                    {
+                        pack_A_tile(A_data, AT_tile, i, max_ii, k, max_kk);
+                    }
                 }
             }
+
+#if __F16C__
+            if (opt.use_fp16_weight)
+            {
+                // keep packed A in fp16, unpacked tile by tile in forward
+                Option opt_cast = opt;
+                opt_cast.blob_allocator = opt.weight_allocator;
+
+                Mat AT_data_fp16;
+                cast_float32_to_float16(AT_data, AT_data_fp16, opt_cast);
+                if (AT_data_fp16.empty())
+                    return -100;
+
+                AT_data = AT_data_fp16;
+            }
+#endif // __F16C__
+
+            key.store(AT_data);
         }
 
         A_data.release();
@@ -7244,39 +7378,61 @@ int Gemm_x86::create_pipeline(const Option& opt)
         const int K = constantK;
 
         int TILE_M, TILE_N, TILE_K;
-        get_optimal_tile_mnk(0, N, K, constant_TILE_M, constant_TILE_N, constant_TILE_K, TILE_M, TILE_N, TILE_K, opt.num_threads);
+        get_optimal_tile_mnk(0, N, K, constant_TILE_M, constant_TILE_N, constant_TILE_K, TILE_M, TILE_N, TILE_K, get_plan_num_threads(opt));
 
         const int nn_N = (N + TILE_N - 1) / TILE_N;
         const int nn_K = (K + TILE_K - 1) / TILE_K;
 
-        BT_data.create(TILE_K * TILE_N, (K + TILE_K - 1) / TILE_K, (N + TILE_N - 1) / TILE_N, 4u, (Allocator*)0);
-        if (BT_data.empty())
-            return -100;
+        WeightCacheKey key(opt, "gemm_x86_B", B_data, N, K, TILE_N, TILE_K * 2 + transB);
+        if (key.lookup(BT_data) != 0)
+        {
+            BT_data.create(TILE_K * TILE_N, (K + TILE_K - 1) / TILE_K, (N + TILE_N - 1) / TILE_N, 4u, opt.weight_allocator);
+            if (BT_data.empty())
+                return -100;
 
-        const int nn_NK = nn_N * nn_K;
+            const int nn_NK = nn_N * nn_K;
 
-        #pragma omp parallel for num_threads(opt.num_threads)
-        for (int ppjk = 0; ppjk < nn_NK; ppjk++)
-        {
-            const int ppj = ppjk / nn_K;
-            const int ppk = ppjk % nn_K;
+            #pragma omp parallel for num_threads(opt.num_threads)
+            for (int ppjk = 0; ppjk < nn_NK; ppjk++)
+            {
+                const int ppj = ppjk / nn_K;
+                const int ppk = ppjk % nn_K;
 
-            const int j = ppj * TILE_N;
-            const int k = ppk * TILE_K;
+                const int j = ppj * TILE_N;
+                const int k = ppk * TILE_K;
 
-            const int max_jj = std::min((N - j), TILE_N);
-            const int max_kk = std::min((K - k), TILE_K);
+                const int max_jj = std::min((N - j), TILE_N);
+                const int max_kk = std::min((K - k), TILE_K);
 
-            Mat BT_tile = BT_data.channel(j / TILE_N).row_range(k / TILE_K, 1);
+                Mat BT_tile = BT_data.channel(j / TILE_N).row_range(k / TILE_K, 1);
 
-            if (transB)
-            {
-                pack_B_tile(B_data, BT_tile, j, max_jj, k, max_kk);
+                if (transB)
+                {
+                    pack_B_tile(B_data, BT_tile, j, max_jj, k, max_kk);
+                }
+                else
+                {
+                    transpose_pack_B_tile(B_data, BT_tile, j, max_jj, k, max_kk);
+                }
             }
-            else
+
+#if __F16C__
+            if (opt.use_fp16_weight)
             {
-                transpose_pack_B_tile(B_data, BT_tile, j, max_jj, k, max_kk);
+                // keep packed B in fp16, unpacked tile by tile in forward
+                Option opt_cast = opt;
+                opt_cast.blob_allocator = opt.weight_allocator;
+
+                Mat BT_data_fp16;
+                cast_float32_to_float16(BT_data, BT_data_fp16, opt_cast);
+                if (BT_data_fp16.empty())
+                    return -100;
+
+                BT_data = BT_data_fp16;
             }
+#endif // __F16C__
+
+            key.store(BT_data);
         }
 
         B_data.release();
@@ -7320,7 +7476,7 @@ int Gemm_x86::create_pipeline(const Option& opt)
 
     if (constantA || constantB || constantC)
     {
-        nT = opt.num_threads;
+        nT = get_plan_num_threads(opt);
     }
 
     return 0;
@@ -7328,6 +7484,11 @@ int Gemm_x86::create_pipeline(const Option& opt)
 
 int Gemm_x86::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, const Option& opt) const
 {
+    if (weight_quant_bits)
+    {
+        return forward_weight_quant_x86(bottom_blobs, top_blobs, opt);
+    }
+
     int M;
     int N;
     if (constantA && constantB)
@@ -7469,10 +7630,10 @@ int Gemm_x86::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& to
         return -100;
 
     int _nT = nT ? nT : opt.num_threads;
-    if (nT != 0 && opt.num_threads != nT)
+    if (nT != 0 && opt.num_threads > nT)
     {
-        // force num_threads the same as in create_pipeline
-        // so we could use pre-packed A/B from the same tile config
+        // pre-packed A/B use the tile config of create_pipeline
+        // fewer threads share the same tiles, more threads can not be used
         NCNN_LOGE("opt.num_threads %d changed, gemm will use load-time value %d", opt.num_threads, nT);
     }
 
@@ -7513,4 +7674,183 @@ int Gemm_x86::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& to
     return ret;
 }
 
+// dequantize quantized B rows into the packed B layout of gemm_BT_x86
+static int weight_quant_pack_B_x86(const Mat& W, const Mat& W_scales, Mat& BT, int N, int K, int bits, int group_size, int TILE_N, int TILE_K, const Option& opt)
+{
+    const int row_bytes = weight_quant_row_bytes(K, bits);
+    const int group_count = weight_quant_group_count(K, group_size);
+
+    const int nn_N = (N + TILE_N - 1) / TILE_N;
+
+    BT.create(TILE_K * TILE_N, (K + TILE_K - 1) / TILE_K, nn_N, 4u, opt.workspace_allocator);
+    if (BT.empty())
+        return -100;
+
+    // fp32 rows of one column tile per thread
+    Mat B_tiles(K, TILE_N, opt.num_threads, 4u, opt.workspace_allocator);
+    if (B_tiles.empty())
+        return -100;
+
+    #pragma omp parallel for num_threads(opt.num_threads)
+    for (int ppj = 0; ppj < nn_N; ppj++)
+    {
+        const int j = ppj * TILE_N;
+
+        const int max_jj = std::min((N - j), TILE_N);
+
+        Mat B_tile = B_tiles.channel(get_omp_thread_num());
+
+        for (int jj = 0; jj < max_jj; jj++)
+        {
+            const unsigned char* kptr = (const unsigned char*)W + (j + jj) * row_bytes;
+            const float* scales = (const float*)W_scales + (j + jj) * group_count;
+            weight_quant_dequantize_row_x86(kptr, scales, B_tile.row(jj), K, bits, group_size);
+        }
+
+        for (int k = 0; k < K; k += TILE_K)
+        {
+            const int max_kk = std::min((K - k), TILE_K);
+
+            Mat BT_tile = BT.channel(ppj).row_range(k / TILE_K, 1);
+
+            pack_B_tile(B_tile, BT_tile, 0, max_jj, k, max_kk);
+        }
+    }
+
+    return 0;
+}
+
+int Gemm_x86::forward_weight_quant_x86(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, const Option& opt) const
+{
+    const Mat& A0 = bottom_blobs[0];
+
+    const int M = transA ? A0.w : (A0.dims == 3 ? A0.c : A0.h);
+    const int N = constantN;
+    const int K = constantK;
+
+    const float* ptrC = 0;
+    int broadcast_type_C = 0;
+    if (constantC)
+    {
+        ptrC = C_data;
+        broadcast_type_C = constant_broadcast_type_C;
+    }
+    else if (bottom_blobs.size() == 2)
+    {
+        const Mat& C = bottom_blobs[1];
+        ptrC = C;
+
+        if (C.dims == 1 && C.w == 1)
+            broadcast_type_C = 0;
+        if (C.dims == 1 && C.w == M)
+            broadcast_type_C = 1;
+        if (C.dims == 1 && C.w == N)
+            broadcast_type_C = 4;
+        if (C.dims == 2 && C.w == 1 && C.h == M)
+            broadcast_type_C = 2;
+        if (C.dims == 2 && C.w == N && C.h == M)
+            broadcast_type_C = 3;
+        if (C.dims == 2 && C.w == N && C.h == 1)
+            broadcast_type_C = 4;
+    }
+
+    Mat& top_blob = top_blobs[0];
+    if (output_transpose)
+    {
+        if (output_N1M)
+            top_blob.create(M, 1, N, 4u, opt.blob_allocator);
+        else
+            top_blob.create(M, N, 4u, opt.blob_allocator);
+    }
+    else
+    {
+        if (output_N1M)
+            top_blob.create(N, 1, M, 4u, opt.blob_allocator);
+        else
+            top_blob.create(N, M, 4u, opt.blob_allocator);
+    }
+    if (top_blob.empty())
+        return -100;
+
+    const int out_hstep = top_blob.dims == 3 ? (int)top_blob.cstep : top_blob.w;
+    const int out_istep = output_transpose ? 1 : out_hstep;
+    const int out_nstep = output_transpose ? out_hstep : 1;
+
+    if (M >= 32)
+    {
+        // rows pay for dequantizing B once per forward, run the packed kernel over it
+        int TILE_M, TILE_N, TILE_K;
+        get_optimal_tile_mnk(M, N, K, constant_TILE_M, constant_TILE_N, constant_TILE_K, TILE_M, TILE_N, TILE_K, opt.num_threads);
+
+        Mat BT;
+        int ret = weight_quant_pack_B_x86(B_data, B_quant_scales, BT, N, K, weight_quant_bits, weight_quant_group_size, TILE_N, TILE_K, opt);
+        if (ret != 0)
+            return ret;
+
+        ret = gemm_BT_x86(A0, BT, Mat(), top_blob, 0, N, K, transA, output_transpose, constant_TILE_M, constant_TILE_N, constant_TILE_K, opt.num_threads, opt);
+        if (ret != 0)
+            return ret;
+    }
+    else
+    {
+        Mat A = A0;
+        int A_hstep = A0.dims == 3 ? (int)A0.cstep : A0.w;
+        if (transA)
+        {
+            // transpose A to row-major
+            A.create(K, M, 4u, opt.workspace_allocator);
+            if (A.empty())
+                return -100;
+
+            for (int i = 0; i < M; i++)
+            {
+                float* ptr = A.row(i);
+                for (int k = 0; k < K; k++)
+                {
+                    ptr[k] = A0[k * A_hstep + i];
+                }
+            }
+
+            A_hstep = K;
+        }
+
+        int ret = weight_quant_gemm_x86(A, A_hstep, M, B_data, B_quant_scales, top_blob, out_istep, out_nstep, N, K, weight_quant_bits, weight_quant_group_size, opt);
+        if (ret != 0)
+            return ret;
+    }
+
+    if (!ptrC && alpha == 1.f)
+        return 0;
+
+    #pragma omp parallel for num_threads(opt.num_threads)
+    for (int i = 0; i < M; i++)
+    {
+        float* outptr = (float*)top_blob + i * out_istep;
+
+        for (int n = 0; n < N; n++)
+        {
+            float sum = outptr[n * out_nstep];
+
+            if (ptrC)
+            {
+                float c = 0.f;
+                if (broadcast_type_C == 0)
+                    c = ptrC[0];
+                if (broadcast_type_C == 1 || broadcast_type_C == 2)
+                    c = ptrC[i];
+                if (broadcast_type_C == 3)
+                    c = ptrC[i * N + n];
+                if (broadcast_type_C == 4)
+                    c = ptrC[n];
+
+                sum += c * beta;
+            }
+
+            outptr[n * out_nstep] = sum * alpha;
+        }
+    }
+
+    return 0;
+}
+
 } // namespace ncnn
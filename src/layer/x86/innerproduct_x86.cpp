@@ -27,11 +27,14 @@
 #include "layer_type.h"
 
 #include "cpu.h"
+#include "weight_quant.h"
+#include "weightcache.h"
 
 namespace ncnn {
 
 #include "innerproduct_fp.h"
 #include "innerproduct_gemm_fp.h"
+#include "gemm_weight_quant.h"
 
 #if NCNN_F16C && __AVX__
 #define NCNN_IMPL_FP16S 1
@@ -47,6 +50,7 @@ InnerProduct_x86::InnerProduct_x86()
 #endif // __SSE2__
 
     flatten = 0;
+    gemm = 0;
 }
 
 int InnerProduct_x86::create_pipeline(const Option& opt)
@@ -62,6 +66,37 @@ int InnerProduct_x86::create_pipeline(const Option& opt)
         flatten->create_pipeline(opt);
     }
 
+    if (weight_quant_bits)
+    {
+        const int num_input = weight_data_size / num_output;
+
+        gemm = ncnn::create_layer_cpu(ncnn::LayerType::Gemm);
+
+        ncnn::ParamDict pd;
+        pd.set(2, 0);                        // transA
+        pd.set(3, 1);                        // transB
+        pd.set(4, 0);                        // constantA
+        pd.set(5, 1);                        // constantB
+        pd.set(6, 1);                        // constantC
+        pd.set(7, 0);                        // M
+        pd.set(8, num_output);               // N
+        pd.set(9, num_input);                // K
+        pd.set(10, -1);                      // constant_broadcast_type_C
+        pd.set(15, weight_quant_bits);       // weight_quant_bits
+        pd.set(16, weight_quant_group_size); // weight_quant_group_size
+        gemm->load_param(pd);
+
+        Mat weights[2];
+        weights[0] = weight_data;
+        weights[1] = weight_quant_scales;
+        gemm->load_model(ModelBinFromMatArray(weights));
+        gemm->create_pipeline(opt);
+
+        // quantized weight stays packed, consumed in row-major layout
+        support_packing = false;
+        return 0;
+    }
+
 #if NCNN_INT8
     if (opt.use_int8_inference && weight_data.elemsize == (size_t)1u)
     {
@@ -78,7 +113,12 @@ int InnerProduct_x86::create_pipeline(const Option& opt)
 
     const int num_input = weight_data_size / num_output;
 
-    innerproduct_transform_kernel_sse(weight_data, weight_data_tm, num_input, num_output, opt);
+    WeightCacheKey key(opt, "innerproduct_x86", weight_data, num_input, num_output);
+    if (key.lookup(weight_data_tm) != 0)
+    {
+        innerproduct_transform_kernel_sse(weight_data, weight_data_tm, num_input, num_output, opt);
+        key.store(weight_data_tm);
+    }
 
     weight_data.release();
 
@@ -94,11 +134,23 @@ int InnerProduct_x86::destroy_pipeline(const Option& opt)
         flatten = 0;
     }
 
+    if (gemm)
+    {
+        gemm->destroy_pipeline(opt);
+        delete gemm;
+        gemm = 0;
+    }
+
     return 0;
 }
 
 int InnerProduct_x86::forward(const Mat& bottom_blob, Mat& top_blob, const Option& opt) const
 {
+    if (weight_quant_bits)
+    {
+        return forward_weight_quant_x86(bottom_blob, top_blob, opt);
+    }
+
 #if NCNN_INT8
     if (opt.use_int8_inference && int8_scale_term)
     {
@@ -168,12 +220,79 @@ int InnerProduct_x86::forward(const Mat& bottom_blob, Mat& top_blob, const Optio
     return 0;
 }
 
+int InnerProduct_x86::forward_weight_quant_x86(const Mat& bottom_blob, Mat& top_blob, const Option& opt) const
+{
+    const int num_input = weight_data_size / num_output;
+
+    Mat bottom_blob_flattened = bottom_blob;
+    int num_batch = 1;
+    if (bottom_blob.dims == 2 && bottom_blob.w == num_input)
+    {
+        // gemm
+        num_batch = bottom_blob.h;
+
+        top_blob.create(num_output, num_batch, 4u, opt.blob_allocator);
+    }
+    else
+    {
+        if (bottom_blob.dims != 1)
+        {
+            Option opt_flatten = opt;
+            opt_flatten.blob_allocator = opt.workspace_allocator;
+
+            flatten->forward(bottom_blob, bottom_blob_flattened, opt_flatten);
+            if (bottom_blob_flattened.empty())
+                return -100;
+        }
+
+        top_blob.create(num_output, 4u, opt.blob_allocator);
+    }
+    if (top_blob.empty())
+        return -100;
+
+    int ret = 0;
+    if (num_batch >= 32)
+    {
+        // the packed gemm kernel takes over once rows are many enough to reuse dequantized weight
+        ret = gemm->forward(bottom_blob_flattened, top_blob, opt);
+    }
+    else
+    {
+        ret = weight_quant_gemm_x86(bottom_blob_flattened, num_input, num_batch, weight_data, weight_quant_scales, top_blob, num_output, 1, num_output, num_input, weight_quant_bits, weight_quant_group_size, opt);
+    }
+    if (ret != 0)
+        return ret;
+
+    #pragma omp parallel for num_threads(opt.num_threads)
+    for (int j = 0; j < num_batch; j++)
+    {
+        float* outptr = top_blob.row(j);
+
+        for (int p = 0; p < num_output; p++)
+        {
+            float sum = outptr[p];
+
+            if (bias_term)
+                sum += bias_data[p];
+
+            outptr[p] = activation_ss(sum, activation_type, activation_params);
+        }
+    }
+
+    return 0;
+}
+
 #if NCNN_F16C && __AVX__
 int InnerProduct_x86::create_pipeline_fp16s(const Option& opt)
 {
     const int num_input = weight_data_size / num_output;
 
-    innerproduct_transform_kernel_fp16s_sse(weight_data, weight_data_tm, num_input, num_output, opt);
+    WeightCacheKey key(opt, "innerproduct_x86_fp16s", weight_data, num_input, num_output);
+    if (key.lookup(weight_data_tm) != 0)
+    {
+        innerproduct_transform_kernel_fp16s_sse(weight_data, weight_data_tm, num_input, num_output, opt);
+        key.store(weight_data_tm);
+    }
 
     weight_data.release();
 
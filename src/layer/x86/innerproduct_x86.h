@@ -30,6 +30,7 @@ public:
     virtual int forward(const Mat& bottom_blob, Mat& top_blob, const Option& opt) const;
 
 protected:
+    int forward_weight_quant_x86(const Mat& bottom_blob, Mat& top_blob, const Option& opt) const;
 #if NCNN_F16C && __AVX__
     int create_pipeline_fp16s(const Option& opt);
     int forward_fp16s(const Mat& bottom_blob, Mat& top_blob, const Option& opt) const;
@@ -42,6 +43,9 @@ protected:
 public:
     Layer* flatten;
 
+    // weight quantized gemm for batched input
+    Layer* gemm;
+
     Mat weight_data_tm;
 
 #if NCNN_INT8
@@ -14,7 +14,9 @@
 
 #include "modelbin.h"
 
+#include "cpu.h"
 #include "datareader.h"
+#include "weightcodec.h"
 
 #include <string.h>
 
@@ -63,15 +65,21 @@ Mat ModelBin::load(int w, int h, int d, int c, int type) const
 class ModelBinFromDataReaderPrivate
 {
 public:
-    ModelBinFromDataReaderPrivate(const DataReader& _dr)
-        : dr(_dr)
+    ModelBinFromDataReaderPrivate(const DataReader& _dr, int _num_threads)
+        : dr(_dr), num_threads(_num_threads)
     {
     }
     const DataReader& dr;
+    int num_threads;
 };
 
 ModelBinFromDataReader::ModelBinFromDataReader(const DataReader& _dr)
-    : ModelBin(), d(new ModelBinFromDataReaderPrivate(_dr))
+    : ModelBin(), d(new ModelBinFromDataReaderPrivate(_dr, get_physical_big_cpu_count()))
+{
+}
+
+ModelBinFromDataReader::ModelBinFromDataReader(const DataReader& _dr, int num_threads)
+    : ModelBin(), d(new ModelBinFromDataReaderPrivate(_dr, num_threads))
 {
 }
 
@@ -229,6 +237,73 @@ Mat ModelBinFromDataReader::load(int w, int type) const
 
             return m;
         }
+        else if (flag_struct.tag == NCNN_WEIGHT_COMPRESSED_TAG)
+        {
+            // compressed data
+            unsigned int stream_size = 0;
+            nread = d->dr.read(&stream_size, sizeof(stream_size));
+            if (nread != sizeof(stream_size))
+            {
+                NCNN_LOGE("ModelBin read stream_size failed %zd", nread);
+                return Mat();
+            }
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+            swap_endianness_32(&stream_size);
+#endif
+
+            size_t align_stream_size = alignSize(stream_size, 4);
+
+            // try reference data
+            const unsigned char* stream = 0;
+            std::vector<unsigned char> stream_data;
+            nread = d->dr.reference(align_stream_size, (const void**)&stream);
+            if (nread != align_stream_size)
+            {
+                stream_data.resize(align_stream_size);
+                nread = d->dr.read(stream_data.data(), align_stream_size);
+                if (nread != align_stream_size)
+                {
+                    NCNN_LOGE("ModelBin read compressed weight failed %zd", nread);
+                    return Mat();
+                }
+
+                stream = stream_data.data();
+            }
+
+            const int elemsize = compressed_weight_elemsize(stream, stream_size);
+            if (elemsize == 0)
+            {
+                NCNN_LOGE("ModelBin compressed weight header corrupted");
+                return Mat();
+            }
+
+            if (elemsize == 2)
+            {
+                std::vector<unsigned short> float16_weights(w);
+                if (decompress_weight(stream, stream_size, float16_weights.data(), w, 2, d->num_threads) != 0)
+                {
+                    NCNN_LOGE("ModelBin decompress float16_weights failed");
+                    return Mat();
+                }
+
+                m = Mat::from_float16(float16_weights.data(), w);
+            }
+            else
+            {
+                m.create(w, (size_t)(elemsize == 1 ? 1u : 4u));
+                if (m.empty())
+                    return m;
+
+                if (decompress_weight(stream, stream_size, m.data, w, elemsize, d->num_threads) != 0)
+                {
+                    NCNN_LOGE("ModelBin decompress weight_data failed");
+                    return Mat();
+                }
+            }
+
+            return m;
+        }
 
         if (flag != 0)
         {
@@ -45,6 +45,8 @@ class NCNN_EXPORT ModelBinFromDataReader : public ModelBin
 {
 public:
     explicit ModelBinFromDataReader(const DataReader& dr);
+    // compressed weights are decoded with num_threads
+    ModelBinFromDataReader(const DataReader& dr, int num_threads);
     virtual ~ModelBinFromDataReader();
 
     virtual Mat load(int w, int type) const;
@@ -0,0 +1,431 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "modelcontainer.h"
+
+#include "allocator.h"
+#include "datareader.h"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace ncnn {
+
+static const uint32_t model_container_magic = 0x434d434e; // NCMC
+static const uint32_t model_container_version = 1;
+
+// payload alignment, a cache line and enough for any simd load
+static const size_t model_container_align = 64;
+
+struct model_container_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t section_count;
+    uint32_t reserved0;
+    uint64_t table_offset;
+    uint64_t file_size;
+    unsigned char reserved1[32];
+};
+
+struct model_container_section
+{
+    uint32_t type;
+    int32_t index;
+    uint64_t offset;
+    uint64_t size;
+    uint32_t crc32;
+    uint32_t reserved;
+};
+
+// crc32 with reflected polynomial 0xedb88320
+static const uint32_t model_container_crc32_table[256] = {
+    0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f, 0xe963a535, 0x9e6495a3,
+    0x0edb8832, 0x79dcb8a4, 0xe0d5e91e, 0x97d2d988, 0x09b64c2b, 0x7eb17cbd, 0xe7b82d07, 0x90bf1d91,
+    0x1db71064, 0x6ab020f2, 0xf3b97148, 0x84be41de, 0x1adad47d, 0x6ddde4eb, 0xf4d4b551, 0x83d385c7,
+    0x136c9856, 0x646ba8c0, 0xfd62f97a, 0x8a65c9ec, 0x14015c4f, 0x63066cd9, 0xfa0f3d63, 0x8d080df5,
+    0x3b6e20c8, 0x4c69105e, 0xd56041e4, 0xa2677172, 0x3c03e4d1, 0x4b04d447, 0xd20d85fd, 0xa50ab56b,
+    0x35b5a8fa, 0x42b2986c, 0xdbbbc9d6, 0xacbcf940, 0x32d86ce3, 0x45df5c75, 0xdcd60dcf, 0xabd13d59,
+    0x26d930ac, 0x51de003a, 0xc8d75180, 0xbfd06116, 0x21b4f4b5, 0x56b3c423, 0xcfba9599, 0xb8bda50f,
+    0x2802b89e, 0x5f058808, 0xc60cd9b2, 0xb10be924, 0x2f6f7c87, 0x58684c11, 0xc1611dab, 0xb6662d3d,
+    0x76dc4190, 0x01db7106, 0x98d220bc, 0xefd5102a, 0x71b18589, 0x06b6b51f, 0x9fbfe4a5, 0xe8b8d433,
+    0x7807c9a2, 0x0f00f934, 0x9609a88e, 0xe10e9818, 0x7f6a0dbb, 0x086d3d2d, 0x91646c97, 0xe6635c01,
+    0x6b6b51f4, 0x1c6c6162, 0x856530d8, 0xf262004e, 0x6c0695ed, 0x1b01a57b, 0x8208f4c1, 0xf50fc457,
+    0x65b0d9c6, 0x12b7e950, 0x8bbeb8ea, 0xfcb9887c, 0x62dd1ddf, 0x15da2d49, 0x8cd37cf3, 0xfbd44c65,
+    0x4db26158, 0x3ab551ce, 0xa3bc0074, 0xd4bb30e2, 0x4adfa541, 0x3dd895d7, 0xa4d1c46d, 0xd3d6f4fb,
+    0x4369e96a, 0x346ed9fc, 0xad678846, 0xda60b8d0, 0x44042d73, 0x33031de5, 0xaa0a4c5f, 0xdd0d7cc9,
+    0x5005713c, 0x270241aa, 0xbe0b1010, 0xc90c2086, 0x5768b525, 0x206f85b3, 0xb966d409, 0xce61e49f,
+    0x5edef90e, 0x29d9c998, 0xb0d09822, 0xc7d7a8b4, 0x59b33d17, 0x2eb40d81, 0xb7bd5c3b, 0xc0ba6cad,
+    0xedb88320, 0x9abfb3b6, 0x03b6e20c, 0x74b1d29a, 0xead54739, 0x9dd277af, 0x04db2615, 0x73dc1683,
+    0xe3630b12, 0x94643b84, 0x0d6d6a3e, 0x7a6a5aa8, 0xe40ecf0b, 0x9309ff9d, 0x0a00ae27, 0x7d079eb1,
+    0xf00f9344, 0x8708a3d2, 0x1e01f268, 0x6906c2fe, 0xf762575d, 0x806567cb, 0x196c3671, 0x6e6b06e7,
+    0xfed41b76, 0x89d32be0, 0x10da7a5a, 0x67dd4acc, 0xf9b9df6f, 0x8ebeeff9, 0x17b7be43, 0x60b08ed5,
+    0xd6d6a3e8, 0xa1d1937e, 0x38d8c2c4, 0x4fdff252, 0xd1bb67f1, 0xa6bc5767, 0x3fb506dd, 0x48b2364b,
+    0xd80d2bda, 0xaf0a1b4c, 0x36034af6, 0x41047a60, 0xdf60efc3, 0xa867df55, 0x316e8eef, 0x4669be79,
+    0xcb61b38c, 0xbc66831a, 0x256fd2a0, 0x5268e236, 0xcc0c7795, 0xbb0b4703, 0x220216b9, 0x5505262f,
+    0xc5ba3bbe, 0xb2bd0b28, 0x2bb45a92, 0x5cb36a04, 0xc2d7ffa7, 0xb5d0cf31, 0x2cd99e8b, 0x5bdeae1d,
+    0x9b64c2b0, 0xec63f226, 0x756aa39c, 0x026d930a, 0x9c0906a9, 0xeb0e363f, 0x72076785, 0x05005713,
+    0x95bf4a82, 0xe2b87a14, 0x7bb12bae, 0x0cb61b38, 0x92d28e9b, 0xe5d5be0d, 0x7cdcefb7, 0x0bdbdf21,
+    0x86d3d2d4, 0xf1d4e242, 0x68ddb3f8, 0x1fda836e, 0x81be16cd, 0xf6b9265b, 0x6fb077e1, 0x18b74777,
+    0x88085ae6, 0xff0f6a70, 0x66063bca, 0x11010b5c, 0x8f659eff, 0xf862ae69, 0x616bffd3, 0x166ccf45,
+    0xa00ae278, 0xd70dd2ee, 0x4e048354, 0x3903b3c2, 0xa7672661, 0xd06016f7, 0x4969474d, 0x3e6e77db,
+    0xaed16a4a, 0xd9d65adc, 0x40df0b66, 0x37d83bf0, 0xa9bcae53, 0xdebb9ec5, 0x47b2cf7f, 0x30b5ffe9,
+    0xbdbdf21c, 0xcabac28a, 0x53b39330, 0x24b4a3a6, 0xbad03605, 0xcdd70693, 0x54de5729, 0x23d967bf,
+    0xb3667a2e, 0xc4614ab8, 0x5d681b02, 0x2a6f2b94, 0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d,
+};
+
+uint32_t model_container_crc32(const unsigned char* data, size_t size, uint32_t crc)
+{
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+    {
+        crc = model_container_crc32_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+class ModelContainerPrivate
+{
+public:
+    const unsigned char* base;
+    size_t size;
+    const model_container_section* sections;
+    int section_count;
+
+#if NCNN_STDIO
+    DataReaderFromMmap* mmap;
+#endif // NCNN_STDIO
+};
+
+ModelContainer::ModelContainer()
+    : d(new ModelContainerPrivate)
+{
+    d->base = 0;
+    d->size = 0;
+    d->sections = 0;
+    d->section_count = 0;
+#if NCNN_STDIO
+    d->mmap = 0;
+#endif // NCNN_STDIO
+}
+
+ModelContainer::~ModelContainer()
+{
+    close();
+
+    delete d;
+}
+
+ModelContainer::ModelContainer(const ModelContainer&)
+    : d(0)
+{
+}
+
+ModelContainer& ModelContainer::operator=(const ModelContainer&)
+{
+    return *this;
+}
+
+int ModelContainer::open(const unsigned char* mem, size_t size)
+{
+    close();
+
+    if (!mem || size < sizeof(model_container_header))
+        return -1;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    // header and section table are little-endian structs referenced in place
+    NCNN_LOGE("model container is not supported on big-endian");
+    return -1;
+#endif
+
+    model_container_header header;
+    memcpy(&header, mem, sizeof(header));
+
+    if (header.magic != model_container_magic || header.version != model_container_version)
+    {
+        NCNN_LOGE("not a model container");
+        return -1;
+    }
+
+    if (header.file_size != size)
+    {
+        NCNN_LOGE("model container size %llu mismatch %llu", (unsigned long long)size, (unsigned long long)header.file_size);
+        return -1;
+    }
+
+    // sections are referenced in place
+    const uint64_t table_size = (uint64_t)header.section_count * sizeof(model_container_section);
+    if (header.table_offset % 8 != 0 || header.table_offset > size || table_size > size - header.table_offset || ((size_t)mem & 7) != 0)
+    {
+        NCNN_LOGE("model container section table out of range");
+        return -1;
+    }
+
+    const model_container_section* sections = (const model_container_section*)(mem + header.table_offset);
+    for (uint32_t i = 0; i < header.section_count; i++)
+    {
+        const model_container_section& s = sections[i];
+        if (s.offset % model_container_align != 0 || s.offset > size || s.size > size - s.offset)
+        {
+            NCNN_LOGE("model container section %u out of range", i);
+            return -1;
+        }
+    }
+
+    d->base = mem;
+    d->size = size;
+    d->sections = sections;
+    d->section_count = (int)header.section_count;
+
+    return 0;
+}
+
+#if NCNN_STDIO
+int ModelContainer::open(const char* path)
+{
+    close();
+
+    DataReaderFromMmap* dr = new DataReaderFromMmap(path);
+
+    const size_t size = dr->size();
+
+    const unsigned char* mem = 0;
+    if (size == 0 || dr->reference(size, (const void**)&mem) != size)
+    {
+        delete dr;
+        return -1;
+    }
+
+    int ret = open(mem, size);
+    if (ret != 0)
+    {
+        NCNN_LOGE("open model container %s failed", path);
+        delete dr;
+        return ret;
+    }
+
+    d->mmap = dr;
+
+    return 0;
+}
+#endif // NCNN_STDIO
+
+void ModelContainer::close()
+{
+    d->base = 0;
+    d->size = 0;
+    d->sections = 0;
+    d->section_count = 0;
+
+#if NCNN_STDIO
+    delete d->mmap;
+    d->mmap = 0;
+#endif // NCNN_STDIO
+}
+
+int ModelContainer::verify() const
+{
+    if (!d->base)
+        return -1;
+
+    int ret = 0;
+    for (int i = 0; i < d->section_count; i++)
+    {
+        const model_container_section& s = d->sections[i];
+
+        if (model_container_crc32(d->base + s.offset, (size_t)s.size) != s.crc32)
+        {
+            NCNN_LOGE("model container section %d type %u index %d corrupted", i, s.type, s.index);
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
+
+int ModelContainer::verify_section(int type, int index) const
+{
+    for (int i = 0; i < d->section_count; i++)
+    {
+        const model_container_section& s = d->sections[i];
+        if ((int)s.type != type || s.index != index)
+            continue;
+
+        if (model_container_crc32(d->base + s.offset, (size_t)s.size) != s.crc32)
+        {
+            NCNN_LOGE("model container section %d type %u index %d corrupted", i, s.type, s.index);
+            return -1;
+        }
+
+        return 0;
+    }
+
+    return -1;
+}
+
+int ModelContainer::section_count() const
+{
+    return d->section_count;
+}
+
+int ModelContainer::section(int i, int* type, int* index, const unsigned char** data, size_t* size) const
+{
+    if (i < 0 || i >= d->section_count)
+        return -1;
+
+    const model_container_section& s = d->sections[i];
+    *type = (int)s.type;
+    *index = s.index;
+    *data = d->base + s.offset;
+    *size = (size_t)s.size;
+    return 0;
+}
+
+int ModelContainer::find_section(int type, int index, const unsigned char** data, size_t* size) const
+{
+    for (int i = 0; i < d->section_count; i++)
+    {
+        const model_container_section& s = d->sections[i];
+        if ((int)s.type != type || s.index != index)
+            continue;
+
+        *data = d->base + s.offset;
+        *size = (size_t)s.size;
+        return 0;
+    }
+
+    return -1;
+}
+
+class ModelContainerWriterPrivate
+{
+public:
+    std::vector<model_container_section> sections;
+    std::vector<std::vector<unsigned char> > payloads;
+};
+
+ModelContainerWriter::ModelContainerWriter()
+    : d(new ModelContainerWriterPrivate)
+{
+}
+
+ModelContainerWriter::~ModelContainerWriter()
+{
+    delete d;
+}
+
+ModelContainerWriter::ModelContainerWriter(const ModelContainerWriter&)
+    : d(0)
+{
+}
+
+ModelContainerWriter& ModelContainerWriter::operator=(const ModelContainerWriter&)
+{
+    return *this;
+}
+
+void ModelContainerWriter::add_section(int type, int index, const void* data, size_t size)
+{
+    model_container_section s;
+    s.type = (uint32_t)type;
+    s.index = index;
+    s.offset = 0;
+    s.size = size;
+    s.crc32 = model_container_crc32((const unsigned char*)data, size);
+    s.reserved = 0;
+    d->sections.push_back(s);
+
+    d->payloads.push_back(std::vector<unsigned char>(size));
+    if (size > 0)
+        memcpy(d->payloads.back().data(), data, size);
+}
+
+#if NCNN_STDIO
+int ModelContainerWriter::save(const char* path) const
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    NCNN_LOGE("model container is not supported on big-endian");
+    return -1;
+#endif
+
+    const size_t section_count = d->sections.size();
+
+    model_container_header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = model_container_magic;
+    header.version = model_container_version;
+    header.section_count = (uint32_t)section_count;
+    header.table_offset = sizeof(header);
+
+    std::vector<model_container_section> sections = d->sections;
+
+    size_t offset = alignSize(sizeof(header) + section_count * sizeof(model_container_section), model_container_align);
+    for (size_t i = 0; i < section_count; i++)
+    {
+        sections[i].offset = offset;
+        offset = alignSize(offset + (size_t)sections[i].size, model_container_align);
+    }
+
+    // the last payload is padded too, so that file size is aligned
+    header.file_size = offset;
+
+    FILE* fp = fopen(path, "wb");
+    if (!fp)
+    {
+        NCNN_LOGE("fopen %s failed", path);
+        return -1;
+    }
+
+    int ret = 0;
+
+    if (fwrite(&header, sizeof(header), 1, fp) != 1)
+        ret = -1;
+
+    if (ret == 0 && section_count > 0 && fwrite(sections.data(), sizeof(model_container_section), section_count, fp) != section_count)
+        ret = -1;
+
+    static const unsigned char padding[model_container_align] = {0};
+
+    size_t written = sizeof(header) + section_count * sizeof(model_container_section);
+    for (size_t i = 0; ret == 0 && i < section_count; i++)
+    {
+        const size_t padding_size = (size_t)sections[i].offset - written;
+        if (padding_size > 0 && fwrite(padding, 1, padding_size, fp) != padding_size)
+            ret = -1;
+
+        const size_t size = (size_t)sections[i].size;
+        if (ret == 0 && size > 0 && fwrite(d->payloads[i].data(), 1, size, fp) != size)
+            ret = -1;
+
+        written = (size_t)sections[i].offset + size;
+    }
+
+    const size_t padding_size = (size_t)header.file_size - written;
+    if (ret == 0 && padding_size > 0 && fwrite(padding, 1, padding_size, fp) != padding_size)
+        ret = -1;
+
+    fclose(fp);
+
+    if (ret != 0)
+    {
+        NCNN_LOGE("write model container %s failed", path);
+        return -1;
+    }
+
+    return 0;
+}
+#endif // NCNN_STDIO
+
+} // namespace ncnn
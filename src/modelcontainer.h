@@ -0,0 +1,120 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#ifndef NCNN_MODELCONTAINER_H
+#define NCNN_MODELCONTAINER_H
+
+#include <stdint.h>
+
+#include "platform.h"
+
+namespace ncnn {
+
+// single file model container
+//
+// header            64 bytes, magic NCMC, version, section count, table offset, file size
+// section table     32 bytes per section, type, index, offset, size, crc32
+// section payloads  each starting at 64 byte boundary
+//
+// all fields are little-endian, containers are not opened or written on big-endian targets
+// sections are addressed by type and index, so any one is read without touching the others
+enum ModelContainerSectionType
+{
+    // plain param text, null terminated
+    MODEL_CONTAINER_PARAM = 1,
+    // binary param as written by ncnn2mem
+    MODEL_CONTAINER_PARAM_BIN = 2,
+    // model bin stream of one layer, index is layer index
+    // int8 scales stored along with the layer weights are part of it
+    MODEL_CONTAINER_LAYER_WEIGHT = 3,
+    // weight cache file holding weights transformed by create_pipeline
+    MODEL_CONTAINER_WEIGHT_CACHE = 4,
+    // int8 calibration table text the model was quantized with
+    MODEL_CONTAINER_INT8_TABLE = 5
+};
+
+class ModelContainerPrivate;
+class NCNN_EXPORT ModelContainer
+{
+public:
+    ModelContainer();
+    ~ModelContainer();
+
+    // reference container in memory, the memory should be retained while the container is used
+    // header and section table are checked, payloads are not read
+    // return 0 if success
+    int open(const unsigned char* mem, size_t size);
+
+#if NCNN_STDIO
+    // map container file read-only, payloads are faulted in on demand
+    // return 0 if success
+    int open(const char* path);
+#endif // NCNN_STDIO
+
+    void close();
+
+    // compare crc32 of every payload with the section table
+    // return 0 if all sections are intact
+    int verify() const;
+
+    // compare crc32 of the payload of the section of type and index with the section table
+    // return 0 if found and intact
+    int verify_section(int type, int index) const;
+
+    int section_count() const;
+
+    // type, index and payload of section i
+    int section(int i, int* type, int* index, const unsigned char** data, size_t* size) const;
+
+    // payload of the section of type and index, 64 byte aligned
+    // return 0 if found
+    int find_section(int type, int index, const unsigned char** data, size_t* size) const;
+
+private:
+    ModelContainer(const ModelContainer&);
+    ModelContainer& operator=(const ModelContainer&);
+
+private:
+    ModelContainerPrivate* const d;
+};
+
+class ModelContainerWriterPrivate;
+class NCNN_EXPORT ModelContainerWriter
+{
+public:
+    ModelContainerWriter();
+    ~ModelContainerWriter();
+
+    // payload is copied, sections are written in order of adding
+    void add_section(int type, int index, const void* data, size_t size);
+
+#if NCNN_STDIO
+    // return 0 if success
+    int save(const char* path) const;
+#endif // NCNN_STDIO
+
+private:
+    ModelContainerWriter(const ModelContainerWriter&);
+    ModelContainerWriter& operator=(const ModelContainerWriter&);
+
+private:
+    ModelContainerWriterPrivate* const d;
+};
+
+// crc32 of ieee 802.3, as stored in the section table
+NCNN_EXPORT uint32_t model_container_crc32(const unsigned char* data, size_t size, uint32_t crc = 0);
+
+} // namespace ncnn
+
+#endif // NCNN_MODELCONTAINER_H
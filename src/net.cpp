@@ -14,20 +14,22 @@
 
 #include "net.h"
 
+#include "benchmark.h"
 #include "cpu.h"
 #include "datareader.h"
 #include "layer_type.h"
 #include "modelbin.h"
+#include "modelcontainer.h"
 #include "paramdict.h"
+#include "profiler.h"
+#include "weightcache.h"
 
+#include <algorithm>
+#include <limits.h>
 #include <stdarg.h>
 #include <stdint.h>
 #include <string.h>
 
-#if NCNN_BENCHMARK
-#include "benchmark.h"
-#endif // NCNN_BENCHMARK
-
 #if NCNN_VULKAN
 #include "command.h"
 #include "pipelinecache.h"
@@ -35,6 +37,19 @@
 
 namespace ncnn {
 
+class MemoryPlan;
+class MemoryPlanAllocator;
+
+// arena pooled for reuse, freed through the allocator it came from
+struct MemoryPlanArena
+{
+    size_t size;
+    void* data;
+    Allocator* allocator;
+};
+
+class BranchExecutor;
+class BranchAllocator;
 class NetPrivate
 {
 public:
@@ -49,7 +64,21 @@ public:
 #endif // NCNN_VULKAN
 
     friend class Extractor;
-    int forward_layer(int layer_index, std::vector<Mat>& blob_mats, const Option& opt) const;
+    int forward_layer(int layer_index, std::vector<Mat>& blob_mats, const Option& opt, Profiler* profiler = 0, TrackingAllocator* memory_tracker = 0) const;
+
+    // run the layers producing blob in topological order
+    int forward_blob(int blob_index, std::vector<Mat>& blob_mats, const Option& opt, Profiler* profiler, TrackingAllocator* memory_tracker);
+
+    // run the layers producing blob, independent branches concurrently
+    int forward_blob_branch_parallel(int blob_index, std::vector<Mat>& blob_mats, const Option& opt, Profiler* profiler, TrackingAllocator* memory_tracker);
+
+    // mark layers needed for producing missing blobs
+    void mark_needed_layers(int blob_index, const std::vector<int>& schedule, const std::vector<Mat>& blob_mats, std::vector<unsigned char>& layer_needed) const;
+
+    // topologically sorted layers needed to produce blob, built once per blob
+    void build_layer_schedule(int blob_index, std::vector<int>& schedule) const;
+    const std::vector<int>& get_layer_schedule(int blob_index);
+    void update_layer_schedules();
 
 #if NCNN_VULKAN
     int forward_layer(int layer_index, std::vector<Mat>& blob_mats, std::vector<VkMat>& blob_mats_gpu, VkCompute& cmd, const Option& opt) const;
@@ -64,14 +93,83 @@ public:
     int do_forward_layer(const Layer* layer, std::vector<VkImageMat>& blob_mats_gpu_image, VkCompute& cmd, const Option& opt) const;
 #endif // NCNN_VULKAN
 
+    // create pipeline of loaded layer with its masked option, recording elapsed time
+    int create_layer_pipeline(int layer_index, const Option& opt) const;
+
+    // create pipeline of layer deferred by lazy pipeline mode, once
+    int ensure_layer_pipeline(int layer_index) const;
+
+    // create pipelines of layers on worker threads as they finish loading
+    int load_model_parallel(const DataReader& dr, const Option& opt);
+
+    // pass the owned layers and their weight storage to a net sharing them
+    // called by a source net being cleared, with g_share_lock held
+    void hand_over_layers();
+
+    // reset load records before loading weights
+    // return true if pipelines are created on first forward
+    bool begin_load_model();
+
+    // local allocators and gpu upload after weights are loaded
+    int end_load_model(int ret);
+
+    // load weights of layer from its container section, recording elapsed time
+    // compressed weights are decoded with num_threads
+    int load_layer_section(int layer_index, const ModelContainer& container, int num_threads);
+
+    // load layers of container and create their pipelines on worker threads, in any order
+    int load_container_parallel(const ModelContainer& container, const Option& opt);
+
+    // load layers in order on the loader thread, marking each runnable once its pipeline is created
+    int load_model_streaming(const DataReader& dr);
+    static void* model_loader_worker(void* args);
+
+    // wait until layer is runnable while weights are streaming in
+    int wait_layer_loaded(int layer_index) const;
+
     void update_input_output_indexes();
 #if NCNN_STRING
     void update_input_output_names();
 #endif // NCNN_STRING
 
+    MemoryPlanAllocator* acquire_memory_plan_allocator(const std::vector<Mat>& blob_mats, const Option& opt);
+    void reclaim_memory_plan_allocator(MemoryPlanAllocator* allocator);
+    size_t get_memory_plan_size(const std::vector<int>& shape_key);
+    void clear_memory_plans();
+
+    BranchExecutor* acquire_branch_executor(int num_threads);
+    Allocator* acquire_branch_allocator(Allocator* allocator);
+    void clear_branch_executor();
+
     std::vector<Blob> blobs;
     std::vector<Layer*> layers;
 
+    // 1 for layers created by the overwrite builtin layer creator
+    std::vector<unsigned char> layer_overwritten;
+
+    // milliseconds spent in load_model and create_pipeline of each layer
+    std::vector<double> layer_load_times;
+    mutable std::vector<double> layer_pipeline_times;
+
+    // 1 for layers whose pipeline is not created yet in lazy pipeline mode
+    mutable std::vector<int> layer_pipeline_pending;
+    mutable Mutex layer_pipeline_lock;
+
+    // background loading by load_model_async
+    // layers before loaded_layer_count are runnable, INT_MAX when all are
+    Thread* model_loader;
+    const DataReader* model_loader_dr;
+    int model_loader_ret;
+    bool model_loading;
+    mutable int loaded_layer_count;
+    mutable Mutex loaded_layer_lock;
+    mutable ConditionVariable loaded_layer_cond;
+#if NCNN_STDIO
+    // model file opened by load_model_async(modelpath)
+    FILE* model_loader_fp;
+    DataReader* model_loader_file_dr;
+#endif // NCNN_STDIO
+
     std::vector<int> input_blob_indexes;
     std::vector<int> output_blob_indexes;
 #if NCNN_STRING
@@ -79,12 +177,46 @@ public:
     std::vector<const char*> output_blob_names;
 #endif // NCNN_STRING
 
+    // cached layer execution schedules indexed by blob
+    Mutex layer_schedules_lock;
+    std::vector<std::vector<int> > layer_schedules;
+
     std::vector<custom_layer_registry_entry> custom_layer_registry;
     std::vector<overwrite_builtin_layer_registry_entry> overwrite_builtin_layer_registry;
 
     PoolAllocator* local_blob_allocator;
     PoolAllocator* local_workspace_allocator;
 
+    // static memory plans keyed by input shapes and the arenas carved by them
+    Mutex memory_plan_lock;
+    std::vector<MemoryPlan*> memory_plans;
+    std::vector<MemoryPlanArena> memory_plan_arenas;
+
+#if NCNN_STDIO
+    // mapped model files referenced by layer weights
+    std::vector<DataReaderFromMmap*> model_mmaps;
+    std::vector<ModelContainer*> model_containers;
+#endif // NCNN_STDIO
+
+    // default profiler of extractors
+    Profiler* profiler;
+
+    // the net owning layers when shared by share_model(), and the nets sharing this one
+    // guarded by g_share_lock
+    NetPrivate* shared_source;
+    std::vector<NetPrivate*> sharers;
+
+    // registries the layers were created with, when handed over by a cleared source net
+    bool layers_inherited;
+    std::vector<custom_layer_registry_entry> inherited_custom_layer_registry;
+    std::vector<overwrite_builtin_layer_registry_entry> inherited_overwrite_builtin_layer_registry;
+
+    // worker threads for branch parallel inference, one pool per thread count
+    // and the locked blob and workspace allocators
+    Mutex branch_executor_lock;
+    std::vector<BranchExecutor*> branch_executors;
+    std::vector<BranchAllocator*> branch_allocators;
+
 #if NCNN_VULKAN
     const VulkanDevice* vkdev;
 
@@ -95,12 +227,30 @@ public:
 #endif // NCNN_VULKAN
 };
 
+// guards share_model() relations between nets
+static Mutex g_share_lock;
+
 NetPrivate::NetPrivate(Option& _opt)
     : opt(_opt)
 {
     local_blob_allocator = 0;
     local_workspace_allocator = 0;
 
+    profiler = 0;
+
+    model_loader = 0;
+    model_loader_dr = 0;
+    model_loader_ret = 0;
+    model_loading = false;
+    loaded_layer_count = INT_MAX;
+#if NCNN_STDIO
+    model_loader_fp = 0;
+    model_loader_file_dr = 0;
+#endif // NCNN_STDIO
+
+    shared_source = 0;
+    layers_inherited = false;
+
 #if NCNN_VULKAN
     vkdev = 0;
     weight_vkallocator = 0;
@@ -171,1789 +321,3595 @@ int NetPrivate::upload_model()
 }
 #endif // NCNN_VULKAN
 
-int NetPrivate::forward_layer(int layer_index, std::vector<Mat>& blob_mats, const Option& opt) const
+class MemoryPlan
 {
-    const Layer* layer = layers[layer_index];
+public:
+    // input shapes the plan was recorded with
+    std::vector<int> shape_key;
 
-    //     NCNN_LOGE("forward_layer %d %s", layer_index, layer->name.c_str());
+    // blob allocation sizes and arena offsets in allocation order
+    std::vector<size_t> sizes;
+    std::vector<size_t> offsets;
 
-    // load bottom blobs
-    for (size_t i = 0; i < layer->bottoms.size(); i++)
+    // allocator event sequence
+    // i >= 0 for allocating the i-th blob, -i-1 for freeing it
+    std::vector<int> events;
+
+    size_t arena_size;
+
+    // extractors replaying this plan
+    int refcount;
+    // superseded by a new recording, delete when no longer referenced
+    bool stale;
+};
+
+// plan blob offsets by greedy-by-size placement
+// the largest blob gets placed first, at the lowest offset not overlapping
+// any placed blob that is alive at the same time
+static size_t plan_memory_offsets(const std::vector<size_t>& sizes, const std::vector<int>& events, std::vector<size_t>& offsets)
+{
+    const int count = (int)sizes.size();
+    const int event_count = (int)events.size();
+
+    std::vector<int> alloc_steps(count, 0);
+    std::vector<int> free_steps(count, event_count);
+    for (int i = 0; i < event_count; i++)
     {
-        int bottom_blob_index = layer->bottoms[i];
+        if (events[i] >= 0)
+            alloc_steps[events[i]] = i;
+        else
+            free_steps[-events[i] - 1] = i;
+    }
+
+    std::vector<size_t> aligned_sizes(count);
+    for (int i = 0; i < count; i++)
+    {
+        aligned_sizes[i] = alignSize(sizes[i], NCNN_MALLOC_ALIGN);
+    }
 
-        if (blob_mats[bottom_blob_index].dims == 0)
+    // order by size descending, earlier allocation first on tie
+    std::vector<int> order(count);
+    for (int i = 0; i < count; i++)
+    {
+        int j = i;
+        for (; j > 0 && aligned_sizes[order[j - 1]] < aligned_sizes[i]; j--)
         {
-            int ret = forward_layer(blobs[bottom_blob_index].producer, blob_mats, opt);
-            if (ret != 0)
-                return ret;
+            order[j] = order[j - 1];
         }
+        order[j] = i;
     }
 
-#if NCNN_BENCHMARK
-    double start = get_current_time();
-    Mat bottom_blob;
-    if (layer->one_blob_only)
+    offsets.resize(count);
+
+    size_t arena_size = 0;
+    std::vector<std::pair<size_t, size_t> > conflicts;
+    for (int i = 0; i < count; i++)
     {
-        int bottom_blob_index = layer->bottoms[0];
-        bottom_blob.dims = blob_mats[bottom_blob_index].dims;
-        bottom_blob.w = blob_mats[bottom_blob_index].w;
-        bottom_blob.h = blob_mats[bottom_blob_index].h;
-        bottom_blob.d = blob_mats[bottom_blob_index].d;
-        bottom_blob.c = blob_mats[bottom_blob_index].c;
-        bottom_blob.elempack = blob_mats[bottom_blob_index].elempack;
-        bottom_blob.elemsize = blob_mats[bottom_blob_index].elemsize;
+        const int id = order[i];
+
+        // collect placed blobs with overlapping lifetime, sorted by offset
+        conflicts.clear();
+        for (int j = 0; j < i; j++)
+        {
+            const int pid = order[j];
+            if (alloc_steps[pid] < free_steps[id] && alloc_steps[id] < free_steps[pid])
+            {
+                std::pair<size_t, size_t> c(offsets[pid], offsets[pid] + aligned_sizes[pid]);
+
+                size_t k = conflicts.size();
+                conflicts.push_back(c);
+                for (; k > 0 && conflicts[k - 1].first > c.first; k--)
+                {
+                    conflicts[k] = conflicts[k - 1];
+                }
+                conflicts[k] = c;
+            }
+        }
+
+        // first gap that fits
+        size_t offset = 0;
+        for (size_t j = 0; j < conflicts.size(); j++)
+        {
+            if (offset + aligned_sizes[id] <= conflicts[j].first)
+                break;
+
+            offset = std::max(offset, conflicts[j].second);
+        }
+
+        offsets[id] = offset;
+        arena_size = std::max(arena_size, offset + aligned_sizes[id]);
     }
-#endif
-    int ret = 0;
-    if (layer->featmask)
+
+    return arena_size;
+}
+
+static void get_memory_plan_shape_key(const std::vector<Mat>& blob_mats, const Option& opt, std::vector<int>& shape_key)
+{
+    shape_key.clear();
+    shape_key.push_back(opt.lightmode ? 1 : 0);
+    for (size_t i = 0; i < blob_mats.size(); i++)
     {
-        ret = do_forward_layer(layer, blob_mats, get_masked_option(opt, layer->featmask));
+        const Mat& m = blob_mats[i];
+        if (m.dims == 0)
+            continue;
+
+        shape_key.push_back((int)i);
+        shape_key.push_back(m.dims);
+        shape_key.push_back(m.w);
+        shape_key.push_back(m.h);
+        shape_key.push_back(m.d);
+        shape_key.push_back(m.c);
+        shape_key.push_back((int)m.elemsize);
+        shape_key.push_back(m.elempack);
     }
-    else
+}
+
+static bool shape_key_equal(const std::vector<int>& a, const std::vector<int>& b)
+{
+    if (a.size() != b.size())
+        return false;
+
+    for (size_t i = 0; i < a.size(); i++)
     {
-        ret = do_forward_layer(layer, blob_mats, opt);
+        if (a[i] != b[i])
+            return false;
     }
-#if NCNN_BENCHMARK
-    double end = get_current_time();
-    if (layer->one_blob_only)
+
+    return true;
+}
+
+// blob allocator of one extractor under static memory plan
+// without a plan, it forwards to the fallback allocator and records the event sequence
+// with a plan, it replays the events by returning arena offsets
+// allocation deviating from the plan falls back to the fallback allocator from then on
+// so that arena regions handed out never overlap in lifetime
+class MemoryPlanAllocator : public Allocator
+{
+public:
+    MemoryPlanAllocator(Allocator* _fallback, const std::vector<int>& _shape_key, MemoryPlan* _plan, unsigned char* _arena, size_t _arena_size, Allocator* _arena_allocator);
+    virtual ~MemoryPlanAllocator();
+
+    virtual void* fastMalloc(size_t size);
+    virtual void fastFree(void* ptr);
+
+public:
+    Mutex lock;
+    Allocator* fallback;
+    std::vector<int> shape_key;
+
+    // replay
+    MemoryPlan* plan;
+    unsigned char* arena;
+    size_t arena_size;
+    Allocator* arena_allocator;
+    size_t step;
+    int alloc_count;
+    bool deviated;
+
+    // record
+    std::vector<size_t> sizes;
+    std::vector<int> events;
+    std::vector<std::pair<void*, int> > live_ptrs;
+
+    int live_count;
+    // extractor gone while blob still alive, delete self on the last free
+    bool orphaned;
+};
+
+MemoryPlanAllocator::MemoryPlanAllocator(Allocator* _fallback, const std::vector<int>& _shape_key, MemoryPlan* _plan, unsigned char* _arena, size_t _arena_size, Allocator* _arena_allocator)
+    : fallback(_fallback), shape_key(_shape_key), plan(_plan), arena(_arena), arena_size(_arena_size), arena_allocator(_arena_allocator)
+{
+    step = 0;
+    alloc_count = 0;
+    deviated = false;
+    live_count = 0;
+    orphaned = false;
+}
+
+MemoryPlanAllocator::~MemoryPlanAllocator()
+{
+    if (orphaned && arena)
     {
-        int top_blob_index = layer->tops[0];
-        benchmark(layer, bottom_blob, blob_mats[top_blob_index], start, end);
+        if (arena_allocator)
+            arena_allocator->fastFree(arena);
+        else
+            ncnn::fastFree(arena);
     }
-    else
+}
+
+void* MemoryPlanAllocator::fastMalloc(size_t size)
+{
+    lock.lock();
+
+    live_count++;
+
+    if (arena)
     {
-        benchmark(layer, start, end);
+        if (plan && !deviated && step < plan->events.size() && plan->events[step] == alloc_count && plan->sizes[alloc_count] == size)
+        {
+            void* ptr = arena + plan->offsets[alloc_count];
+            alloc_count++;
+            step++;
+
+            lock.unlock();
+
+            return ptr;
+        }
+
+        deviated = true;
+
+        void* ptr = fallback ? fallback->fastMalloc(size) : ncnn::fastMalloc(size);
+
+        lock.unlock();
+
+        return ptr;
     }
-#endif
-    if (ret != 0)
-        return ret;
 
-    //     NCNN_LOGE("forward_layer %d %s done", layer_index, layer->name.c_str());
-    //     const Mat& blob = blob_mats[layer->tops[0]];
-    //     NCNN_LOGE("[%-2d %-16s %-16s]  %d    blobs count = %-3d   size = %-3d x %-3d", layer_index, layer->type.c_str(), layer->name.c_str(), layer->tops[0], blob.c, blob.h, blob.w);
+    void* ptr = fallback ? fallback->fastMalloc(size) : ncnn::fastMalloc(size);
 
-    return 0;
+    int id = (int)sizes.size();
+    sizes.push_back(size);
+    events.push_back(id);
+    live_ptrs.push_back(std::make_pair(ptr, id));
+
+    lock.unlock();
+
+    return ptr;
 }
 
-#if NCNN_VULKAN
-int NetPrivate::forward_layer(int layer_index, std::vector<Mat>& blob_mats, std::vector<VkMat>& blob_mats_gpu, VkCompute& cmd, const Option& opt) const
+void MemoryPlanAllocator::fastFree(void* ptr)
 {
-    const Layer* layer = layers[layer_index];
+    lock.lock();
 
-    //     NCNN_LOGE("forward_layer %d %d %s", layer->support_vulkan, layer_index, layer->name.c_str());
-
-    bool cmd_submit_and_wait = false;
+    live_count--;
 
-    // load bottom blobs
-    for (size_t i = 0; i < layer->bottoms.size(); i++)
+    if (arena && (unsigned char*)ptr >= arena && (unsigned char*)ptr < arena + arena_size)
     {
-        int bottom_blob_index = layer->bottoms[i];
-
-        if (blob_mats_gpu[bottom_blob_index].dims == 0 && blob_mats[bottom_blob_index].dims == 0)
+        if (plan && !deviated)
         {
-            int ret = forward_layer(blobs[bottom_blob_index].producer, blob_mats, blob_mats_gpu, cmd, opt);
-            if (ret != 0)
-                return ret;
+            const int event = step < plan->events.size() ? plan->events[step] : 0;
+            if (event < 0 && arena + plan->offsets[-event - 1] == ptr)
+            {
+                step++;
+            }
+            else
+            {
+                deviated = true;
+            }
         }
-
-        if (layer->support_vulkan)
+    }
+    else
+    {
+        if (!arena)
         {
-            if (blob_mats_gpu[bottom_blob_index].dims == 0)
+            for (int i = (int)live_ptrs.size() - 1; i >= 0; i--)
             {
-                // host to buffer
-                cmd.record_upload(blob_mats[bottom_blob_index], blob_mats_gpu[bottom_blob_index], opt);
-
-                if (opt.lightmode)
+                if (live_ptrs[i].first == ptr)
                 {
-                    // delete after taken in light mode
-                    blob_mats[bottom_blob_index].release();
+                    events.push_back(-live_ptrs[i].second - 1);
+                    live_ptrs.erase(live_ptrs.begin() + i);
+                    break;
                 }
             }
         }
+
+        if (fallback)
+            fallback->fastFree(ptr);
         else
-        {
-            if (blob_mats[bottom_blob_index].dims == 0)
-            {
-                Option opt_download = opt;
-                opt_download.use_packing_layout = layer->support_packing;
+            ncnn::fastFree(ptr);
+    }
 
-                // buffer to host
-                cmd.record_download(blob_mats_gpu[bottom_blob_index], blob_mats[bottom_blob_index], opt_download);
+    if (orphaned && live_count == 0)
+    {
+        lock.unlock();
 
-                if (opt.lightmode)
-                {
-                    // delete after taken in light mode
-                    blob_mats_gpu[bottom_blob_index].release();
-                }
+        delete this;
+        return;
+    }
 
-                cmd_submit_and_wait = true;
-            }
+    lock.unlock();
+}
+
+MemoryPlanAllocator* NetPrivate::acquire_memory_plan_allocator(const std::vector<Mat>& blob_mats, const Option& opt)
+{
+    std::vector<int> shape_key;
+    get_memory_plan_shape_key(blob_mats, opt, shape_key);
+
+    MemoryPlan* plan = 0;
+    unsigned char* arena = 0;
+    size_t arena_size = 0;
+    Allocator* arena_allocator = opt.weight_allocator;
+
+    memory_plan_lock.lock();
+
+    for (size_t i = 0; i < memory_plans.size(); i++)
+    {
+        if (shape_key_equal(memory_plans[i]->shape_key, shape_key))
+        {
+            plan = memory_plans[i];
+            break;
         }
     }
 
-    int ret;
-    if (cmd_submit_and_wait)
+    if (plan)
     {
-        ret = cmd.submit_and_wait();
+        plan->refcount++;
 
-#if NCNN_BENCHMARK
-        std::vector<uint64_t> results(layer_index * 2);
-        cmd.get_query_pool_results(0, layer_index * 2, results);
-        for (int i = 0; i < layer_index; i++)
+        // take the smallest pooled arena that fits
+        int arena_index = -1;
+        for (size_t i = 0; i < memory_plan_arenas.size(); i++)
         {
-            uint64_t start = results[i * 2];
-            uint64_t end = results[i * 2 + 1];
-            if (start == 0 || end == 0)
+            if (memory_plan_arenas[i].size < plan->arena_size)
                 continue;
 
-            double duration_us = (end - start) * vkdev->info.timestamp_period() / 1000;
-            NCNN_LOGE("%-24s %-30s %8.2lfus    |", layers[i]->type.c_str(), layers[i]->name.c_str(), duration_us);
+            if (arena_index == -1 || memory_plan_arenas[i].size < memory_plan_arenas[arena_index].size)
+                arena_index = (int)i;
         }
-#endif // NCNN_BENCHMARK
 
-        cmd.reset();
-        if (ret != 0)
-            return ret;
+        if (arena_index != -1)
+        {
+            arena_size = memory_plan_arenas[arena_index].size;
+            arena = (unsigned char*)memory_plan_arenas[arena_index].data;
+            arena_allocator = memory_plan_arenas[arena_index].allocator;
+            memory_plan_arenas.erase(memory_plan_arenas.begin() + arena_index);
+        }
     }
 
-    if (layer->support_vulkan)
+    memory_plan_lock.unlock();
+
+    if (plan && !arena)
     {
-#if NCNN_BENCHMARK
-        cmd.record_write_timestamp(layer_index * 2);
-#endif
-        if (layer->featmask)
-        {
-            ret = do_forward_layer(layer, blob_mats_gpu, cmd, get_masked_option(opt, layer->featmask));
-        }
-        else
+        arena_size = plan->arena_size;
+        arena = (unsigned char*)(arena_allocator ? arena_allocator->fastMalloc(arena_size) : ncnn::fastMalloc(arena_size));
+    }
+
+    return new MemoryPlanAllocator(opt.blob_allocator, shape_key, plan, arena, arena_size, arena_allocator);
+}
+
+void NetPrivate::reclaim_memory_plan_allocator(MemoryPlanAllocator* allocator)
+{
+    allocator->lock.lock();
+
+    if (allocator->live_count != 0)
+    {
+        // blob referenced elsewhere, the allocator goes away with its last blob
+        allocator->orphaned = true;
+
+        if (allocator->plan)
         {
-            ret = do_forward_layer(layer, blob_mats_gpu, cmd, opt);
+            memory_plan_lock.lock();
+            allocator->plan->refcount--;
+            if (allocator->plan->stale && allocator->plan->refcount == 0)
+            {
+                delete allocator->plan;
+            }
+            allocator->plan = 0;
+            memory_plan_lock.unlock();
         }
-#if NCNN_BENCHMARK
-        cmd.record_write_timestamp(layer_index * 2 + 1);
-#endif
+
+        allocator->lock.unlock();
+        return;
     }
-    else
+
+    allocator->lock.unlock();
+
+    MemoryPlan* plan = allocator->plan;
+
+    if (plan)
     {
-#if NCNN_BENCHMARK
-        double start = get_current_time();
-        Mat bottom_blob;
-        if (layer->one_blob_only)
+        const bool plan_matched = !allocator->deviated && allocator->step == plan->events.size();
+
+        memory_plan_lock.lock();
+
+        if (allocator->arena)
         {
-            int bottom_blob_index = layer->bottoms[0];
-            bottom_blob = blob_mats[bottom_blob_index].shape();
+            MemoryPlanArena pooled;
+            pooled.size = allocator->arena_size;
+            pooled.data = allocator->arena;
+            pooled.allocator = allocator->arena_allocator;
+            memory_plan_arenas.push_back(pooled);
         }
-#endif
-        if (layer->featmask)
+
+        if (!plan_matched && !plan->stale)
         {
-            ret = do_forward_layer(layer, blob_mats, get_masked_option(opt, layer->featmask));
+            // record again on next run
+            plan->stale = true;
+            for (size_t i = 0; i < memory_plans.size(); i++)
+            {
+                if (memory_plans[i] == plan)
+                {
+                    memory_plans.erase(memory_plans.begin() + i);
+                    break;
+                }
+            }
         }
-        else
+
+        plan->refcount--;
+        if (plan->stale && plan->refcount == 0)
         {
-            ret = do_forward_layer(layer, blob_mats, opt);
+            delete plan;
         }
-#if NCNN_BENCHMARK
-        double end = get_current_time();
-        if (layer->one_blob_only)
+
+        memory_plan_lock.unlock();
+    }
+    else if (!allocator->events.empty())
+    {
+        MemoryPlan* new_plan = new MemoryPlan;
+        new_plan->shape_key = allocator->shape_key;
+        new_plan->sizes = allocator->sizes;
+        new_plan->events = allocator->events;
+        new_plan->arena_size = plan_memory_offsets(new_plan->sizes, new_plan->events, new_plan->offsets);
+        new_plan->refcount = 0;
+        new_plan->stale = false;
+
+        memory_plan_lock.lock();
+
+        for (size_t i = 0; i < memory_plans.size(); i++)
         {
-            int top_blob_index = layer->tops[0];
-            benchmark(layer, bottom_blob, blob_mats[top_blob_index], start, end);
+            if (shape_key_equal(memory_plans[i]->shape_key, new_plan->shape_key))
+            {
+                // concurrent recording finished earlier
+                memory_plans[i]->stale = true;
+                if (memory_plans[i]->refcount == 0)
+                {
+                    delete memory_plans[i];
+                }
+                memory_plans.erase(memory_plans.begin() + i);
+                break;
+            }
         }
-        else
+
+        memory_plans.push_back(new_plan);
+
+        memory_plan_lock.unlock();
+    }
+
+    delete allocator;
+}
+
+size_t NetPrivate::get_memory_plan_size(const std::vector<int>& shape_key)
+{
+    size_t arena_size = 0;
+
+    memory_plan_lock.lock();
+
+    for (size_t i = 0; i < memory_plans.size(); i++)
+    {
+        if (shape_key_equal(memory_plans[i]->shape_key, shape_key))
         {
-            benchmark(layer, start, end);
+            arena_size = memory_plans[i]->arena_size;
+            break;
         }
-#endif
     }
-    if (ret != 0)
-        return ret;
 
-    //     NCNN_LOGE("forward_layer %d %d %s done", layer->support_vulkan, layer_index, layer->name.c_str());
+    memory_plan_lock.unlock();
 
-    return 0;
+    return arena_size;
 }
 
-int NetPrivate::forward_layer(int layer_index, std::vector<Mat>& blob_mats, std::vector<VkMat>& blob_mats_gpu, std::vector<VkImageMat>& blob_mats_gpu_image, VkCompute& cmd, const Option& opt) const
+void NetPrivate::clear_memory_plans()
+{
+    memory_plan_lock.lock();
+
+    for (size_t i = 0; i < memory_plans.size(); i++)
+    {
+        memory_plans[i]->stale = true;
+        if (memory_plans[i]->refcount == 0)
+        {
+            delete memory_plans[i];
+        }
+    }
+    memory_plans.clear();
+
+    for (size_t i = 0; i < memory_plan_arenas.size(); i++)
+    {
+        if (memory_plan_arenas[i].allocator)
+            memory_plan_arenas[i].allocator->fastFree(memory_plan_arenas[i].data);
+        else
+            ncnn::fastFree(memory_plan_arenas[i].data);
+    }
+    memory_plan_arenas.clear();
+
+    memory_plan_lock.unlock();
+}
+
+static void get_profile_shape(const Mat& m, Mat& shape)
+{
+    shape.dims = m.dims;
+    shape.w = m.w;
+    shape.h = m.h;
+    shape.d = m.d;
+    shape.c = m.c;
+    shape.elemsize = m.elemsize;
+    shape.elempack = m.elempack;
+    shape.cstep = m.cstep;
+}
+
+int NetPrivate::forward_layer(int layer_index, std::vector<Mat>& blob_mats, const Option& opt, Profiler* profiler, TrackingAllocator* memory_tracker) const
 {
     const Layer* layer = layers[layer_index];
 
-    //     NCNN_LOGE("forward_layer %d %d %s", layer->support_vulkan, layer_index, layer->name.c_str());
+    if (wait_layer_loaded(layer_index) != 0)
+        return -1;
 
-    bool cmd_submit_and_wait = false;
-    bool image_allocation_failed = false;
+    if (ensure_layer_pipeline(layer_index) != 0)
+        return -1;
 
-IMAGE_ALLOCATION_FAILED:
+    if (memory_tracker)
+        memory_tracker->begin_layer(layer_index);
 
-    if (image_allocation_failed)
+    LayerProfile* record = 0;
+    std::vector<const void*> bottom_data;
+    HardwareCounters counters_start;
+    if (profiler)
     {
+        // bottoms may be released or overwritten in place by forward
+        record = new LayerProfile;
+        record->layer_index = layer_index;
+        record->typeindex = layer->typeindex;
 #if NCNN_STRING
-        NCNN_LOGE("forward_layer %d %s image allocation failed, fallback to cpu", layer_index, layer->name.c_str());
-#else
-        NCNN_LOGE("forward_layer %d image allocation failed, fallback to cpu", layer_index);
-#endif
+        record->type = layer->type;
+        record->name = layer->name;
+#endif // NCNN_STRING
+        record->bottom_shapes.resize(layer->bottoms.size());
+        bottom_data.resize(layer->bottoms.size());
+        for (size_t i = 0; i < layer->bottoms.size(); i++)
+        {
+            const Mat& bottom_blob = blob_mats[layer->bottoms[i]];
+            get_profile_shape(bottom_blob, record->bottom_shapes[i]);
+            bottom_data[i] = bottom_blob.data;
+        }
+        record->use_bf16_storage = opt.use_bf16_storage && !(layer->featmask & (1 << 2));
+        record->num_threads = opt.num_threads;
+        record->thread_id = profiler->thread_id();
+        if (profiler->hardware_counters_enabled())
+            profiler->read_hardware_counters(counters_start);
+        record->start = profiler->now();
     }
 
-    // load bottom blobs
-    for (size_t i = 0; i < layer->bottoms.size(); i++)
-    {
-        int bottom_blob_index = layer->bottoms[i];
+    //     NCNN_LOGE("forward_layer %d %s", layer_index, layer->name.c_str());
 
-        if (blob_mats_gpu_image[bottom_blob_index].dims == 0 && blob_mats_gpu[bottom_blob_index].dims == 0 && blob_mats[bottom_blob_index].dims == 0)
+    // bottom blobs are produced in schedule order
+
+#if NCNN_BENCHMARK
+    double start = get_current_time();
+    Mat bottom_blob;
+    if (layer->one_blob_only)
+    {
+        int bottom_blob_index = layer->bottoms[0];
+        bottom_blob.dims = blob_mats[bottom_blob_index].dims;
+        bottom_blob.w = blob_mats[bottom_blob_index].w;
+        bottom_blob.h = blob_mats[bottom_blob_index].h;
+        bottom_blob.d = blob_mats[bottom_blob_index].d;
+        bottom_blob.c = blob_mats[bottom_blob_index].c;
+        bottom_blob.elempack = blob_mats[bottom_blob_index].elempack;
+        bottom_blob.elemsize = blob_mats[bottom_blob_index].elemsize;
+    }
+#endif
+    int ret = 0;
+    if (layer->featmask)
+    {
+        ret = do_forward_layer(layer, blob_mats, get_masked_option(opt, layer->featmask));
+    }
+    else
+    {
+        ret = do_forward_layer(layer, blob_mats, opt);
+    }
+#if NCNN_BENCHMARK
+    double end = get_current_time();
+    if (layer->one_blob_only)
+    {
+        int top_blob_index = layer->tops[0];
+        benchmark(layer, bottom_blob, blob_mats[top_blob_index], start, end);
+    }
+    else
+    {
+        benchmark(layer, start, end);
+    }
+#endif
+    if (record)
+    {
+        record->end = profiler->now();
+        if (profiler->hardware_counters_enabled() && profiler->read_hardware_counters(record->counters) == 0)
         {
-            int ret = forward_layer(blobs[bottom_blob_index].producer, blob_mats, blob_mats_gpu, blob_mats_gpu_image, cmd, opt);
-            if (ret != 0)
-                return ret;
+            HardwareCounters& c = record->counters;
+            c.cycles = c.cycles != -1 ? c.cycles - counters_start.cycles : -1;
+            c.instructions = c.instructions != -1 ? c.instructions - counters_start.instructions : -1;
+            c.l1d_read_misses = c.l1d_read_misses != -1 ? c.l1d_read_misses - counters_start.l1d_read_misses : -1;
+            c.llc_misses = c.llc_misses != -1 ? c.llc_misses - counters_start.llc_misses : -1;
+            c.branch_misses = c.branch_misses != -1 ? c.branch_misses - counters_start.branch_misses : -1;
         }
-
-        if (layer->support_vulkan && !image_allocation_failed)
+        record->top_shapes.resize(layer->tops.size());
+        for (size_t i = 0; i < layer->tops.size(); i++)
         {
-            if (layer->support_image_storage)
+            const Mat& top_blob = blob_mats[layer->tops[i]];
+            get_profile_shape(top_blob, record->top_shapes[i]);
+
+            bool inplace = false;
+            for (size_t j = 0; j < bottom_data.size(); j++)
             {
-                if (blob_mats_gpu_image[bottom_blob_index].dims == 0)
-                {
-                    if (blob_mats_gpu[bottom_blob_index].dims == 0)
-                    {
-                        // host to image
-                        cmd.record_upload(blob_mats[bottom_blob_index], blob_mats_gpu_image[bottom_blob_index], opt);
+                if (top_blob.data == bottom_data[j])
+                    inplace = true;
+            }
+            if (!inplace)
+                record->bytes_allocated += top_blob.total() * top_blob.elemsize;
+        }
 
-                        if (blob_mats_gpu_image[bottom_blob_index].empty())
-                        {
-                            image_allocation_failed = true;
-                            goto IMAGE_ALLOCATION_FAILED;
-                        }
+        if (ret == 0)
+        {
+            record->cost = get_layer_cost(layer, !layer_overwritten[layer_index], record->bottom_shapes, record->top_shapes, opt);
+            profiler->add(*record);
+        }
 
-                        if (opt.lightmode)
-                        {
-                            // delete after taken in light mode
-                            blob_mats[bottom_blob_index].release();
-                        }
-                    }
-                    else
-                    {
-                        // buffer to image
-                        cmd.record_buffer_to_image(blob_mats_gpu[bottom_blob_index], blob_mats_gpu_image[bottom_blob_index], opt);
+        delete record;
+    }
 
-                        if (blob_mats_gpu_image[bottom_blob_index].empty())
-                        {
-                            image_allocation_failed = true;
-                            goto IMAGE_ALLOCATION_FAILED;
-                        }
+    if (memory_tracker)
+        memory_tracker->end_layer(layer_index);
 
-                        if (opt.lightmode)
-                        {
-                            // delete after taken in light mode
-                            blob_mats_gpu[bottom_blob_index].release();
-                        }
-                    }
-                }
-            }
-            else
-            {
-                if (blob_mats_gpu[bottom_blob_index].dims == 0)
-                {
-                    if (blob_mats_gpu_image[bottom_blob_index].dims == 0)
-                    {
-                        // host to buffer
-                        cmd.record_upload(blob_mats[bottom_blob_index], blob_mats_gpu[bottom_blob_index], opt);
+    if (ret != 0)
+        return ret;
 
-                        if (opt.lightmode)
-                        {
-                            // delete after taken in light mode
-                            blob_mats[bottom_blob_index].release();
-                        }
-                    }
-                    else
-                    {
-                        // image to buffer
-                        cmd.record_image_to_buffer(blob_mats_gpu_image[bottom_blob_index], blob_mats_gpu[bottom_blob_index], opt);
+    //     NCNN_LOGE("forward_layer %d %s done", layer_index, layer->name.c_str());
+    //     const Mat& blob = blob_mats[layer->tops[0]];
+    //     NCNN_LOGE("[%-2d %-16s %-16s]  %d    blobs count = %-3d   size = %-3d x %-3d", layer_index, layer->type.c_str(), layer->name.c_str(), layer->tops[0], blob.c, blob.h, blob.w);
 
-                        if (opt.lightmode)
-                        {
-                            // delete after taken in light mode
-                            blob_mats_gpu_image[bottom_blob_index].release();
-                        }
-                    }
-                }
-            }
-        }
-        else
-        {
-            if (blob_mats[bottom_blob_index].dims == 0)
-            {
-                if (blob_mats_gpu_image[bottom_blob_index].dims == 0)
-                {
-                    // buffer to host
-                    cmd.record_download(blob_mats_gpu[bottom_blob_index], blob_mats[bottom_blob_index], opt);
+    return 0;
+}
 
-                    if (opt.lightmode)
-                    {
-                        // delete after taken in light mode
-                        blob_mats_gpu[bottom_blob_index].release();
-                    }
+int NetPrivate::forward_blob(int blob_index, std::vector<Mat>& blob_mats, const Option& opt, Profiler* profiler, TrackingAllocator* memory_tracker)
+{
+    if (blobs[blob_index].producer == -1)
+    {
+        NCNN_LOGE("blob %d has no producer and no input", blob_index);
+        return -1;
+    }
 
-                    cmd_submit_and_wait = true;
-                }
-                else
-                {
-                    // image to host
-                    cmd.record_download(blob_mats_gpu_image[bottom_blob_index], blob_mats[bottom_blob_index], opt);
+    const std::vector<int>& schedule = get_layer_schedule(blob_index);
 
-                    if (opt.lightmode)
-                    {
-                        // delete after taken in light mode
-                        blob_mats_gpu_image[bottom_blob_index].release();
-                    }
+    std::vector<unsigned char> layer_needed;
+    mark_needed_layers(blob_index, schedule, blob_mats, layer_needed);
 
-                    cmd_submit_and_wait = true;
-                }
-            }
-        }
+    for (size_t i = 0; i < schedule.size(); i++)
+    {
+        const int layer_index = schedule[i];
+        if (!layer_needed[layer_index])
+            continue;
+
+        int ret = forward_layer(layer_index, blob_mats, opt, profiler, memory_tracker);
+        if (ret != 0)
+            return ret;
     }
 
-    int ret;
-    if (cmd_submit_and_wait)
+    return 0;
+}
+
+void NetPrivate::mark_needed_layers(int blob_index, const std::vector<int>& schedule, const std::vector<Mat>& blob_mats, std::vector<unsigned char>& layer_needed) const
+{
+    // mark layers producing missing blobs in reverse topological order
+    // blobs already present, such as inputs and previous extraction, prune their producers
+    layer_needed.assign(layers.size(), 0);
+    layer_needed[blobs[blob_index].producer] = 1;
+    for (int i = (int)schedule.size() - 1; i >= 0; i--)
     {
-        ret = cmd.submit_and_wait();
+        const Layer* layer = layers[schedule[i]];
+        if (!layer_needed[schedule[i]])
+            continue;
 
-#if NCNN_BENCHMARK
-        std::vector<uint64_t> results(layer_index * 2);
-        cmd.get_query_pool_results(0, layer_index * 2, results);
-        for (int i = 0; i < layer_index; i++)
+        for (size_t j = 0; j < layer->bottoms.size(); j++)
         {
-            uint64_t start = results[i * 2];
-            uint64_t end = results[i * 2 + 1];
-            if (start == 0 || end == 0)
-                continue;
-
-            double duration_us = (end - start) * vkdev->info.timestamp_period() / 1000;
-            NCNN_LOGE("%-24s %-30s %8.2lfus    |", layers[i]->type.c_str(), layers[i]->name.c_str(), duration_us);
+            int bottom_blob_index = layer->bottoms[j];
+            int producer = blobs[bottom_blob_index].producer;
+            if (blob_mats[bottom_blob_index].dims == 0 && producer != -1)
+            {
+                layer_needed[producer] = 1;
+            }
         }
-#endif // NCNN_BENCHMARK
+    }
+}
 
-        cmd.reset();
+void NetPrivate::build_layer_schedule(int blob_index, std::vector<int>& schedule) const
+{
+    schedule.clear();
 
-        if (ret != 0)
-            return ret;
-    }
+    const int producer = blobs[blob_index].producer;
+    if (producer == -1)
+        return;
 
-    if (layer->support_vulkan && !image_allocation_failed)
+    // depth-first post order over producers, bottoms visited in order
+    // same order as resolving bottom blobs recursively
+    std::vector<unsigned char> visited(layers.size(), 0);
+    std::vector<std::pair<int, size_t> > stack;
+
+    visited[producer] = 1;
+    stack.push_back(std::make_pair(producer, (size_t)0));
+    while (!stack.empty())
     {
-#if NCNN_BENCHMARK
-        cmd.record_write_timestamp(layer_index * 2);
-#endif
-        if (layer->support_image_storage)
+        const int layer_index = stack.back().first;
+        const size_t bottom_index = stack.back().second;
+        const Layer* layer = layers[layer_index];
+
+        if (bottom_index == layer->bottoms.size())
         {
-            if (layer->featmask)
-            {
-                ret = do_forward_layer(layer, blob_mats_gpu_image, cmd, get_masked_option(opt, layer->featmask));
-            }
-            else
-            {
-                ret = do_forward_layer(layer, blob_mats_gpu_image, cmd, opt);
-            }
-            if (ret == -100)
-            {
-                image_allocation_failed = true;
-                goto IMAGE_ALLOCATION_FAILED;
-            }
+            schedule.push_back(layer_index);
+            stack.pop_back();
+            continue;
         }
-        else
+
+        stack.back().second = bottom_index + 1;
+
+        const int bottom_producer = blobs[layer->bottoms[bottom_index]].producer;
+        if (bottom_producer != -1 && !visited[bottom_producer])
         {
-            if (layer->featmask)
-            {
-                ret = do_forward_layer(layer, blob_mats_gpu, cmd, get_masked_option(opt, layer->featmask));
-            }
-            else
-            {
-                ret = do_forward_layer(layer, blob_mats_gpu, cmd, opt);
-            }
+            visited[bottom_producer] = 1;
+            stack.push_back(std::make_pair(bottom_producer, (size_t)0));
         }
-#if NCNN_BENCHMARK
-        cmd.record_write_timestamp(layer_index * 2 + 1);
-#endif
     }
-    else
+}
+
+const std::vector<int>& NetPrivate::get_layer_schedule(int blob_index)
+{
+    layer_schedules_lock.lock();
+
+    std::vector<int>& schedule = layer_schedules[blob_index];
+    if (schedule.empty())
     {
-#if NCNN_BENCHMARK
-        double start = get_current_time();
-        Mat bottom_blob;
-        if (layer->one_blob_only)
+        build_layer_schedule(blob_index, schedule);
+    }
+
+    layer_schedules_lock.unlock();
+
+    return schedule;
+}
+
+void NetPrivate::update_layer_schedules()
+{
+    layer_schedules.clear();
+    layer_schedules.resize(blobs.size());
+
+    // prebuild for network outputs
+    for (size_t i = 0; i < output_blob_indexes.size(); i++)
+    {
+        int blob_index = output_blob_indexes[i];
+        build_layer_schedule(blob_index, layer_schedules[blob_index]);
+    }
+}
+
+// serialize blob and workspace allocations from concurrent branches
+// the allocator may not be thread-safe, such as UnlockedPoolAllocator
+class BranchAllocator : public Allocator
+{
+public:
+    BranchAllocator(Allocator* _allocator)
+        : allocator(_allocator)
+    {
+    }
+
+    virtual void* fastMalloc(size_t size)
+    {
+        MutexLockGuard guard(lock);
+        return allocator->fastMalloc(size);
+    }
+
+    virtual void fastFree(void* ptr)
+    {
+        MutexLockGuard guard(lock);
+        allocator->fastFree(ptr);
+    }
+
+    Allocator* const allocator;
+    Mutex lock;
+};
+
+// dependency state of one branch parallel forward
+class BranchRun
+{
+public:
+    const NetPrivate* net;
+    std::vector<Mat>* blob_mats;
+    Option opt;
+    Profiler* profiler;
+    TrackingAllocator* memory_tracker;
+
+    // unfinished producers per layer
+    std::vector<int> pending;
+    // blobs to be produced in this run
+    std::vector<unsigned char> blob_produced;
+
+    Mutex lock;
+    ConditionVariable finished;
+    int remaining;
+    int running;
+    int queued;
+    int ret;
+};
+
+class BranchExecutor
+{
+public:
+    BranchExecutor(int worker_count);
+    ~BranchExecutor();
+
+    void push(BranchRun* run, int layer_index);
+
+    // run layer and then its successors on the calling thread
+    // extra ready successors are pushed to workers
+    void run_chain(BranchRun* run, int layer_index);
+
+    static void* worker(void* args);
+
+    Mutex lock;
+    ConditionVariable cond;
+    std::list<std::pair<BranchRun*, int> > tasks;
+    std::vector<Thread*> workers;
+    bool stop;
+};
+
+BranchExecutor::BranchExecutor(int worker_count)
+{
+    stop = false;
+
+    workers.resize(worker_count);
+    for (int i = 0; i < worker_count; i++)
+    {
+        workers[i] = new Thread(worker, this);
+    }
+}
+
+BranchExecutor::~BranchExecutor()
+{
+    lock.lock();
+    stop = true;
+    cond.broadcast();
+    lock.unlock();
+
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+        workers[i]->join();
+        delete workers[i];
+    }
+}
+
+void BranchExecutor::push(BranchRun* run, int layer_index)
+{
+    lock.lock();
+    tasks.push_back(std::make_pair(run, layer_index));
+    cond.signal();
+    lock.unlock();
+}
+
+void BranchExecutor::run_chain(BranchRun* run, int layer_index)
+{
+    // run->running is counted for this thread by the caller
+    while (layer_index != -1)
+    {
+        run->lock.lock();
+        const bool skip = run->ret != 0;
+        // share threads among the branches running and waiting
+        Option opt = run->opt;
+        opt.num_threads = run->opt.num_threads / (run->running + run->queued);
+        if (opt.num_threads < 1)
+            opt.num_threads = 1;
+        run->lock.unlock();
+
+        int ret = 0;
+        if (!skip)
         {
-            int bottom_blob_index = layer->bottoms[0];
-            bottom_blob = blob_mats[bottom_blob_index].shape();
+            set_flush_denormals(opt.flush_denormals);
+            ret = run->net->forward_layer(layer_index, *run->blob_mats, opt, run->profiler, run->memory_tracker);
         }
-#endif
-        if (layer->featmask)
+
+        int next_layer_index = -1;
+
+        run->lock.lock();
+        run->remaining--;
+        if (ret != 0 && run->ret == 0)
         {
-            ret = do_forward_layer(layer, blob_mats, get_masked_option(opt, layer->featmask));
+            run->ret = ret;
         }
-        else
+
+        if (run->ret == 0)
         {
-            ret = do_forward_layer(layer, blob_mats, opt);
+            const Layer* layer = run->net->layers[layer_index];
+            for (size_t i = 0; i < layer->tops.size(); i++)
+            {
+                const int top_blob_index = layer->tops[i];
+                const int consumer = run->net->blobs[top_blob_index].consumer;
+                if (consumer == -1 || !run->blob_produced[top_blob_index])
+                    continue;
+
+                if (--run->pending[consumer] != 0)
+                    continue;
+
+                if (next_layer_index == -1)
+                {
+                    next_layer_index = consumer;
+                }
+                else
+                {
+                    run->queued++;
+                    push(run, consumer);
+                }
+            }
         }
-#if NCNN_BENCHMARK
-        double end = get_current_time();
-        if (layer->one_blob_only)
+
+        if (next_layer_index == -1)
         {
-            int top_blob_index = layer->tops[0];
-            benchmark(layer, bottom_blob, blob_mats[top_blob_index], start, end);
+            run->running--;
         }
-        else
+
+        if (run->remaining == 0 || (run->ret != 0 && run->running == 0 && run->queued == 0))
         {
-            benchmark(layer, start, end);
+            run->finished.signal();
         }
-#endif
+        run->lock.unlock();
+
+        layer_index = next_layer_index;
     }
-    if (ret != 0)
-        return ret;
+}
 
-    //     NCNN_LOGE("forward_layer %d %d %s done", layer->support_vulkan, layer_index, layer->name.c_str());
+void* BranchExecutor::worker(void* args)
+{
+    BranchExecutor* executor = (BranchExecutor*)args;
+
+    for (;;)
+    {
+        executor->lock.lock();
+        while (executor->tasks.empty() && !executor->stop)
+        {
+            executor->cond.wait(executor->lock);
+        }
+        if (executor->stop)
+        {
+            executor->lock.unlock();
+            break;
+        }
+        std::pair<BranchRun*, int> task = executor->tasks.front();
+        executor->tasks.pop_front();
+        executor->lock.unlock();
+
+        BranchRun* run = task.first;
+        run->lock.lock();
+        run->queued--;
+        run->running++;
+        run->lock.unlock();
+
+        executor->run_chain(run, task.second);
+    }
 
     return 0;
 }
-#endif // NCNN_VULKAN
 
-int NetPrivate::convert_layout(Mat& bottom_blob, const Layer* layer, const Option& opt) const
+BranchExecutor* NetPrivate::acquire_branch_executor(int num_threads)
 {
-    if (bottom_blob.elembits() == 32)
+    MutexLockGuard guard(branch_executor_lock);
+
+    // the calling thread runs one branch itself
+    const int worker_count = num_threads - 1;
+
+    for (size_t i = 0; i < branch_executors.size(); i++)
     {
-        // clang-format off
-        // *INDENT-OFF*
+        if ((int)branch_executors[i]->workers.size() == worker_count)
+            return branch_executors[i];
+    }
 
-#if NCNN_ARM82
-        if (opt.use_fp16_storage && cpu_support_arm_asimdhp() && layer->support_fp16_storage)
-        {
-            Mat bottom_blob_fp16;
-            cast_float32_to_float16(bottom_blob, bottom_blob_fp16, opt);
-            bottom_blob = bottom_blob_fp16;
-        }
-        else
-#endif // NCNN_ARM82
-#if NCNN_RVV
-        if (opt.use_fp16_storage && cpu_support_riscv_v() && cpu_support_riscv_zfh() && layer->support_fp16_storage)
+    BranchExecutor* branch_executor = new BranchExecutor(worker_count);
+    branch_executors.push_back(branch_executor);
+    return branch_executor;
+}
+
+Allocator* NetPrivate::acquire_branch_allocator(Allocator* allocator)
+{
+    MutexLockGuard guard(branch_executor_lock);
+
+    for (size_t i = 0; i < branch_allocators.size(); i++)
+    {
+        if (branch_allocators[i]->allocator == allocator)
+            return branch_allocators[i];
+    }
+
+    BranchAllocator* branch_allocator = new BranchAllocator(allocator);
+    branch_allocators.push_back(branch_allocator);
+    return branch_allocator;
+}
+
+void NetPrivate::clear_branch_executor()
+{
+    MutexLockGuard guard(branch_executor_lock);
+
+    for (size_t i = 0; i < branch_executors.size(); i++)
+    {
+        delete branch_executors[i];
+    }
+    branch_executors.clear();
+
+    for (size_t i = 0; i < branch_allocators.size(); i++)
+    {
+        delete branch_allocators[i];
+    }
+    branch_allocators.clear();
+}
+
+int NetPrivate::forward_blob_branch_parallel(int blob_index, std::vector<Mat>& blob_mats, const Option& opt, Profiler* profiler, TrackingAllocator* memory_tracker)
+{
+    if (blobs[blob_index].producer == -1)
+    {
+        NCNN_LOGE("blob %d has no producer and no input", blob_index);
+        return -1;
+    }
+
+    const std::vector<int>& schedule = get_layer_schedule(blob_index);
+
+    std::vector<unsigned char> layer_needed;
+    mark_needed_layers(blob_index, schedule, blob_mats, layer_needed);
+
+    BranchRun run;
+    run.net = this;
+    run.blob_mats = &blob_mats;
+    run.opt = opt;
+    run.profiler = profiler;
+    run.memory_tracker = memory_tracker;
+    run.pending.resize(layers.size(), 0);
+    run.blob_produced.resize(blobs.size(), 0);
+    run.remaining = 0;
+    run.running = 0;
+    run.queued = 0;
+    run.ret = 0;
+
+    for (size_t i = 0; i < schedule.size(); i++)
+    {
+        const int layer_index = schedule[i];
+        if (!layer_needed[layer_index])
+            continue;
+
+        // wait for needed producers, even if the blob is present already
+        // since the producer overwrites it as in serial order
+        const Layer* layer = layers[layer_index];
+        for (size_t j = 0; j < layer->bottoms.size(); j++)
         {
-            Mat bottom_blob_fp16;
-            cast_float32_to_float16(bottom_blob, bottom_blob_fp16, opt);
-            bottom_blob = bottom_blob_fp16;
+            int bottom_blob_index = layer->bottoms[j];
+            int producer = blobs[bottom_blob_index].producer;
+            if (producer != -1 && layer_needed[producer])
+            {
+                run.blob_produced[bottom_blob_index] = 1;
+                run.pending[layer_index]++;
+            }
         }
-        else
-#endif // NCNN_RVV
-#if NCNN_BF16
-        if (opt.use_bf16_storage && layer->support_bf16_storage)
+
+        run.remaining++;
+    }
+
+    // layers whose bottoms are all present start first
+    std::vector<int> ready_layers;
+    for (size_t i = 0; i < schedule.size(); i++)
+    {
+        const int layer_index = schedule[i];
+        if (layer_needed[layer_index] && run.pending[layer_index] == 0)
         {
-            Mat bottom_blob_bf16;
-            cast_float32_to_bfloat16(bottom_blob, bottom_blob_bf16, opt);
-            bottom_blob = bottom_blob_bf16;
+            ready_layers.push_back(layer_index);
         }
-#endif // NCNN_BF16
+    }
 
-        // *INDENT-ON*
-        // clang-format on
+    if (ready_layers.empty())
+        return 0;
+
+    BranchExecutor* executor = acquire_branch_executor(opt.num_threads);
+
+    run.lock.lock();
+    run.running = 1;
+    for (size_t i = 1; i < ready_layers.size(); i++)
+    {
+        run.queued++;
+        executor->push(&run, ready_layers[i]);
     }
+    run.lock.unlock();
 
-    int dst_elempack = 1;
-    if (opt.use_packing_layout)
+    executor->run_chain(&run, ready_layers[0]);
+
+    run.lock.lock();
+    while (run.remaining != 0 && !(run.ret != 0 && run.running == 0 && run.queued == 0))
     {
-        // resolve dst_elempack
-        int dims = bottom_blob.dims;
-        int elemcount = 0;
-        if (dims == 1) elemcount = bottom_blob.elempack * bottom_blob.w;
-        if (dims == 2) elemcount = bottom_blob.elempack * bottom_blob.h;
-        if (dims == 3 || dims == 4) elemcount = bottom_blob.elempack * bottom_blob.c;
+        run.finished.wait(run.lock);
+    }
+    run.lock.unlock();
 
-        int elembits = bottom_blob.elembits();
+    return run.ret;
+}
 
-        if (layer->support_packing)
-        {
-            if (elembits == 32)
-            {
-#if NCNN_AVX512
-                if (elemcount % 16 == 0 && ncnn::cpu_support_x86_avx512())
-                    dst_elempack = 16;
-                else if (elemcount % 8 == 0 && ncnn::cpu_support_x86_avx())
-                    dst_elempack = 8;
-                else if (elemcount % 4 == 0)
-                    dst_elempack = 4;
-#elif NCNN_AVX
-                if (elemcount % 8 == 0 && ncnn::cpu_support_x86_avx())
-                    dst_elempack = 8;
-                else if (elemcount % 4 == 0)
-                    dst_elempack = 4;
-#elif NCNN_RVV
-                const int packn = ncnn::cpu_riscv_vlenb() / 4;
-                if (elemcount % packn == 0)
-                    dst_elempack = packn;
-#else
-                if (elemcount % 4 == 0)
-                    dst_elempack = 4;
-#endif
-            }
-            if (elembits == 16)
+#if NCNN_VULKAN
+int NetPrivate::forward_layer(int layer_index, std::vector<Mat>& blob_mats, std::vector<VkMat>& blob_mats_gpu, VkCompute& cmd, const Option& opt) const
+{
+    const Layer* layer = layers[layer_index];
+
+    //     NCNN_LOGE("forward_layer %d %d %s", layer->support_vulkan, layer_index, layer->name.c_str());
+
+    bool cmd_submit_and_wait = false;
+
+    // load bottom blobs
+    for (size_t i = 0; i < layer->bottoms.size(); i++)
+    {
+        int bottom_blob_index = layer->bottoms[i];
+
+        if (blob_mats_gpu[bottom_blob_index].dims == 0 && blob_mats[bottom_blob_index].dims == 0)
+        {
+            int ret = forward_layer(blobs[bottom_blob_index].producer, blob_mats, blob_mats_gpu, cmd, opt);
+            if (ret != 0)
+                return ret;
+        }
+
+        if (layer->support_vulkan)
+        {
+            if (blob_mats_gpu[bottom_blob_index].dims == 0)
             {
-#if NCNN_ARM82
-                if (elemcount % 8 == 0 && ncnn::cpu_support_arm_asimdhp() && opt.use_fp16_arithmetic)
-                    dst_elempack = 8;
-                else if (elemcount % 4 == 0)
-                    dst_elempack = 4;
-#elif NCNN_RVV
-                const int packn = ncnn::cpu_riscv_vlenb() / 2;
-                if (elemcount % packn == 0)
-                    dst_elempack = packn;
-#else
-                if (elemcount % 4 == 0)
-                    dst_elempack = 4;
-#endif
+                // host to buffer
+                cmd.record_upload(blob_mats[bottom_blob_index], blob_mats_gpu[bottom_blob_index], opt);
+
+                if (opt.lightmode)
+                {
+                    // delete after taken in light mode
+                    blob_mats[bottom_blob_index].release();
+                }
             }
-            if (elembits == 8)
+        }
+        else
+        {
+            if (blob_mats[bottom_blob_index].dims == 0)
             {
-#if NCNN_RVV
-                const int packn = ncnn::cpu_riscv_vlenb() / 1;
-                if (elemcount % packn == 0)
-                    dst_elempack = packn;
-#else
-                if (elemcount % 8 == 0)
-                    dst_elempack = 8;
-#endif
+                Option opt_download = opt;
+                opt_download.use_packing_layout = layer->support_packing;
+
+                // buffer to host
+                cmd.record_download(blob_mats_gpu[bottom_blob_index], blob_mats[bottom_blob_index], opt_download);
+
+                if (opt.lightmode)
+                {
+                    // delete after taken in light mode
+                    blob_mats_gpu[bottom_blob_index].release();
+                }
+
+                cmd_submit_and_wait = true;
             }
         }
     }
 
-    if (bottom_blob.elempack != dst_elempack)
+    int ret;
+    if (cmd_submit_and_wait)
     {
-        Mat bottom_blob_packed;
-        convert_packing(bottom_blob, bottom_blob_packed, dst_elempack, opt);
-        bottom_blob = bottom_blob_packed;
+        ret = cmd.submit_and_wait();
+
+#if NCNN_BENCHMARK
+        std::vector<uint64_t> results(layer_index * 2);
+        cmd.get_query_pool_results(0, layer_index * 2, results);
+        for (int i = 0; i < layer_index; i++)
+        {
+            uint64_t start = results[i * 2];
+            uint64_t end = results[i * 2 + 1];
+            if (start == 0 || end == 0)
+                continue;
+
+            double duration_us = (end - start) * vkdev->info.timestamp_period() / 1000;
+            NCNN_LOGE("%-24s %-30s %8.2lfus    |", layers[i]->type.c_str(), layers[i]->name.c_str(), duration_us);
+        }
+#endif // NCNN_BENCHMARK
+
+        cmd.reset();
+        if (ret != 0)
+            return ret;
     }
 
-    if (bottom_blob.elembits() == 16)
+    if (layer->support_vulkan)
     {
-        // clang-format off
-        // *INDENT-OFF*
-
-#if NCNN_ARM82
-        if (opt.use_fp16_storage && cpu_support_arm_asimdhp() && !layer->support_fp16_storage)
+#if NCNN_BENCHMARK
+        cmd.record_write_timestamp(layer_index * 2);
+#endif
+        if (layer->featmask)
         {
-            Mat bottom_blob_fp32;
-            cast_float16_to_float32(bottom_blob, bottom_blob_fp32, opt);
-            bottom_blob = bottom_blob_fp32;
+            ret = do_forward_layer(layer, blob_mats_gpu, cmd, get_masked_option(opt, layer->featmask));
         }
         else
-#endif // NCNN_ARM82
-#if NCNN_RVV
-        if (opt.use_fp16_storage && cpu_support_riscv_v() && cpu_support_riscv_zfh() && !layer->support_fp16_storage)
         {
-            Mat bottom_blob_fp32;
-            cast_float16_to_float32(bottom_blob, bottom_blob_fp32, opt);
-            bottom_blob = bottom_blob_fp32;
+            ret = do_forward_layer(layer, blob_mats_gpu, cmd, opt);
+        }
+#if NCNN_BENCHMARK
+        cmd.record_write_timestamp(layer_index * 2 + 1);
+#endif
+    }
+    else
+    {
+#if NCNN_BENCHMARK
+        double start = get_current_time();
+        Mat bottom_blob;
+        if (layer->one_blob_only)
+        {
+            int bottom_blob_index = layer->bottoms[0];
+            bottom_blob = blob_mats[bottom_blob_index].shape();
+        }
+#endif
+        if (layer->featmask)
+        {
+            ret = do_forward_layer(layer, blob_mats, get_masked_option(opt, layer->featmask));
         }
         else
-#endif // NCNN_RVV
-#if NCNN_BF16
-        if (opt.use_bf16_storage && !layer->support_bf16_storage)
         {
-            Mat bottom_blob_fp32;
-            cast_bfloat16_to_float32(bottom_blob, bottom_blob_fp32, opt);
-            bottom_blob = bottom_blob_fp32;
+            ret = do_forward_layer(layer, blob_mats, opt);
         }
-#endif // NCNN_BF16
-
-        // *INDENT-ON*
-        // clang-format on
+#if NCNN_BENCHMARK
+        double end = get_current_time();
+        if (layer->one_blob_only)
+        {
+            int top_blob_index = layer->tops[0];
+            benchmark(layer, bottom_blob, blob_mats[top_blob_index], start, end);
+        }
+        else
+        {
+            benchmark(layer, start, end);
+        }
+#endif
     }
+    if (ret != 0)
+        return ret;
+
+    //     NCNN_LOGE("forward_layer %d %d %s done", layer->support_vulkan, layer_index, layer->name.c_str());
 
     return 0;
 }
 
-int NetPrivate::do_forward_layer(const Layer* layer, std::vector<Mat>& blob_mats, const Option& opt) const
+int NetPrivate::forward_layer(int layer_index, std::vector<Mat>& blob_mats, std::vector<VkMat>& blob_mats_gpu, std::vector<VkImageMat>& blob_mats_gpu_image, VkCompute& cmd, const Option& opt) const
 {
-    if (layer->one_blob_only)
-    {
-        int bottom_blob_index = layer->bottoms[0];
-        int top_blob_index = layer->tops[0];
+    const Layer* layer = layers[layer_index];
 
-        Mat& bottom_blob_ref = blob_mats[bottom_blob_index];
-        Mat bottom_blob;
+    //     NCNN_LOGE("forward_layer %d %d %s", layer->support_vulkan, layer_index, layer->name.c_str());
 
-        if (opt.lightmode)
-        {
-            // deep copy for inplace forward if data is shared
-            if (layer->support_inplace && *bottom_blob_ref.refcount != 1)
-            {
-                bottom_blob = bottom_blob_ref.clone(opt.blob_allocator);
-            }
-        }
-        if (bottom_blob.dims == 0)
-        {
-            bottom_blob = bottom_blob_ref;
-        }
+    bool cmd_submit_and_wait = false;
+    bool image_allocation_failed = false;
 
-        convert_layout(bottom_blob, layer, opt);
+IMAGE_ALLOCATION_FAILED:
 
-        // forward
-        if (opt.lightmode && layer->support_inplace)
-        {
-            Mat& bottom_top_blob = bottom_blob;
-            int ret = layer->forward_inplace(bottom_top_blob, opt);
-            if (ret != 0)
-                return ret;
+    if (image_allocation_failed)
+    {
+#if NCNN_STRING
+        NCNN_LOGE("forward_layer %d %s image allocation failed, fallback to cpu", layer_index, layer->name.c_str());
+#else
+        NCNN_LOGE("forward_layer %d image allocation failed, fallback to cpu", layer_index);
+#endif
+    }
 
-            // store top blob
-            blob_mats[top_blob_index] = bottom_top_blob;
-        }
-        else
+    // load bottom blobs
+    for (size_t i = 0; i < layer->bottoms.size(); i++)
+    {
+        int bottom_blob_index = layer->bottoms[i];
+
+        if (blob_mats_gpu_image[bottom_blob_index].dims == 0 && blob_mats_gpu[bottom_blob_index].dims == 0 && blob_mats[bottom_blob_index].dims == 0)
         {
-            Mat top_blob;
-            int ret = layer->forward(bottom_blob, top_blob, opt);
+            int ret = forward_layer(blobs[bottom_blob_index].producer, blob_mats, blob_mats_gpu, blob_mats_gpu_image, cmd, opt);
             if (ret != 0)
                 return ret;
-
-            // store top blob
-            blob_mats[top_blob_index] = top_blob;
         }
 
-        if (opt.lightmode)
-        {
-            // delete after taken in light mode
-            blob_mats[bottom_blob_index].release();
-        }
-    }
-    else
-    {
-        std::vector<Mat> bottom_blobs(layer->bottoms.size());
-        for (size_t i = 0; i < layer->bottoms.size(); i++)
+        if (layer->support_vulkan && !image_allocation_failed)
         {
-            int bottom_blob_index = layer->bottoms[i];
-
-            Mat& bottom_blob_ref = blob_mats[bottom_blob_index];
-            bottom_blobs[i].release();
-
-            if (opt.lightmode)
+            if (layer->support_image_storage)
             {
-                // deep copy for inplace forward if data is shared
+                if (blob_mats_gpu_image[bottom_blob_index].dims == 0)
+                {
+                    if (blob_mats_gpu[bottom_blob_index].dims == 0)
+                    {
+                        // host to image
+                        cmd.record_upload(blob_mats[bottom_blob_index], blob_mats_gpu_image[bottom_blob_index], opt);
+
+                        if (blob_mats_gpu_image[bottom_blob_index].empty())
+                        {
+                            image_allocation_failed = true;
+                            goto IMAGE_ALLOCATION_FAILED;
+                        }
+
+                        if (opt.lightmode)
+                        {
+                            // delete after taken in light mode
+                            blob_mats[bottom_blob_index].release();
+                        }
+                    }
+                    else
+                    {
+                        // buffer to image
+                        cmd.record_buffer_to_image(blob_mats_gpu[bottom_blob_index], blob_mats_gpu_image[bottom_blob_index], opt);
+
+                        if (blob_mats_gpu_image[bottom_blob_index].empty())
+                        {
+                            image_allocation_failed = true;
+                            goto IMAGE_ALLOCATION_FAILED;
+                        }
+
+                        if (opt.lightmode)
+                        {
+                            // delete after taken in light mode
+                            blob_mats_gpu[bottom_blob_index].release();
+                        }
+                    }
+                }
+            }
+            else
+            {
+                if (blob_mats_gpu[bottom_blob_index].dims == 0)
+                {
+                    if (blob_mats_gpu_image[bottom_blob_index].dims == 0)
+                    {
+                        // host to buffer
+                        cmd.record_upload(blob_mats[bottom_blob_index], blob_mats_gpu[bottom_blob_index], opt);
+
+                        if (opt.lightmode)
+                        {
+                            // delete after taken in light mode
+                            blob_mats[bottom_blob_index].release();
+                        }
+                    }
+                    else
+                    {
+                        // image to buffer
+                        cmd.record_image_to_buffer(blob_mats_gpu_image[bottom_blob_index], blob_mats_gpu[bottom_blob_index], opt);
+
+                        if (opt.lightmode)
+                        {
+                            // delete after taken in light mode
+                            blob_mats_gpu_image[bottom_blob_index].release();
+                        }
+                    }
+                }
+            }
+        }
+        else
+        {
+            if (blob_mats[bottom_blob_index].dims == 0)
+            {
+                if (blob_mats_gpu_image[bottom_blob_index].dims == 0)
+                {
+                    // buffer to host
+                    cmd.record_download(blob_mats_gpu[bottom_blob_index], blob_mats[bottom_blob_index], opt);
+
+                    if (opt.lightmode)
+                    {
+                        // delete after taken in light mode
+                        blob_mats_gpu[bottom_blob_index].release();
+                    }
+
+                    cmd_submit_and_wait = true;
+                }
+                else
+                {
+                    // image to host
+                    cmd.record_download(blob_mats_gpu_image[bottom_blob_index], blob_mats[bottom_blob_index], opt);
+
+                    if (opt.lightmode)
+                    {
+                        // delete after taken in light mode
+                        blob_mats_gpu_image[bottom_blob_index].release();
+                    }
+
+                    cmd_submit_and_wait = true;
+                }
+            }
+        }
+    }
+
+    int ret;
+    if (cmd_submit_and_wait)
+    {
+        ret = cmd.submit_and_wait();
+
+#if NCNN_BENCHMARK
+        std::vector<uint64_t> results(layer_index * 2);
+        cmd.get_query_pool_results(0, layer_index * 2, results);
+        for (int i = 0; i < layer_index; i++)
+        {
+            uint64_t start = results[i * 2];
+            uint64_t end = results[i * 2 + 1];
+            if (start == 0 || end == 0)
+                continue;
+
+            double duration_us = (end - start) * vkdev->info.timestamp_period() / 1000;
+            NCNN_LOGE("%-24s %-30s %8.2lfus    |", layers[i]->type.c_str(), layers[i]->name.c_str(), duration_us);
+        }
+#endif // NCNN_BENCHMARK
+
+        cmd.reset();
+
+        if (ret != 0)
+            return ret;
+    }
+
+    if (layer->support_vulkan && !image_allocation_failed)
+    {
+#if NCNN_BENCHMARK
+        cmd.record_write_timestamp(layer_index * 2);
+#endif
+        if (layer->support_image_storage)
+        {
+            if (layer->featmask)
+            {
+                ret = do_forward_layer(layer, blob_mats_gpu_image, cmd, get_masked_option(opt, layer->featmask));
+            }
+            else
+            {
+                ret = do_forward_layer(layer, blob_mats_gpu_image, cmd, opt);
+            }
+            if (ret == -100)
+            {
+                image_allocation_failed = true;
+                goto IMAGE_ALLOCATION_FAILED;
+            }
+        }
+        else
+        {
+            if (layer->featmask)
+            {
+                ret = do_forward_layer(layer, blob_mats_gpu, cmd, get_masked_option(opt, layer->featmask));
+            }
+            else
+            {
+                ret = do_forward_layer(layer, blob_mats_gpu, cmd, opt);
+            }
+        }
+#if NCNN_BENCHMARK
+        cmd.record_write_timestamp(layer_index * 2 + 1);
+#endif
+    }
+    else
+    {
+#if NCNN_BENCHMARK
+        double start = get_current_time();
+        Mat bottom_blob;
+        if (layer->one_blob_only)
+        {
+            int bottom_blob_index = layer->bottoms[0];
+            bottom_blob = blob_mats[bottom_blob_index].shape();
+        }
+#endif
+        if (layer->featmask)
+        {
+            ret = do_forward_layer(layer, blob_mats, get_masked_option(opt, layer->featmask));
+        }
+        else
+        {
+            ret = do_forward_layer(layer, blob_mats, opt);
+        }
+#if NCNN_BENCHMARK
+        double end = get_current_time();
+        if (layer->one_blob_only)
+        {
+            int top_blob_index = layer->tops[0];
+            benchmark(layer, bottom_blob, blob_mats[top_blob_index], start, end);
+        }
+        else
+        {
+            benchmark(layer, start, end);
+        }
+#endif
+    }
+    if (ret != 0)
+        return ret;
+
+    //     NCNN_LOGE("forward_layer %d %d %s done", layer->support_vulkan, layer_index, layer->name.c_str());
+
+    return 0;
+}
+#endif // NCNN_VULKAN
+
+int NetPrivate::convert_layout(Mat& bottom_blob, const Layer* layer, const Option& opt) const
+{
+    if (bottom_blob.elembits() == 32)
+    {
+        // clang-format off
+        // *INDENT-OFF*
+
+#if NCNN_ARM82
+        if (opt.use_fp16_storage && cpu_support_arm_asimdhp() && layer->support_fp16_storage)
+        {
+            Mat bottom_blob_fp16;
+            cast_float32_to_float16(bottom_blob, bottom_blob_fp16, opt);
+            bottom_blob = bottom_blob_fp16;
+        }
+        else
+#endif // NCNN_ARM82
+#if NCNN_RVV
+        if (opt.use_fp16_storage && cpu_support_riscv_v() && cpu_support_riscv_zfh() && layer->support_fp16_storage)
+        {
+            Mat bottom_blob_fp16;
+            cast_float32_to_float16(bottom_blob, bottom_blob_fp16, opt);
+            bottom_blob = bottom_blob_fp16;
+        }
+        else
+#endif // NCNN_RVV
+#if NCNN_BF16
+        if (opt.use_bf16_storage && layer->support_bf16_storage)
+        {
+            Mat bottom_blob_bf16;
+            cast_float32_to_bfloat16(bottom_blob, bottom_blob_bf16, opt);
+            bottom_blob = bottom_blob_bf16;
+        }
+#endif // NCNN_BF16
+
+        // *INDENT-ON*
+        // clang-format on
+    }
+
+    int dst_elempack = 1;
+    if (opt.use_packing_layout)
+    {
+        // resolve dst_elempack
+        int dims = bottom_blob.dims;
+        int elemcount = 0;
+        if (dims == 1) elemcount = bottom_blob.elempack * bottom_blob.w;
+        if (dims == 2) elemcount = bottom_blob.elempack * bottom_blob.h;
+        if (dims == 3 || dims == 4) elemcount = bottom_blob.elempack * bottom_blob.c;
+
+        int elembits = bottom_blob.elembits();
+
+        if (layer->support_packing)
+        {
+            if (elembits == 32)
+            {
+#if NCNN_AVX512
+                if (elemcount % 16 == 0 && ncnn::cpu_support_x86_avx512())
+                    dst_elempack = 16;
+                else if (elemcount % 8 == 0 && ncnn::cpu_support_x86_avx())
+                    dst_elempack = 8;
+                else if (elemcount % 4 == 0)
+                    dst_elempack = 4;
+#elif NCNN_AVX
+                if (elemcount % 8 == 0 && ncnn::cpu_support_x86_avx())
+                    dst_elempack = 8;
+                else if (elemcount % 4 == 0)
+                    dst_elempack = 4;
+#elif NCNN_RVV
+                const int packn = ncnn::cpu_riscv_vlenb() / 4;
+                if (elemcount % packn == 0)
+                    dst_elempack = packn;
+#else
+                if (elemcount % 4 == 0)
+                    dst_elempack = 4;
+#endif
+            }
+            if (elembits == 16)
+            {
+#if NCNN_ARM82
+                if (elemcount % 8 == 0 && ncnn::cpu_support_arm_asimdhp() && opt.use_fp16_arithmetic)
+                    dst_elempack = 8;
+                else if (elemcount % 4 == 0)
+                    dst_elempack = 4;
+#elif NCNN_RVV
+                const int packn = ncnn::cpu_riscv_vlenb() / 2;
+                if (elemcount % packn == 0)
+                    dst_elempack = packn;
+#else
+                if (elemcount % 4 == 0)
+                    dst_elempack = 4;
+#endif
+            }
+            if (elembits == 8)
+            {
+#if NCNN_RVV
+                const int packn = ncnn::cpu_riscv_vlenb() / 1;
+                if (elemcount % packn == 0)
+                    dst_elempack = packn;
+#else
+                if (elemcount % 8 == 0)
+                    dst_elempack = 8;
+#endif
+            }
+        }
+    }
+
+    if (bottom_blob.elempack != dst_elempack)
+    {
+        Mat bottom_blob_packed;
+        convert_packing(bottom_blob, bottom_blob_packed, dst_elempack, opt);
+        bottom_blob = bottom_blob_packed;
+    }
+
+    if (bottom_blob.elembits() == 16)
+    {
+        // clang-format off
+        // *INDENT-OFF*
+
+#if NCNN_ARM82
+        if (opt.use_fp16_storage && cpu_support_arm_asimdhp() && !layer->support_fp16_storage)
+        {
+            Mat bottom_blob_fp32;
+            cast_float16_to_float32(bottom_blob, bottom_blob_fp32, opt);
+            bottom_blob = bottom_blob_fp32;
+        }
+        else
+#endif // NCNN_ARM82
+#if NCNN_RVV
+        if (opt.use_fp16_storage && cpu_support_riscv_v() && cpu_support_riscv_zfh() && !layer->support_fp16_storage)
+        {
+            Mat bottom_blob_fp32;
+            cast_float16_to_float32(bottom_blob, bottom_blob_fp32, opt);
+            bottom_blob = bottom_blob_fp32;
+        }
+        else
+#endif // NCNN_RVV
+#if NCNN_BF16
+        if (opt.use_bf16_storage && !layer->support_bf16_storage)
+        {
+            Mat bottom_blob_fp32;
+            cast_bfloat16_to_float32(bottom_blob, bottom_blob_fp32, opt);
+            bottom_blob = bottom_blob_fp32;
+        }
+#endif // NCNN_BF16
+
+        // *INDENT-ON*
+        // clang-format on
+    }
+
+    return 0;
+}
+
+int NetPrivate::do_forward_layer(const Layer* layer, std::vector<Mat>& blob_mats, const Option& opt) const
+{
+    if (layer->one_blob_only)
+    {
+        int bottom_blob_index = layer->bottoms[0];
+        int top_blob_index = layer->tops[0];
+
+        Mat& bottom_blob_ref = blob_mats[bottom_blob_index];
+        Mat bottom_blob;
+
+        if (opt.lightmode)
+        {
+            // deep copy for inplace forward if data is shared
+            if (layer->support_inplace && *bottom_blob_ref.refcount != 1)
+            {
+                bottom_blob = bottom_blob_ref.clone(opt.blob_allocator);
+            }
+        }
+        if (bottom_blob.dims == 0)
+        {
+            bottom_blob = bottom_blob_ref;
+        }
+
+        convert_layout(bottom_blob, layer, opt);
+
+        // forward
+        if (opt.lightmode && layer->support_inplace)
+        {
+            Mat& bottom_top_blob = bottom_blob;
+            int ret = layer->forward_inplace(bottom_top_blob, opt);
+            if (ret != 0)
+                return ret;
+
+            // store top blob
+            blob_mats[top_blob_index] = bottom_top_blob;
+        }
+        else
+        {
+            Mat top_blob;
+            int ret = layer->forward(bottom_blob, top_blob, opt);
+            if (ret != 0)
+                return ret;
+
+            // store top blob
+            blob_mats[top_blob_index] = top_blob;
+        }
+
+        if (opt.lightmode)
+        {
+            // delete after taken in light mode
+            blob_mats[bottom_blob_index].release();
+        }
+    }
+    else
+    {
+        std::vector<Mat> bottom_blobs(layer->bottoms.size());
+        for (size_t i = 0; i < layer->bottoms.size(); i++)
+        {
+            int bottom_blob_index = layer->bottoms[i];
+
+            Mat& bottom_blob_ref = blob_mats[bottom_blob_index];
+            bottom_blobs[i].release();
+
+            if (opt.lightmode)
+            {
+                // deep copy for inplace forward if data is shared
+                if (layer->support_inplace && *bottom_blob_ref.refcount != 1)
+                {
+                    bottom_blobs[i] = bottom_blob_ref.clone(opt.blob_allocator);
+                }
+            }
+            if (bottom_blobs[i].dims == 0)
+            {
+                bottom_blobs[i] = bottom_blob_ref;
+            }
+
+            convert_layout(bottom_blobs[i], layer, opt);
+        }
+
+        // forward
+        if (opt.lightmode && layer->support_inplace)
+        {
+            std::vector<Mat>& bottom_top_blobs = bottom_blobs;
+            int ret = layer->forward_inplace(bottom_top_blobs, opt);
+            if (ret != 0)
+                return ret;
+
+            // store top blobs
+            for (size_t i = 0; i < layer->tops.size(); i++)
+            {
+                int top_blob_index = layer->tops[i];
+
+                blob_mats[top_blob_index] = bottom_top_blobs[i];
+            }
+        }
+        else
+        {
+            std::vector<Mat> top_blobs(layer->tops.size());
+            int ret = layer->forward(bottom_blobs, top_blobs, opt);
+            if (ret != 0)
+                return ret;
+
+            // store top blobs
+            for (size_t i = 0; i < layer->tops.size(); i++)
+            {
+                int top_blob_index = layer->tops[i];
+
+                blob_mats[top_blob_index] = top_blobs[i];
+            }
+        }
+
+        if (opt.lightmode)
+        {
+            for (size_t i = 0; i < layer->bottoms.size(); i++)
+            {
+                int bottom_blob_index = layer->bottoms[i];
+
+                // delete after taken in light mode
+                blob_mats[bottom_blob_index].release();
+            }
+        }
+    }
+
+    return 0;
+}
+
+#if NCNN_VULKAN
+int NetPrivate::do_forward_layer(const Layer* layer, std::vector<VkMat>& blob_mats_gpu, VkCompute& cmd, const Option& opt) const
+{
+    if (layer->one_blob_only)
+    {
+        // load bottom blob
+        int bottom_blob_index = layer->bottoms[0];
+        int top_blob_index = layer->tops[0];
+
+        VkMat& bottom_blob_ref = blob_mats_gpu[bottom_blob_index];
+        VkMat bottom_blob;
+
+        if (opt.lightmode)
+        {
+            // deep copy for inplace forward if data is shared
+            if (layer->support_inplace && *bottom_blob_ref.refcount != 1)
+            {
+                cmd.record_clone(bottom_blob_ref, bottom_blob, opt);
+                //                     NCNN_LOGE("clone %p[+%lu] %p[+%lu]", bottom_blob_ref.buffer(), bottom_blob_ref.buffer_offset(), bottom_blob.buffer(), bottom_blob.buffer_offset());
+            }
+        }
+        if (bottom_blob.dims == 0)
+        {
+            bottom_blob = bottom_blob_ref;
+        }
+
+        // forward
+        if (opt.lightmode && layer->support_inplace)
+        {
+            VkMat& bottom_top_blob = bottom_blob;
+            int ret = layer->forward_inplace(bottom_top_blob, cmd, opt);
+            if (ret != 0)
+                return ret;
+
+            // store top blob
+            blob_mats_gpu[top_blob_index] = bottom_top_blob;
+        }
+        else
+        {
+            VkMat top_blob;
+            int ret = layer->forward(bottom_blob, top_blob, cmd, opt);
+            if (ret != 0)
+                return ret;
+
+            // store top blob
+            blob_mats_gpu[top_blob_index] = top_blob;
+        }
+
+        if (opt.lightmode)
+        {
+            // delete after taken in light mode
+            blob_mats_gpu[bottom_blob_index].release();
+        }
+    }
+    else
+    {
+        // load bottom blobs
+        std::vector<VkMat> bottom_blobs(layer->bottoms.size());
+        for (size_t i = 0; i < layer->bottoms.size(); i++)
+        {
+            int bottom_blob_index = layer->bottoms[i];
+
+            VkMat& bottom_blob_ref = blob_mats_gpu[bottom_blob_index];
+            bottom_blobs[i].release();
+
+            if (opt.lightmode)
+            {
+                // deep copy for inplace forward if data is shared
+                if (layer->support_inplace && *bottom_blob_ref.refcount != 1)
+                {
+                    cmd.record_clone(bottom_blob_ref, bottom_blobs[i], opt);
+                    //                         NCNN_LOGE("clone %p[+%lu] %p[+%lu]", bottom_blob_ref.buffer(), bottom_blob_ref.buffer_offset(), bottom_blobs[i].buffer(), bottom_blobs[i].buffer_offset());
+                }
+            }
+            if (bottom_blobs[i].dims == 0)
+            {
+                bottom_blobs[i] = bottom_blob_ref;
+            }
+        }
+
+        // forward
+        if (opt.lightmode && layer->support_inplace)
+        {
+            std::vector<VkMat>& bottom_top_blobs = bottom_blobs;
+            int ret = layer->forward_inplace(bottom_top_blobs, cmd, opt);
+            if (ret != 0)
+                return ret;
+
+            // store top blobs
+            for (size_t i = 0; i < layer->tops.size(); i++)
+            {
+                int top_blob_index = layer->tops[i];
+
+                blob_mats_gpu[top_blob_index] = bottom_top_blobs[i];
+            }
+        }
+        else
+        {
+            std::vector<VkMat> top_blobs(layer->tops.size());
+            int ret = layer->forward(bottom_blobs, top_blobs, cmd, opt);
+            if (ret != 0)
+                return ret;
+
+            // store top blobs
+            for (size_t i = 0; i < layer->tops.size(); i++)
+            {
+                int top_blob_index = layer->tops[i];
+
+                blob_mats_gpu[top_blob_index] = top_blobs[i];
+            }
+        }
+
+        if (opt.lightmode)
+        {
+            for (size_t i = 0; i < layer->bottoms.size(); i++)
+            {
+                int bottom_blob_index = layer->bottoms[i];
+
+                // delete after taken in light mode
+                blob_mats_gpu[bottom_blob_index].release();
+            }
+        }
+    }
+
+    return 0;
+}
+
+int NetPrivate::do_forward_layer(const Layer* layer, std::vector<VkImageMat>& blob_mats_gpu_image, VkCompute& cmd, const Option& opt) const
+{
+    if (layer->one_blob_only)
+    {
+        // load bottom blob
+        int bottom_blob_index = layer->bottoms[0];
+        int top_blob_index = layer->tops[0];
+
+        VkImageMat& bottom_blob_ref = blob_mats_gpu_image[bottom_blob_index];
+        VkImageMat bottom_blob;
+
+        if (opt.lightmode)
+        {
+            // deep copy for inplace forward if data is shared
+            if (layer->support_inplace && *bottom_blob_ref.refcount != 1)
+            {
+                cmd.record_clone(bottom_blob_ref, bottom_blob, opt);
+                //                         NCNN_LOGE("clone %p[+%lu] %p[+%lu]", bottom_blob_ref.buffer(), bottom_blob_ref.buffer_offset(), bottom_blob.buffer(), bottom_blob.buffer_offset());
+            }
+        }
+        if (bottom_blob.dims == 0)
+        {
+            bottom_blob = bottom_blob_ref;
+        }
+
+        // forward
+        if (opt.lightmode && layer->support_inplace)
+        {
+            VkImageMat& bottom_top_blob = bottom_blob;
+            int ret = layer->forward_inplace(bottom_top_blob, cmd, opt);
+            if (ret != 0)
+                return ret;
+
+            // store top blob
+            blob_mats_gpu_image[top_blob_index] = bottom_top_blob;
+        }
+        else
+        {
+            VkImageMat top_blob;
+            int ret = layer->forward(bottom_blob, top_blob, cmd, opt);
+            if (ret != 0)
+                return ret;
+
+            // store top blob
+            blob_mats_gpu_image[top_blob_index] = top_blob;
+        }
+
+        if (opt.lightmode)
+        {
+            // delete after taken in light mode
+            blob_mats_gpu_image[bottom_blob_index].release();
+        }
+    }
+    else
+    {
+        // load bottom blobs
+        std::vector<VkImageMat> bottom_blobs(layer->bottoms.size());
+        for (size_t i = 0; i < layer->bottoms.size(); i++)
+        {
+            int bottom_blob_index = layer->bottoms[i];
+
+            VkImageMat& bottom_blob_ref = blob_mats_gpu_image[bottom_blob_index];
+
+            if (opt.lightmode)
+            {
+                // deep copy for inplace forward if data is shared
                 if (layer->support_inplace && *bottom_blob_ref.refcount != 1)
                 {
-                    bottom_blobs[i] = bottom_blob_ref.clone(opt.blob_allocator);
+                    cmd.record_clone(bottom_blob_ref, bottom_blobs[i], opt);
+                    //                             NCNN_LOGE("clone %p[+%lu] %p[+%lu]", bottom_blob_ref.buffer(), bottom_blob_ref.buffer_offset(), bottom_blobs[i].buffer(), bottom_blobs[i].buffer_offset());
+                }
+            }
+            if (bottom_blobs[i].dims == 0)
+            {
+                bottom_blobs[i] = bottom_blob_ref;
+            }
+        }
+
+        // forward
+        if (opt.lightmode && layer->support_inplace)
+        {
+            std::vector<VkImageMat>& bottom_top_blobs = bottom_blobs;
+            int ret = layer->forward_inplace(bottom_top_blobs, cmd, opt);
+            if (ret != 0)
+                return ret;
+
+            // store top blobs
+            for (size_t i = 0; i < layer->tops.size(); i++)
+            {
+                int top_blob_index = layer->tops[i];
+
+                blob_mats_gpu_image[top_blob_index] = bottom_top_blobs[i];
+            }
+        }
+        else
+        {
+            std::vector<VkImageMat> top_blobs(layer->tops.size());
+            int ret = layer->forward(bottom_blobs, top_blobs, cmd, opt);
+            if (ret != 0)
+                return ret;
+
+            // store top blobs
+            for (size_t i = 0; i < layer->tops.size(); i++)
+            {
+                int top_blob_index = layer->tops[i];
+
+                blob_mats_gpu_image[top_blob_index] = top_blobs[i];
+            }
+        }
+
+        if (opt.lightmode)
+        {
+            for (size_t i = 0; i < layer->bottoms.size(); i++)
+            {
+                int bottom_blob_index = layer->bottoms[i];
+
+                // delete after taken in light mode
+                blob_mats_gpu_image[bottom_blob_index].release();
+            }
+        }
+    }
+
+    return 0;
+}
+#endif // NCNN_VULKAN
+
+void NetPrivate::update_input_output_indexes()
+{
+    input_blob_indexes.clear();
+    output_blob_indexes.clear();
+
+    for (size_t i = 0; i < layers.size(); i++)
+    {
+        if (layers[i]->typeindex == LayerType::Input)
+        {
+            int blob_index = layers[i]->tops[0];
+            input_blob_indexes.push_back(blob_index);
+        }
+    }
+
+    for (size_t i = 0; i < blobs.size(); i++)
+    {
+        if (blobs[i].producer != -1 && blobs[i].consumer == -1)
+        {
+            output_blob_indexes.push_back(i);
+        }
+    }
+}
+
+#if NCNN_STRING
+void NetPrivate::update_input_output_names()
+{
+    input_blob_names.clear();
+    output_blob_names.clear();
+
+    for (size_t i = 0; i < input_blob_indexes.size(); i++)
+    {
+        int blob_index = input_blob_indexes[i];
+        input_blob_names.push_back(blobs[blob_index].name.c_str());
+    }
+
+    for (size_t i = 0; i < output_blob_indexes.size(); i++)
+    {
+        int blob_index = output_blob_indexes[i];
+        output_blob_names.push_back(blobs[blob_index].name.c_str());
+    }
+}
+#endif // NCNN_STRING
+
+Net::Net()
+    : d(new NetPrivate(opt))
+{
+}
+
+Net::~Net()
+{
+    clear();
+
+    delete d;
+}
+
+Net::Net(const Net&)
+    : d(0)
+{
+}
+
+Net& Net::operator=(const Net&)
+{
+    return *this;
+}
+
+#if NCNN_STRING
+int Net::register_custom_layer(const char* type, layer_creator_func creator, layer_destroyer_func destroyer, void* userdata)
+{
+    int typeindex = layer_to_index(type);
+    if (typeindex != -1)
+    {
+        NCNN_LOGE("overwrite built-in layer type %s", type);
+
+        for (size_t i = 0; i < d->overwrite_builtin_layer_registry.size(); i++)
+        {
+            if (d->overwrite_builtin_layer_registry[i].typeindex == typeindex)
+            {
+                NCNN_LOGE("overwrite existing overwritten built-in layer index %d", typeindex);
+
+                d->overwrite_builtin_layer_registry[i].creator = creator;
+                d->overwrite_builtin_layer_registry[i].destroyer = destroyer;
+                d->overwrite_builtin_layer_registry[i].userdata = userdata;
+                return 0;
+            }
+        }
+
+        struct overwrite_builtin_layer_registry_entry entry = {typeindex, creator, destroyer, userdata};
+        d->overwrite_builtin_layer_registry.push_back(entry);
+        return 0;
+    }
+
+    int custom_index = custom_layer_to_index(type);
+    if (custom_index == -1)
+    {
+        struct custom_layer_registry_entry entry = {type, creator, destroyer, userdata};
+        d->custom_layer_registry.push_back(entry);
+    }
+    else
+    {
+        NCNN_LOGE("overwrite existing custom layer type %s", type);
+        d->custom_layer_registry[custom_index].name = type;
+        d->custom_layer_registry[custom_index].creator = creator;
+        d->custom_layer_registry[custom_index].destroyer = destroyer;
+        d->custom_layer_registry[custom_index].userdata = userdata;
+    }
+
+    return 0;
+}
+#endif // NCNN_STRING
+
+int Net::register_custom_layer(int index, layer_creator_func creator, layer_destroyer_func destroyer, void* userdata)
+{
+    int custom_index = index & ~LayerType::CustomBit;
+    if (index == custom_index)
+    {
+        NCNN_LOGE("overwrite built-in layer type %d", index);
+
+        for (size_t i = 0; i < d->overwrite_builtin_layer_registry.size(); i++)
+        {
+            if (d->overwrite_builtin_layer_registry[i].typeindex == index)
+            {
+                NCNN_LOGE("overwrite existing overwritten built-in layer index %d", index);
+
+                d->overwrite_builtin_layer_registry[i].creator = creator;
+                d->overwrite_builtin_layer_registry[i].destroyer = destroyer;
+                d->overwrite_builtin_layer_registry[i].userdata = userdata;
+                return 0;
+            }
+        }
+
+        struct overwrite_builtin_layer_registry_entry entry = {index, creator, destroyer, userdata};
+        d->overwrite_builtin_layer_registry.push_back(entry);
+        return 0;
+    }
+
+    if ((int)d->custom_layer_registry.size() <= custom_index)
+    {
+#if NCNN_STRING
+        struct custom_layer_registry_entry dummy = {"", 0, 0, 0};
+#else
+        struct custom_layer_registry_entry dummy = {0, 0, 0};
+#endif // NCNN_STRING
+        d->custom_layer_registry.resize(custom_index + 1, dummy);
+    }
+
+    if (d->custom_layer_registry[custom_index].creator)
+    {
+        NCNN_LOGE("overwrite existing custom layer index %d", custom_index);
+    }
+
+    d->custom_layer_registry[custom_index].creator = creator;
+    d->custom_layer_registry[custom_index].destroyer = destroyer;
+    d->custom_layer_registry[custom_index].userdata = userdata;
+    return 0;
+}
+
+#if NCNN_STRING
+int Net::load_param(const DataReader& dr)
+{
+#define SCAN_VALUE(fmt, v)                \
+    if (dr.scan(fmt, &v) != 1)            \
+    {                                     \
+        NCNN_LOGE("parse " #v " failed"); \
+        return -1;                        \
+    }
+
+    int magic = 0;
+    SCAN_VALUE("%d", magic)
+    if (magic != 7767517)
+    {
+        NCNN_LOGE("param is too old, please regenerate");
+        return -1;
+    }
+
+    // parse
+    int layer_count = 0;
+    int blob_count = 0;
+    SCAN_VALUE("%d", layer_count)
+    SCAN_VALUE("%d", blob_count)
+    if (layer_count <= 0 || blob_count <= 0)
+    {
+        NCNN_LOGE("invalid layer_count or blob_count");
+        return -1;
+    }
+
+    d->layers.resize((size_t)layer_count);
+    d->layer_overwritten.resize((size_t)layer_count, 0);
+    d->blobs.resize((size_t)blob_count);
+
+#if NCNN_VULKAN
+    // TODO enable gpu when bf16 conversion implemented
+    if (opt.use_bf16_storage)
+        opt.use_vulkan_compute = false;
+
+    if (opt.use_vulkan_compute)
+    {
+        if (!d->vkdev) d->vkdev = get_gpu_device();
+        if (!d->vkdev) opt.use_vulkan_compute = false; // no vulkan device, fallback to cpu
+    }
+    if (opt.use_vulkan_compute)
+    {
+        // sanitize use options
+        if (!d->vkdev->info.support_fp16_packed()) opt.use_fp16_packed = false;
+        if (!d->vkdev->info.support_fp16_storage()) opt.use_fp16_storage = false;
+        if (!d->vkdev->info.support_fp16_uniform()) opt.use_fp16_uniform = false;
+        if (!d->vkdev->info.support_fp16_arithmetic()) opt.use_fp16_arithmetic = false;
+        if (!d->vkdev->info.support_int8_packed()) opt.use_int8_packed = false;
+        if (!d->vkdev->info.support_int8_storage()) opt.use_int8_storage = false;
+        if (!d->vkdev->info.support_int8_uniform()) opt.use_int8_uniform = false;
+        if (!d->vkdev->info.support_int8_arithmetic()) opt.use_int8_arithmetic = false;
+        if (!d->vkdev->info.support_cooperative_matrix()) opt.use_cooperative_matrix = false;
+
+        if (d->vkdev->info.bug_buffer_image_load_zero()) opt.use_image_storage = false;
+
+        // enable local memory optimization on discrete gpu only
+        if (d->vkdev->info.type() != 0) opt.use_shader_local_memory = false;
+
+        // fp16a makes no sense when fp16 storage disabled
+        if (!opt.use_fp16_packed && !opt.use_fp16_storage) opt.use_fp16_arithmetic = false;
+
+        // fp16 uniform makes no sense when fp16 arithmetic disabled
+        if (!opt.use_fp16_arithmetic) opt.use_fp16_uniform = false;
+    }
+    else
+    {
+        // fp16a makes no sense when fp16 storage disabled
+        if (!opt.use_fp16_storage) opt.use_fp16_arithmetic = false;
+    }
+#endif // NCNN_VULKAN
+
+    ParamDict pd;
+
+    int blob_index = 0;
+    for (int i = 0; i < layer_count; i++)
+    {
+        char layer_type[256];
+        char layer_name[256];
+        int bottom_count = 0;
+        int top_count = 0;
+        SCAN_VALUE("%255s", layer_type)
+        SCAN_VALUE("%255s", layer_name)
+        SCAN_VALUE("%d", bottom_count)
+        SCAN_VALUE("%d", top_count)
+
+        Layer* layer = create_overwrite_builtin_layer(layer_type);
+        bool overwritten = layer != 0;
+#if NCNN_VULKAN
+        if (!layer && opt.use_vulkan_compute && d->vkdev)
+        {
+            layer = create_layer_vulkan(layer_type);
+        }
+#endif // NCNN_VULKAN
+        if (!layer)
+        {
+            layer = create_layer_cpu(layer_type);
+        }
+        if (!layer)
+        {
+            layer = create_custom_layer(layer_type);
+        }
+        if (!layer)
+        {
+            NCNN_LOGE("layer %s not exists or registered", layer_type);
+            clear();
+            return -1;
+        }
+
+#if NCNN_VULKAN
+        if (opt.use_vulkan_compute)
+            layer->vkdev = d->vkdev;
+#endif // NCNN_VULKAN
+
+        layer->type = std::string(layer_type);
+        layer->name = std::string(layer_name);
+        //         NCNN_LOGE("new layer %d %s", i, layer_name);
+
+        layer->bottoms.resize(bottom_count);
+        for (int j = 0; j < bottom_count; j++)
+        {
+            char bottom_name[256];
+            SCAN_VALUE("%255s", bottom_name)
+
+            int bottom_blob_index = find_blob_index_by_name(bottom_name);
+            if (bottom_blob_index == -1)
+            {
+                Blob& blob = d->blobs[blob_index];
+
+                bottom_blob_index = blob_index;
+
+                blob.name = std::string(bottom_name);
+                //                 NCNN_LOGE("new blob %s", bottom_name);
+
+                blob_index++;
+            }
+
+            Blob& blob = d->blobs[bottom_blob_index];
+
+            blob.consumer = i;
+
+            layer->bottoms[j] = bottom_blob_index;
+        }
+
+        layer->tops.resize(top_count);
+        for (int j = 0; j < top_count; j++)
+        {
+            Blob& blob = d->blobs[blob_index];
+
+            char blob_name[256];
+            SCAN_VALUE("%255s", blob_name)
+
+            blob.name = std::string(blob_name);
+            //             NCNN_LOGE("new blob %s", blob_name);
+
+            blob.producer = i;
+
+            layer->tops[j] = blob_index;
+
+            blob_index++;
+        }
+
+        int layer_support_vulkan = layer->support_vulkan;
+
+        // layer specific params
+        int pdlr = pd.load_param(dr);
+        if (pdlr != 0)
+        {
+            NCNN_LOGE("ParamDict load_param %d %s failed", i, layer_name);
+            continue;
+        }
+
+        // pull out top shape hints
+        Mat shape_hints = pd.get(30, Mat());
+        if (!shape_hints.empty())
+        {
+            const int* psh = shape_hints;
+            for (int j = 0; j < top_count; j++)
+            {
+                Blob& blob = d->blobs[layer->tops[j]];
+
+                int dims = psh[0];
+                if (dims == 1)
+                {
+                    blob.shape = Mat(psh[1], (void*)0, 4u, 1);
                 }
+                if (dims == 2)
+                {
+                    blob.shape = Mat(psh[1], psh[2], (void*)0, 4u, 1);
+                }
+                if (dims == 3)
+                {
+                    blob.shape = Mat(psh[1], psh[2], psh[3], (void*)0, 4u, 1);
+                }
+
+                psh += 4;
             }
-            if (bottom_blobs[i].dims == 0)
-            {
-                bottom_blobs[i] = bottom_blob_ref;
-            }
+        }
 
-            convert_layout(bottom_blobs[i], layer, opt);
+        // set bottom and top shape hints
+        layer->bottom_shapes.resize(bottom_count);
+        for (int j = 0; j < bottom_count; j++)
+        {
+            layer->bottom_shapes[j] = d->blobs[layer->bottoms[j]].shape;
         }
 
-        // forward
-        if (opt.lightmode && layer->support_inplace)
+        layer->top_shapes.resize(top_count);
+        for (int j = 0; j < top_count; j++)
         {
-            std::vector<Mat>& bottom_top_blobs = bottom_blobs;
-            int ret = layer->forward_inplace(bottom_top_blobs, opt);
-            if (ret != 0)
-                return ret;
+            layer->top_shapes[j] = d->blobs[layer->tops[j]].shape;
+        }
 
-            // store top blobs
-            for (size_t i = 0; i < layer->tops.size(); i++)
-            {
-                int top_blob_index = layer->tops[i];
+        // pull out layer specific feature disabled set
+        layer->featmask = pd.get(31, 0);
 
-                blob_mats[top_blob_index] = bottom_top_blobs[i];
-            }
-        }
-        else
+        int lr = layer->load_param(pd);
+        if (lr != 0)
         {
-            std::vector<Mat> top_blobs(layer->tops.size());
-            int ret = layer->forward(bottom_blobs, top_blobs, opt);
-            if (ret != 0)
-                return ret;
+            NCNN_LOGE("layer load_param %d %s failed", i, layer_name);
+            continue;
+        }
 
-            // store top blobs
-            for (size_t i = 0; i < layer->tops.size(); i++)
-            {
-                int top_blob_index = layer->tops[i];
+        if (layer->support_int8_storage)
+        {
+            // no int8 gpu support yet
+            opt.use_vulkan_compute = false;
+        }
 
-                blob_mats[top_blob_index] = top_blobs[i];
-            }
+        Option opt1 = get_masked_option(opt, layer->featmask);
+#if NCNN_VULKAN
+        if (opt1.use_vulkan_compute)
+        {
+            if (!layer->support_image_storage) opt1.use_image_storage = false;
         }
+#endif // NCNN_VULKAN
 
-        if (opt.lightmode)
+        if (layer_support_vulkan && (!layer->support_vulkan || !opt1.use_vulkan_compute))
         {
-            for (size_t i = 0; i < layer->bottoms.size(); i++)
+            // vulkan layer cannot handle these param, recreate cpu layer
+            Layer* layer_cpu = create_overwrite_builtin_layer(layer_type);
+            overwritten = layer_cpu != 0;
+            if (!layer_cpu)
             {
-                int bottom_blob_index = layer->bottoms[i];
+                layer_cpu = create_layer_cpu(layer_type);
+            }
+            if (!layer_cpu)
+            {
+                layer_cpu = create_custom_layer(layer_type);
+            }
+            if (!layer_cpu)
+            {
+                NCNN_LOGE("layer %s not exists or registered", layer_type);
+                clear();
+                return -1;
+            }
 
-                // delete after taken in light mode
-                blob_mats[bottom_blob_index].release();
+            layer_cpu->type = layer->type;
+            layer_cpu->name = layer->name;
+            layer_cpu->bottoms = layer->bottoms;
+            layer_cpu->tops = layer->tops;
+            layer_cpu->bottom_shapes = layer->bottom_shapes;
+            layer_cpu->top_shapes = layer->top_shapes;
+            layer_cpu->featmask = layer->featmask;
+
+            int lr = layer_cpu->load_param(pd);
+            if (lr != 0)
+            {
+                NCNN_LOGE("layer load_param %d %s failed", i, layer_name);
+                continue;
             }
+
+            delete layer;
+            layer = layer_cpu;
         }
+
+        d->layers[i] = layer;
+        d->layer_overwritten[i] = overwritten;
     }
 
+    d->update_input_output_indexes();
+    d->update_input_output_names();
+    d->update_layer_schedules();
+
+#undef SCAN_VALUE
     return 0;
 }
+#endif // NCNN_STRING
 
-#if NCNN_VULKAN
-int NetPrivate::do_forward_layer(const Layer* layer, std::vector<VkMat>& blob_mats_gpu, VkCompute& cmd, const Option& opt) const
+int Net::load_param_bin(const DataReader& dr)
 {
-    if (layer->one_blob_only)
+#if __BIG_ENDIAN__
+#define READ_VALUE(buf)                            \
+    if (dr.read(&buf, sizeof(buf)) != sizeof(buf)) \
+    {                                              \
+        NCNN_LOGE("read " #buf " failed");         \
+        return -1;                                 \
+    }                                              \
+    if (sizeof(buf) == 2)                          \
+        swap_endianness_16(&buf);                  \
+    if (sizeof(buf) == 4)                          \
+        swap_endianness_32(&buf);
+#else
+#define READ_VALUE(buf)                            \
+    if (dr.read(&buf, sizeof(buf)) != sizeof(buf)) \
+    {                                              \
+        NCNN_LOGE("read " #buf " failed");         \
+        return -1;                                 \
+    }
+#endif
+
+    int magic = 0;
+    READ_VALUE(magic)
+    if (magic != 7767517)
     {
-        // load bottom blob
-        int bottom_blob_index = layer->bottoms[0];
-        int top_blob_index = layer->tops[0];
+        NCNN_LOGE("param is too old, please regenerate");
+        return -1;
+    }
 
-        VkMat& bottom_blob_ref = blob_mats_gpu[bottom_blob_index];
-        VkMat bottom_blob;
+    int layer_count = 0;
+    int blob_count = 0;
+    READ_VALUE(layer_count)
+    READ_VALUE(blob_count)
+    if (layer_count <= 0 || blob_count <= 0)
+    {
+        NCNN_LOGE("invalid layer_count or blob_count");
+        return -1;
+    }
 
-        if (opt.lightmode)
-        {
-            // deep copy for inplace forward if data is shared
-            if (layer->support_inplace && *bottom_blob_ref.refcount != 1)
-            {
-                cmd.record_clone(bottom_blob_ref, bottom_blob, opt);
-                //                     NCNN_LOGE("clone %p[+%lu] %p[+%lu]", bottom_blob_ref.buffer(), bottom_blob_ref.buffer_offset(), bottom_blob.buffer(), bottom_blob.buffer_offset());
-            }
-        }
-        if (bottom_blob.dims == 0)
-        {
-            bottom_blob = bottom_blob_ref;
-        }
+    d->layers.resize(layer_count);
+    d->layer_overwritten.resize(layer_count, 0);
+    d->blobs.resize(blob_count);
 
-        // forward
-        if (opt.lightmode && layer->support_inplace)
-        {
-            VkMat& bottom_top_blob = bottom_blob;
-            int ret = layer->forward_inplace(bottom_top_blob, cmd, opt);
-            if (ret != 0)
-                return ret;
+#if NCNN_VULKAN
+    // TODO enable gpu when bf16 conversion implemented
+    if (opt.use_bf16_storage)
+        opt.use_vulkan_compute = false;
 
-            // store top blob
-            blob_mats_gpu[top_blob_index] = bottom_top_blob;
+    if (opt.use_vulkan_compute)
+    {
+        if (!d->vkdev) d->vkdev = get_gpu_device();
+        if (!d->vkdev) opt.use_vulkan_compute = false; // no vulkan device, fallback to cpu
+    }
+    if (opt.use_vulkan_compute)
+    {
+        // sanitize use options
+        if (!d->vkdev->info.support_fp16_packed()) opt.use_fp16_packed = false;
+        if (!d->vkdev->info.support_fp16_storage()) opt.use_fp16_storage = false;
+        if (!d->vkdev->info.support_fp16_uniform()) opt.use_fp16_uniform = false;
+        if (!d->vkdev->info.support_fp16_arithmetic()) opt.use_fp16_arithmetic = false;
+        if (!d->vkdev->info.support_int8_packed()) opt.use_int8_packed = false;
+        if (!d->vkdev->info.support_int8_storage()) opt.use_int8_storage = false;
+        if (!d->vkdev->info.support_int8_uniform()) opt.use_int8_uniform = false;
+        if (!d->vkdev->info.support_int8_arithmetic()) opt.use_int8_arithmetic = false;
+        if (!d->vkdev->info.support_cooperative_matrix()) opt.use_cooperative_matrix = false;
+
+        if (d->vkdev->info.bug_buffer_image_load_zero()) opt.use_image_storage = false;
+
+        // enable local memory optimization on discrete gpu only
+        if (d->vkdev->info.type() != 0) opt.use_shader_local_memory = false;
+
+        // fp16a makes no sense when fp16 storage disabled
+        if (!opt.use_fp16_packed && !opt.use_fp16_storage) opt.use_fp16_arithmetic = false;
+
+        // fp16 uniform makes no sense when fp16 arithmetic disabled
+        if (!opt.use_fp16_arithmetic) opt.use_fp16_uniform = false;
+    }
+    else
+    {
+        // fp16a makes no sense when fp16 storage disabled
+        if (!opt.use_fp16_storage) opt.use_fp16_arithmetic = false;
+    }
+#endif // NCNN_VULKAN
+
+    ParamDict pd;
+
+    for (int i = 0; i < layer_count; i++)
+    {
+        int typeindex;
+        int bottom_count;
+        int top_count;
+        READ_VALUE(typeindex)
+        READ_VALUE(bottom_count)
+        READ_VALUE(top_count)
+
+        Layer* layer = create_overwrite_builtin_layer(typeindex);
+        bool overwritten = layer != 0;
+#if NCNN_VULKAN
+        if (!layer && opt.use_vulkan_compute && d->vkdev)
+        {
+            layer = create_layer_vulkan(typeindex);
         }
-        else
+#endif // NCNN_VULKAN
+        if (!layer)
         {
-            VkMat top_blob;
-            int ret = layer->forward(bottom_blob, top_blob, cmd, opt);
-            if (ret != 0)
-                return ret;
-
-            // store top blob
-            blob_mats_gpu[top_blob_index] = top_blob;
+            layer = create_layer_cpu(typeindex);
         }
-
-        if (opt.lightmode)
+        if (!layer)
         {
-            // delete after taken in light mode
-            blob_mats_gpu[bottom_blob_index].release();
+            int custom_index = typeindex & ~LayerType::CustomBit;
+            layer = create_custom_layer(custom_index);
         }
-    }
-    else
-    {
-        // load bottom blobs
-        std::vector<VkMat> bottom_blobs(layer->bottoms.size());
-        for (size_t i = 0; i < layer->bottoms.size(); i++)
+        if (!layer)
         {
-            int bottom_blob_index = layer->bottoms[i];
+            NCNN_LOGE("layer %d not exists or registered", typeindex);
+            clear();
+            return -1;
+        }
 
-            VkMat& bottom_blob_ref = blob_mats_gpu[bottom_blob_index];
-            bottom_blobs[i].release();
+#if NCNN_VULKAN
+        if (opt.use_vulkan_compute)
+            layer->vkdev = d->vkdev;
+#endif // NCNN_VULKAN
 
-            if (opt.lightmode)
-            {
-                // deep copy for inplace forward if data is shared
-                if (layer->support_inplace && *bottom_blob_ref.refcount != 1)
-                {
-                    cmd.record_clone(bottom_blob_ref, bottom_blobs[i], opt);
-                    //                         NCNN_LOGE("clone %p[+%lu] %p[+%lu]", bottom_blob_ref.buffer(), bottom_blob_ref.buffer_offset(), bottom_blobs[i].buffer(), bottom_blobs[i].buffer_offset());
-                }
-            }
-            if (bottom_blobs[i].dims == 0)
-            {
-                bottom_blobs[i] = bottom_blob_ref;
-            }
-        }
+        //         layer->type = std::string(layer_type);
+        //         layer->name = std::string(layer_name);
+        //         NCNN_LOGE("new layer %d", typeindex);
 
-        // forward
-        if (opt.lightmode && layer->support_inplace)
+        layer->bottoms.resize(bottom_count);
+        for (int j = 0; j < bottom_count; j++)
         {
-            std::vector<VkMat>& bottom_top_blobs = bottom_blobs;
-            int ret = layer->forward_inplace(bottom_top_blobs, cmd, opt);
-            if (ret != 0)
-                return ret;
+            int bottom_blob_index;
+            READ_VALUE(bottom_blob_index)
 
-            // store top blobs
-            for (size_t i = 0; i < layer->tops.size(); i++)
-            {
-                int top_blob_index = layer->tops[i];
+            Blob& blob = d->blobs[bottom_blob_index];
 
-                blob_mats_gpu[top_blob_index] = bottom_top_blobs[i];
-            }
+            blob.consumer = i;
+
+            layer->bottoms[j] = bottom_blob_index;
         }
-        else
+
+        layer->tops.resize(top_count);
+        for (int j = 0; j < top_count; j++)
         {
-            std::vector<VkMat> top_blobs(layer->tops.size());
-            int ret = layer->forward(bottom_blobs, top_blobs, cmd, opt);
-            if (ret != 0)
-                return ret;
+            int top_blob_index;
+            READ_VALUE(top_blob_index)
 
-            // store top blobs
-            for (size_t i = 0; i < layer->tops.size(); i++)
-            {
-                int top_blob_index = layer->tops[i];
+            Blob& blob = d->blobs[top_blob_index];
 
-                blob_mats_gpu[top_blob_index] = top_blobs[i];
-            }
-        }
+            //             blob.name = std::string(blob_name);
+            //             NCNN_LOGE("new blob %s", blob_name);
 
-        if (opt.lightmode)
-        {
-            for (size_t i = 0; i < layer->bottoms.size(); i++)
-            {
-                int bottom_blob_index = layer->bottoms[i];
+            blob.producer = i;
 
-                // delete after taken in light mode
-                blob_mats_gpu[bottom_blob_index].release();
-            }
+            layer->tops[j] = top_blob_index;
         }
-    }
-
-    return 0;
-}
 
-int NetPrivate::do_forward_layer(const Layer* layer, std::vector<VkImageMat>& blob_mats_gpu_image, VkCompute& cmd, const Option& opt) const
-{
-    if (layer->one_blob_only)
-    {
-        // load bottom blob
-        int bottom_blob_index = layer->bottoms[0];
-        int top_blob_index = layer->tops[0];
+        int layer_support_vulkan = layer->support_vulkan;
 
-        VkImageMat& bottom_blob_ref = blob_mats_gpu_image[bottom_blob_index];
-        VkImageMat bottom_blob;
+        // layer specific params
+        int pdlr = pd.load_param_bin(dr);
+        if (pdlr != 0)
+        {
+            NCNN_LOGE("ParamDict load_param_bin %d failed", i);
+            continue;
+        }
 
-        if (opt.lightmode)
+        // pull out top blob shape hints
+        Mat shape_hints = pd.get(30, Mat());
+        if (!shape_hints.empty())
         {
-            // deep copy for inplace forward if data is shared
-            if (layer->support_inplace && *bottom_blob_ref.refcount != 1)
+            const int* psh = shape_hints;
+            for (int j = 0; j < top_count; j++)
             {
-                cmd.record_clone(bottom_blob_ref, bottom_blob, opt);
-                //                         NCNN_LOGE("clone %p[+%lu] %p[+%lu]", bottom_blob_ref.buffer(), bottom_blob_ref.buffer_offset(), bottom_blob.buffer(), bottom_blob.buffer_offset());
+                Blob& blob = d->blobs[layer->tops[j]];
+
+                int dims = psh[0];
+                if (dims == 1)
+                {
+                    blob.shape = Mat(psh[1], (void*)0, 4u, 1);
+                }
+                if (dims == 2)
+                {
+                    blob.shape = Mat(psh[1], psh[2], (void*)0, 4u, 1);
+                }
+                if (dims == 3)
+                {
+                    blob.shape = Mat(psh[1], psh[2], psh[3], (void*)0, 4u, 1);
+                }
+
+                psh += 4;
             }
         }
-        if (bottom_blob.dims == 0)
+
+        // set bottom and top shape hints
+        layer->bottom_shapes.resize(bottom_count);
+        for (int j = 0; j < bottom_count; j++)
         {
-            bottom_blob = bottom_blob_ref;
+            layer->bottom_shapes[j] = d->blobs[layer->bottoms[j]].shape;
         }
 
-        // forward
-        if (opt.lightmode && layer->support_inplace)
+        layer->top_shapes.resize(top_count);
+        for (int j = 0; j < top_count; j++)
         {
-            VkImageMat& bottom_top_blob = bottom_blob;
-            int ret = layer->forward_inplace(bottom_top_blob, cmd, opt);
-            if (ret != 0)
-                return ret;
-
-            // store top blob
-            blob_mats_gpu_image[top_blob_index] = bottom_top_blob;
+            layer->top_shapes[j] = d->blobs[layer->tops[j]].shape;
         }
-        else
-        {
-            VkImageMat top_blob;
-            int ret = layer->forward(bottom_blob, top_blob, cmd, opt);
-            if (ret != 0)
-                return ret;
 
-            // store top blob
-            blob_mats_gpu_image[top_blob_index] = top_blob;
-        }
+        // pull out layer specific feature disabled set
+        layer->featmask = pd.get(31, 0);
 
-        if (opt.lightmode)
+        int lr = layer->load_param(pd);
+        if (lr != 0)
         {
-            // delete after taken in light mode
-            blob_mats_gpu_image[bottom_blob_index].release();
+            NCNN_LOGE("layer load_param %d failed", i);
+            continue;
         }
-    }
-    else
-    {
-        // load bottom blobs
-        std::vector<VkImageMat> bottom_blobs(layer->bottoms.size());
-        for (size_t i = 0; i < layer->bottoms.size(); i++)
+
+        if (layer->support_int8_storage)
         {
-            int bottom_blob_index = layer->bottoms[i];
+            // no int8 gpu support yet
+            opt.use_vulkan_compute = false;
+        }
 
-            VkImageMat& bottom_blob_ref = blob_mats_gpu_image[bottom_blob_index];
+        Option opt1 = get_masked_option(opt, layer->featmask);
+#if NCNN_VULKAN
+        if (opt1.use_vulkan_compute)
+        {
+            if (!layer->support_image_storage) opt1.use_image_storage = false;
+        }
+#endif // NCNN_VULKAN
 
-            if (opt.lightmode)
+        if (layer_support_vulkan && (!layer->support_vulkan || !opt1.use_vulkan_compute))
+        {
+            // vulkan layer cannot handle these param, recreate cpu layer
+            Layer* layer_cpu = create_overwrite_builtin_layer(typeindex);
+            overwritten = layer_cpu != 0;
+            if (!layer_cpu)
             {
-                // deep copy for inplace forward if data is shared
-                if (layer->support_inplace && *bottom_blob_ref.refcount != 1)
-                {
-                    cmd.record_clone(bottom_blob_ref, bottom_blobs[i], opt);
-                    //                             NCNN_LOGE("clone %p[+%lu] %p[+%lu]", bottom_blob_ref.buffer(), bottom_blob_ref.buffer_offset(), bottom_blobs[i].buffer(), bottom_blobs[i].buffer_offset());
-                }
+                layer_cpu = create_layer_cpu(typeindex);
             }
-            if (bottom_blobs[i].dims == 0)
+            if (!layer_cpu)
             {
-                bottom_blobs[i] = bottom_blob_ref;
+                int custom_index = typeindex & ~LayerType::CustomBit;
+                layer_cpu = create_custom_layer(custom_index);
             }
-        }
-
-        // forward
-        if (opt.lightmode && layer->support_inplace)
-        {
-            std::vector<VkImageMat>& bottom_top_blobs = bottom_blobs;
-            int ret = layer->forward_inplace(bottom_top_blobs, cmd, opt);
-            if (ret != 0)
-                return ret;
-
-            // store top blobs
-            for (size_t i = 0; i < layer->tops.size(); i++)
+            if (!layer_cpu)
             {
-                int top_blob_index = layer->tops[i];
-
-                blob_mats_gpu_image[top_blob_index] = bottom_top_blobs[i];
+                NCNN_LOGE("layer %d not exists or registered", typeindex);
+                clear();
+                return -1;
             }
-        }
-        else
-        {
-            std::vector<VkImageMat> top_blobs(layer->tops.size());
-            int ret = layer->forward(bottom_blobs, top_blobs, cmd, opt);
-            if (ret != 0)
-                return ret;
-
-            // store top blobs
-            for (size_t i = 0; i < layer->tops.size(); i++)
-            {
-                int top_blob_index = layer->tops[i];
 
-                blob_mats_gpu_image[top_blob_index] = top_blobs[i];
-            }
-        }
+            layer_cpu->bottoms = layer->bottoms;
+            layer_cpu->tops = layer->tops;
+            layer_cpu->bottom_shapes = layer->bottom_shapes;
+            layer_cpu->top_shapes = layer->top_shapes;
+            layer_cpu->featmask = layer->featmask;
 
-        if (opt.lightmode)
-        {
-            for (size_t i = 0; i < layer->bottoms.size(); i++)
+            int lr = layer_cpu->load_param(pd);
+            if (lr != 0)
             {
-                int bottom_blob_index = layer->bottoms[i];
-
-                // delete after taken in light mode
-                blob_mats_gpu_image[bottom_blob_index].release();
+                NCNN_LOGE("layer load_param %d failed", i);
+                continue;
             }
+
+            delete layer;
+            layer = layer_cpu;
         }
+
+        d->layers[i] = layer;
+        d->layer_overwritten[i] = overwritten;
     }
 
+    d->update_input_output_indexes();
+    d->update_layer_schedules();
+
+#undef READ_VALUE
     return 0;
 }
-#endif // NCNN_VULKAN
 
-void NetPrivate::update_input_output_indexes()
+// threads creating pipelines side by side transform weights on one thread each,
+// so that they do not fork opt.num_threads threads each while the tiles still follow opt.num_threads
+static Option get_parallel_load_option(const Option& opt)
 {
-    input_blob_indexes.clear();
-    output_blob_indexes.clear();
-
-    for (size_t i = 0; i < layers.size(); i++)
-    {
-        if (layers[i]->typeindex == LayerType::Input)
-        {
-            int blob_index = layers[i]->tops[0];
-            input_blob_indexes.push_back(blob_index);
-        }
-    }
-
-    for (size_t i = 0; i < blobs.size(); i++)
-    {
-        if (blobs[i].producer != -1 && blobs[i].consumer == -1)
-        {
-            output_blob_indexes.push_back(i);
-        }
-    }
+    Option opt1 = opt;
+    opt1.plan_num_threads = get_plan_num_threads(opt);
+    opt1.num_threads = 1;
+    return opt1;
 }
 
-#if NCNN_STRING
-void NetPrivate::update_input_output_names()
+// layers loaded in order are handed to threads creating their pipelines
+class ParallelLoadQueue
 {
-    input_blob_names.clear();
-    output_blob_names.clear();
+public:
+    ParallelLoadQueue(NetPrivate* _d, const Option& _opt);
 
-    for (size_t i = 0; i < input_blob_indexes.size(); i++)
-    {
-        int blob_index = input_blob_indexes[i];
-        input_blob_names.push_back(blobs[blob_index].name.c_str());
-    }
+    // layers before layer_count are loaded
+    void set_loaded(int layer_count);
 
-    for (size_t i = 0; i < output_blob_indexes.size(); i++)
-    {
-        int blob_index = output_blob_indexes[i];
-        output_blob_names.push_back(blobs[blob_index].name.c_str());
-    }
-}
-#endif // NCNN_STRING
+    // no more layers will be loaded
+    void finish();
 
-Net::Net()
-    : d(new NetPrivate(opt))
-{
-}
+    // create pipelines of loaded layers until finished
+    void run();
 
-Net::~Net()
-{
-    clear();
+    static void* worker(void* args);
 
-    delete d;
+    NetPrivate* d;
+    const Option& opt;
+
+    Mutex lock;
+    ConditionVariable cond;
+    int loaded;
+    int next;
+    bool finished;
+    int ret;
+};
+
+ParallelLoadQueue::ParallelLoadQueue(NetPrivate* _d, const Option& _opt)
+    : d(_d), opt(_opt)
+{
+    loaded = 0;
+    next = 0;
+    finished = false;
+    ret = 0;
 }
 
-Net::Net(const Net&)
-    : d(0)
+void ParallelLoadQueue::set_loaded(int layer_count)
 {
+    lock.lock();
+    loaded = layer_count;
+    cond.signal();
+    lock.unlock();
 }
 
-Net& Net::operator=(const Net&)
+void ParallelLoadQueue::finish()
 {
-    return *this;
+    lock.lock();
+    finished = true;
+    cond.broadcast();
+    lock.unlock();
 }
 
-#if NCNN_STRING
-int Net::register_custom_layer(const char* type, layer_creator_func creator, layer_destroyer_func destroyer, void* userdata)
+void ParallelLoadQueue::run()
 {
-    int typeindex = layer_to_index(type);
-    if (typeindex != -1)
+    lock.lock();
+    for (;;)
     {
-        NCNN_LOGE("overwrite built-in layer type %s", type);
-
-        for (size_t i = 0; i < d->overwrite_builtin_layer_registry.size(); i++)
+        while (next >= loaded && !finished)
         {
-            if (d->overwrite_builtin_layer_registry[i].typeindex == typeindex)
-            {
-                NCNN_LOGE("overwrite existing overwritten built-in layer index %d", typeindex);
-
-                d->overwrite_builtin_layer_registry[i].creator = creator;
-                d->overwrite_builtin_layer_registry[i].destroyer = destroyer;
-                d->overwrite_builtin_layer_registry[i].userdata = userdata;
-                return 0;
-            }
+            cond.wait(lock);
         }
 
-        struct overwrite_builtin_layer_registry_entry entry = {typeindex, creator, destroyer, userdata};
-        d->overwrite_builtin_layer_registry.push_back(entry);
-        return 0;
-    }
+        if (next >= loaded)
+            break;
 
-    int custom_index = custom_layer_to_index(type);
-    if (custom_index == -1)
-    {
-        struct custom_layer_registry_entry entry = {type, creator, destroyer, userdata};
-        d->custom_layer_registry.push_back(entry);
-    }
-    else
-    {
-        NCNN_LOGE("overwrite existing custom layer type %s", type);
-        d->custom_layer_registry[custom_index].name = type;
-        d->custom_layer_registry[custom_index].creator = creator;
-        d->custom_layer_registry[custom_index].destroyer = destroyer;
-        d->custom_layer_registry[custom_index].userdata = userdata;
+        int layer_index = next++;
+
+        lock.unlock();
+
+        int cret = d->create_layer_pipeline(layer_index, opt);
+
+        lock.lock();
+
+        if (cret != 0)
+            ret = -1;
     }
+    lock.unlock();
+}
 
+void* ParallelLoadQueue::worker(void* args)
+{
+    ParallelLoadQueue* q = (ParallelLoadQueue*)args;
+    q->run();
     return 0;
 }
-#endif // NCNN_STRING
 
-int Net::register_custom_layer(int index, layer_creator_func creator, layer_destroyer_func destroyer, void* userdata)
+int NetPrivate::create_layer_pipeline(int layer_index, const Option& opt) const
 {
-    int custom_index = index & ~LayerType::CustomBit;
-    if (index == custom_index)
-    {
-        NCNN_LOGE("overwrite built-in layer type %d", index);
+    Layer* layer = layers[layer_index];
 
-        for (size_t i = 0; i < d->overwrite_builtin_layer_registry.size(); i++)
-        {
-            if (d->overwrite_builtin_layer_registry[i].typeindex == index)
-            {
-                NCNN_LOGE("overwrite existing overwritten built-in layer index %d", index);
+    Option opt1 = get_masked_option(opt, layer->featmask);
 
-                d->overwrite_builtin_layer_registry[i].creator = creator;
-                d->overwrite_builtin_layer_registry[i].destroyer = destroyer;
-                d->overwrite_builtin_layer_registry[i].userdata = userdata;
-                return 0;
-            }
-        }
+    double start = get_current_time();
 
-        struct overwrite_builtin_layer_registry_entry entry = {index, creator, destroyer, userdata};
-        d->overwrite_builtin_layer_registry.push_back(entry);
-        return 0;
-    }
+    int cret = layer->create_pipeline(opt1);
 
-    if ((int)d->custom_layer_registry.size() <= custom_index)
+    layer_pipeline_times[layer_index] = get_current_time() - start;
+
+    if (cret != 0)
     {
 #if NCNN_STRING
-        struct custom_layer_registry_entry dummy = {"", 0, 0, 0};
+        NCNN_LOGE("layer create_pipeline %d %s failed", layer_index, layer->name.c_str());
 #else
-        struct custom_layer_registry_entry dummy = {0, 0, 0};
-#endif // NCNN_STRING
-        d->custom_layer_registry.resize(custom_index + 1, dummy);
+        NCNN_LOGE("layer create_pipeline %d failed", layer_index);
+#endif
+        return -1;
     }
 
-    if (d->custom_layer_registry[custom_index].creator)
-    {
-        NCNN_LOGE("overwrite existing custom layer index %d", custom_index);
-    }
+    return 0;
+}
+
+int NetPrivate::ensure_layer_pipeline(int layer_index) const
+{
+    // layers and their pending state belong to the source net when shared
+    const NetPrivate* owner = shared_source ? shared_source : this;
+
+    if (owner->layer_pipeline_pending.empty())
+        return 0;
+
+    int* pending = &owner->layer_pipeline_pending[layer_index];
+    if (NCNN_XADD(pending, 0) == 0)
+        return 0;
+
+    MutexLockGuard lock(owner->layer_pipeline_lock);
+
+    if (*pending == 0)
+        return 0;
+
+    int ret = owner->create_layer_pipeline(layer_index, owner->opt);
+    if (ret != 0)
+        return ret;
+
+    NCNN_XADD(pending, -1);
 
-    d->custom_layer_registry[custom_index].creator = creator;
-    d->custom_layer_registry[custom_index].destroyer = destroyer;
-    d->custom_layer_registry[custom_index].userdata = userdata;
     return 0;
 }
 
-#if NCNN_STRING
-int Net::load_param(const DataReader& dr)
+int NetPrivate::wait_layer_loaded(int layer_index) const
 {
-#define SCAN_VALUE(fmt, v)                \
-    if (dr.scan(fmt, &v) != 1)            \
-    {                                     \
-        NCNN_LOGE("parse " #v " failed"); \
-        return -1;                        \
-    }
+    // layers and their loading state belong to the source net when shared
+    const NetPrivate* owner = shared_source ? shared_source : this;
 
-    int magic = 0;
-    SCAN_VALUE("%d", magic)
-    if (magic != 7767517)
-    {
-        NCNN_LOGE("param is too old, please regenerate");
-        return -1;
-    }
+    if (NCNN_XADD(&owner->loaded_layer_count, 0) > layer_index)
+        return 0;
 
-    // parse
-    int layer_count = 0;
-    int blob_count = 0;
-    SCAN_VALUE("%d", layer_count)
-    SCAN_VALUE("%d", blob_count)
-    if (layer_count <= 0 || blob_count <= 0)
+    owner->loaded_layer_lock.lock();
+
+    while (owner->loaded_layer_count <= layer_index && owner->model_loading)
     {
-        NCNN_LOGE("invalid layer_count or blob_count");
-        return -1;
+        owner->loaded_layer_cond.wait(owner->loaded_layer_lock);
     }
 
-    d->layers.resize((size_t)layer_count);
-    d->blobs.resize((size_t)blob_count);
+    int ret = owner->loaded_layer_count > layer_index ? 0 : -1;
 
-#if NCNN_VULKAN
-    // TODO enable gpu when bf16 conversion implemented
-    if (opt.use_bf16_storage)
-        opt.use_vulkan_compute = false;
+    owner->loaded_layer_lock.unlock();
 
-    if (opt.use_vulkan_compute)
+    if (ret != 0)
     {
-        if (!d->vkdev) d->vkdev = get_gpu_device();
-        if (!d->vkdev) opt.use_vulkan_compute = false; // no vulkan device, fallback to cpu
+        NCNN_LOGE("layer %d weights not loaded", layer_index);
     }
-    if (opt.use_vulkan_compute)
-    {
-        // sanitize use options
-        if (!d->vkdev->info.support_fp16_packed()) opt.use_fp16_packed = false;
-        if (!d->vkdev->info.support_fp16_storage()) opt.use_fp16_storage = false;
-        if (!d->vkdev->info.support_fp16_uniform()) opt.use_fp16_uniform = false;
-        if (!d->vkdev->info.support_fp16_arithmetic()) opt.use_fp16_arithmetic = false;
-        if (!d->vkdev->info.support_int8_packed()) opt.use_int8_packed = false;
-        if (!d->vkdev->info.support_int8_storage()) opt.use_int8_storage = false;
-        if (!d->vkdev->info.support_int8_uniform()) opt.use_int8_uniform = false;
-        if (!d->vkdev->info.support_int8_arithmetic()) opt.use_int8_arithmetic = false;
-        if (!d->vkdev->info.support_cooperative_matrix()) opt.use_cooperative_matrix = false;
 
-        if (d->vkdev->info.bug_buffer_image_load_zero()) opt.use_image_storage = false;
-
-        // enable local memory optimization on discrete gpu only
-        if (d->vkdev->info.type() != 0) opt.use_shader_local_memory = false;
+    return ret;
+}
 
-        // fp16a makes no sense when fp16 storage disabled
-        if (!opt.use_fp16_packed && !opt.use_fp16_storage) opt.use_fp16_arithmetic = false;
+int NetPrivate::load_model_streaming(const DataReader& dr)
+{
+    const int layer_count = (int)layers.size();
 
-        // fp16 uniform makes no sense when fp16 arithmetic disabled
-        if (!opt.use_fp16_arithmetic) opt.use_fp16_uniform = false;
-    }
-    else
-    {
-        // fp16a makes no sense when fp16 storage disabled
-        if (!opt.use_fp16_storage) opt.use_fp16_arithmetic = false;
-    }
-#endif // NCNN_VULKAN
+    const bool lazy_pipeline = !layer_pipeline_pending.empty();
 
-    ParamDict pd;
+    int ret = 0;
 
-    int blob_index = 0;
+    ModelBinFromDataReader mb(dr, opt.num_threads);
     for (int i = 0; i < layer_count; i++)
     {
-        char layer_type[256];
-        char layer_name[256];
-        int bottom_count = 0;
-        int top_count = 0;
-        SCAN_VALUE("%255s", layer_type)
-        SCAN_VALUE("%255s", layer_name)
-        SCAN_VALUE("%d", bottom_count)
-        SCAN_VALUE("%d", top_count)
+        Layer* layer = layers[i];
 
-        Layer* layer = create_overwrite_builtin_layer(layer_type);
-#if NCNN_VULKAN
-        if (!layer && opt.use_vulkan_compute && d->vkdev)
+        //Here we found inconsistent content in the parameter file.
+        if (!layer)
         {
-            layer = create_layer_vulkan(layer_type);
+            NCNN_LOGE("load_model error at layer %d, parameter file has inconsistent content.", i);
+            ret = -1;
+            break;
         }
-#endif // NCNN_VULKAN
-        if (!layer)
+
+        double start = get_current_time();
+
+        int lret = layer->load_model(mb);
+
+        layer_load_times[i] = get_current_time() - start;
+
+        if (lret != 0)
         {
-            layer = create_layer_cpu(layer_type);
+#if NCNN_STRING
+            NCNN_LOGE("layer load_model %d %s failed", i, layer->name.c_str());
+#else
+            NCNN_LOGE("layer load_model %d failed", i);
+#endif
+            ret = -1;
+            break;
         }
-        if (!layer)
+
+        if (lazy_pipeline)
         {
-            layer = create_custom_layer(layer_type);
+            // created on first forward
+            layer_pipeline_pending[i] = 1;
         }
-        if (!layer)
+        else if (create_layer_pipeline(i, opt) != 0)
         {
-            NCNN_LOGE("layer %s not exists or registered", layer_type);
-            clear();
-            return -1;
+            ret = -1;
+            break;
         }
 
-#if NCNN_VULKAN
-        if (opt.use_vulkan_compute)
-            layer->vkdev = d->vkdev;
-#endif // NCNN_VULKAN
+        loaded_layer_lock.lock();
+        loaded_layer_count = i + 1;
+        loaded_layer_cond.broadcast();
+        loaded_layer_lock.unlock();
+    }
 
-        layer->type = std::string(layer_type);
-        layer->name = std::string(layer_name);
-        //         NCNN_LOGE("new layer %d %s", i, layer_name);
+    // waiters on layers never loaded give up
+    loaded_layer_lock.lock();
+    if (ret == 0)
+        loaded_layer_count = INT_MAX;
+    model_loading = false;
+    loaded_layer_cond.broadcast();
+    loaded_layer_lock.unlock();
 
-        layer->bottoms.resize(bottom_count);
-        for (int j = 0; j < bottom_count; j++)
-        {
-            char bottom_name[256];
-            SCAN_VALUE("%255s", bottom_name)
+    return ret;
+}
 
-            int bottom_blob_index = find_blob_index_by_name(bottom_name);
-            if (bottom_blob_index == -1)
-            {
-                Blob& blob = d->blobs[blob_index];
+void* NetPrivate::model_loader_worker(void* args)
+{
+    NetPrivate* d = (NetPrivate*)args;
+    d->model_loader_ret = d->load_model_streaming(*d->model_loader_dr);
+    return 0;
+}
 
-                bottom_blob_index = blob_index;
+int NetPrivate::load_model_parallel(const DataReader& dr, const Option& opt)
+{
+    const int layer_count = (int)layers.size();
 
-                blob.name = std::string(bottom_name);
-                //                 NCNN_LOGE("new blob %s", bottom_name);
+    // the loading thread joins the workers once all weights are read
+    const int worker_count = (opt.num_threads < layer_count ? opt.num_threads : layer_count) - 1;
 
-                blob_index++;
-            }
+    const Option opt_load = worker_count > 0 ? get_parallel_load_option(opt) : opt;
+    ParallelLoadQueue q(this, opt_load);
 
-            Blob& blob = d->blobs[bottom_blob_index];
+    std::vector<Thread*> workers(worker_count);
+    for (int i = 0; i < worker_count; i++)
+    {
+        workers[i] = new Thread(ParallelLoadQueue::worker, &q);
+    }
 
-            blob.consumer = i;
+    int ret = 0;
 
-            layer->bottoms[j] = bottom_blob_index;
-        }
+    ModelBinFromDataReader mb(dr, opt.num_threads);
+    for (int i = 0; i < layer_count; i++)
+    {
+        Layer* layer = layers[i];
 
-        layer->tops.resize(top_count);
-        for (int j = 0; j < top_count; j++)
+        //Here we found inconsistent content in the parameter file.
+        if (!layer)
         {
-            Blob& blob = d->blobs[blob_index];
-
-            char blob_name[256];
-            SCAN_VALUE("%255s", blob_name)
+            NCNN_LOGE("load_model error at layer %d, parameter file has inconsistent content.", i);
+            ret = -1;
+            break;
+        }
 
-            blob.name = std::string(blob_name);
-            //             NCNN_LOGE("new blob %s", blob_name);
+        double start = get_current_time();
 
-            blob.producer = i;
+        int lret = layer->load_model(mb);
 
-            layer->tops[j] = blob_index;
+        layer_load_times[i] = get_current_time() - start;
 
-            blob_index++;
+        if (lret != 0)
+        {
+#if NCNN_STRING
+            NCNN_LOGE("layer load_model %d %s failed", i, layer->name.c_str());
+#else
+            NCNN_LOGE("layer load_model %d failed", i);
+#endif
+            ret = -1;
+            break;
         }
 
-        int layer_support_vulkan = layer->support_vulkan;
+        q.set_loaded(i + 1);
+    }
 
-        // layer specific params
-        int pdlr = pd.load_param(dr);
-        if (pdlr != 0)
-        {
-            NCNN_LOGE("ParamDict load_param %d %s failed", i, layer_name);
-            continue;
-        }
+    q.finish();
+    q.run();
 
-        // pull out top shape hints
-        Mat shape_hints = pd.get(30, Mat());
-        if (!shape_hints.empty())
-        {
-            const int* psh = shape_hints;
-            for (int j = 0; j < top_count; j++)
-            {
-                Blob& blob = d->blobs[layer->tops[j]];
+    for (int i = 0; i < worker_count; i++)
+    {
+        workers[i]->join();
+        delete workers[i];
+    }
 
-                int dims = psh[0];
-                if (dims == 1)
-                {
-                    blob.shape = Mat(psh[1], (void*)0, 4u, 1);
-                }
-                if (dims == 2)
-                {
-                    blob.shape = Mat(psh[1], psh[2], (void*)0, 4u, 1);
-                }
-                if (dims == 3)
-                {
-                    blob.shape = Mat(psh[1], psh[2], psh[3], (void*)0, 4u, 1);
-                }
+    if (q.ret != 0)
+        ret = -1;
 
-                psh += 4;
-            }
-        }
+    return ret;
+}
 
-        // set bottom and top shape hints
-        layer->bottom_shapes.resize(bottom_count);
-        for (int j = 0; j < bottom_count; j++)
-        {
-            layer->bottom_shapes[j] = d->blobs[layer->bottoms[j]].shape;
-        }
+bool NetPrivate::begin_load_model()
+{
+    const int layer_count = (int)layers.size();
 
-        layer->top_shapes.resize(top_count);
-        for (int j = 0; j < top_count; j++)
+#if NCNN_VULKAN
+    if (opt.use_vulkan_compute)
+    {
+        if (!opt.pipeline_cache)
         {
-            layer->top_shapes[j] = d->blobs[layer->tops[j]].shape;
+            if (!pipeline_cache)
+                pipeline_cache = new PipelineCache(vkdev);
+            opt.pipeline_cache = pipeline_cache;
         }
+    }
+#endif // NCNN_VULKAN
 
-        // pull out layer specific feature disabled set
-        layer->featmask = pd.get(31, 0);
+    layer_load_times.clear();
+    layer_load_times.resize(layer_count, 0.0);
+    layer_pipeline_times.clear();
+    layer_pipeline_times.resize(layer_count, 0.0);
 
-        int lr = layer->load_param(pd);
-        if (lr != 0)
+    const bool lazy_pipeline = opt.use_lazy_pipeline && !opt.use_vulkan_compute;
+
+    layer_pipeline_pending.clear();
+    if (lazy_pipeline)
+    {
+        layer_pipeline_pending.resize(layer_count, 0);
+    }
+
+    return lazy_pipeline;
+}
+
+int NetPrivate::end_load_model(int ret)
+{
+    if (opt.use_local_pool_allocator)
+    {
+        if (opt.blob_allocator == 0)
         {
-            NCNN_LOGE("layer load_param %d %s failed", i, layer_name);
-            continue;
+            if (!local_blob_allocator)
+            {
+                local_blob_allocator = new PoolAllocator;
+                local_blob_allocator->set_size_compare_ratio(0.f);
+            }
         }
-
-        if (layer->support_int8_storage)
+        if (opt.workspace_allocator == 0)
         {
-            // no int8 gpu support yet
-            opt.use_vulkan_compute = false;
+            if (!local_workspace_allocator)
+            {
+                local_workspace_allocator = new PoolAllocator;
+                local_workspace_allocator->set_size_compare_ratio(0.f);
+            }
         }
+    }
 
-        Option opt1 = get_masked_option(opt, layer->featmask);
 #if NCNN_VULKAN
-        if (opt1.use_vulkan_compute)
-        {
-            if (!layer->support_image_storage) opt1.use_image_storage = false;
-        }
+    if (ret == 0 && opt.use_vulkan_compute)
+    {
+        ret = upload_model();
+    }
 #endif // NCNN_VULKAN
 
-        if (layer_support_vulkan && (!layer->support_vulkan || !opt1.use_vulkan_compute))
+    return ret;
+}
+
+int Net::load_model(const DataReader& dr)
+{
+    if (d->layers.empty())
+    {
+        NCNN_LOGE("network graph not ready");
+        return -1;
+    }
+
+    int layer_count = (int)d->layers.size();
+
+    // load file
+    int ret = 0;
+
+    const bool lazy_pipeline = d->begin_load_model();
+
+    if (!lazy_pipeline && opt.use_parallel_load && opt.num_threads > 1 && !opt.use_vulkan_compute)
+    {
+        ret = d->load_model_parallel(dr, opt);
+    }
+    else
+    {
+        ModelBinFromDataReader mb(dr, opt.num_threads);
+        for (int i = 0; i < layer_count; i++)
         {
-            // vulkan layer cannot handle these param, recreate cpu layer
-            Layer* layer_cpu = create_overwrite_builtin_layer(layer_type);
-            if (!layer_cpu)
-            {
-                layer_cpu = create_layer_cpu(layer_type);
-            }
-            if (!layer_cpu)
+            Layer* layer = d->layers[i];
+
+            //Here we found inconsistent content in the parameter file.
+            if (!layer)
             {
-                layer_cpu = create_custom_layer(layer_type);
+                NCNN_LOGE("load_model error at layer %d, parameter file has inconsistent content.", i);
+                ret = -1;
+                break;
             }
-            if (!layer_cpu)
+
+            double start = get_current_time();
+
+            int lret = layer->load_model(mb);
+
+            d->layer_load_times[i] = get_current_time() - start;
+
+            if (lret != 0)
             {
-                NCNN_LOGE("layer %s not exists or registered", layer_type);
-                clear();
-                return -1;
+#if NCNN_STRING
+                NCNN_LOGE("layer load_model %d %s failed", i, layer->name.c_str());
+#else
+                NCNN_LOGE("layer load_model %d failed", i);
+#endif
+                ret = -1;
+                break;
             }
 
-            layer_cpu->type = layer->type;
-            layer_cpu->name = layer->name;
-            layer_cpu->bottoms = layer->bottoms;
-            layer_cpu->tops = layer->tops;
-            layer_cpu->bottom_shapes = layer->bottom_shapes;
-            layer_cpu->top_shapes = layer->top_shapes;
-            layer_cpu->featmask = layer->featmask;
-
-            int lr = layer_cpu->load_param(pd);
-            if (lr != 0)
+            if (lazy_pipeline)
             {
-                NCNN_LOGE("layer load_param %d %s failed", i, layer_name);
+                // created on first forward
+                d->layer_pipeline_pending[i] = 1;
                 continue;
             }
 
-            delete layer;
-            layer = layer_cpu;
+            int cret = d->create_layer_pipeline(i, opt);
+            if (cret != 0)
+            {
+                ret = -1;
+                break;
+            }
         }
-
-        d->layers[i] = layer;
-    }
-
-    d->update_input_output_indexes();
-    d->update_input_output_names();
-
-#undef SCAN_VALUE
-    return 0;
-}
-#endif // NCNN_STRING
-
-int Net::load_param_bin(const DataReader& dr)
-{
-#if __BIG_ENDIAN__
-#define READ_VALUE(buf)                            \
-    if (dr.read(&buf, sizeof(buf)) != sizeof(buf)) \
-    {                                              \
-        NCNN_LOGE("read " #buf " failed");         \
-        return -1;                                 \
-    }                                              \
-    if (sizeof(buf) == 2)                          \
-        swap_endianness_16(&buf);                  \
-    if (sizeof(buf) == 4)                          \
-        swap_endianness_32(&buf);
-#else
-#define READ_VALUE(buf)                            \
-    if (dr.read(&buf, sizeof(buf)) != sizeof(buf)) \
-    {                                              \
-        NCNN_LOGE("read " #buf " failed");         \
-        return -1;                                 \
     }
-#endif
 
-    int magic = 0;
-    READ_VALUE(magic)
-    if (magic != 7767517)
+    return d->end_load_model(ret);
+}
+
+int Net::load_model_async(const DataReader& dr)
+{
+    if (d->layers.empty())
     {
-        NCNN_LOGE("param is too old, please regenerate");
+        NCNN_LOGE("network graph not ready");
         return -1;
     }
 
-    int layer_count = 0;
-    int blob_count = 0;
-    READ_VALUE(layer_count)
-    READ_VALUE(blob_count)
-    if (layer_count <= 0 || blob_count <= 0)
+    wait_model_loaded();
+
+    // gpu weights are uploaded at once
+    if (opt.use_vulkan_compute)
+        return load_model(dr);
+
+    d->begin_load_model();
+
+    // local allocators are made before extractors are created
+    d->end_load_model(0);
+
+    d->model_loader_dr = &dr;
+    d->model_loader_ret = 0;
+    d->model_loading = true;
+    d->loaded_layer_count = 0;
+    d->model_loader = new Thread(NetPrivate::model_loader_worker, d);
+
+    return 0;
+}
+
+int Net::wait_model_loaded()
+{
+    if (!d->model_loader)
+        return 0;
+
+    d->model_loader->join();
+    delete d->model_loader;
+    d->model_loader = 0;
+    d->model_loader_dr = 0;
+
+#if NCNN_STDIO
+    if (d->model_loader_fp)
     {
-        NCNN_LOGE("invalid layer_count or blob_count");
-        return -1;
+        delete d->model_loader_file_dr;
+        fclose(d->model_loader_fp);
+        d->model_loader_file_dr = 0;
+        d->model_loader_fp = 0;
     }
+#endif // NCNN_STDIO
 
-    d->layers.resize(layer_count);
-    d->blobs.resize(blob_count);
-
-#if NCNN_VULKAN
-    // TODO enable gpu when bf16 conversion implemented
-    if (opt.use_bf16_storage)
-        opt.use_vulkan_compute = false;
+    return d->model_loader_ret;
+}
 
-    if (opt.use_vulkan_compute)
+// reader bounded to one container section
+// data is referenced in place when 4-byte aligned, as container payloads are
+class DataReaderFromSection : public DataReader
+{
+public:
+    DataReaderFromSection(const unsigned char* _data, size_t _size)
+        : data(_data), size(_size), offset(0)
     {
-        if (!d->vkdev) d->vkdev = get_gpu_device();
-        if (!d->vkdev) opt.use_vulkan_compute = false; // no vulkan device, fallback to cpu
     }
-    if (opt.use_vulkan_compute)
+
+    virtual size_t read(void* buf, size_t _size) const
     {
-        // sanitize use options
-        if (!d->vkdev->info.support_fp16_packed()) opt.use_fp16_packed = false;
-        if (!d->vkdev->info.support_fp16_storage()) opt.use_fp16_storage = false;
-        if (!d->vkdev->info.support_fp16_uniform()) opt.use_fp16_uniform = false;
-        if (!d->vkdev->info.support_fp16_arithmetic()) opt.use_fp16_arithmetic = false;
-        if (!d->vkdev->info.support_int8_packed()) opt.use_int8_packed = false;
-        if (!d->vkdev->info.support_int8_storage()) opt.use_int8_storage = false;
-        if (!d->vkdev->info.support_int8_uniform()) opt.use_int8_uniform = false;
-        if (!d->vkdev->info.support_int8_arithmetic()) opt.use_int8_arithmetic = false;
-        if (!d->vkdev->info.support_cooperative_matrix()) opt.use_cooperative_matrix = false;
+        if (offset >= size)
+            return 0;
 
-        if (d->vkdev->info.bug_buffer_image_load_zero()) opt.use_image_storage = false;
+        if (_size > size - offset)
+            _size = size - offset;
 
-        // enable local memory optimization on discrete gpu only
-        if (d->vkdev->info.type() != 0) opt.use_shader_local_memory = false;
+        memcpy(buf, data + offset, _size);
+        offset += _size;
+        return _size;
+    }
 
-        // fp16a makes no sense when fp16 storage disabled
-        if (!opt.use_fp16_packed && !opt.use_fp16_storage) opt.use_fp16_arithmetic = false;
+    virtual size_t reference(size_t _size, const void** buf) const
+    {
+        if (offset >= size || _size > size - offset)
+            return 0;
 
-        // fp16 uniform makes no sense when fp16 arithmetic disabled
-        if (!opt.use_fp16_arithmetic) opt.use_fp16_uniform = false;
+        if (((size_t)(data + offset) & 3) != 0)
+            return 0;
+
+        *buf = data + offset;
+        offset += _size;
+        return _size;
     }
-    else
+
+    const unsigned char* data;
+    size_t size;
+    mutable size_t offset;
+};
+
+int NetPrivate::load_layer_section(int layer_index, const ModelContainer& container, int num_threads)
+{
+    Layer* layer = layers[layer_index];
+
+    //Here we found inconsistent content in the parameter file.
+    if (!layer)
     {
-        // fp16a makes no sense when fp16 storage disabled
-        if (!opt.use_fp16_storage) opt.use_fp16_arithmetic = false;
+        NCNN_LOGE("load_model error at layer %d, parameter file has inconsistent content.", layer_index);
+        return -1;
     }
-#endif // NCNN_VULKAN
 
-    ParamDict pd;
+    // layers without weights have no section
+    const unsigned char* data = 0;
+    size_t size = 0;
+    if (container.find_section(MODEL_CONTAINER_LAYER_WEIGHT, layer_index, &data, &size) == 0 && container.verify_section(MODEL_CONTAINER_LAYER_WEIGHT, layer_index) != 0)
+        return -1;
 
-    for (int i = 0; i < layer_count; i++)
-    {
-        int typeindex;
-        int bottom_count;
-        int top_count;
-        READ_VALUE(typeindex)
-        READ_VALUE(bottom_count)
-        READ_VALUE(top_count)
+    double start = get_current_time();
 
-        Layer* layer = create_overwrite_builtin_layer(typeindex);
-#if NCNN_VULKAN
-        if (!layer && opt.use_vulkan_compute && d->vkdev)
-        {
-            layer = create_layer_vulkan(typeindex);
-        }
-#endif // NCNN_VULKAN
-        if (!layer)
-        {
-            layer = create_layer_cpu(typeindex);
-        }
-        if (!layer)
-        {
-            int custom_index = typeindex & ~LayerType::CustomBit;
-            layer = create_custom_layer(custom_index);
-        }
-        if (!layer)
-        {
-            NCNN_LOGE("layer %d not exists or registered", typeindex);
-            clear();
-            return -1;
-        }
+    DataReaderFromSection dr(data, size);
+    ModelBinFromDataReader mb(dr, num_threads);
+    int lret = layer->load_model(mb);
 
-#if NCNN_VULKAN
-        if (opt.use_vulkan_compute)
-            layer->vkdev = d->vkdev;
-#endif // NCNN_VULKAN
+    layer_load_times[layer_index] = get_current_time() - start;
 
-        //         layer->type = std::string(layer_type);
-        //         layer->name = std::string(layer_name);
-        //         NCNN_LOGE("new layer %d", typeindex);
+    if (lret != 0)
+    {
+#if NCNN_STRING
+        NCNN_LOGE("layer load_model %d %s failed", layer_index, layer->name.c_str());
+#else
+        NCNN_LOGE("layer load_model %d failed", layer_index);
+#endif
+        return -1;
+    }
 
-        layer->bottoms.resize(bottom_count);
-        for (int j = 0; j < bottom_count; j++)
-        {
-            int bottom_blob_index;
-            READ_VALUE(bottom_blob_index)
+    return 0;
+}
 
-            Blob& blob = d->blobs[bottom_blob_index];
+// layers of container are taken by threads loading them and creating their pipelines
+class ContainerLoadQueue
+{
+public:
+    ContainerLoadQueue(NetPrivate* _d, const ModelContainer& _container, const Option& _opt);
 
-            blob.consumer = i;
+    // load layers until none left
+    void run();
 
-            layer->bottoms[j] = bottom_blob_index;
-        }
+    static void* worker(void* args);
 
-        layer->tops.resize(top_count);
-        for (int j = 0; j < top_count; j++)
-        {
-            int top_blob_index;
-            READ_VALUE(top_blob_index)
+    NetPrivate* d;
+    const ModelContainer& container;
+    const Option& opt;
 
-            Blob& blob = d->blobs[top_blob_index];
+    int next;
+    int failed;
+};
 
-            //             blob.name = std::string(blob_name);
-            //             NCNN_LOGE("new blob %s", blob_name);
+ContainerLoadQueue::ContainerLoadQueue(NetPrivate* _d, const ModelContainer& _container, const Option& _opt)
+    : d(_d), container(_container), opt(_opt)
+{
+    next = 0;
+    failed = 0;
+}
 
-            blob.producer = i;
+void ContainerLoadQueue::run()
+{
+    const int layer_count = (int)d->layers.size();
 
-            layer->tops[j] = top_blob_index;
-        }
+    for (;;)
+    {
+        int layer_index = NCNN_XADD(&next, 1);
+        if (layer_index >= layer_count || NCNN_XADD(&failed, 0) != 0)
+            break;
 
-        int layer_support_vulkan = layer->support_vulkan;
+        // layers are decoded in parallel already
+        int ret = d->load_layer_section(layer_index, container, 1);
+        if (ret == 0)
+            ret = d->create_layer_pipeline(layer_index, opt);
 
-        // layer specific params
-        int pdlr = pd.load_param_bin(dr);
-        if (pdlr != 0)
-        {
-            NCNN_LOGE("ParamDict load_param_bin %d failed", i);
-            continue;
-        }
+        if (ret != 0)
+            NCNN_XADD(&failed, 1);
+    }
+}
 
-        // pull out top blob shape hints
-        Mat shape_hints = pd.get(30, Mat());
-        if (!shape_hints.empty())
-        {
-            const int* psh = shape_hints;
-            for (int j = 0; j < top_count; j++)
-            {
-                Blob& blob = d->blobs[layer->tops[j]];
+void* ContainerLoadQueue::worker(void* args)
+{
+    ContainerLoadQueue* q = (ContainerLoadQueue*)args;
+    q->run();
+    return 0;
+}
 
-                int dims = psh[0];
-                if (dims == 1)
-                {
-                    blob.shape = Mat(psh[1], (void*)0, 4u, 1);
-                }
-                if (dims == 2)
-                {
-                    blob.shape = Mat(psh[1], psh[2], (void*)0, 4u, 1);
-                }
-                if (dims == 3)
-                {
-                    blob.shape = Mat(psh[1], psh[2], psh[3], (void*)0, 4u, 1);
-                }
+int NetPrivate::load_container_parallel(const ModelContainer& container, const Option& opt)
+{
+    const int layer_count = (int)layers.size();
 
-                psh += 4;
-            }
-        }
+    // the loading thread works as one of them
+    const int worker_count = (opt.num_threads < layer_count ? opt.num_threads : layer_count) - 1;
 
-        // set bottom and top shape hints
-        layer->bottom_shapes.resize(bottom_count);
-        for (int j = 0; j < bottom_count; j++)
-        {
-            layer->bottom_shapes[j] = d->blobs[layer->bottoms[j]].shape;
-        }
+    const Option opt_load = worker_count > 0 ? get_parallel_load_option(opt) : opt;
+    ContainerLoadQueue q(this, container, opt_load);
 
-        layer->top_shapes.resize(top_count);
-        for (int j = 0; j < top_count; j++)
-        {
-            layer->top_shapes[j] = d->blobs[layer->tops[j]].shape;
-        }
+    std::vector<Thread*> workers(worker_count);
+    for (int i = 0; i < worker_count; i++)
+    {
+        workers[i] = new Thread(ContainerLoadQueue::worker, &q);
+    }
 
-        // pull out layer specific feature disabled set
-        layer->featmask = pd.get(31, 0);
+    q.run();
 
-        int lr = layer->load_param(pd);
-        if (lr != 0)
-        {
-            NCNN_LOGE("layer load_param %d failed", i);
-            continue;
-        }
+    for (int i = 0; i < worker_count; i++)
+    {
+        workers[i]->join();
+        delete workers[i];
+    }
 
-        if (layer->support_int8_storage)
-        {
-            // no int8 gpu support yet
-            opt.use_vulkan_compute = false;
-        }
+    return q.failed ? -1 : 0;
+}
 
-        Option opt1 = get_masked_option(opt, layer->featmask);
-#if NCNN_VULKAN
-        if (opt1.use_vulkan_compute)
-        {
-            if (!layer->support_image_storage) opt1.use_image_storage = false;
-        }
-#endif // NCNN_VULKAN
+int Net::load_container(const ModelContainer& container)
+{
+    const unsigned char* param = 0;
+    size_t param_size = 0;
 
-        if (layer_support_vulkan && (!layer->support_vulkan || !opt1.use_vulkan_compute))
+    int ret = -1;
+    // consumed sections are checked against their crc32 before use
+    if (container.find_section(MODEL_CONTAINER_PARAM_BIN, 0, &param, &param_size) == 0)
+    {
+        if (container.verify_section(MODEL_CONTAINER_PARAM_BIN, 0) != 0)
+            return -1;
+
+        DataReaderFromSection dr(param, param_size);
+        ret = load_param_bin(dr);
+    }
+#if NCNN_STRING
+    else if (container.find_section(MODEL_CONTAINER_PARAM, 0, &param, &param_size) == 0)
+    {
+        if (container.verify_section(MODEL_CONTAINER_PARAM, 0) != 0)
+            return -1;
+
+        if (param_size == 0 || param[param_size - 1] != '\0')
         {
-            // vulkan layer cannot handle these param, recreate cpu layer
-            Layer* layer_cpu = create_overwrite_builtin_layer(typeindex);
-            if (!layer_cpu)
-            {
-                layer_cpu = create_layer_cpu(typeindex);
-            }
-            if (!layer_cpu)
-            {
-                int custom_index = typeindex & ~LayerType::CustomBit;
-                layer_cpu = create_custom_layer(custom_index);
-            }
-            if (!layer_cpu)
-            {
-                NCNN_LOGE("layer %d not exists or registered", typeindex);
-                clear();
-                return -1;
-            }
+            NCNN_LOGE("model container param is not null terminated");
+            return -1;
+        }
 
-            layer_cpu->bottoms = layer->bottoms;
-            layer_cpu->tops = layer->tops;
-            layer_cpu->bottom_shapes = layer->bottom_shapes;
-            layer_cpu->top_shapes = layer->top_shapes;
-            layer_cpu->featmask = layer->featmask;
+        ret = load_param_mem((const char*)param);
+    }
+#endif // NCNN_STRING
+    else
+    {
+        NCNN_LOGE("model container has no param");
+    }
 
-            int lr = layer_cpu->load_param(pd);
-            if (lr != 0)
+    if (ret != 0)
+        return ret;
+
+    // weights transformed on this cpu before, entries made elsewhere are ignored
+    const unsigned char* cache = 0;
+    size_t cache_size = 0;
+    if (opt.weight_cache && container.find_section(MODEL_CONTAINER_WEIGHT_CACHE, 0, &cache, &cache_size) == 0)
+    {
+        if (container.verify_section(MODEL_CONTAINER_WEIGHT_CACHE, 0) != 0)
+            return -1;
+
+        opt.weight_cache->load(cache, cache_size);
+    }
+
+    const int layer_count = (int)d->layers.size();
+
+    const bool lazy_pipeline = d->begin_load_model();
+
+    if (!lazy_pipeline && opt.use_parallel_load && opt.num_threads > 1 && !opt.use_vulkan_compute)
+    {
+        ret = d->load_container_parallel(container, opt);
+    }
+    else
+    {
+        for (int i = 0; i < layer_count; i++)
+        {
+            ret = d->load_layer_section(i, container, opt.num_threads);
+            if (ret != 0)
+                break;
+
+            if (lazy_pipeline)
             {
-                NCNN_LOGE("layer load_param %d failed", i);
+                // created on first forward
+                d->layer_pipeline_pending[i] = 1;
                 continue;
             }
 
-            delete layer;
-            layer = layer_cpu;
+            ret = d->create_layer_pipeline(i, opt);
+            if (ret != 0)
+                break;
         }
-
-        d->layers[i] = layer;
     }
 
-    d->update_input_output_indexes();
-
-#undef READ_VALUE
-    return 0;
+    return d->end_load_model(ret);
 }
 
-int Net::load_model(const DataReader& dr)
+void NetPrivate::hand_over_layers()
 {
-    if (d->layers.empty())
+    // finish deferred pipelines while the options they were loaded with are alive
+    for (size_t i = 0; i < layer_pipeline_pending.size(); i++)
     {
-        NCNN_LOGE("network graph not ready");
-        return -1;
-    }
+        if (layer_pipeline_pending[i] == 0)
+            continue;
 
-    int layer_count = (int)d->layers.size();
+        if (create_layer_pipeline((int)i, opt) != 0)
+        {
+            NCNN_LOGE("layer %d pipeline not created before hand over", (int)i);
+            // ignore anyway
+        }
 
-    // load file
-    int ret = 0;
+        layer_pipeline_pending[i] = 0;
+    }
 
-#if NCNN_VULKAN
-    if (opt.use_vulkan_compute)
+    NetPrivate* heir = sharers[0];
+
+    heir->shared_source = 0;
+    heir->sharers.assign(sharers.begin() + 1, sharers.end());
+    for (size_t i = 0; i < heir->sharers.size(); i++)
     {
-        if (!opt.pipeline_cache)
-        {
-            if (!d->pipeline_cache)
-                d->pipeline_cache = new PipelineCache(d->vkdev);
-            opt.pipeline_cache = d->pipeline_cache;
-        }
+        heir->sharers[i]->shared_source = heir;
     }
+    sharers.clear();
+
+    // the heir destroys the layers with the registries they were created with
+    heir->layers_inherited = true;
+    heir->inherited_custom_layer_registry = layers_inherited ? inherited_custom_layer_registry : custom_layer_registry;
+    heir->inherited_overwrite_builtin_layer_registry = layers_inherited ? inherited_overwrite_builtin_layer_registry : overwrite_builtin_layer_registry;
+    layers_inherited = false;
+    inherited_custom_layer_registry.clear();
+    inherited_overwrite_builtin_layer_registry.clear();
+
+    // the heir shares the layer list already, this net drops it
+    layers.clear();
+    layer_pipeline_pending.clear();
+
+#if NCNN_STDIO
+    heir->model_mmaps.swap(model_mmaps);
+    heir->model_containers.swap(model_containers);
+#endif // NCNN_STDIO
+
+#if NCNN_VULKAN
+    std::swap(heir->weight_vkallocator, weight_vkallocator);
+    std::swap(heir->weight_staging_vkallocator, weight_staging_vkallocator);
+    std::swap(heir->pipeline_cache, pipeline_cache);
+    opt.pipeline_cache = 0;
 #endif // NCNN_VULKAN
+}
 
-    ModelBinFromDataReader mb(dr);
-    for (int i = 0; i < layer_count; i++)
-    {
-        Layer* layer = d->layers[i];
+int Net::share_model(const Net& net)
+{
+    if (net.d == d)
+        return -1;
 
-        //Here we found inconsistent content in the parameter file.
-        if (!layer)
-        {
-            NCNN_LOGE("load_model error at layer %d, parameter file has inconsistent content.", i);
-            ret = -1;
-            break;
-        }
+    clear();
 
-        int lret = layer->load_model(mb);
-        if (lret != 0)
-        {
-#if NCNN_STRING
-            NCNN_LOGE("layer load_model %d %s failed", i, layer->name.c_str());
-#else
-            NCNN_LOGE("layer load_model %d failed", i);
-#endif
-            ret = -1;
-            break;
-        }
+    MutexLockGuard lock(g_share_lock);
 
-        Option opt1 = get_masked_option(opt, layer->featmask);
+    NetPrivate* source = net.d->shared_source ? net.d->shared_source : net.d;
+    if (source == d)
+        return -1;
 
-        int cret = layer->create_pipeline(opt1);
-        if (cret != 0)
-        {
-#if NCNN_STRING
-            NCNN_LOGE("layer create_pipeline %d %s failed", i, layer->name.c_str());
-#else
-            NCNN_LOGE("layer create_pipeline %d failed", i);
-#endif
-            ret = -1;
-            break;
-        }
+    if (source->layers.empty())
+    {
+        NCNN_LOGE("network graph not ready");
+        return -1;
     }
 
+    // options deciding weight layout follow the source net
+    Option opt0 = opt;
+    opt = net.opt;
+    opt.lightmode = opt0.lightmode;
+    opt.num_threads = opt0.num_threads;
+    opt.blob_allocator = opt0.blob_allocator;
+    opt.workspace_allocator = opt0.workspace_allocator;
+    opt.openmp_blocktime = opt0.openmp_blocktime;
+    opt.use_local_pool_allocator = opt0.use_local_pool_allocator;
+    opt.flush_denormals = opt0.flush_denormals;
+    opt.use_static_memory_plan = opt0.use_static_memory_plan;
+    opt.use_branch_parallel = opt0.use_branch_parallel;
+#if NCNN_VULKAN
+    opt.blob_vkallocator = opt0.blob_vkallocator;
+    opt.workspace_vkallocator = opt0.workspace_vkallocator;
+    opt.staging_vkallocator = opt0.staging_vkallocator;
+#endif // NCNN_VULKAN
+
+    d->blobs = source->blobs;
+    d->layers = source->layers;
+    d->layer_overwritten = source->layer_overwritten;
+    d->shared_source = source;
+    source->sharers.push_back(d);
+
+    d->update_input_output_indexes();
+#if NCNN_STRING
+    d->update_input_output_names();
+#endif // NCNN_STRING
+    d->update_layer_schedules();
+
     if (opt.use_local_pool_allocator)
     {
         if (opt.blob_allocator == 0)
         {
-            if (!d->local_blob_allocator)
-            {
-                d->local_blob_allocator = new PoolAllocator;
-                d->local_blob_allocator->set_size_compare_ratio(0.f);
-            }
+            d->local_blob_allocator = new PoolAllocator;
+            d->local_blob_allocator->set_size_compare_ratio(0.f);
         }
         if (opt.workspace_allocator == 0)
         {
-            if (!d->local_workspace_allocator)
-            {
-                d->local_workspace_allocator = new PoolAllocator;
-                d->local_workspace_allocator->set_size_compare_ratio(0.f);
-            }
+            d->local_workspace_allocator = new PoolAllocator;
+            d->local_workspace_allocator->set_size_compare_ratio(0.f);
         }
     }
 
 #if NCNN_VULKAN
-    if (ret == 0 && opt.use_vulkan_compute)
-    {
-        ret = d->upload_model();
-    }
+    d->vkdev = source->vkdev;
 #endif // NCNN_VULKAN
 
-    return ret;
+    return 0;
 }
 
 #if NCNN_STDIO
@@ -2025,6 +3981,74 @@ int Net::load_model(const char* modelpath)
     fclose(fp);
     return ret;
 }
+
+int Net::load_model_mmap(const char* modelpath)
+{
+    DataReaderFromMmap* dr = new DataReaderFromMmap(modelpath);
+    if (dr->size() == 0)
+    {
+        delete dr;
+        return -1;
+    }
+
+    // weights may be referenced in place, keep the mapping with net
+    d->model_mmaps.push_back(dr);
+
+    int ret = load_model(*dr);
+    if (ret != 0)
+        return ret;
+
+    // transformed weights are private copies now
+    // drop the file pages, the ones still referenced are faulted in again on use
+    dr->release_pages();
+
+    return 0;
+}
+
+int Net::load_model_async(const char* modelpath)
+{
+    wait_model_loaded();
+
+    FILE* fp = fopen(modelpath, "rb");
+    if (!fp)
+    {
+        NCNN_LOGE("fopen %s failed", modelpath);
+        return -1;
+    }
+
+    DataReaderFromStdio* dr = new DataReaderFromStdio(fp);
+
+    int ret = load_model_async(*dr);
+    if (ret != 0 || !d->model_loader)
+    {
+        // failed or loaded at once
+        delete dr;
+        fclose(fp);
+        return ret;
+    }
+
+    d->model_loader_fp = fp;
+    d->model_loader_file_dr = dr;
+
+    return 0;
+}
+
+int Net::load_container(const char* path)
+{
+    ModelContainer* container = new ModelContainer;
+    if (container->open(path) != 0)
+    {
+        delete container;
+        return -1;
+    }
+
+    int ret = load_container(*container);
+
+    // weights may be referenced in place, keep the mapping with net
+    d->model_containers.push_back(container);
+
+    return ret;
+}
 #endif // NCNN_STDIO
 
 int Net::load_param(const unsigned char* _mem)
@@ -2111,7 +4135,36 @@ int Net::load_model(AAssetManager* mgr, const char* assetpath)
 
 void Net::clear()
 {
+    // layers are in use by the loader thread
+    wait_model_loaded();
+
     d->blobs.clear();
+    d->layer_schedules.clear();
+    d->layer_load_times.clear();
+    d->layer_pipeline_times.clear();
+
+    {
+        MutexLockGuard lock(g_share_lock);
+
+        if (d->shared_source)
+        {
+            // layers are owned by the source net
+            d->layers.clear();
+
+            std::vector<NetPrivate*>& sharers = d->shared_source->sharers;
+            sharers.erase(std::find(sharers.begin(), sharers.end(), d));
+            d->shared_source = 0;
+        }
+        else if (!d->sharers.empty())
+        {
+            // nets sharing the layers keep them alive
+            d->hand_over_layers();
+        }
+    }
+
+    const std::vector<custom_layer_registry_entry>& custom_layer_registry = d->layers_inherited ? d->inherited_custom_layer_registry : d->custom_layer_registry;
+    const std::vector<overwrite_builtin_layer_registry_entry>& overwrite_builtin_layer_registry = d->layers_inherited ? d->inherited_overwrite_builtin_layer_registry : d->overwrite_builtin_layer_registry;
+
     for (size_t i = 0; i < d->layers.size(); i++)
     {
         Layer* layer = d->layers[i];
@@ -2124,7 +4177,10 @@ void Net::clear()
         }
 #endif // NCNN_VULKAN
 
-        int dret = layer->destroy_pipeline(opt1);
+        // pipeline never created in lazy pipeline mode
+        bool pipeline_pending = !d->layer_pipeline_pending.empty() && d->layer_pipeline_pending[i];
+
+        int dret = pipeline_pending ? 0 : layer->destroy_pipeline(opt1);
         if (dret != 0)
         {
             NCNN_LOGE("layer destroy_pipeline failed");
@@ -2134,9 +4190,9 @@ void Net::clear()
         if (layer->typeindex & ncnn::LayerType::CustomBit)
         {
             int custom_index = layer->typeindex & ~ncnn::LayerType::CustomBit;
-            if (d->custom_layer_registry[custom_index].destroyer)
+            if (custom_layer_registry[custom_index].destroyer)
             {
-                d->custom_layer_registry[custom_index].destroyer(layer, d->custom_layer_registry[custom_index].userdata);
+                custom_layer_registry[custom_index].destroyer(layer, custom_layer_registry[custom_index].userdata);
             }
             else
             {
@@ -2147,19 +4203,19 @@ void Net::clear()
         {
             // check overwrite builtin layer destroyer
             int index = -1;
-            const size_t overwrite_builtin_layer_registry_entry_count = d->overwrite_builtin_layer_registry.size();
+            const size_t overwrite_builtin_layer_registry_entry_count = overwrite_builtin_layer_registry.size();
             for (size_t i = 0; i < overwrite_builtin_layer_registry_entry_count; i++)
             {
-                if (d->overwrite_builtin_layer_registry[i].typeindex == layer->typeindex)
+                if (overwrite_builtin_layer_registry[i].typeindex == layer->typeindex)
                 {
                     index = i;
                     break;
                 }
             }
 
-            if (index != -1 && d->overwrite_builtin_layer_registry[index].destroyer)
+            if (index != -1 && overwrite_builtin_layer_registry[index].destroyer)
             {
-                d->overwrite_builtin_layer_registry[index].destroyer(layer, d->overwrite_builtin_layer_registry[index].userdata);
+                overwrite_builtin_layer_registry[index].destroyer(layer, overwrite_builtin_layer_registry[index].userdata);
             }
             else
             {
@@ -2168,6 +4224,29 @@ void Net::clear()
         }
     }
     d->layers.clear();
+    d->layer_overwritten.clear();
+    d->layer_pipeline_pending.clear();
+    d->layers_inherited = false;
+    d->inherited_custom_layer_registry.clear();
+    d->inherited_overwrite_builtin_layer_registry.clear();
+
+    d->clear_memory_plans();
+    d->clear_branch_executor();
+
+#if NCNN_STDIO
+    // unmap after layers referencing the weights are gone
+    for (size_t i = 0; i < d->model_mmaps.size(); i++)
+    {
+        delete d->model_mmaps[i];
+    }
+    d->model_mmaps.clear();
+
+    for (size_t i = 0; i < d->model_containers.size(); i++)
+    {
+        delete d->model_containers[i];
+    }
+    d->model_containers.clear();
+#endif // NCNN_STDIO
 
     if (d->local_blob_allocator)
     {
@@ -2227,6 +4306,26 @@ const std::vector<const char*>& Net::output_names() const
 }
 #endif
 
+void Net::set_profiler(Profiler* profiler)
+{
+    d->profiler = profiler;
+}
+
+const std::vector<double>& Net::layer_load_times() const
+{
+    return d->layer_load_times;
+}
+
+const std::vector<double>& Net::layer_pipeline_times() const
+{
+    return d->layer_pipeline_times;
+}
+
+const std::vector<unsigned char>& Net::layer_overwritten() const
+{
+    return d->layer_overwritten;
+}
+
 const std::vector<Blob>& Net::blobs() const
 {
     return d->blobs;
@@ -2372,11 +4471,26 @@ public:
     ExtractorPrivate(const Net* _net)
         : net(_net)
     {
+        memory_plan_allocator = 0;
+        branch_blob_allocator = 0;
+        profiler = 0;
+        memory_tracker = 0;
+        untracked_blob_allocator = 0;
+        untracked_workspace_allocator = 0;
     }
     const Net* net;
     std::vector<Mat> blob_mats;
     Option opt;
 
+    MemoryPlanAllocator* memory_plan_allocator;
+    Allocator* branch_blob_allocator;
+    Profiler* profiler;
+    TrackingAllocator* memory_tracker;
+
+    // allocators replaced by memory_tracker, restored when it is unset
+    Allocator* untracked_blob_allocator;
+    Allocator* untracked_workspace_allocator;
+
 #if NCNN_VULKAN
     VkAllocator* local_blob_vkallocator;
     VkAllocator* local_staging_vkallocator;
@@ -2391,6 +4505,7 @@ Extractor::Extractor(const Net* _net, size_t blob_count)
 {
     d->blob_mats.resize(blob_count);
     d->opt = d->net->opt;
+    d->profiler = d->net->d->profiler;
 
 #if NCNN_VULKAN
     if (d->net->opt.use_vulkan_compute)
@@ -2417,6 +4532,11 @@ Extractor::Extractor(const Extractor& rhs)
     d->net = rhs.d->net;
     d->blob_mats = rhs.d->blob_mats;
     d->opt = rhs.d->opt;
+    d->branch_blob_allocator = rhs.d->branch_blob_allocator;
+    d->profiler = rhs.d->profiler;
+    d->memory_tracker = rhs.d->memory_tracker;
+    d->untracked_blob_allocator = rhs.d->untracked_blob_allocator;
+    d->untracked_workspace_allocator = rhs.d->untracked_workspace_allocator;
 
 #if NCNN_VULKAN
     d->local_blob_vkallocator = 0;
@@ -2432,9 +4552,21 @@ Extractor& Extractor::operator=(const Extractor& rhs)
     if (this == &rhs)
         return *this;
 
-    d->net = rhs.d->net;
     d->blob_mats = rhs.d->blob_mats;
+
+    if (d->memory_plan_allocator)
+    {
+        d->net->d->reclaim_memory_plan_allocator(d->memory_plan_allocator);
+        d->memory_plan_allocator = 0;
+    }
+
+    d->net = rhs.d->net;
     d->opt = rhs.d->opt;
+    d->branch_blob_allocator = rhs.d->branch_blob_allocator;
+    d->profiler = rhs.d->profiler;
+    d->memory_tracker = rhs.d->memory_tracker;
+    d->untracked_blob_allocator = rhs.d->untracked_blob_allocator;
+    d->untracked_workspace_allocator = rhs.d->untracked_workspace_allocator;
 
 #if NCNN_VULKAN
     d->local_blob_vkallocator = 0;
@@ -2451,6 +4583,12 @@ void Extractor::clear()
 {
     d->blob_mats.clear();
 
+    if (d->memory_plan_allocator)
+    {
+        d->net->d->reclaim_memory_plan_allocator(d->memory_plan_allocator);
+        d->memory_plan_allocator = 0;
+    }
+
 #if NCNN_VULKAN
     if (d->opt.use_vulkan_compute)
     {
@@ -2469,11 +4607,53 @@ void Extractor::clear()
 #endif // NCNN_VULKAN
 }
 
+size_t Extractor::memory_plan_size() const
+{
+    if (d->memory_plan_allocator)
+        return d->net->d->get_memory_plan_size(d->memory_plan_allocator->shape_key);
+
+    std::vector<int> shape_key;
+    get_memory_plan_shape_key(d->blob_mats, d->opt, shape_key);
+    return d->net->d->get_memory_plan_size(shape_key);
+}
+
 void Extractor::set_light_mode(bool enable)
 {
     d->opt.lightmode = enable;
 }
 
+void Extractor::set_branch_parallel(bool enable)
+{
+    d->opt.use_branch_parallel = enable;
+}
+
+void Extractor::set_profiler(Profiler* profiler)
+{
+    d->profiler = profiler;
+}
+
+void Extractor::set_memory_tracker(TrackingAllocator* tracker)
+{
+    if (!d->memory_tracker)
+    {
+        d->untracked_blob_allocator = d->opt.blob_allocator;
+        d->untracked_workspace_allocator = d->opt.workspace_allocator;
+    }
+
+    d->memory_tracker = tracker;
+
+    if (tracker)
+    {
+        d->opt.blob_allocator = tracker;
+        d->opt.workspace_allocator = tracker;
+    }
+    else
+    {
+        d->opt.blob_allocator = d->untracked_blob_allocator;
+        d->opt.workspace_allocator = d->untracked_workspace_allocator;
+    }
+}
+
 void Extractor::set_num_threads(int num_threads)
 {
     NCNN_LOGE("ex.set_num_threads() is no-op, please set net.opt.num_threads=N before net.load_param()");
@@ -2576,8 +4756,6 @@ int Extractor::extract(int blob_index, Mat& feat, int type)
 
     if (d->blob_mats[blob_index].dims == 0)
     {
-        int layer_index = d->net->blobs()[blob_index].producer;
-
         // use local allocator
         if (d->opt.use_local_pool_allocator)
         {
@@ -2591,6 +4769,29 @@ int Extractor::extract(int blob_index, Mat& feat, int type)
             }
         }
 
+        Option opt = d->opt;
+        const bool branch_parallel = opt.use_branch_parallel && opt.num_threads > 1 && !opt.use_vulkan_compute;
+        if (opt.use_static_memory_plan && !opt.use_vulkan_compute && !branch_parallel)
+        {
+            // carve blobs from the static memory plan arena
+            if (!d->memory_plan_allocator)
+            {
+                d->memory_plan_allocator = d->net->d->acquire_memory_plan_allocator(d->blob_mats, d->opt);
+            }
+            opt.blob_allocator = d->memory_plan_allocator;
+        }
+        if (branch_parallel && opt.blob_allocator)
+        {
+            // branches allocate blobs concurrently
+            d->branch_blob_allocator = d->net->d->acquire_branch_allocator(opt.blob_allocator);
+            opt.blob_allocator = d->branch_blob_allocator;
+        }
+        if (branch_parallel && opt.workspace_allocator)
+        {
+            // and workspace too
+            opt.workspace_allocator = d->net->d->acquire_branch_allocator(opt.workspace_allocator);
+        }
+
 #if NCNN_VULKAN
         if (d->opt.use_vulkan_compute)
         {
@@ -2671,12 +4872,23 @@ int Extractor::extract(int blob_index, Mat& feat, int type)
                 }
             }
         }
+        else if (branch_parallel)
+        {
+            ret = d->net->d->forward_blob_branch_parallel(blob_index, d->blob_mats, opt, d->profiler, d->memory_tracker);
+        }
         else
         {
-            ret = d->net->d->forward_layer(layer_index, d->blob_mats, d->opt);
+            ret = d->net->d->forward_blob(blob_index, d->blob_mats, opt, d->profiler, d->memory_tracker);
         }
 #else
-        ret = d->net->d->forward_layer(layer_index, d->blob_mats, d->opt);
+        if (branch_parallel)
+        {
+            ret = d->net->d->forward_blob_branch_parallel(blob_index, d->blob_mats, opt, d->profiler, d->memory_tracker);
+        }
+        else
+        {
+            ret = d->net->d->forward_blob(blob_index, d->blob_mats, opt, d->profiler, d->memory_tracker);
+        }
 #endif // NCNN_VULKAN
     }
 
@@ -2731,6 +4943,20 @@ int Extractor::extract(int blob_index, Mat& feat, int type)
         feat = feat.clone();
     }
 
+    if (d->branch_blob_allocator && feat.allocator == d->branch_blob_allocator)
+    {
+        // detach the returned mat from locked blob allocator
+        // so we could destroy net instance much earlier
+        feat = feat.clone();
+    }
+
+    if (d->memory_plan_allocator && feat.allocator == d->memory_plan_allocator)
+    {
+        // detach the returned mat from memory plan arena
+        // which is recycled by the next extractor
+        feat = feat.clone();
+    }
+
     set_kmp_blocktime(old_blocktime);
     set_flush_denormals(old_flush_denormals);
 
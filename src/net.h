@@ -34,7 +34,9 @@ class VkCompute;
 #endif // NCNN_VULKAN
 class DataReader;
 class Extractor;
+class ModelContainer;
 class NetPrivate;
+class Profiler;
 class NCNN_EXPORT Net
 {
 public:
@@ -92,8 +94,43 @@ public:
     // return 0 if success
     int load_model(FILE* fp);
     int load_model(const char* modelpath);
+
+    // load network weight data from memory mapped model file
+    // weight data is referenced in place when possible and paged in on demand
+    // the mapping is owned by net and released on clear
+    // return 0 if success
+    int load_model_mmap(const char* modelpath);
+
+    // load network structure and weight data from single file model container
+    // the container is memory mapped and owned by net, weight data is referenced in place
+    // return 0 if success
+    int load_container(const char* path);
+
+    // start loading network weight data from model file on a background thread
+    // the file is owned by net until loading finishes
+    // return 0 if loading started
+    int load_model_async(const char* modelpath);
 #endif // NCNN_STDIO
 
+    // start loading network weight data on a background thread and return immediately
+    // extractors may run meanwhile, each layer waits until its weights are loaded and its pipeline created
+    // so that early layers run while later weights are still streaming in
+    // the data reader should be retained until wait_model_loaded() returns
+    // return 0 if loading started
+    int load_model_async(const DataReader& dr);
+
+    // wait for loading started by load_model_async to finish
+    // return 0 if all weights are loaded
+    int wait_model_loaded();
+
+    // load network structure and weight data from opened model container
+    // layer weights are read by random access, concurrently when opt.use_parallel_load
+    // transformed weights in the container are loaded into opt.weight_cache if any
+    // sections used are checked against their crc32 and loading fails on mismatch
+    // weight data is referenced, so the container should be retained when used
+    // return 0 if success
+    int load_container(const ModelContainer& container);
+
     // load network structure from external memory
     // memory pointer must be 32-bit aligned
     // return bytes consumed
@@ -123,6 +160,15 @@ public:
 #endif // __ANDROID_API__ >= 9
 #endif // NCNN_PLATFORM_API
 
+    // share network structure and weight data of another loaded net
+    // layers and their transformed weights are referenced, not copied
+    // options deciding weight layout follow the source net, while
+    // lightmode, num_threads and allocators are kept per net
+    // the source net may be cleared or destroyed first, a net sharing the layers then owns them
+    // but not while extractors of the sharing nets are running
+    // return 0 if success
+    int share_model(const Net& net);
+
     // unload network structure and weight data
     void clear();
 
@@ -140,6 +186,19 @@ public:
     const std::vector<Blob>& blobs() const;
     const std::vector<Layer*>& layers() const;
 
+    // set default profiler of extractors created afterwards, no owner transfer
+    // per-layer records of cpu inference are added to profiler when set
+    // pass 0 to disable, which is the default
+    void set_profiler(Profiler* profiler);
+
+    // milliseconds spent in load_model and create_pipeline of each layer by the last model loading
+    // indexed the same as layers()
+    const std::vector<double>& layer_load_times() const;
+    const std::vector<double>& layer_pipeline_times() const;
+
+    // 1 for layers created by the overwrite builtin layer creator, indexed the same as layers()
+    const std::vector<unsigned char>& layer_overwritten() const;
+
     std::vector<Blob>& mutable_blobs();
     std::vector<Layer*>& mutable_layers();
 
@@ -182,10 +241,30 @@ public:
     // enabled by default
     void set_light_mode(bool enable);
 
+    // enable branch parallel
+    // independent branches run concurrently on a worker pool of the net
+    // disabled by default
+    void set_branch_parallel(bool enable);
+
+    // set profiler collecting per-layer records of cpu inference, no owner transfer
+    // defaults to the one set by net.set_profiler()
+    void set_profiler(Profiler* profiler);
+
+    // record blob and workspace allocations of each layer, no owner transfer
+    // tracker becomes the blob and workspace allocator, and must outlive extracted blobs
+    // blobs carved from the static memory plan arena are not seen by tracker
+    // pass 0 to disable and restore the previous allocators, which is the default
+    void set_memory_tracker(TrackingAllocator* tracker);
+
     // deprecated, no-op
     // instead, set net.opt.num_threads before net.load_param()
     void set_num_threads(int num_threads);
 
+    // get the arena size in bytes of static memory plan for current input shapes
+    // the plan is made after the first extractor with the same input shapes is destroyed
+    // return 0 if no plan available
+    size_t memory_plan_size() const;
+
     // set blob memory allocator
     void set_blob_allocator(Allocator* allocator);
 
@@ -32,6 +32,9 @@ Option::Option()
     pipeline_cache = 0;
 #endif // NCNN_VULKAN
 
+    weight_cache = 0;
+    weight_allocator = 0;
+
     openmp_blocktime = 20;
 
     use_winograd_convolution = true;
@@ -60,7 +63,7 @@ Option::Option()
     use_image_storage = false;
     use_tensor_storage = false;
 
-    use_reserved_0 = false;
+    use_lazy_pipeline = false;
 
     flush_denormals = 3;
 
@@ -77,6 +80,18 @@ Option::Option()
 
     use_fp16_uniform = true;
     use_int8_uniform = true;
+
+    use_static_memory_plan = false;
+    use_branch_parallel = false;
+    use_parallel_load = false;
+    use_fp16_weight = false;
+
+    plan_num_threads = 0;
+}
+
+int get_plan_num_threads(const Option& opt)
+{
+    return opt.plan_num_threads > 0 ? opt.plan_num_threads : opt.num_threads;
 }
 
 } // namespace ncnn
@@ -25,6 +25,7 @@ class PipelineCache;
 #endif // NCNN_VULKAN
 
 class Allocator;
+class WeightCache;
 class NCNN_EXPORT Option
 {
 public:
@@ -61,6 +62,17 @@ public:
     PipelineCache* pipeline_cache;
 #endif // NCNN_VULKAN
 
+    // weight cache for cpu inference
+    // transformed weights made in create_pipeline are looked up and stored here
+    // changes should be applied before loading network structure and weight
+    WeightCache* weight_cache;
+
+    // long-lived memory allocator for cpu inference, such as HugePageAllocator
+    // transformed weights made in create_pipeline and static memory plan arenas are placed here
+    // the allocator should be retained until the net is cleared
+    // changes should be applied before loading network structure and weight
+    Allocator* weight_allocator;
+
     // the time openmp threads busy-wait for more work before going to sleep
     // default value is 20ms to keep the cores enabled
     // without too much extra power consumption afterwards
@@ -117,7 +129,10 @@ public:
     bool use_image_storage;
     bool use_tensor_storage;
 
-    bool use_reserved_0;
+    // create layer pipeline on first forward for cpu inference
+    // layers never run keep their untransformed weights only
+    // disabled by default
+    bool use_lazy_pipeline;
 
     // enable DAZ(Denormals-Are-Zero) and FTZ(Flush-To-Zero)
     // default value is 3
@@ -148,11 +163,39 @@ public:
     bool use_fp16_uniform;
     bool use_int8_uniform;
 
-    bool use_reserved_9;
-    bool use_reserved_10;
-    bool use_reserved_11;
+    // enable static memory plan for cpu inference
+    // blob memory of an extractor is carved from one arena, with offsets planned
+    // from blob lifetimes of the first run with the same input shapes
+    // disabled by default
+    bool use_static_memory_plan;
+
+    // run independent branches of the graph concurrently for cpu inference
+    // num_threads is shared among the branches running at the same time
+    // disabled by default
+    bool use_branch_parallel;
+
+    // create layer pipelines concurrently on num_threads threads for cpu inference
+    // weights of later layers are read while earlier layers transform theirs
+    // custom layers should have thread-safe create_pipeline when enabled
+    // disabled by default
+    bool use_parallel_load;
+
+    // keep transformed weights of x86 convolution and gemm in fp16 for cpu inference
+    // unpacked to fp32 tile by tile with f16c in forward, halves the weight memory
+    // takes effect on f16c capable cpu only
+    // changes should be applied before loading network structure and weight
+    // disabled by default
+    bool use_fp16_weight;
+
+    // thread count create_pipeline plans the tiles of transformed weights for
+    // so that weights transformed on fewer threads still run on this many threads in forward
+    // 0 follows num_threads, which is the default
+    int plan_num_threads;
 };
 
+// thread count create_pipeline plans for, plan_num_threads if set or num_threads
+NCNN_EXPORT int get_plan_num_threads(const Option& opt);
+
 } // namespace ncnn
 
 #endif // NCNN_OPTION_H
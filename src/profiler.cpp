@@ -0,0 +1,832 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "profiler.h"
+
+#include "benchmark.h"
+#include "cpu.h"
+#include "layer.h"
+#include "layer_type.h"
+
+#include "layer/batchnorm.h"
+#include "layer/convolution.h"
+#include "layer/convolution1d.h"
+#include "layer/convolution3d.h"
+#include "layer/convolutiondepthwise.h"
+#include "layer/convolutiondepthwise1d.h"
+#include "layer/convolutiondepthwise3d.h"
+#include "layer/deconvolution.h"
+#include "layer/deconvolution1d.h"
+#include "layer/deconvolution3d.h"
+#include "layer/deconvolutiondepthwise.h"
+#include "layer/deconvolutiondepthwise1d.h"
+#include "layer/deconvolutiondepthwise3d.h"
+#include "layer/embed.h"
+#include "layer/gemm.h"
+#include "layer/groupnorm.h"
+#include "layer/gru.h"
+#include "layer/innerproduct.h"
+#include "layer/instancenorm.h"
+#include "layer/layernorm.h"
+#include "layer/lstm.h"
+#include "layer/memorydata.h"
+#include "layer/multiheadattention.h"
+#include "layer/pooling.h"
+#include "layer/pooling1d.h"
+#include "layer/pooling3d.h"
+#include "layer/prelu.h"
+#include "layer/rnn.h"
+#include "layer/scale.h"
+#include "layer/weight_quant.h"
+
+#include <stdio.h>
+
+#if defined __linux__
+#include <linux/perf_event.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace ncnn {
+
+LayerCost::LayerCost()
+{
+    flops = 0;
+    bytes_read = 0;
+    bytes_written = 0;
+    weight_bytes = 0;
+}
+
+// unpacked element count
+static double get_elements(const Mat& m)
+{
+    if (m.dims == 0)
+        return 0;
+
+    return (double)m.w * m.h * m.d * m.c * m.elempack;
+}
+
+static double get_bytes(const Mat& m)
+{
+    if (m.dims == 0)
+        return 0;
+
+    return (double)m.w * m.h * m.d * m.c * m.elemsize;
+}
+
+// unpacked size of the outermost axis
+static int get_outer_size(const Mat& m)
+{
+    if (m.dims == 1)
+        return m.w * m.elempack;
+    if (m.dims == 2)
+        return m.h * m.elempack;
+    return m.c * m.elempack;
+}
+
+// kernel elements per output channel of convolution, or per input channel of deconvolution
+// dynamic weight blob has output or input channel outermost
+static double get_kernel_elements(const std::vector<Mat>& bottom_shapes, int dynamic_weight, int weight_data_size, int channels)
+{
+    if (dynamic_weight && bottom_shapes.size() >= 2)
+    {
+        const Mat& weight = bottom_shapes[1];
+        const int outer = get_outer_size(weight);
+        return outer ? get_elements(weight) / outer : 0;
+    }
+
+    return channels ? (double)weight_data_size / channels : 0;
+}
+
+// packed gemm and convolution weights kept in fp16 by use_fp16_weight, see gemm_x86 and convolution_x86
+static bool is_fp16_weight(const Option& opt)
+{
+    return opt.use_fp16_weight && cpu_support_x86_f16c();
+}
+
+// innerproduct weights converted to fp16 for fp16 storage
+static bool is_fp16_storage_weight(const Option& opt)
+{
+    return opt.use_fp16_storage && (cpu_support_x86_f16c() || cpu_support_arm_asimdhp());
+}
+
+// group-wise quantized rows of K plus one fp32 scale per group
+static double get_weight_quant_bytes(int N, int K, int bits, int group_size)
+{
+    return (double)N * (weight_quant_row_bytes(K, bits) + weight_quant_group_count(K, group_size) * 4);
+}
+
+template<typename T>
+static void get_convolution_cost(const T* op, int dynamic_weight, int weight_elemsize, const std::vector<Mat>& bottom_shapes, double top_elements, LayerCost& cost)
+{
+    cost.flops = 2 * top_elements * get_kernel_elements(bottom_shapes, dynamic_weight, op->weight_data_size, op->num_output);
+    cost.weight_bytes = (double)op->weight_data_size * weight_elemsize + (op->bias_term ? op->num_output * 4 : 0);
+}
+
+template<typename T>
+static void get_deconvolution_cost(const T* op, int dynamic_weight, const std::vector<Mat>& bottom_shapes, LayerCost& cost)
+{
+    const int channels = bottom_shapes.empty() ? 0 : get_outer_size(bottom_shapes[0]);
+    const double bottom_elements = bottom_shapes.empty() ? 0 : get_elements(bottom_shapes[0]);
+    cost.flops = 2 * bottom_elements * get_kernel_elements(bottom_shapes, dynamic_weight, op->weight_data_size, channels);
+    cost.weight_bytes = (double)op->weight_data_size * 4 + (op->bias_term ? op->num_output * 4 : 0);
+}
+
+LayerCost get_layer_cost(const Layer* layer, bool builtin, const std::vector<Mat>& bottom_shapes, const std::vector<Mat>& top_shapes, const Option& opt)
+{
+    LayerCost cost;
+
+    double bottom_elements = 0;
+    double top_elements = 0;
+    for (size_t i = 0; i < bottom_shapes.size(); i++)
+    {
+        bottom_elements += get_elements(bottom_shapes[i]);
+        cost.bytes_read += get_bytes(bottom_shapes[i]);
+    }
+    for (size_t i = 0; i < top_shapes.size(); i++)
+    {
+        top_elements += get_elements(top_shapes[i]);
+        cost.bytes_written += get_bytes(top_shapes[i]);
+    }
+
+    if (!builtin || (layer->typeindex & LayerType::CustomBit))
+    {
+        // the layer class is unknown, its params can not be read
+        cost.flops = -1;
+        cost.weight_bytes = -1;
+        return cost;
+    }
+
+    const Mat bottom_shape = bottom_shapes.empty() ? Mat() : bottom_shapes[0];
+
+    // element-wise by default, one op per output element and extra input
+    cost.flops = top_elements * (bottom_shapes.size() > 2 ? bottom_shapes.size() - 1 : 1);
+
+    switch (layer->typeindex)
+    {
+    case LayerType::Input:
+    case LayerType::Noop:
+    case LayerType::Split:
+        // blobs are referenced, not copied
+        cost.flops = 0;
+        cost.bytes_read = 0;
+        cost.bytes_written = 0;
+        break;
+    case LayerType::Cast:
+    case LayerType::Concat:
+    case LayerType::CopyTo:
+    case LayerType::Crop:
+    case LayerType::DeepCopy:
+    case LayerType::ExpandDims:
+    case LayerType::Flatten:
+    case LayerType::Packing:
+    case LayerType::Padding:
+    case LayerType::Permute:
+    case LayerType::PixelShuffle:
+    case LayerType::Reorg:
+    case LayerType::Reshape:
+    case LayerType::ShuffleChannel:
+    case LayerType::Slice:
+    case LayerType::Squeeze:
+    case LayerType::Tile:
+        cost.flops = 0;
+        break;
+    case LayerType::Convolution:
+    {
+        const Convolution* op = (const Convolution*)layer;
+        // winograd kernels stay in fp32
+        const bool winograd = opt.use_winograd_convolution && op->kernel_w == 3 && op->kernel_h == 3 && op->stride_w == 1 && op->stride_h == 1 && op->dilation_w == 1 && op->dilation_h == 1;
+        const int weight_elemsize = op->int8_scale_term ? 1 : (!op->dynamic_weight && !winograd && is_fp16_weight(opt)) ? 2 : 4;
+        get_convolution_cost(op, op->dynamic_weight, weight_elemsize, bottom_shapes, top_elements, cost);
+        break;
+    }
+    case LayerType::ConvolutionDepthWise:
+    {
+        const ConvolutionDepthWise* op = (const ConvolutionDepthWise*)layer;
+        get_convolution_cost(op, op->dynamic_weight, op->int8_scale_term ? 1 : 4, bottom_shapes, top_elements, cost);
+        break;
+    }
+    case LayerType::Convolution1D:
+    {
+        const Convolution1D* op = (const Convolution1D*)layer;
+        get_convolution_cost(op, op->dynamic_weight, 4, bottom_shapes, top_elements, cost);
+        break;
+    }
+    case LayerType::ConvolutionDepthWise1D:
+    {
+        const ConvolutionDepthWise1D* op = (const ConvolutionDepthWise1D*)layer;
+        get_convolution_cost(op, op->dynamic_weight, 4, bottom_shapes, top_elements, cost);
+        break;
+    }
+    case LayerType::Convolution3D:
+        get_convolution_cost((const Convolution3D*)layer, 0, 4, bottom_shapes, top_elements, cost);
+        break;
+    case LayerType::ConvolutionDepthWise3D:
+        get_convolution_cost((const ConvolutionDepthWise3D*)layer, 0, 4, bottom_shapes, top_elements, cost);
+        break;
+    case LayerType::Deconvolution:
+    {
+        const Deconvolution* op = (const Deconvolution*)layer;
+        get_deconvolution_cost(op, op->dynamic_weight, bottom_shapes, cost);
+        break;
+    }
+    case LayerType::DeconvolutionDepthWise:
+    {
+        const DeconvolutionDepthWise* op = (const DeconvolutionDepthWise*)layer;
+        get_deconvolution_cost(op, op->dynamic_weight, bottom_shapes, cost);
+        break;
+    }
+    case LayerType::Deconvolution1D:
+    {
+        const Deconvolution1D* op = (const Deconvolution1D*)layer;
+        get_deconvolution_cost(op, op->dynamic_weight, bottom_shapes, cost);
+        break;
+    }
+    case LayerType::DeconvolutionDepthWise1D:
+    {
+        const DeconvolutionDepthWise1D* op = (const DeconvolutionDepthWise1D*)layer;
+        get_deconvolution_cost(op, op->dynamic_weight, bottom_shapes, cost);
+        break;
+    }
+    case LayerType::Deconvolution3D:
+        get_deconvolution_cost((const Deconvolution3D*)layer, 0, bottom_shapes, cost);
+        break;
+    case LayerType::DeconvolutionDepthWise3D:
+        get_deconvolution_cost((const DeconvolutionDepthWise3D*)layer, 0, bottom_shapes, cost);
+        break;
+    case LayerType::InnerProduct:
+    {
+        const InnerProduct* op = (const InnerProduct*)layer;
+        const int weight_elemsize = op->int8_scale_term ? 1 : is_fp16_storage_weight(opt) ? 2 : 4;
+        get_convolution_cost(op, 0, weight_elemsize, bottom_shapes, top_elements, cost);
+        if (op->weight_quant_bits && op->num_output)
+        {
+            const int num_input = op->weight_data_size / op->num_output;
+            cost.weight_bytes = get_weight_quant_bytes(op->num_output, num_input, op->weight_quant_bits, op->weight_quant_group_size) + (op->bias_term ? op->num_output * 4 : 0);
+        }
+        break;
+    }
+    case LayerType::Gemm:
+    {
+        const Gemm* op = (const Gemm*)layer;
+        int K = op->constantK;
+        if (!op->constantA && !bottom_shapes.empty())
+        {
+            K = op->transA ? get_outer_size(bottom_shape) : bottom_shape.w;
+        }
+        cost.flops = 2 * top_elements * K;
+        const int weight_elemsize = is_fp16_weight(opt) ? 2 : 4;
+        if (op->constantA)
+            cost.weight_bytes += (double)op->constantM * op->constantK * weight_elemsize;
+        if (op->constantB && op->weight_quant_bits)
+            cost.weight_bytes += get_weight_quant_bytes(op->constantN, op->constantK, op->weight_quant_bits, op->weight_quant_group_size);
+        else if (op->constantB)
+            cost.weight_bytes += (double)op->constantN * op->constantK * weight_elemsize;
+        if (op->constantC)
+            cost.weight_bytes += get_bytes(op->C_data);
+        break;
+    }
+    case LayerType::MatMul:
+        cost.flops = 2 * top_elements * bottom_shape.w;
+        break;
+    case LayerType::MultiHeadAttention:
+    {
+        const MultiHeadAttention* op = (const MultiHeadAttention*)layer;
+        const double q_len = bottom_shapes.empty() ? 0 : get_outer_size(bottom_shape);
+        const double kv_len = bottom_shapes.size() >= 2 ? get_outer_size(bottom_shapes[1]) : q_len;
+        const double embed_dim = op->embed_dim;
+        const double projection = q_len * embed_dim * embed_dim * 2 + kv_len * (op->kdim + op->vdim) * embed_dim;
+        const double attention = q_len * kv_len * embed_dim * 2;
+        cost.flops = 2 * (projection + attention);
+        cost.weight_bytes = (embed_dim * embed_dim * 2 + (double)(op->kdim + op->vdim) * embed_dim + embed_dim * 4) * 4;
+        break;
+    }
+    case LayerType::LSTM:
+    {
+        const LSTM* op = (const LSTM*)layer;
+        const int num_directions = op->direction == 2 ? 2 : 1;
+        const double step = 4.0 * op->hidden_size * (bottom_shape.w + op->num_output) + (op->num_output != op->hidden_size ? (double)op->hidden_size * op->num_output : 0);
+        cost.flops = 2 * step * bottom_shape.h * num_directions;
+        cost.weight_bytes = step * num_directions * 4;
+        break;
+    }
+    case LayerType::GRU:
+    {
+        const GRU* op = (const GRU*)layer;
+        const int num_directions = op->direction == 2 ? 2 : 1;
+        const double step = 3.0 * op->num_output * (bottom_shape.w + op->num_output);
+        cost.flops = 2 * step * bottom_shape.h * num_directions;
+        cost.weight_bytes = step * num_directions * 4;
+        break;
+    }
+    case LayerType::RNN:
+    {
+        const RNN* op = (const RNN*)layer;
+        const int num_directions = op->direction == 2 ? 2 : 1;
+        const double step = (double)op->num_output * (bottom_shape.w + op->num_output);
+        cost.flops = 2 * step * bottom_shape.h * num_directions;
+        cost.weight_bytes = step * num_directions * 4;
+        break;
+    }
+    case LayerType::Pooling:
+    {
+        const Pooling* op = (const Pooling*)layer;
+        cost.flops = op->global_pooling || op->adaptive_pooling ? bottom_elements : top_elements * op->kernel_w * op->kernel_h;
+        break;
+    }
+    case LayerType::Pooling1D:
+    {
+        const Pooling1D* op = (const Pooling1D*)layer;
+        cost.flops = op->global_pooling || op->adaptive_pooling ? bottom_elements : top_elements * op->kernel_w;
+        break;
+    }
+    case LayerType::Pooling3D:
+    {
+        const Pooling3D* op = (const Pooling3D*)layer;
+        cost.flops = op->global_pooling || op->adaptive_pooling ? bottom_elements : top_elements * op->kernel_w * op->kernel_h * op->kernel_d;
+        break;
+    }
+    case LayerType::BatchNorm:
+        cost.flops = 2 * top_elements;
+        cost.weight_bytes = ((const BatchNorm*)layer)->channels * 2 * 4;
+        break;
+    case LayerType::Scale:
+    {
+        const Scale* op = (const Scale*)layer;
+        cost.flops = (op->bias_term ? 2 : 1) * top_elements;
+        cost.weight_bytes = (double)op->scale_data_size * (op->bias_term ? 2 : 1) * 4;
+        break;
+    }
+    case LayerType::PReLU:
+        cost.flops = 2 * top_elements;
+        cost.weight_bytes = ((const PReLU*)layer)->num_slope * 4;
+        break;
+    case LayerType::LayerNorm:
+    {
+        const LayerNorm* op = (const LayerNorm*)layer;
+        cost.flops = 5 * top_elements;
+        cost.weight_bytes = op->affine ? op->affine_size * 2 * 4 : 0;
+        break;
+    }
+    case LayerType::GroupNorm:
+    {
+        const GroupNorm* op = (const GroupNorm*)layer;
+        cost.flops = 5 * top_elements;
+        cost.weight_bytes = op->affine ? op->channels * 2 * 4 : 0;
+        break;
+    }
+    case LayerType::InstanceNorm:
+    {
+        const InstanceNorm* op = (const InstanceNorm*)layer;
+        cost.flops = 5 * top_elements;
+        cost.weight_bytes = op->affine ? op->channels * 2 * 4 : 0;
+        break;
+    }
+    case LayerType::MVN:
+    case LayerType::Normalize:
+        cost.flops = 5 * top_elements;
+        break;
+    case LayerType::Softmax:
+        // max, exp, sum and scale
+        cost.flops = 4 * top_elements;
+        break;
+    case LayerType::Embed:
+    {
+        // only gathered rows are read
+        const Embed* op = (const Embed*)layer;
+        cost.flops = 0;
+        cost.weight_bytes = (double)op->weight_data_size * 4;
+        cost.bytes_read += top_elements * 4;
+        break;
+    }
+    case LayerType::MemoryData:
+        cost.flops = 0;
+        cost.weight_bytes = cost.bytes_written;
+        break;
+    default:
+        break;
+    }
+
+    if (layer->typeindex != LayerType::Embed)
+        cost.bytes_read += cost.weight_bytes;
+
+    return cost;
+}
+
+LayerProfile::LayerProfile()
+{
+    layer_index = -1;
+    typeindex = -1;
+    use_bf16_storage = false;
+    num_threads = 1;
+    thread_id = 0;
+    start = 0;
+    end = 0;
+    bytes_allocated = 0;
+}
+
+HardwareCounters::HardwareCounters()
+{
+    cycles = -1;
+    instructions = -1;
+    l1d_read_misses = -1;
+    llc_misses = -1;
+    branch_misses = -1;
+}
+
+// perf_event counters of one thread, read at once as a group
+class PerfEventGroup
+{
+public:
+    PerfEventGroup();
+    ~PerfEventGroup();
+
+    // return 0 if any event opened
+    int open();
+
+    int read(HardwareCounters& counters) const;
+
+public:
+    // opened events in group order, index into HardwareCounters fields
+    int fds[5];
+    int fields[5];
+    int count;
+};
+
+PerfEventGroup::PerfEventGroup()
+{
+    count = 0;
+}
+
+PerfEventGroup::~PerfEventGroup()
+{
+#if defined __linux__
+    for (int i = 0; i < count; i++)
+    {
+        close(fds[i]);
+    }
+#endif
+}
+
+int PerfEventGroup::open()
+{
+#if defined __linux__
+    const uint32_t types[5] = {
+        PERF_TYPE_HARDWARE,
+        PERF_TYPE_HARDWARE,
+        PERF_TYPE_HW_CACHE,
+        PERF_TYPE_HARDWARE,
+        PERF_TYPE_HARDWARE
+    };
+    const uint64_t configs[5] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES
+    };
+
+    for (int i = 0; i < 5; i++)
+    {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = types[i];
+        attr.config = configs[i];
+        attr.disabled = count == 0 ? 1 : 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        // calling thread on any cpu
+        const int group_fd = count == 0 ? -1 : fds[0];
+        int fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+        if (fd == -1)
+            continue;
+
+        fds[count] = fd;
+        fields[count] = i;
+        count++;
+    }
+
+    if (count == 0)
+        return -1;
+
+    ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+int PerfEventGroup::read(HardwareCounters& counters) const
+{
+#if defined __linux__
+    uint64_t buf[3 + 5];
+    ssize_t nread = ::read(fds[0], buf, sizeof(buf));
+    if (nread < (ssize_t)(sizeof(uint64_t) * (3 + count)))
+        return -1;
+
+    // scale up when the group was multiplexed with other events
+    const uint64_t time_enabled = buf[1];
+    const uint64_t time_running = buf[2];
+    const double scale = time_running > 0 ? (double)time_enabled / time_running : 1.0;
+
+    int64_t* values[5] = {
+        &counters.cycles,
+        &counters.instructions,
+        &counters.l1d_read_misses,
+        &counters.llc_misses,
+        &counters.branch_misses
+    };
+
+    for (int i = 0; i < count; i++)
+    {
+        *values[fields[i]] = (int64_t)(buf[3 + i] * scale);
+    }
+
+    return 0;
+#else
+    (void)counters;
+    return -1;
+#endif
+}
+
+class ProfilerPrivate
+{
+public:
+    double base_time;
+    std::vector<LayerProfile> records;
+    Mutex lock;
+
+    // thread id + 1 of each thread seen
+    ThreadLocalStorage thread_ids;
+    int thread_count;
+
+    // perf event group of each thread seen
+    bool hardware_counters;
+    ThreadLocalStorage thread_counters;
+    std::vector<PerfEventGroup*> counter_groups;
+};
+
+Profiler::Profiler()
+    : d(new ProfilerPrivate)
+{
+    d->base_time = get_current_time();
+    d->thread_count = 0;
+    d->hardware_counters = false;
+}
+
+Profiler::~Profiler()
+{
+    for (size_t i = 0; i < d->counter_groups.size(); i++)
+    {
+        delete d->counter_groups[i];
+    }
+
+    delete d;
+}
+
+Profiler::Profiler(const Profiler&)
+    : d(0)
+{
+}
+
+Profiler& Profiler::operator=(const Profiler&)
+{
+    return *this;
+}
+
+void Profiler::clear()
+{
+    MutexLockGuard lock(d->lock);
+
+    d->records.clear();
+    d->base_time = get_current_time();
+}
+
+double Profiler::now() const
+{
+    return get_current_time() - d->base_time;
+}
+
+void Profiler::add(const LayerProfile& record)
+{
+    MutexLockGuard lock(d->lock);
+
+    d->records.push_back(record);
+}
+
+std::vector<LayerProfile> Profiler::records() const
+{
+    MutexLockGuard lock(d->lock);
+
+    return d->records;
+}
+
+int Profiler::thread_id() const
+{
+    size_t id = (size_t)d->thread_ids.get();
+    if (id == 0)
+    {
+        MutexLockGuard lock(d->lock);
+
+        id = (size_t)++d->thread_count;
+        d->thread_ids.set((void*)id);
+    }
+
+    return (int)id - 1;
+}
+
+int Profiler::enable_hardware_counters()
+{
+    d->hardware_counters = true;
+
+    HardwareCounters counters;
+    if (read_hardware_counters(counters) != 0)
+    {
+        d->hardware_counters = false;
+        return -1;
+    }
+
+    return 0;
+}
+
+bool Profiler::hardware_counters_enabled() const
+{
+    return d->hardware_counters;
+}
+
+int Profiler::read_hardware_counters(HardwareCounters& counters) const
+{
+    if (!d->hardware_counters)
+        return -1;
+
+    PerfEventGroup* group = (PerfEventGroup*)d->thread_counters.get();
+    if (!group)
+    {
+        group = new PerfEventGroup;
+        if (group->open() != 0)
+        {
+            delete group;
+            return -1;
+        }
+
+        d->thread_counters.set(group);
+
+        MutexLockGuard lock(d->lock);
+        d->counter_groups.push_back(group);
+    }
+
+    return group->read(counters);
+}
+
+#if NCNN_STDIO
+static void write_json_string(FILE* fp, const char* s)
+{
+    fputc('"', fp);
+    for (; *s; s++)
+    {
+        const unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\')
+            fprintf(fp, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(fp, "\\u%04x", c);
+        else
+            fputc(c, fp);
+    }
+    fputc('"', fp);
+}
+
+static const char* get_elemtype(const Mat& m, bool use_bf16_storage)
+{
+    const int elembits = m.elempack ? (int)(m.elemsize * 8 / m.elempack) : 0;
+    if (elembits == 32)
+        return "fp32";
+    if (elembits == 16)
+        return use_bf16_storage ? "bf16" : "fp16";
+    if (elembits == 8)
+        return "int8";
+    return "unknown";
+}
+
+static void write_json_shapes(FILE* fp, const std::vector<Mat>& shapes, bool use_bf16_storage)
+{
+    fprintf(fp, "[");
+    for (size_t i = 0; i < shapes.size(); i++)
+    {
+        const Mat& m = shapes[i];
+        fprintf(fp, "%s{\"dims\":%d,\"w\":%d,\"h\":%d,\"d\":%d,\"c\":%d,\"elempack\":%d,\"elemtype\":\"%s\"}", i == 0 ? "" : ",", m.dims, m.w, m.h, m.d, m.c, m.elempack, get_elemtype(m, use_bf16_storage));
+    }
+    fprintf(fp, "]");
+}
+
+static void write_json_layer_fields(FILE* fp, const LayerProfile& r)
+{
+    fprintf(fp, "\"layer_index\":%d,\"typeindex\":%d,", r.layer_index, r.typeindex);
+#if NCNN_STRING
+    fprintf(fp, "\"type\":");
+    write_json_string(fp, r.type.c_str());
+    fprintf(fp, ",\"name\":");
+    write_json_string(fp, r.name.c_str());
+    fprintf(fp, ",");
+#endif // NCNN_STRING
+    fprintf(fp, "\"num_threads\":%d,\"bytes_allocated\":%lu,", r.num_threads, (unsigned long)r.bytes_allocated);
+    fprintf(fp, "\"flops\":%.0f,\"bytes_read\":%.0f,\"bytes_written\":%.0f,\"weight_bytes\":%.0f,\"bottoms\":", r.cost.flops, r.cost.bytes_read, r.cost.bytes_written, r.cost.weight_bytes);
+    write_json_shapes(fp, r.bottom_shapes, r.use_bf16_storage);
+    fprintf(fp, ",\"tops\":");
+    write_json_shapes(fp, r.top_shapes, r.use_bf16_storage);
+
+    const HardwareCounters& c = r.counters;
+    if (c.cycles != -1)
+        fprintf(fp, ",\"cycles\":%lld", (long long)c.cycles);
+    if (c.instructions != -1)
+        fprintf(fp, ",\"instructions\":%lld", (long long)c.instructions);
+    if (c.l1d_read_misses != -1)
+        fprintf(fp, ",\"l1d_read_misses\":%lld", (long long)c.l1d_read_misses);
+    if (c.llc_misses != -1)
+        fprintf(fp, ",\"llc_misses\":%lld", (long long)c.llc_misses);
+    if (c.branch_misses != -1)
+        fprintf(fp, ",\"branch_misses\":%lld", (long long)c.branch_misses);
+}
+
+int Profiler::save_json(const char* path) const
+{
+    FILE* fp = fopen(path, "wb");
+    if (!fp)
+    {
+        NCNN_LOGE("fopen %s failed", path);
+        return -1;
+    }
+
+    std::vector<LayerProfile> rs = records();
+
+    fprintf(fp, "[\n");
+    for (size_t i = 0; i < rs.size(); i++)
+    {
+        const LayerProfile& r = rs[i];
+
+        fprintf(fp, "{");
+        write_json_layer_fields(fp, r);
+        fprintf(fp, ",\"thread_id\":%d,\"start\":%.3f,\"end\":%.3f}%s\n", r.thread_id, r.start, r.end, i + 1 == rs.size() ? "" : ",");
+    }
+    fprintf(fp, "]\n");
+
+    fclose(fp);
+
+    return 0;
+}
+
+int Profiler::save_chrome_trace(const char* path) const
+{
+    FILE* fp = fopen(path, "wb");
+    if (!fp)
+    {
+        NCNN_LOGE("fopen %s failed", path);
+        return -1;
+    }
+
+    std::vector<LayerProfile> rs = records();
+
+    // complete events with microsecond timestamps
+    fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (size_t i = 0; i < rs.size(); i++)
+    {
+        const LayerProfile& r = rs[i];
+
+        fprintf(fp, "{\"name\":");
+#if NCNN_STRING
+        write_json_string(fp, r.name.c_str());
+        fprintf(fp, ",\"cat\":");
+        write_json_string(fp, r.type.c_str());
+#else
+        fprintf(fp, "\"%d\",\"cat\":\"%d\"", r.layer_index, r.typeindex);
+#endif // NCNN_STRING
+        fprintf(fp, ",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{", r.thread_id, r.start * 1000, (r.end - r.start) * 1000);
+        write_json_layer_fields(fp, r);
+        fprintf(fp, "}}%s\n", i + 1 == rs.size() ? "" : ",");
+    }
+    fprintf(fp, "]}\n");
+
+    fclose(fp);
+
+    return 0;
+}
+#endif // NCNN_STDIO
+
+} // namespace ncnn
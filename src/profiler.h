@@ -0,0 +1,153 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#ifndef NCNN_PROFILER_H
+#define NCNN_PROFILER_H
+
+#include <stdint.h>
+
+#include "platform.h"
+
+#include "mat.h"
+
+namespace ncnn {
+
+class Layer;
+
+// analytic cost of one layer forward, derived from layer parameters and blob shapes
+// flops counts one multiply-add as two, element-wise layers as one per output element
+// bytes count bottom and weight reads and top writes once, cache reuse ignored
+class NCNN_EXPORT LayerCost
+{
+public:
+    LayerCost();
+
+    double flops;
+    double bytes_read;
+    double bytes_written;
+    double weight_bytes;
+};
+
+// estimate cost of layer running on blobs of bottom_shapes producing top_shapes
+// builtin tells the layer comes from the builtin creator, only then its params are read
+// custom layers and overwritten builtin layers get flops and weight_bytes of -1 as unknown
+// weight_bytes follows the weight storage picked by opt, fp16 or group-wise quantized
+NCNN_EXPORT LayerCost get_layer_cost(const Layer* layer, bool builtin, const std::vector<Mat>& bottom_shapes, const std::vector<Mat>& top_shapes, const Option& opt);
+
+// hardware event counts of one thread, -1 if not available
+class NCNN_EXPORT HardwareCounters
+{
+public:
+    HardwareCounters();
+
+    int64_t cycles;
+    int64_t instructions;
+    int64_t l1d_read_misses;
+    int64_t llc_misses;
+    int64_t branch_misses;
+};
+
+// one forward of one layer
+class NCNN_EXPORT LayerProfile
+{
+public:
+    LayerProfile();
+
+    int layer_index;
+    int typeindex;
+#if NCNN_STRING
+    std::string type;
+    std::string name;
+#endif // NCNN_STRING
+
+    // shape, elemsize and elempack of blobs, without data
+    std::vector<Mat> bottom_shapes;
+    std::vector<Mat> top_shapes;
+
+    // blobs stored as bf16 when 16-bit
+    bool use_bf16_storage;
+
+    int num_threads;
+
+    // small integer per thread that ran the layer, in order of first appearance
+    int thread_id;
+
+    // milliseconds since profiler creation or last clear()
+    double start;
+    double end;
+
+    // bytes of top blobs allocated by the layer, in-place output excluded
+    size_t bytes_allocated;
+
+    // analytic flops and memory traffic
+    LayerCost cost;
+
+    // events of the thread running the layer, openmp worker threads not included
+    HardwareCounters counters;
+};
+
+class ProfilerPrivate;
+class NCNN_EXPORT Profiler
+{
+public:
+    Profiler();
+    virtual ~Profiler();
+
+    // drop records and restart the clock
+    void clear();
+
+    // milliseconds since profiler creation or last clear()
+    double now() const;
+
+    // called by net after each layer forward
+    void add(const LayerProfile& record);
+
+    // records in order of layer finish
+    std::vector<LayerProfile> records() const;
+
+    // thread id for the calling thread
+    int thread_id() const;
+
+    // count hardware events of each thread running layers with linux perf_event
+    // counters are opened per thread on first use, events unsupported by the cpu stay -1
+    // return 0 if success, -1 if perf_event is not available, as in most containers
+    int enable_hardware_counters();
+
+    bool hardware_counters_enabled() const;
+
+    // read running counts of the calling thread
+    // return 0 if success
+    int read_hardware_counters(HardwareCounters& counters) const;
+
+#if NCNN_STDIO
+    // write records as json array
+    // return 0 if success
+    int save_json(const char* path) const;
+
+    // write records in chrome trace event format, viewable in chrome://tracing or perfetto
+    // return 0 if success
+    int save_chrome_trace(const char* path) const;
+#endif // NCNN_STDIO
+
+private:
+    Profiler(const Profiler&);
+    Profiler& operator=(const Profiler&);
+
+private:
+    ProfilerPrivate* const d;
+};
+
+} // namespace ncnn
+
+#endif // NCNN_PROFILER_H
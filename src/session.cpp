@@ -0,0 +1,831 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "session.h"
+
+#include "benchmark.h"
+#include "layer_type.h"
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+namespace ncnn {
+
+class InferenceRequest
+{
+public:
+    InferenceRequest()
+    {
+        refcount = 1;
+        done = false;
+        ret = 0;
+        callback = 0;
+        userdata = 0;
+        submit_time = 0;
+    }
+
+    void addref()
+    {
+        MutexLockGuard guard(lock);
+        refcount++;
+    }
+
+    static void release(InferenceRequest* request)
+    {
+        request->lock.lock();
+        int refs = --request->refcount;
+        request->lock.unlock();
+
+        if (refs == 0)
+            delete request;
+    }
+
+    std::vector<int> input_indexes;
+    std::vector<Mat> inputs;
+    std::vector<int> output_indexes;
+    std::vector<Mat> outputs;
+
+    inference_callback_func callback;
+    void* userdata;
+
+    double submit_time;
+
+    Mutex lock;
+    ConditionVariable finished;
+    int refcount;
+    bool done;
+    int ret;
+};
+
+InferenceFuture::InferenceFuture()
+    : request(0)
+{
+}
+
+InferenceFuture::InferenceFuture(InferenceRequest* _request)
+    : request(_request)
+{
+    if (request)
+        request->addref();
+}
+
+InferenceFuture::~InferenceFuture()
+{
+    if (request)
+        InferenceRequest::release(request);
+}
+
+InferenceFuture::InferenceFuture(const InferenceFuture& rhs)
+    : request(rhs.request)
+{
+    if (request)
+        request->addref();
+}
+
+InferenceFuture& InferenceFuture::operator=(const InferenceFuture& rhs)
+{
+    if (this == &rhs)
+        return *this;
+
+    if (rhs.request)
+        rhs.request->addref();
+
+    if (request)
+        InferenceRequest::release(request);
+
+    request = rhs.request;
+
+    return *this;
+}
+
+bool InferenceFuture::valid() const
+{
+    return request != 0;
+}
+
+bool InferenceFuture::ready() const
+{
+    if (!request)
+        return false;
+
+    MutexLockGuard guard(request->lock);
+    return request->done;
+}
+
+int InferenceFuture::wait() const
+{
+    if (!request)
+        return -1;
+
+    MutexLockGuard guard(request->lock);
+    while (!request->done)
+    {
+        request->finished.wait(request->lock);
+    }
+    return request->ret;
+}
+
+const std::vector<Mat>& InferenceFuture::outputs() const
+{
+    static const std::vector<Mat> empty;
+    if (!request)
+        return empty;
+
+    return request->outputs;
+}
+
+InferenceSessionStat::InferenceSessionStat()
+{
+    queue_depth = 0;
+    running = 0;
+    submitted = 0;
+    completed = 0;
+    failed = 0;
+    queue_time_avg = 0;
+    latency_avg = 0;
+    latency_min = 0;
+    latency_max = 0;
+    batches = 0;
+    batch_size_avg = 0;
+}
+
+class InferenceWorker
+{
+public:
+    InferenceSessionPrivate* session;
+    UnlockedPoolAllocator blob_allocator;
+    Thread* thread;
+};
+
+class InferenceSessionPrivate
+{
+public:
+    int run_request(InferenceWorker* worker, InferenceRequest* request);
+    void finish_request(InferenceRequest* request, int ret, double pickup_time);
+    void enqueue(InferenceRequest* request);
+
+    // take requests compatible with batch[0] from queue, lock held
+    void collect_batch(std::vector<InferenceRequest*>& batch);
+
+    // find the row batchable layer chain feeding outputs
+    // return 0 if found, with the bottom blob of the chain and its top blob
+    int find_batch_chain(const std::vector<int>& output_indexes, int& bottom_blob_index, int& top_blob_index) const;
+
+    // stack requests at the batch chain and run the rest per request
+    // return 0 if batched, the per request results are in rets
+    int run_batch(InferenceWorker* worker, const std::vector<InferenceRequest*>& batch, std::vector<int>& rets);
+    void run_requests(InferenceWorker* worker, const std::vector<InferenceRequest*>& batch, double pickup_time);
+
+    static void* worker_thread(void* args);
+
+    const Net* net;
+    PoolAllocator workspace_allocator;
+    std::vector<InferenceWorker*> workers;
+
+    mutable Mutex lock;
+    ConditionVariable cond;
+    std::list<InferenceRequest*> queue;
+    bool stop;
+
+    int max_batch_size;
+    double max_batch_wait;
+
+    // counters guarded by lock
+    int running;
+    unsigned int submitted;
+    unsigned int completed;
+    unsigned int failed;
+    double queue_time_sum;
+    double latency_sum;
+    double latency_min;
+    double latency_max;
+    unsigned int batches;
+    unsigned int batched_requests;
+};
+
+int InferenceSessionPrivate::run_request(InferenceWorker* worker, InferenceRequest* request)
+{
+    if (request->input_indexes.size() != request->inputs.size())
+    {
+        NCNN_LOGE("%d input indexes while %d inputs", (int)request->input_indexes.size(), (int)request->inputs.size());
+        return -1;
+    }
+
+    Extractor ex = net->create_extractor();
+    ex.set_blob_allocator(&worker->blob_allocator);
+    ex.set_workspace_allocator(&workspace_allocator);
+
+    for (size_t i = 0; i < request->input_indexes.size(); i++)
+    {
+        int ret = ex.input(request->input_indexes[i], request->inputs[i]);
+        if (ret != 0)
+            return ret;
+    }
+
+    request->outputs.resize(request->output_indexes.size());
+    for (size_t i = 0; i < request->output_indexes.size(); i++)
+    {
+        Mat& out = request->outputs[i];
+
+        int ret = ex.extract(request->output_indexes[i], out);
+        if (ret != 0)
+            return ret;
+
+        if (out.allocator == &worker->blob_allocator)
+        {
+            // detach the returned mat from unlocked worker allocator
+            // so it could be released on any thread
+            out = out.clone();
+        }
+    }
+
+    return 0;
+}
+
+void InferenceSessionPrivate::finish_request(InferenceRequest* request, int ret, double pickup_time)
+{
+    if (ret != 0)
+    {
+        request->outputs.clear();
+    }
+
+    if (request->callback)
+    {
+        request->callback(ret, request->outputs, request->userdata);
+    }
+
+    double end = get_current_time();
+    double latency = end - request->submit_time;
+
+    lock.lock();
+    running--;
+    completed++;
+    if (ret != 0)
+    {
+        failed++;
+    }
+    queue_time_sum += pickup_time - request->submit_time;
+    latency_sum += latency;
+    latency_min = std::min(latency_min, latency);
+    latency_max = std::max(latency_max, latency);
+    lock.unlock();
+
+    request->lock.lock();
+    request->ret = ret;
+    request->done = true;
+    request->finished.broadcast();
+    request->lock.unlock();
+
+    InferenceRequest::release(request);
+}
+
+void InferenceSessionPrivate::enqueue(InferenceRequest* request)
+{
+    request->submit_time = get_current_time();
+
+    lock.lock();
+    submitted++;
+    queue.push_back(request);
+    if (max_batch_size > 1)
+    {
+        // a worker collecting a batch may be waiting too
+        cond.broadcast();
+    }
+    else
+    {
+        cond.signal();
+    }
+    lock.unlock();
+
+#if !NCNN_THREADS
+    // no worker thread, run inline on the submitting thread
+    lock.lock();
+    queue.pop_front();
+    running++;
+    lock.unlock();
+
+    double pickup_time = get_current_time();
+    run_requests(workers[0], std::vector<InferenceRequest*>(1, request), pickup_time);
+#endif // NCNN_THREADS
+}
+
+static bool is_batch_compatible(const InferenceRequest* a, const InferenceRequest* b)
+{
+    if (a->input_indexes.size() != b->input_indexes.size() || a->inputs.size() != b->inputs.size() || a->output_indexes.size() != b->output_indexes.size())
+        return false;
+
+    for (size_t i = 0; i < a->input_indexes.size(); i++)
+    {
+        if (a->input_indexes[i] != b->input_indexes[i])
+            return false;
+    }
+
+    for (size_t i = 0; i < a->output_indexes.size(); i++)
+    {
+        if (a->output_indexes[i] != b->output_indexes[i])
+            return false;
+    }
+
+    for (size_t i = 0; i < a->inputs.size(); i++)
+    {
+        const Mat& m0 = a->inputs[i];
+        const Mat& m1 = b->inputs[i];
+        if (m0.dims != m1.dims || m0.w != m1.w || m0.h != m1.h || m0.d != m1.d || m0.c != m1.c || m0.elemsize != m1.elemsize || m0.elempack != m1.elempack)
+            return false;
+    }
+
+    return true;
+}
+
+void InferenceSessionPrivate::collect_batch(std::vector<InferenceRequest*>& batch)
+{
+    std::list<InferenceRequest*>::iterator it = queue.begin();
+    while (it != queue.end() && (int)batch.size() < max_batch_size)
+    {
+        if (is_batch_compatible(batch[0], *it))
+        {
+            batch.push_back(*it);
+            it = queue.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+// layers filled in by hand through mutable_layers() are not known to be builtin
+static bool is_builtin_layer(const std::vector<unsigned char>& layer_overwritten, size_t layer_index)
+{
+    return layer_index < layer_overwritten.size() && !layer_overwritten[layer_index];
+}
+
+static bool is_row_batchable(const Layer* layer, bool builtin)
+{
+    if (!layer->one_blob_only || layer->bottoms.size() != 1 || layer->tops.size() != 1)
+        return false;
+
+    // builtin layers overwritten by the user may not treat rows independently
+    if (!builtin)
+        return false;
+
+    // elementwise layers behave the same on one vector and on stacked vectors
+    // Gemm with constant B would too, but its params are not readable without
+    // casting, which is wrong for builtin layers overwritten by the user
+    switch (layer->typeindex)
+    {
+    case LayerType::InnerProduct:
+    case LayerType::AbsVal:
+    case LayerType::BNLL:
+    case LayerType::Clip:
+    case LayerType::Dropout:
+    case LayerType::ELU:
+    case LayerType::GELU:
+    case LayerType::HardSigmoid:
+    case LayerType::HardSwish:
+    case LayerType::Mish:
+    case LayerType::ReLU:
+    case LayerType::SELU:
+    case LayerType::Sigmoid:
+    case LayerType::Swish:
+    case LayerType::TanH:
+        return true;
+    default:
+        return false;
+    }
+}
+
+int InferenceSessionPrivate::find_batch_chain(const std::vector<int>& output_indexes, int& bottom_blob_index, int& top_blob_index) const
+{
+    const std::vector<Blob>& blobs = net->blobs();
+    const std::vector<Layer*>& layers = net->layers();
+    const std::vector<unsigned char>& layer_overwritten = net->layer_overwritten();
+
+    // mark layers the outputs depend on
+    std::vector<unsigned char> layer_needed(layers.size(), 0);
+    std::vector<int> blob_stack;
+    for (size_t i = 0; i < output_indexes.size(); i++)
+    {
+        if (output_indexes[i] < 0 || output_indexes[i] >= (int)blobs.size())
+            return -1;
+
+        blob_stack.push_back(output_indexes[i]);
+    }
+    while (!blob_stack.empty())
+    {
+        int producer = blobs[blob_stack.back()].producer;
+        blob_stack.pop_back();
+        if (producer == -1 || layer_needed[producer])
+            continue;
+
+        layer_needed[producer] = 1;
+        const Layer* layer = layers[producer];
+        for (size_t i = 0; i < layer->bottoms.size(); i++)
+        {
+            blob_stack.push_back(layer->bottoms[i]);
+        }
+    }
+
+    // the first needed InnerProduct in layer order starts the chain
+    int first_layer_index = -1;
+    for (size_t i = 0; i < layers.size(); i++)
+    {
+        if (layer_needed[i] && layers[i]->typeindex == LayerType::InnerProduct && is_row_batchable(layers[i], is_builtin_layer(layer_overwritten, i)))
+        {
+            first_layer_index = (int)i;
+            break;
+        }
+    }
+
+    if (first_layer_index == -1)
+        return -1;
+
+    bottom_blob_index = layers[first_layer_index]->bottoms[0];
+    top_blob_index = layers[first_layer_index]->tops[0];
+
+    // extend with the following row batchable layers
+    for (;;)
+    {
+        int consumer = blobs[top_blob_index].consumer;
+        if (consumer == -1 || !layer_needed[consumer] || !is_row_batchable(layers[consumer], is_builtin_layer(layer_overwritten, consumer)))
+            break;
+
+        top_blob_index = layers[consumer]->tops[0];
+    }
+
+    return 0;
+}
+
+int InferenceSessionPrivate::run_batch(InferenceWorker* worker, const std::vector<InferenceRequest*>& batch, std::vector<int>& rets)
+{
+    const InferenceRequest* request0 = batch[0];
+    if (request0->input_indexes.size() != request0->inputs.size())
+        return -1;
+
+    int bottom_blob_index = -1;
+    int top_blob_index = -1;
+    if (find_batch_chain(request0->output_indexes, bottom_blob_index, top_blob_index) != 0)
+        return -1;
+
+    const int batch_size = (int)batch.size();
+
+    // per request part before the chain
+    // light mode is off so that outputs before the chain remain available
+    std::vector<Extractor*> extractors(batch_size);
+    std::vector<Mat> bottoms(batch_size);
+    int ret = 0;
+    for (int i = 0; i < batch_size; i++)
+    {
+        Extractor* ex = new Extractor(net->create_extractor());
+        ex->set_light_mode(false);
+        ex->set_blob_allocator(&worker->blob_allocator);
+        ex->set_workspace_allocator(&workspace_allocator);
+        extractors[i] = ex;
+
+        // a bad input fails the batch, and the requests are retried one by one
+        for (size_t j = 0; ret == 0 && j < batch[i]->input_indexes.size(); j++)
+        {
+            ret = ex->input(batch[i]->input_indexes[j], batch[i]->inputs[j]);
+        }
+        if (ret != 0)
+            break;
+
+        ret = ex->extract(bottom_blob_index, bottoms[i]);
+        if (ret != 0)
+            break;
+
+        // a matrix already runs as rows of its own
+        const Mat& b = bottoms[i];
+        if (b.dims == 2 || b.w * b.h * b.d * b.c != bottoms[0].w * bottoms[0].h * bottoms[0].d * bottoms[0].c)
+        {
+            ret = -1;
+            break;
+        }
+    }
+
+    Mat stacked;
+    if (ret == 0)
+    {
+        // stack flattened bottoms along a new outer axis
+        const int size = bottoms[0].w * bottoms[0].h * bottoms[0].d * bottoms[0].c;
+        stacked.create(size, batch_size, 4u, &worker->blob_allocator);
+        for (int i = 0; i < batch_size; i++)
+        {
+            Mat flattened = bottoms[i].reshape(size);
+            memcpy(stacked.row(i), flattened, size * sizeof(float));
+        }
+
+        Extractor ex = net->create_extractor();
+        ex.set_blob_allocator(&worker->blob_allocator);
+        ex.set_workspace_allocator(&workspace_allocator);
+        ret = ex.input(bottom_blob_index, stacked);
+
+        Mat tops;
+        if (ret == 0)
+            ret = ex.extract(top_blob_index, tops);
+        if (ret == 0 && (tops.dims != 2 || tops.h != batch_size))
+        {
+            ret = -1;
+        }
+
+        // feed each row back and run the rest per request
+        for (int i = 0; ret == 0 && i < batch_size; i++)
+        {
+            ret = extractors[i]->input(top_blob_index, Mat(tops.w, (void*)tops.row(i), 4u).clone(&worker->blob_allocator));
+        }
+    }
+
+    if (ret == 0)
+    {
+        for (int i = 0; i < batch_size; i++)
+        {
+            InferenceRequest* request = batch[i];
+
+            rets[i] = 0;
+            request->outputs.resize(request->output_indexes.size());
+            for (size_t j = 0; j < request->output_indexes.size(); j++)
+            {
+                Mat& out = request->outputs[j];
+
+                rets[i] = extractors[i]->extract(request->output_indexes[j], out);
+                if (rets[i] != 0)
+                    break;
+
+                if (out.allocator == &worker->blob_allocator)
+                {
+                    out = out.clone();
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < batch_size; i++)
+    {
+        delete extractors[i];
+    }
+
+    return ret;
+}
+
+void InferenceSessionPrivate::run_requests(InferenceWorker* worker, const std::vector<InferenceRequest*>& batch, double pickup_time)
+{
+    std::vector<int> rets(batch.size(), 0);
+
+    bool batched = batch.size() > 1 && run_batch(worker, batch, rets) == 0;
+    if (!batched)
+    {
+        // not batchable, one by one
+        for (size_t i = 0; i < batch.size(); i++)
+        {
+            rets[i] = run_request(worker, batch[i]);
+        }
+    }
+
+    lock.lock();
+    batches += batched ? 1 : (unsigned int)batch.size();
+    batched_requests += (unsigned int)batch.size();
+    lock.unlock();
+
+    for (size_t i = 0; i < batch.size(); i++)
+    {
+        finish_request(batch[i], rets[i], pickup_time);
+    }
+}
+
+void* InferenceSessionPrivate::worker_thread(void* args)
+{
+    InferenceWorker* worker = (InferenceWorker*)args;
+    InferenceSessionPrivate* d = worker->session;
+
+    std::vector<InferenceRequest*> batch;
+    for (;;)
+    {
+        d->lock.lock();
+        while (d->queue.empty() && !d->stop)
+        {
+            d->cond.wait(d->lock);
+        }
+        if (d->queue.empty())
+        {
+            // stop after queued requests are drained
+            d->lock.unlock();
+            break;
+        }
+
+        batch.clear();
+        batch.push_back(d->queue.front());
+        d->queue.pop_front();
+
+        if (d->max_batch_size > 1)
+        {
+            d->collect_batch(batch);
+
+            // wait for more requests until the first one waited long enough
+            // submit wakes us up, the timeout only bounds the wait in whole milliseconds
+            for (;;)
+            {
+                double remaining = d->max_batch_wait - (get_current_time() - batch[0]->submit_time);
+                if ((int)batch.size() >= d->max_batch_size || d->stop || remaining <= 0)
+                    break;
+
+                d->cond.wait(d->lock, (int)ceil(remaining));
+
+                d->collect_batch(batch);
+            }
+        }
+
+        d->running += (int)batch.size();
+        d->lock.unlock();
+
+        double pickup_time = get_current_time();
+        d->run_requests(worker, batch, pickup_time);
+    }
+
+    return 0;
+}
+
+InferenceSession::InferenceSession(const Net* net, int worker_count)
+    : d(new InferenceSessionPrivate)
+{
+    d->net = net;
+    d->stop = false;
+    d->running = 0;
+    d->submitted = 0;
+    d->completed = 0;
+    d->failed = 0;
+    d->queue_time_sum = 0;
+    d->latency_sum = 0;
+    d->latency_min = DBL_MAX;
+    d->latency_max = 0;
+    d->batches = 0;
+    d->batched_requests = 0;
+    d->max_batch_size = 1;
+    d->max_batch_wait = 0;
+
+    if (worker_count < 1)
+        worker_count = 1;
+
+    d->workers.resize(worker_count);
+    for (int i = 0; i < worker_count; i++)
+    {
+        InferenceWorker* worker = new InferenceWorker;
+        worker->session = d;
+        worker->blob_allocator.set_size_compare_ratio(0.f);
+        worker->thread = 0;
+        d->workers[i] = worker;
+    }
+
+#if NCNN_THREADS
+    for (int i = 0; i < worker_count; i++)
+    {
+        d->workers[i]->thread = new Thread(InferenceSessionPrivate::worker_thread, d->workers[i]);
+    }
+#endif // NCNN_THREADS
+}
+
+InferenceSession::~InferenceSession()
+{
+    d->lock.lock();
+    d->stop = true;
+    d->cond.broadcast();
+    d->lock.unlock();
+
+    for (size_t i = 0; i < d->workers.size(); i++)
+    {
+        InferenceWorker* worker = d->workers[i];
+        if (worker->thread)
+        {
+            worker->thread->join();
+            delete worker->thread;
+        }
+        delete worker;
+    }
+
+    delete d;
+}
+
+void InferenceSession::set_batching(int max_batch_size, double max_batch_wait)
+{
+    MutexLockGuard guard(d->lock);
+    d->max_batch_size = max_batch_size < 1 ? 1 : max_batch_size;
+    d->max_batch_wait = max_batch_wait;
+}
+
+#if NCNN_STRING
+static int find_blob_index_by_name(const Net* net, const char* name)
+{
+    const std::vector<Blob>& blobs = net->blobs();
+    for (size_t i = 0; i < blobs.size(); i++)
+    {
+        if (blobs[i].name == name)
+            return static_cast<int>(i);
+    }
+
+    NCNN_LOGE("find_blob_index_by_name %s failed", name);
+    return -1;
+}
+
+InferenceFuture InferenceSession::submit(const std::vector<const char*>& input_names, const std::vector<Mat>& inputs, const std::vector<const char*>& output_names)
+{
+    return submit(input_names, inputs, output_names, 0, 0);
+}
+
+InferenceFuture InferenceSession::submit(const std::vector<const char*>& input_names, const std::vector<Mat>& inputs, const std::vector<const char*>& output_names, inference_callback_func callback, void* userdata)
+{
+    std::vector<int> input_indexes(input_names.size());
+    for (size_t i = 0; i < input_names.size(); i++)
+    {
+        input_indexes[i] = find_blob_index_by_name(d->net, input_names[i]);
+    }
+
+    std::vector<int> output_indexes(output_names.size());
+    for (size_t i = 0; i < output_names.size(); i++)
+    {
+        output_indexes[i] = find_blob_index_by_name(d->net, output_names[i]);
+    }
+
+    return submit(input_indexes, inputs, output_indexes, callback, userdata);
+}
+#endif // NCNN_STRING
+
+InferenceFuture InferenceSession::submit(const std::vector<int>& input_indexes, const std::vector<Mat>& inputs, const std::vector<int>& output_indexes)
+{
+    return submit(input_indexes, inputs, output_indexes, 0, 0);
+}
+
+InferenceFuture InferenceSession::submit(const std::vector<int>& input_indexes, const std::vector<Mat>& inputs, const std::vector<int>& output_indexes, inference_callback_func callback, void* userdata)
+{
+    InferenceRequest* request = new InferenceRequest;
+    request->input_indexes = input_indexes;
+    request->inputs = inputs;
+    request->output_indexes = output_indexes;
+    request->callback = callback;
+    request->userdata = userdata;
+
+    // the queue holds the initial reference until finished
+    InferenceFuture future(request);
+
+    d->enqueue(request);
+
+    return future;
+}
+
+int InferenceSession::queue_depth() const
+{
+    MutexLockGuard guard(d->lock);
+    return (int)d->queue.size();
+}
+
+InferenceSessionStat InferenceSession::stat() const
+{
+    InferenceSessionStat s;
+
+    MutexLockGuard guard(d->lock);
+    s.queue_depth = (int)d->queue.size();
+    s.running = d->running;
+    s.submitted = d->submitted;
+    s.completed = d->completed;
+    s.failed = d->failed;
+    if (d->completed > 0)
+    {
+        s.queue_time_avg = d->queue_time_sum / d->completed;
+        s.latency_avg = d->latency_sum / d->completed;
+        s.latency_min = d->latency_min;
+        s.latency_max = d->latency_max;
+    }
+    s.batches = d->batches;
+    if (d->batches > 0)
+    {
+        s.batch_size_avg = (double)d->batched_requests / d->batches;
+    }
+
+    return s;
+}
+
+void InferenceSession::reset_stat()
+{
+    MutexLockGuard guard(d->lock);
+    d->submitted = 0;
+    d->completed = 0;
+    d->failed = 0;
+    d->queue_time_sum = 0;
+    d->latency_sum = 0;
+    d->latency_min = DBL_MAX;
+    d->latency_max = 0;
+    d->batches = 0;
+    d->batched_requests = 0;
+}
+
+} // namespace ncnn
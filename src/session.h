@@ -0,0 +1,140 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#ifndef NCNN_SESSION_H
+#define NCNN_SESSION_H
+
+#include "mat.h"
+#include "net.h"
+#include "platform.h"
+
+namespace ncnn {
+
+class InferenceRequest;
+class NCNN_EXPORT InferenceFuture
+{
+public:
+    // empty future
+    InferenceFuture();
+    ~InferenceFuture();
+
+    // copy, shares the same request
+    InferenceFuture(const InferenceFuture& rhs);
+    InferenceFuture& operator=(const InferenceFuture& rhs);
+
+    // whether bound to a submitted request
+    bool valid() const;
+
+    // whether the request is finished, never blocks
+    bool ready() const;
+
+    // block until the request is finished
+    // return 0 if success
+    int wait() const;
+
+    // output mats in the order of requested outputs
+    // available after wait()
+    const std::vector<Mat>& outputs() const;
+
+protected:
+    friend class InferenceSession;
+    InferenceFuture(InferenceRequest* request);
+
+private:
+    InferenceRequest* request;
+};
+
+// called on worker thread when request is finished
+// ret is 0 if success, outputs are in the order of requested outputs
+typedef void (*inference_callback_func)(int ret, const std::vector<Mat>& outputs, void* userdata);
+
+class NCNN_EXPORT InferenceSessionStat
+{
+public:
+    InferenceSessionStat();
+
+    // requests waiting in queue and running on workers now
+    int queue_depth;
+    int running;
+
+    // requests since creation or last reset_stat()
+    unsigned int submitted;
+    unsigned int completed;
+    unsigned int failed;
+
+    // milliseconds of finished requests
+    // queue time is from submit to worker pickup, latency is from submit to finish
+    double queue_time_avg;
+    double latency_avg;
+    double latency_min;
+    double latency_max;
+
+    // forward passes run by workers, a batch counts once
+    unsigned int batches;
+    double batch_size_avg;
+};
+
+class InferenceSessionPrivate;
+class NCNN_EXPORT InferenceSession
+{
+public:
+    // create worker threads running requests on the loaded net
+    // each worker owns a blob pool allocator, workers share a workspace pool allocator
+    // net should be retained until session is destroyed
+    InferenceSession(const Net* net, int worker_count = 1);
+
+    // finish queued requests and join workers
+    ~InferenceSession();
+
+    // coalesce up to max_batch_size queued requests with identical input shapes
+    // a worker waits at most max_batch_wait milliseconds since the first request submitted
+    // requests are stacked at the first InnerProduct feeding outputs, the rest runs per request
+    // max_batch_size 1 disables batching, which is the default
+    void set_batching(int max_batch_size, double max_batch_wait = 0);
+
+#if NCNN_STRING
+    // submit request with inputs and output names
+    // return future that becomes ready when outputs are extracted
+    InferenceFuture submit(const std::vector<const char*>& input_names, const std::vector<Mat>& inputs, const std::vector<const char*>& output_names);
+
+    // submit request and invoke callback when finished
+    InferenceFuture submit(const std::vector<const char*>& input_names, const std::vector<Mat>& inputs, const std::vector<const char*>& output_names, inference_callback_func callback, void* userdata = 0);
+#endif // NCNN_STRING
+
+    // submit request with inputs and outputs by blob index
+    InferenceFuture submit(const std::vector<int>& input_indexes, const std::vector<Mat>& inputs, const std::vector<int>& output_indexes);
+
+    // submit request by blob index and invoke callback when finished
+    InferenceFuture submit(const std::vector<int>& input_indexes, const std::vector<Mat>& inputs, const std::vector<int>& output_indexes, inference_callback_func callback, void* userdata = 0);
+
+    // requests waiting in queue
+    int queue_depth() const;
+
+    // snapshot of queue and latency counters
+    InferenceSessionStat stat() const;
+
+    // reset request counters and latency statistics
+    void reset_stat();
+
+private:
+    InferenceSession(const InferenceSession&);
+    InferenceSession& operator=(const InferenceSession&);
+
+private:
+    InferenceSessionPrivate* const d;
+};
+
+} // namespace ncnn
+
+#endif // NCNN_SESSION_H
@@ -0,0 +1,588 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "weightcache.h"
+
+#include "cpu.h"
+#include "datareader.h"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace ncnn {
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t fmix64(uint64_t k)
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+// https://en.wikipedia.org/wiki/MurmurHash
+// murmur3 style mixing over 64-bit words, not the reference x64_128 output
+static uint64_t murmur3_64(const unsigned char* data, size_t size, uint64_t h)
+{
+    const uint64_t c1 = 0x87c37b91114253d5ULL;
+    const uint64_t c2 = 0x4cf5ad432745937fULL;
+
+    const size_t nblocks = size / 8;
+    for (size_t i = 0; i < nblocks; i++)
+    {
+        uint64_t k;
+        memcpy(&k, data + i * 8, 8);
+
+        k *= c1;
+        k = rotl64(k, 31);
+        k *= c2;
+
+        h ^= k;
+        h = rotl64(h, 27);
+        h = h * 5 + 0x52dce729;
+    }
+
+    uint64_t k = 0;
+    for (size_t i = nblocks * 8; i < size; i++)
+    {
+        k = (k << 8) | data[i];
+    }
+    k *= c1;
+    k = rotl64(k, 31);
+    k *= c2;
+    h ^= k;
+
+    h ^= (uint64_t)size;
+
+    return fmix64(h);
+}
+
+static uint64_t hash_ints(const int* data, int count, uint64_t h)
+{
+    return murmur3_64((const unsigned char*)data, count * sizeof(int), h);
+}
+
+// cpu features and cache sizes select kernels and tile sizes of transformed layout
+// library version is mixed in as kernels may change layout between releases
+static uint64_t cpu_digest()
+{
+    int bits[] = {
+        (int)sizeof(void*),
+        NCNN_MALLOC_ALIGN,
+        cpu_support_arm_neon(),
+        cpu_support_arm_vfpv4(),
+        cpu_support_arm_asimdhp(),
+        cpu_support_arm_asimddp(),
+        cpu_support_arm_asimdfhm(),
+        cpu_support_arm_bf16(),
+        cpu_support_arm_i8mm(),
+        cpu_support_arm_sve(),
+        cpu_support_arm_sve2(),
+        cpu_support_x86_avx(),
+        cpu_support_x86_fma(),
+        cpu_support_x86_xop(),
+        cpu_support_x86_f16c(),
+        cpu_support_x86_avx2(),
+        cpu_support_x86_avx_vnni(),
+        cpu_support_x86_avx512(),
+        cpu_support_x86_avx512_vnni(),
+        cpu_support_x86_avx512_bf16(),
+        cpu_support_x86_avx512_fp16(),
+        cpu_support_loongarch_lsx(),
+        cpu_support_loongarch_lasx(),
+        cpu_support_mips_msa(),
+        cpu_support_loongson_mmi(),
+        cpu_support_riscv_v(),
+        cpu_support_riscv_zfh(),
+        cpu_riscv_vlenb(),
+        get_cpu_level2_cache_size(),
+        get_cpu_level3_cache_size()
+    };
+
+    uint64_t h = murmur3_64((const unsigned char*)NCNN_VERSION_STRING, strlen(NCNN_VERSION_STRING), 0);
+    return hash_ints(bits, sizeof(bits) / sizeof(int), h);
+}
+
+WeightCacheKey::WeightCacheKey(const Option& _opt, const char* _transform, const Mat& _weight, int p0, int p1, int p2, int p3)
+    : opt(&_opt), transform(_transform), weight(&_weight)
+{
+    params[0] = p0;
+    params[1] = p1;
+    params[2] = p2;
+    params[3] = p3;
+
+    digested = false;
+    d0 = 0;
+    d1 = 0;
+}
+
+int WeightCacheKey::lookup(Mat& transformed) const
+{
+    if (!opt->weight_cache)
+        return -1;
+
+    return opt->weight_cache->get(*this, transformed);
+}
+
+void WeightCacheKey::store(Mat& transformed) const
+{
+    if (opt->weight_allocator && transformed.allocator != opt->weight_allocator && !transformed.empty())
+    {
+        Mat relocated = transformed.clone(opt->weight_allocator);
+        if (!relocated.empty())
+            transformed = relocated;
+    }
+
+    if (!opt->weight_cache)
+        return;
+
+    opt->weight_cache->put(*this, transformed);
+}
+
+uint64_t WeightCacheKey::digest0() const
+{
+    make_digest();
+    return d0;
+}
+
+uint64_t WeightCacheKey::digest1() const
+{
+    make_digest();
+    return d1;
+}
+
+void WeightCacheKey::make_digest() const
+{
+    if (digested)
+        return;
+
+    // raw weight content, channel by channel without cstep padding
+    const Mat& w = *weight;
+    const size_t channel_size = (size_t)w.w * w.h * w.d * w.elemsize;
+    uint64_t h = 0;
+    for (int q = 0; q < w.c; q++)
+    {
+        h = murmur3_64((const unsigned char*)w.channel(q).data, channel_size, h);
+    }
+    d0 = h;
+
+    // transform, shape, parameters and options
+    int desc[] = {
+        w.dims,
+        w.w,
+        w.h,
+        w.d,
+        w.c,
+        (int)w.elemsize,
+        w.elempack,
+        params[0],
+        params[1],
+        params[2],
+        params[3],
+        get_plan_num_threads(*opt),
+        opt->use_packing_layout,
+        opt->use_fp16_packed,
+        opt->use_fp16_storage,
+        opt->use_fp16_arithmetic,
+        opt->use_bf16_storage,
+        opt->use_int8_inference,
+        opt->use_int8_packed,
+        opt->use_int8_storage,
+        opt->use_int8_arithmetic,
+        opt->use_a53_a55_optimized_kernel,
+        opt->use_fp16_weight
+    };
+
+    h = murmur3_64((const unsigned char*)transform, strlen(transform), 0);
+    d1 = hash_ints(desc, sizeof(desc) / sizeof(int), h);
+
+    digested = true;
+}
+
+class WeightCachePrivate
+{
+public:
+    struct weight_cache_entry
+    {
+        uint64_t d0;
+        uint64_t d1;
+        Mat m;
+    };
+
+    // on-disk layout, followed by aligned mat data
+    struct weight_cache_header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t entry_count;
+        uint32_t reserved;
+        uint64_t cpu_digest;
+        uint64_t data_offset;
+    };
+
+    struct weight_cache_record
+    {
+        uint64_t d0;
+        uint64_t d1;
+        int dims;
+        int w;
+        int h;
+        int d;
+        int c;
+        int elempack;
+        uint32_t elemsize;
+        uint32_t reserved;
+        uint64_t cstep;
+        uint64_t offset;
+    };
+
+    int find(uint64_t d0, uint64_t d1) const;
+
+    std::vector<weight_cache_entry> entries;
+    mutable int hits;
+
+#if NCNN_STDIO
+    // mapped cache files referenced by entries
+    std::vector<DataReaderFromMmap*> mmaps;
+#endif // NCNN_STDIO
+
+    mutable Mutex lock;
+};
+
+static const uint32_t weight_cache_magic = 0x4357434e; // NCWC
+static const uint32_t weight_cache_version = 1;
+
+// a * b, return false on overflow
+static bool mul_size(size_t a, size_t b, size_t& result)
+{
+    if (a != 0 && b > (size_t)-1 / a)
+        return false;
+
+    result = a * b;
+    return true;
+}
+
+// return 0 if the record describes a mat lying inside the cache of size bytes
+static int check_weight_cache_record(const WeightCachePrivate::weight_cache_record& r, size_t size)
+{
+    if (r.dims < 1 || r.dims > 4 || r.w <= 0 || r.h <= 0 || r.d <= 0 || r.c <= 0)
+        return -1;
+
+    if ((r.dims < 2 && r.h != 1) || (r.dims < 4 && r.d != 1) || (r.dims < 3 && r.c != 1))
+        return -1;
+
+    if (r.elempack <= 0 || r.elemsize == 0 || r.elemsize % r.elempack != 0)
+        return -1;
+
+    if (r.cstep > (uint64_t)(size_t)-1 || r.offset > (uint64_t)size || r.offset % NCNN_MALLOC_ALIGN != 0)
+        return -1;
+
+    size_t wh;
+    size_t whd;
+    if (!mul_size((size_t)r.w, (size_t)r.h, wh) || !mul_size(wh, (size_t)r.d, whd) || (size_t)r.cstep < whd)
+        return -1;
+
+    size_t cstep_bytes;
+    size_t data_size;
+    if (!mul_size((size_t)r.cstep, (size_t)r.elemsize, cstep_bytes) || !mul_size(cstep_bytes, (size_t)r.c, data_size))
+        return -1;
+
+    if (data_size > size - (size_t)r.offset)
+        return -1;
+
+    return 0;
+}
+
+int WeightCachePrivate::find(uint64_t d0, uint64_t d1) const
+{
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        if (entries[i].d0 == d0 && entries[i].d1 == d1)
+            return (int)i;
+    }
+
+    return -1;
+}
+
+WeightCache::WeightCache()
+    : d(new WeightCachePrivate)
+{
+    d->hits = 0;
+}
+
+WeightCache::~WeightCache()
+{
+    clear();
+
+    delete d;
+}
+
+WeightCache::WeightCache(const WeightCache&)
+    : d(0)
+{
+}
+
+WeightCache& WeightCache::operator=(const WeightCache&)
+{
+    return *this;
+}
+
+void WeightCache::clear()
+{
+    MutexLockGuard lock(d->lock);
+
+    d->entries.clear();
+
+#if NCNN_STDIO
+    for (size_t i = 0; i < d->mmaps.size(); i++)
+    {
+        delete d->mmaps[i];
+    }
+    d->mmaps.clear();
+#endif // NCNN_STDIO
+}
+
+int WeightCache::load(const unsigned char* base, size_t size)
+{
+    if (!base || size < sizeof(WeightCachePrivate::weight_cache_header))
+        return -1;
+
+    WeightCachePrivate::weight_cache_header header;
+    memcpy(&header, base, sizeof(header));
+
+    if (header.magic != weight_cache_magic || header.version != weight_cache_version)
+    {
+        NCNN_LOGE("weight cache is not valid");
+        return -1;
+    }
+
+    if (header.cpu_digest != cpu_digest())
+    {
+        NCNN_LOGE("weight cache is made for another cpu, ignored");
+        return -1;
+    }
+
+    if (header.entry_count > (size - sizeof(header)) / sizeof(WeightCachePrivate::weight_cache_record))
+    {
+        NCNN_LOGE("weight cache is truncated");
+        return -1;
+    }
+
+    const WeightCachePrivate::weight_cache_record* records = (const WeightCachePrivate::weight_cache_record*)(base + sizeof(header));
+
+    // a single bad record means a corrupt or stale file, nothing in it is trusted
+    for (uint32_t i = 0; i < header.entry_count; i++)
+    {
+        if (check_weight_cache_record(records[i], size) != 0)
+        {
+            NCNN_LOGE("weight cache entry %u is corrupted", i);
+            return -1;
+        }
+    }
+
+    MutexLockGuard lock(d->lock);
+
+    for (uint32_t i = 0; i < header.entry_count; i++)
+    {
+        const WeightCachePrivate::weight_cache_record& r = records[i];
+
+        if (d->find(r.d0, r.d1) != -1)
+            continue;
+
+        void* data = (void*)(base + r.offset);
+
+        Mat m;
+        if (r.dims == 1)
+            m = Mat(r.w, data, (size_t)r.elemsize, r.elempack);
+        else if (r.dims == 2)
+            m = Mat(r.w, r.h, data, (size_t)r.elemsize, r.elempack);
+        else if (r.dims == 3)
+            m = Mat(r.w, r.h, r.c, data, (size_t)r.elemsize, r.elempack);
+        else
+            m = Mat(r.w, r.h, r.d, r.c, data, (size_t)r.elemsize, r.elempack);
+
+        m.cstep = (size_t)r.cstep;
+
+        WeightCachePrivate::weight_cache_entry e;
+        e.d0 = r.d0;
+        e.d1 = r.d1;
+        e.m = m;
+        d->entries.push_back(e);
+    }
+
+    return 0;
+}
+
+#if NCNN_STDIO
+int WeightCache::load(const char* cachepath)
+{
+    DataReaderFromMmap* dr = new DataReaderFromMmap(cachepath);
+
+    const size_t size = dr->size();
+
+    const unsigned char* base = 0;
+    if (size == 0 || dr->reference(size, (const void**)&base) != size || load(base, size) != 0)
+    {
+        NCNN_LOGE("load weight cache %s failed", cachepath);
+        delete dr;
+        return -1;
+    }
+
+    MutexLockGuard lock(d->lock);
+
+    d->mmaps.push_back(dr);
+
+    return 0;
+}
+
+int WeightCache::save(const char* cachepath) const
+{
+    FILE* fp = fopen(cachepath, "wb");
+    if (!fp)
+    {
+        NCNN_LOGE("fopen %s failed", cachepath);
+        return -1;
+    }
+
+    MutexLockGuard lock(d->lock);
+
+    const size_t entry_count = d->entries.size();
+
+    WeightCachePrivate::weight_cache_header header;
+    header.magic = weight_cache_magic;
+    header.version = weight_cache_version;
+    header.entry_count = (uint32_t)entry_count;
+    header.reserved = 0;
+    header.cpu_digest = cpu_digest();
+    header.data_offset = alignSize(sizeof(header) + entry_count * sizeof(WeightCachePrivate::weight_cache_record), NCNN_MALLOC_ALIGN);
+
+    // data of each entry starts at NCNN_MALLOC_ALIGN boundary, as if allocated by fastMalloc
+    std::vector<WeightCachePrivate::weight_cache_record> records(entry_count);
+    size_t offset = (size_t)header.data_offset;
+    for (size_t i = 0; i < entry_count; i++)
+    {
+        const Mat& m = d->entries[i].m;
+
+        WeightCachePrivate::weight_cache_record& r = records[i];
+        r.d0 = d->entries[i].d0;
+        r.d1 = d->entries[i].d1;
+        r.dims = m.dims;
+        r.w = m.w;
+        r.h = m.h;
+        r.d = m.d;
+        r.c = m.c;
+        r.elempack = m.elempack;
+        r.elemsize = (uint32_t)m.elemsize;
+        r.reserved = 0;
+        r.cstep = m.cstep;
+        r.offset = offset;
+
+        offset = alignSize(offset + m.cstep * m.c * m.elemsize, NCNN_MALLOC_ALIGN);
+    }
+
+    int ret = 0;
+
+    if (fwrite(&header, sizeof(header), 1, fp) != 1)
+        ret = -1;
+
+    if (ret == 0 && entry_count > 0 && fwrite(records.data(), sizeof(WeightCachePrivate::weight_cache_record), entry_count, fp) != entry_count)
+        ret = -1;
+
+    static const unsigned char padding[NCNN_MALLOC_ALIGN] = {0};
+
+    size_t written = sizeof(header) + entry_count * sizeof(WeightCachePrivate::weight_cache_record);
+    for (size_t i = 0; ret == 0 && i < entry_count; i++)
+    {
+        const Mat& m = d->entries[i].m;
+        const size_t data_size = m.cstep * m.c * m.elemsize;
+
+        const size_t padding_size = (size_t)records[i].offset - written;
+        if (padding_size > 0 && fwrite(padding, 1, padding_size, fp) != padding_size)
+            ret = -1;
+
+        if (ret == 0 && fwrite(m.data, 1, data_size, fp) != data_size)
+            ret = -1;
+
+        written = (size_t)records[i].offset + data_size;
+    }
+
+    fclose(fp);
+
+    if (ret != 0)
+    {
+        NCNN_LOGE("write weight cache %s failed", cachepath);
+    }
+
+    return ret;
+}
+#endif // NCNN_STDIO
+
+int WeightCache::size() const
+{
+    MutexLockGuard lock(d->lock);
+
+    return (int)d->entries.size();
+}
+
+int WeightCache::hit_count() const
+{
+    MutexLockGuard lock(d->lock);
+
+    return d->hits;
+}
+
+int WeightCache::get(const WeightCacheKey& key, Mat& transformed) const
+{
+    const uint64_t d0 = key.digest0();
+    const uint64_t d1 = key.digest1();
+
+    MutexLockGuard lock(d->lock);
+
+    int index = d->find(d0, d1);
+    if (index == -1)
+        return -1;
+
+    transformed = d->entries[index].m;
+    d->hits++;
+
+    return 0;
+}
+
+void WeightCache::put(const WeightCacheKey& key, const Mat& transformed)
+{
+    if (transformed.empty())
+        return;
+
+    const uint64_t d0 = key.digest0();
+    const uint64_t d1 = key.digest1();
+
+    MutexLockGuard lock(d->lock);
+
+    if (d->find(d0, d1) != -1)
+        return;
+
+    WeightCachePrivate::weight_cache_entry e;
+    e.d0 = d0;
+    e.d1 = d1;
+    e.m = transformed;
+    d->entries.push_back(e);
+}
+
+} // namespace ncnn
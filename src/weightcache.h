@@ -0,0 +1,111 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#ifndef NCNN_WEIGHTCACHE_H
+#define NCNN_WEIGHTCACHE_H
+
+#include <stdint.h>
+
+#include "platform.h"
+
+#include "mat.h"
+#include "option.h"
+
+namespace ncnn {
+
+// identify one weight transform made in create_pipeline
+// the digest covers transform name, raw weight content and shape,
+// transform parameters and the options affecting transformed layout
+// digest is made on first lookup, so the key is cheap without weight cache
+class NCNN_EXPORT WeightCacheKey
+{
+public:
+    WeightCacheKey(const Option& opt, const char* transform, const Mat& weight, int p0 = 0, int p1 = 0, int p2 = 0, int p3 = 0);
+
+    // find transformed weight in opt.weight_cache
+    // return 0 if found, -1 if not found or no weight cache
+    int lookup(Mat& transformed) const;
+
+    // move transformed weight into opt.weight_allocator if any
+    // and store it into opt.weight_cache if any
+    void store(Mat& transformed) const;
+
+    uint64_t digest0() const;
+    uint64_t digest1() const;
+
+private:
+    void make_digest() const;
+
+private:
+    const Option* opt;
+    const char* transform;
+    const Mat* weight;
+    int params[4];
+
+    mutable bool digested;
+    mutable uint64_t d0;
+    mutable uint64_t d1;
+};
+
+class WeightCachePrivate;
+class NCNN_EXPORT WeightCache
+{
+public:
+    WeightCache();
+
+    virtual ~WeightCache();
+
+    // drop all entries and unmap cache file
+    void clear();
+
+    // reference cache file image in memory, entries are not copied
+    // the memory should be retained while weights looked up from it are used
+    // return 0 if success
+    int load(const unsigned char* mem, size_t size);
+
+#if NCNN_STDIO
+    // map cache file saved before, entries are referenced in place, not copied
+    // the cache should be retained while weights looked up from it are used
+    // file made on another cpu feature set or cache size is ignored
+    // return 0 if success
+    int load(const char* cachepath);
+
+    // write all entries to cache file
+    // return 0 if success
+    int save(const char* cachepath) const;
+#endif // NCNN_STDIO
+
+    // entries loaded and stored
+    int size() const;
+
+    // lookups answered from cache since creation
+    int hit_count() const;
+
+    // return 0 if found
+    int get(const WeightCacheKey& key, Mat& transformed) const;
+
+    // stored entries hold a reference to transformed weight until clear()
+    void put(const WeightCacheKey& key, const Mat& transformed);
+
+private:
+    WeightCache(const WeightCache&);
+    WeightCache& operator=(const WeightCache&);
+
+private:
+    WeightCachePrivate* const d;
+};
+
+} // namespace ncnn
+
+#endif // NCNN_WEIGHTCACHE_H
@@ -0,0 +1,510 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "weightcodec.h"
+
+#include <algorithm>
+#include <stdint.h>
+#include <string.h>
+
+namespace ncnn {
+
+// elements per block, 128k bytes of fp32
+static const int weight_block_size = 32768;
+
+// longest huffman code, the decoder looks up codes in a table of 1 << huffman_max_bits entries
+static const int huffman_max_bits = 12;
+
+enum
+{
+    PLANE_STORED = 0,
+    PLANE_CONSTANT = 1,
+    PLANE_HUFFMAN = 2
+};
+
+static void put_u32(std::vector<unsigned char>& v, uint32_t x)
+{
+    v.push_back((unsigned char)(x & 0xff));
+    v.push_back((unsigned char)((x >> 8) & 0xff));
+    v.push_back((unsigned char)((x >> 16) & 0xff));
+    v.push_back((unsigned char)((x >> 24) & 0xff));
+}
+
+static uint32_t get_u32(const unsigned char* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// memory offset of byte k of little-endian element
+static int plane_byte_offset(int k, int elemsize)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return elemsize - 1 - k;
+#else
+    (void)elemsize;
+    return k;
+#endif
+}
+
+static void build_huffman_lengths(const uint32_t* freq, unsigned char* lengths)
+{
+    uint32_t f[256];
+    memcpy(f, freq, sizeof(f));
+
+    for (;;)
+    {
+        // nodes 0..255 are symbols, merged nodes follow
+        uint64_t weight[511];
+        int parent[511];
+        bool active[511];
+
+        int node_count = 256;
+        int active_count = 0;
+        for (int i = 0; i < 256; i++)
+        {
+            weight[i] = f[i];
+            parent[i] = -1;
+            active[i] = f[i] != 0;
+            active_count += active[i] ? 1 : 0;
+        }
+
+        while (active_count > 1)
+        {
+            int a = -1;
+            int b = -1;
+            for (int i = 0; i < node_count; i++)
+            {
+                if (!active[i])
+                    continue;
+
+                if (a == -1 || weight[i] < weight[a])
+                {
+                    b = a;
+                    a = i;
+                }
+                else if (b == -1 || weight[i] < weight[b])
+                {
+                    b = i;
+                }
+            }
+
+            weight[node_count] = weight[a] + weight[b];
+            parent[node_count] = -1;
+            active[node_count] = true;
+            active[a] = false;
+            active[b] = false;
+            parent[a] = node_count;
+            parent[b] = node_count;
+            node_count++;
+            active_count--;
+        }
+
+        int max_len = 0;
+        for (int i = 0; i < 256; i++)
+        {
+            int len = 0;
+            if (f[i] != 0)
+            {
+                for (int j = i; parent[j] != -1; j = parent[j])
+                    len++;
+            }
+
+            lengths[i] = (unsigned char)len;
+            max_len = len > max_len ? len : max_len;
+        }
+
+        if (max_len <= huffman_max_bits)
+            return;
+
+        // flatten frequencies until the tree is shallow enough
+        for (int i = 0; i < 256; i++)
+        {
+            if (f[i] != 0)
+                f[i] = (f[i] >> 1) | 1;
+        }
+    }
+}
+
+// canonical codes, bit reversed for lsb first stream
+static int build_huffman_codes(const unsigned char* lengths, uint32_t* codes)
+{
+    int bl_count[huffman_max_bits + 1] = {0};
+    for (int i = 0; i < 256; i++)
+    {
+        if (lengths[i] > huffman_max_bits)
+            return -1;
+
+        bl_count[lengths[i]]++;
+    }
+
+    bl_count[0] = 0;
+
+    uint32_t next_code[huffman_max_bits + 1];
+    uint32_t code = 0;
+    next_code[0] = 0;
+    for (int bits = 1; bits <= huffman_max_bits; bits++)
+    {
+        code = (code + bl_count[bits - 1]) << 1;
+        next_code[bits] = code;
+    }
+
+    for (int i = 0; i < 256; i++)
+    {
+        const int len = lengths[i];
+        if (len == 0)
+        {
+            codes[i] = 0;
+            continue;
+        }
+
+        const uint32_t c = next_code[len]++;
+
+        // oversubscribed code lengths
+        if (c >= (1u << len))
+            return -1;
+
+        uint32_t r = 0;
+        for (int j = 0; j < len; j++)
+        {
+            r |= ((c >> j) & 1) << (len - 1 - j);
+        }
+        codes[i] = r;
+    }
+
+    return 0;
+}
+
+static void encode_plane(const unsigned char* plane, int n, std::vector<unsigned char>& out)
+{
+    uint32_t freq[256] = {0};
+    for (int i = 0; i < n; i++)
+    {
+        freq[plane[i]]++;
+    }
+
+    int distinct = 0;
+    for (int i = 0; i < 256; i++)
+    {
+        distinct += freq[i] != 0 ? 1 : 0;
+    }
+
+    if (distinct == 1)
+    {
+        out.push_back(PLANE_CONSTANT);
+        out.push_back(plane[0]);
+        return;
+    }
+
+    unsigned char lengths[256];
+    build_huffman_lengths(freq, lengths);
+
+    uint64_t bits = 0;
+    for (int i = 0; i < 256; i++)
+    {
+        bits += (uint64_t)freq[i] * lengths[i];
+    }
+
+    const size_t huffman_size = 1 + 128 + 4 + (size_t)((bits + 7) / 8);
+    if (huffman_size >= 1 + (size_t)n)
+    {
+        out.push_back(PLANE_STORED);
+        out.insert(out.end(), plane, plane + n);
+        return;
+    }
+
+    uint32_t codes[256];
+    build_huffman_codes(lengths, codes);
+
+    out.push_back(PLANE_HUFFMAN);
+    for (int i = 0; i < 128; i++)
+    {
+        out.push_back((unsigned char)(lengths[i * 2] | (lengths[i * 2 + 1] << 4)));
+    }
+    put_u32(out, (uint32_t)((bits + 7) / 8));
+
+    uint64_t acc = 0;
+    int nbits = 0;
+    for (int i = 0; i < n; i++)
+    {
+        acc |= (uint64_t)codes[plane[i]] << nbits;
+        nbits += lengths[plane[i]];
+
+        while (nbits >= 8)
+        {
+            out.push_back((unsigned char)(acc & 0xff));
+            acc >>= 8;
+            nbits -= 8;
+        }
+    }
+
+    if (nbits > 0)
+    {
+        out.push_back((unsigned char)(acc & 0xff));
+    }
+}
+
+// decode one plane into every stride-th byte of outptr
+// return bytes consumed, 0 if corrupted
+static size_t decode_plane(const unsigned char* p, size_t size, unsigned char* outptr, int n, int stride)
+{
+    if (size < 1)
+        return 0;
+
+    const int mode = p[0];
+
+    if (mode == PLANE_STORED)
+    {
+        if (size < 1 + (size_t)n)
+            return 0;
+
+        const unsigned char* ptr = p + 1;
+        for (int i = 0; i < n; i++)
+        {
+            outptr[i * stride] = ptr[i];
+        }
+
+        return 1 + n;
+    }
+
+    if (mode == PLANE_CONSTANT)
+    {
+        if (size < 2)
+            return 0;
+
+        const unsigned char v = p[1];
+        for (int i = 0; i < n; i++)
+        {
+            outptr[i * stride] = v;
+        }
+
+        return 2;
+    }
+
+    if (mode != PLANE_HUFFMAN || size < 1 + 128 + 4)
+        return 0;
+
+    unsigned char lengths[256];
+    for (int i = 0; i < 128; i++)
+    {
+        lengths[i * 2] = p[1 + i] & 15;
+        lengths[i * 2 + 1] = p[1 + i] >> 4;
+    }
+
+    const size_t stream_size = get_u32(p + 1 + 128);
+    if (stream_size > size - (1 + 128 + 4))
+        return 0;
+
+    uint32_t codes[256];
+    if (build_huffman_codes(lengths, codes) != 0)
+        return 0;
+
+    // symbol in low byte, code length in high byte, zero for codes never assigned
+    unsigned short table[1 << huffman_max_bits];
+    memset(table, 0, sizeof(table));
+    for (int i = 0; i < 256; i++)
+    {
+        const int len = lengths[i];
+        if (len == 0)
+            continue;
+
+        for (uint32_t j = codes[i]; j < (1u << huffman_max_bits); j += 1u << len)
+        {
+            table[j] = (unsigned short)((len << 8) | i);
+        }
+    }
+
+    const unsigned char* ptr = p + 1 + 128 + 4;
+    const unsigned char* end = ptr + stream_size;
+
+    uint64_t acc = 0;
+    int nbits = 0;
+    int i = 0;
+
+#if !(defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    // refill whole bytes up to 56 bits, enough for four codes
+    int bad = 0;
+    for (; i + 3 < n && end - ptr >= 8; i += 4)
+    {
+        uint64_t v;
+        memcpy(&v, ptr, 8);
+        acc |= v << nbits;
+        ptr += (63 - nbits) >> 3;
+        nbits |= 56;
+
+        for (int k = 0; k < 4; k++)
+        {
+            const unsigned short e = table[acc & ((1u << huffman_max_bits) - 1)];
+            const int len = e >> 8;
+            bad |= len == 0;
+
+            outptr[(i + k) * stride] = (unsigned char)(e & 0xff);
+            acc >>= len;
+            nbits -= len;
+        }
+    }
+
+    if (bad)
+        return 0;
+#endif
+
+    for (; i < n; i++)
+    {
+        if (nbits < huffman_max_bits)
+        {
+            while (nbits <= 56 && ptr < end)
+            {
+                acc |= (uint64_t)*ptr++ << nbits;
+                nbits += 8;
+            }
+        }
+
+        const unsigned short e = table[acc & ((1u << huffman_max_bits) - 1)];
+        const int len = e >> 8;
+        if (len == 0 || len > nbits)
+            return 0;
+
+        outptr[i * stride] = (unsigned char)(e & 0xff);
+        acc >>= len;
+        nbits -= len;
+    }
+
+    return 1 + 128 + 4 + stream_size;
+}
+
+int compress_weight(const void* data, int w, int elemsize, std::vector<unsigned char>& stream)
+{
+    if (w < 0 || (elemsize != 1 && elemsize != 2 && elemsize != 4))
+        return -1;
+
+    const int block_count = (w + weight_block_size - 1) / weight_block_size;
+
+    std::vector<std::vector<unsigned char> > blocks(block_count);
+    std::vector<unsigned char> plane;
+
+    const unsigned char* ptr = (const unsigned char*)data;
+    for (int b = 0; b < block_count; b++)
+    {
+        const int n = std::min(weight_block_size, w - b * weight_block_size);
+        const unsigned char* block_ptr = ptr + (size_t)b * weight_block_size * elemsize;
+
+        plane.resize(n);
+        for (int k = 0; k < elemsize; k++)
+        {
+            const int offset = plane_byte_offset(k, elemsize);
+            for (int i = 0; i < n; i++)
+            {
+                plane[i] = block_ptr[i * elemsize + offset];
+            }
+
+            encode_plane(plane.data(), n, blocks[b]);
+        }
+    }
+
+    stream.clear();
+    put_u32(stream, (uint32_t)elemsize);
+    put_u32(stream, (uint32_t)w);
+    put_u32(stream, (uint32_t)weight_block_size);
+    put_u32(stream, (uint32_t)block_count);
+    for (int b = 0; b < block_count; b++)
+    {
+        put_u32(stream, (uint32_t)blocks[b].size());
+    }
+    for (int b = 0; b < block_count; b++)
+    {
+        stream.insert(stream.end(), blocks[b].begin(), blocks[b].end());
+    }
+
+    return 0;
+}
+
+int decompress_weight(const unsigned char* stream, size_t size, void* data, int w, int elemsize, int num_threads)
+{
+    if (size < 16 || (elemsize != 1 && elemsize != 2 && elemsize != 4))
+        return -1;
+
+    const int stream_elemsize = (int)get_u32(stream);
+    const int stream_w = (int)get_u32(stream + 4);
+    const int block_size = (int)get_u32(stream + 8);
+    const int block_count = (int)get_u32(stream + 12);
+
+    if (stream_elemsize != elemsize || stream_w != w || block_size <= 0 || block_count < 0)
+        return -1;
+
+    if (block_count != (int)(((int64_t)w + block_size - 1) / block_size))
+        return -1;
+
+    if ((size - 16) / 4 < (size_t)block_count)
+        return -1;
+
+    // payload offset of each block
+    std::vector<size_t> offsets(block_count + 1);
+    offsets[0] = 16 + (size_t)block_count * 4;
+    for (int b = 0; b < block_count; b++)
+    {
+        offsets[b + 1] = offsets[b] + get_u32(stream + 16 + b * 4);
+        if (offsets[b + 1] > size)
+            return -1;
+    }
+
+    std::vector<int> rets(block_count, 0);
+
+    unsigned char* outptr = (unsigned char*)data;
+
+    #pragma omp parallel for num_threads(num_threads)
+    for (int b = 0; b < block_count; b++)
+    {
+        const int n = std::min(block_size, w - b * block_size);
+        unsigned char* block_outptr = outptr + (size_t)b * block_size * elemsize;
+
+        const unsigned char* p = stream + offsets[b];
+        size_t remain = offsets[b + 1] - offsets[b];
+        for (int k = 0; k < elemsize; k++)
+        {
+            const size_t consumed = decode_plane(p, remain, block_outptr + plane_byte_offset(k, elemsize), n, elemsize);
+            if (consumed == 0)
+            {
+                rets[b] = -1;
+                break;
+            }
+
+            p += consumed;
+            remain -= consumed;
+        }
+    }
+
+    for (int b = 0; b < block_count; b++)
+    {
+        if (rets[b] != 0)
+        {
+            NCNN_LOGE("compressed weight block %d corrupted", b);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int compressed_weight_elemsize(const unsigned char* stream, size_t size)
+{
+    if (size < 4)
+        return 0;
+
+    const int elemsize = (int)get_u32(stream);
+    if (elemsize != 1 && elemsize != 2 && elemsize != 4)
+        return 0;
+
+    return elemsize;
+}
+
+} // namespace ncnn
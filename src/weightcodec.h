@@ -0,0 +1,57 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#ifndef NCNN_WEIGHTCODEC_H
+#define NCNN_WEIGHTCODEC_H
+
+#include <stddef.h>
+#include <vector>
+
+#include "platform.h"
+
+namespace ncnn {
+
+// model bin tag of compressed weight
+// followed by uint32 stream size, the stream and zero padding to 4 bytes
+#define NCNN_WEIGHT_COMPRESSED_TAG 0x015A4C4E
+
+// compressed weight stream
+//
+// uint32 elemsize   1 = int8, 2 = fp16, 4 = fp32
+// uint32 w          element count
+// uint32 block size elements per block
+// uint32 block count
+// uint32            encoded size of each block
+// blocks
+//
+// a block is split into elemsize byte planes, byte k of every element in plane k,
+// so that sign and exponent bytes of float weights line up
+// each plane is stored raw, as one constant byte or canonical huffman coded
+// blocks are independent and decoded in parallel
+
+// compress w elements of elemsize bytes
+// planes that do not shrink are stored raw
+// return 0 if success
+NCNN_EXPORT int compress_weight(const void* data, int w, int elemsize, std::vector<unsigned char>& stream);
+
+// decode stream of size bytes into w elements of elemsize bytes
+// return 0 if success, -1 if the stream is corrupted or of other shape
+NCNN_EXPORT int decompress_weight(const unsigned char* stream, size_t size, void* data, int w, int elemsize, int num_threads = 1);
+
+// elemsize stored in stream, 0 if the stream is too short or the elemsize is not 1, 2 or 4
+NCNN_EXPORT int compressed_weight_elemsize(const unsigned char* stream, size_t size);
+
+} // namespace ncnn
+
+#endif // NCNN_WEIGHTCODEC_H
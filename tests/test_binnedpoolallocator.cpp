@@ -0,0 +1,337 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "allocator.h"
+#include "mat.h"
+#include "testutil.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static int check_block(const unsigned char* p, size_t size, unsigned char value)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        if (p[i] != value)
+            return -1;
+    }
+    return 0;
+}
+
+static int test_binnedpoolallocator_reuse()
+{
+    ncnn::BinnedPoolAllocator allocator;
+
+    const size_t sizes[8] = {1, 100, 256, 257, 4000, 65536, 1000000, 9000000};
+
+    for (int k = 0; k < 3; k++)
+    {
+        void* ptrs[8];
+        for (int i = 0; i < 8; i++)
+        {
+            ptrs[i] = allocator.fastMalloc(sizes[i]);
+            if ((size_t)ptrs[i] % NCNN_MALLOC_ALIGN != 0)
+            {
+                fprintf(stderr, "unaligned block %p\n", ptrs[i]);
+                return -1;
+            }
+
+            memset(ptrs[i], i + 1, sizes[i]);
+        }
+
+        for (int i = 0; i < 8; i++)
+        {
+            if (check_block((const unsigned char*)ptrs[i], sizes[i], (unsigned char)(i + 1)) != 0)
+            {
+                fprintf(stderr, "block %d overwritten\n", i);
+                return -1;
+            }
+
+            allocator.fastFree(ptrs[i]);
+        }
+    }
+
+    // first round allocates, later rounds reuse
+    if (allocator.misses() != 8 || allocator.hits() != 16)
+    {
+        fprintf(stderr, "hits = %d misses = %d\n", (int)allocator.hits(), (int)allocator.misses());
+        return -1;
+    }
+
+    // size class rounding wastes at most a quarter
+    size_t requested = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        requested += sizes[i] < 256 ? 256 : sizes[i];
+    }
+    if (allocator.bytes_cached() < requested || allocator.bytes_cached() > requested * 5 / 4)
+    {
+        fprintf(stderr, "bytes_cached = %d for %d requested\n", (int)allocator.bytes_cached(), (int)requested);
+        return -1;
+    }
+
+    // drop-in blob allocator
+    {
+        ncnn::Mat a = RandomMat(13, 11, 7);
+        ncnn::Mat b = a.clone(&allocator);
+        if (b.allocator != &allocator || CompareMat(a, b, 0.001) != 0)
+        {
+            fprintf(stderr, "mat clone mismatch\n");
+            return -1;
+        }
+    }
+
+    allocator.clear();
+    if (allocator.bytes_cached() != 0)
+    {
+        fprintf(stderr, "clear left %d bytes\n", (int)allocator.bytes_cached());
+        return -1;
+    }
+
+    return 0;
+}
+
+static int test_binnedpoolallocator_batch()
+{
+    ncnn::BinnedPoolAllocator allocator;
+
+    // more blocks of one class than a thread cache holds
+    const int count = 37;
+
+    void* ptrs[count];
+    for (int k = 0; k < 3; k++)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            ptrs[i] = allocator.fastMalloc(1000);
+            memset(ptrs[i], i, 1000);
+        }
+
+        for (int i = 0; i < count; i++)
+        {
+            if (check_block((const unsigned char*)ptrs[i], 1000, (unsigned char)i) != 0)
+            {
+                fprintf(stderr, "block %d overwritten\n", i);
+                return -1;
+            }
+
+            allocator.fastFree(ptrs[i]);
+        }
+
+        // overflow moved to the shared list in batches, nothing lost
+        if (allocator.bytes_cached() != count * 1024)
+        {
+            fprintf(stderr, "bytes_cached = %d after round %d\n", (int)allocator.bytes_cached(), k);
+            return -1;
+        }
+    }
+
+    if (allocator.misses() != count || allocator.hits() != count * 2)
+    {
+        fprintf(stderr, "hits = %d misses = %d\n", (int)allocator.hits(), (int)allocator.misses());
+        return -1;
+    }
+
+    return 0;
+}
+
+#if NCNN_THREADS
+struct binnedpoolallocator_thread_args
+{
+    ncnn::BinnedPoolAllocator* allocator;
+    int seed;
+    // blocks allocated by main thread to be freed here
+    void** foreign;
+    int foreign_count;
+    int ret;
+};
+
+static void* binnedpoolallocator_worker(void* p)
+{
+    binnedpoolallocator_thread_args* args = (binnedpoolallocator_thread_args*)p;
+
+    for (int i = 0; i < args->foreign_count; i++)
+    {
+        args->allocator->fastFree(args->foreign[i]);
+    }
+
+    unsigned int seed = args->seed;
+
+    void* ptrs[16] = {0};
+    size_t sizes[16] = {0};
+    for (int i = 0; i < 4000; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        const int slot = (seed >> 16) % 16;
+
+        if (ptrs[slot])
+        {
+            if (check_block((const unsigned char*)ptrs[slot], sizes[slot], (unsigned char)slot) != 0)
+            {
+                args->ret = -1;
+                return 0;
+            }
+
+            args->allocator->fastFree(ptrs[slot]);
+            ptrs[slot] = 0;
+            continue;
+        }
+
+        seed = seed * 1103515245 + 12345;
+        sizes[slot] = 1 + (seed >> 8) % 100000;
+        ptrs[slot] = args->allocator->fastMalloc(sizes[slot]);
+        memset(ptrs[slot], slot, sizes[slot]);
+    }
+
+    for (int i = 0; i < 16; i++)
+    {
+        if (ptrs[i] && check_block((const unsigned char*)ptrs[i], sizes[i], (unsigned char)i) != 0)
+        {
+            args->ret = -1;
+            return 0;
+        }
+
+        args->allocator->fastFree(ptrs[i]);
+    }
+
+    args->ret = 0;
+    return 0;
+}
+
+static int test_binnedpoolallocator_threads()
+{
+    ncnn::BinnedPoolAllocator allocator;
+
+    const int thread_count = 4;
+    const int foreign_count = 32;
+
+    void* foreign[thread_count][foreign_count];
+    for (int i = 0; i < thread_count; i++)
+    {
+        for (int j = 0; j < foreign_count; j++)
+        {
+            foreign[i][j] = allocator.fastMalloc(1000 * (j + 1));
+        }
+    }
+
+    binnedpoolallocator_thread_args args[thread_count];
+    ncnn::Thread* threads[thread_count];
+    for (int i = 0; i < thread_count; i++)
+    {
+        args[i].allocator = &allocator;
+        args[i].seed = 7767517 + i;
+        args[i].foreign = foreign[i];
+        args[i].foreign_count = foreign_count;
+        args[i].ret = -1;
+        threads[i] = new ncnn::Thread(binnedpoolallocator_worker, &args[i]);
+    }
+
+    for (int i = 0; i < thread_count; i++)
+    {
+        threads[i]->join();
+        delete threads[i];
+    }
+
+    for (int i = 0; i < thread_count; i++)
+    {
+        if (args[i].ret != 0)
+        {
+            fprintf(stderr, "thread %d saw corrupted block\n", i);
+            return -1;
+        }
+    }
+
+    if (allocator.hits() == 0 || allocator.bytes_cached() == 0)
+    {
+        fprintf(stderr, "hits = %d bytes_cached = %d\n", (int)allocator.hits(), (int)allocator.bytes_cached());
+        return -1;
+    }
+
+    return 0;
+}
+
+static void* binnedpoolallocator_exit_worker(void* p)
+{
+    ncnn::BinnedPoolAllocator* allocator = (ncnn::BinnedPoolAllocator*)p;
+
+    // one large block and a few small ones stay in this thread cache
+    void* large = allocator->fastMalloc(4 * 1024 * 1024);
+    void* small[3];
+    for (int i = 0; i < 3; i++)
+    {
+        small[i] = allocator->fastMalloc(1000);
+    }
+
+    allocator->fastFree(large);
+    for (int i = 0; i < 3; i++)
+    {
+        allocator->fastFree(small[i]);
+    }
+
+    return 0;
+}
+
+static int test_binnedpoolallocator_thread_exit()
+{
+    ncnn::BinnedPoolAllocator allocator;
+
+    ncnn::Thread t(binnedpoolallocator_exit_worker, &allocator);
+    t.join();
+
+    // the exited thread handed its cache over
+    if (allocator.bytes_cached() != 4 * 1024 * 1024 + 3 * 1024)
+    {
+        fprintf(stderr, "bytes_cached = %d after thread exit\n", (int)allocator.bytes_cached());
+        return -1;
+    }
+
+    void* large = allocator.fastMalloc(4 * 1024 * 1024);
+    void* small = allocator.fastMalloc(1000);
+    if (allocator.hits() != 2 || allocator.misses() != 4)
+    {
+        fprintf(stderr, "hits = %d misses = %d after thread exit\n", (int)allocator.hits(), (int)allocator.misses());
+        return -1;
+    }
+
+    allocator.fastFree(large);
+    allocator.fastFree(small);
+
+    return 0;
+}
+#endif // NCNN_THREADS
+
+int main()
+{
+    SRAND(7767517);
+
+    int ret = test_binnedpoolallocator_reuse();
+    if (ret != 0)
+        return ret;
+
+    ret = test_binnedpoolallocator_batch();
+    if (ret != 0)
+        return ret;
+
+#if NCNN_THREADS
+    ret = test_binnedpoolallocator_threads();
+    if (ret != 0)
+        return ret;
+
+    ret = test_binnedpoolallocator_thread_exit();
+    if (ret != 0)
+        return ret;
+#endif // NCNN_THREADS
+
+    return 0;
+}
@@ -0,0 +1,373 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "benchmark.h"
+#include "datareader.h"
+#include "layer.h"
+#include "modelbin.h"
+#include "net.h"
+#include "testutil.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+// three branches, one of them split again by slice
+static const char* g_branch_slice_param = "7767517\n"
+                                          "15 18\n"
+                                          "Input data 0 1 data 0=16 1=16 2=3\n"
+                                          "Convolution conv1 1 1 data conv1 0=16 1=3 4=1 5=1 6=432\n"
+                                          "ReLU relu1 1 1 conv1 conv1_relu\n"
+                                          "Split splitncnn_0 1 3 conv1_relu b0 b1 b2\n"
+                                          "Convolution b0_conv 1 1 b0 b0_out 0=8 1=1 5=1 6=128\n"
+                                          "Convolution b1_conv 1 1 b1 b1_conv 0=8 1=3 4=1 5=1 6=1152\n"
+                                          "ReLU b1_relu 1 1 b1_conv b1_out\n"
+                                          "Slice b2_slice 1 2 b2 b2_0 b2_1 -23300=2,8,-233\n"
+                                          "Pooling b2_pool 1 1 b2_0 b2_pool 0=0 1=3 2=1 3=1\n"
+                                          "Convolution b2_conv0 1 1 b2_pool b2_out0 0=4 1=1 5=1 6=32\n"
+                                          "Convolution b2_conv1 1 1 b2_1 b2_out1 0=4 1=3 4=1 5=1 6=288\n"
+                                          "Concat concat 4 1 b0_out b1_out b2_out0 b2_out1 cat\n"
+                                          "Pooling gap 1 1 cat gap 0=1 4=1\n"
+                                          "InnerProduct fc 1 1 gap fc 0=10 1=1 2=240\n"
+                                          "Softmax prob 1 1 fc prob\n";
+
+static int test_branchparallel(const ncnn::Option& opt, bool lightmode)
+{
+    ncnn::Option opt_ref = opt;
+    opt_ref.use_branch_parallel = false;
+
+    ncnn::Net net_ref;
+    ncnn::Net net;
+    if (load_random_net(net_ref, opt_ref, g_branch_slice_param) != 0 || load_random_net(net, opt, g_branch_slice_param) != 0)
+    {
+        fprintf(stderr, "load_random_net failed\n");
+        return -1;
+    }
+
+    ncnn::Mat inputs[2] = {RandomMat(16, 16, 3), RandomMat(23, 19, 3)};
+
+    for (int i = 0; i < 4; i++)
+    {
+        const ncnn::Mat& in = inputs[i % 2];
+
+        ncnn::Mat cat_ref;
+        ncnn::Mat prob_ref;
+        {
+            ncnn::Extractor ex = net_ref.create_extractor();
+            ex.set_light_mode(lightmode);
+            ex.input("data", in);
+            ex.extract("cat", cat_ref);
+            ex.extract("prob", prob_ref);
+        }
+
+        ncnn::Mat cat;
+        ncnn::Mat prob;
+        {
+            ncnn::Extractor ex = net.create_extractor();
+            ex.set_light_mode(lightmode);
+            ex.set_branch_parallel(true);
+            ex.input("data", in);
+            ex.extract("cat", cat);
+            ex.extract("prob", prob);
+        }
+
+        if (CompareMat(cat, cat_ref, 0.001) != 0 || CompareMat(prob, prob_ref, 0.001) != 0)
+        {
+            fprintf(stderr, "test_branchparallel failed run %d lightmode=%d\n", i, lightmode);
+            return -1;
+        }
+    }
+
+    // intermediate blob as input prunes the branches before it
+    {
+        ncnn::Mat b1 = RandomMat(16, 16, 16);
+
+        ncnn::Mat prob_ref;
+        {
+            ncnn::Extractor ex = net_ref.create_extractor();
+            ex.set_light_mode(lightmode);
+            ex.input("data", inputs[0]);
+            ex.input("b1", b1);
+            ex.extract("prob", prob_ref);
+        }
+
+        ncnn::Mat prob;
+        {
+            ncnn::Extractor ex = net.create_extractor();
+            ex.set_light_mode(lightmode);
+            ex.input("data", inputs[0]);
+            ex.input("b1", b1);
+            ex.extract("prob", prob);
+        }
+
+        if (CompareMat(prob, prob_ref, 0.001) != 0)
+        {
+            fprintf(stderr, "test_branchparallel failed with intermediate input lightmode=%d\n", lightmode);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+// peak bytes of outstanding workspace allocations
+class PeakCountAllocator : public ncnn::Allocator
+{
+public:
+    PeakCountAllocator()
+        : current(0), peak(0)
+    {
+    }
+
+    virtual void* fastMalloc(size_t size)
+    {
+        lock.lock();
+        current += size;
+        peak = std::max(peak, current);
+        lock.unlock();
+
+        // keep the payload aligned
+        unsigned char* p = (unsigned char*)ncnn::fastMalloc(size + NCNN_MALLOC_ALIGN);
+        *(size_t*)p = size;
+        return p + NCNN_MALLOC_ALIGN;
+    }
+
+    virtual void fastFree(void* ptr)
+    {
+        unsigned char* p = (unsigned char*)ptr - NCNN_MALLOC_ALIGN;
+
+        lock.lock();
+        current -= *(size_t*)p;
+        lock.unlock();
+
+        ncnn::fastFree(p);
+    }
+
+public:
+    ncnn::Mutex lock;
+    size_t current;
+    size_t peak;
+};
+
+// fails when entered by two threads at once, like an unlocked pool
+class SingleThreadAllocator : public ncnn::Allocator
+{
+public:
+    SingleThreadAllocator()
+        : inside(0), overlapped(0)
+    {
+    }
+
+    virtual void* fastMalloc(size_t size)
+    {
+        enter();
+        void* ptr = ncnn::fastMalloc(size);
+        leave();
+        return ptr;
+    }
+
+    virtual void fastFree(void* ptr)
+    {
+        enter();
+        ncnn::fastFree(ptr);
+        leave();
+    }
+
+    void enter()
+    {
+        if (NCNN_XADD(&inside, 1) != 0)
+            overlapped = 1;
+
+        // widen the window for the other branches
+        ncnn::sleep(1);
+    }
+
+    void leave()
+    {
+        NCNN_XADD(&inside, -1);
+    }
+
+public:
+    int inside;
+    int overlapped;
+};
+
+// extractors with different thread counts share the net
+// and concurrent branches share an unlocked workspace allocator
+static int test_branchparallel_threads_workspace()
+{
+    ncnn::Option opt_ref;
+    opt_ref.num_threads = 1;
+
+    ncnn::Option opt;
+    opt.num_threads = 4;
+    opt.use_branch_parallel = true;
+
+    ncnn::Net net_ref;
+    ncnn::Net net;
+    if (load_random_net(net_ref, opt_ref, g_branch_slice_param) != 0 || load_random_net(net, opt, g_branch_slice_param) != 0)
+    {
+        fprintf(stderr, "load_random_net failed\n");
+        return -1;
+    }
+
+    ncnn::Mat in = RandomMat(16, 16, 3);
+
+    ncnn::Mat prob_ref;
+    {
+        ncnn::Extractor ex = net_ref.create_extractor();
+        ex.input("data", in);
+        ex.extract("prob", prob_ref);
+    }
+
+    const int thread_counts[3] = {2, 4, 3};
+    for (int i = 0; i < 3; i++)
+    {
+        SingleThreadAllocator workspace_allocator;
+
+        net.opt.num_threads = thread_counts[i];
+
+        ncnn::Mat prob;
+        {
+            ncnn::Extractor ex = net.create_extractor();
+            ex.set_workspace_allocator(&workspace_allocator);
+            ex.input("data", in);
+            ex.extract("prob", prob);
+        }
+
+        if (workspace_allocator.overlapped)
+        {
+            fprintf(stderr, "test_branchparallel_threads_workspace workspace allocator entered concurrently num_threads=%d\n", thread_counts[i]);
+            return -1;
+        }
+
+        if (CompareMat(prob, prob_ref, 0.001) != 0)
+        {
+            fprintf(stderr, "test_branchparallel_threads_workspace failed num_threads=%d\n", thread_counts[i]);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+// gemm packed at load time with 4 threads runs on a branch share of 1 thread
+static int test_branchparallel_packed_threads()
+{
+    const int M = 64;
+    const int N = 48;
+    const int K = 80;
+
+    ncnn::Layer* op = ncnn::create_layer_cpu("Gemm");
+
+    ncnn::ParamDict pd;
+    pd.set(2, 1);  // transA
+    pd.set(4, 1);  // constantA
+    pd.set(7, M);  // constantM
+    pd.set(9, K);  // constantK
+    pd.set(14, 1); // output_transpose
+    op->load_param(pd);
+
+    ncnn::Mat weights[1];
+    weights[0] = RandomMat(M, K);
+    op->load_model(ncnn::ModelBinFromMatArray(weights));
+
+    ncnn::Option opt;
+    opt.num_threads = 4;
+    opt.use_packing_layout = true;
+    op->create_pipeline(opt);
+
+    ncnn::Mat b = RandomMat(N, K);
+
+    PeakCountAllocator workspace_full;
+    ncnn::Option opt_full = opt;
+    opt_full.workspace_allocator = &workspace_full;
+
+    PeakCountAllocator workspace_share;
+    ncnn::Option opt_share = opt;
+    opt_share.num_threads = 1;
+    opt_share.use_branch_parallel = true;
+    opt_share.workspace_allocator = &workspace_share;
+
+    std::vector<ncnn::Mat> bottom_blobs(1, b);
+    std::vector<ncnn::Mat> top_full(1);
+    std::vector<ncnn::Mat> top_share(1);
+    int ret = op->forward(bottom_blobs, top_full, opt_full) || op->forward(bottom_blobs, top_share, opt_share);
+
+    op->destroy_pipeline(opt);
+    delete op;
+
+    if (ret != 0)
+    {
+        fprintf(stderr, "test_branchparallel_packed_threads forward failed\n");
+        return -1;
+    }
+
+    if (CompareMat(top_share[0], top_full[0], 0.001) != 0)
+    {
+        fprintf(stderr, "test_branchparallel_packed_threads output mismatch\n");
+        return -1;
+    }
+
+    // per thread scratch follows the runtime thread count
+    // naive gemm on other archs has no per thread scratch
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86) || defined(__aarch64__) || defined(__arm__)
+    if (workspace_share.peak >= workspace_full.peak)
+#else
+    if (workspace_share.peak > workspace_full.peak)
+#endif
+    {
+        fprintf(stderr, "test_branchparallel_packed_threads workspace %zu not below %zu\n", workspace_share.peak, workspace_full.peak);
+        return -1;
+    }
+
+    return 0;
+}
+
+int main()
+{
+    SRAND(7767517);
+
+    ncnn::UnlockedPoolAllocator blob_pool_allocator;
+    ncnn::PoolAllocator workspace_pool_allocator;
+
+    ncnn::Option opts[3];
+    opts[0].num_threads = 4;
+    opts[0].use_packing_layout = false;
+    opts[0].use_branch_parallel = true;
+
+    opts[1].num_threads = 4;
+    opts[1].use_packing_layout = true;
+    opts[1].blob_allocator = &blob_pool_allocator;
+    opts[1].workspace_allocator = &workspace_pool_allocator;
+    opts[1].use_branch_parallel = true;
+
+    opts[2].num_threads = 3;
+    opts[2].use_packing_layout = true;
+    opts[2].use_local_pool_allocator = false;
+    opts[2].use_static_memory_plan = true;
+    opts[2].use_branch_parallel = true;
+
+    for (int i = 0; i < 3; i++)
+    {
+        int ret = test_branchparallel(opts[i], true) || test_branchparallel(opts[i], false);
+        if (ret != 0)
+        {
+            fprintf(stderr, "test_branchparallel failed num_threads=%d use_packing_layout=%d\n", opts[i].num_threads, opts[i].use_packing_layout);
+            return ret;
+        }
+    }
+
+    return test_branchparallel_packed_threads() || test_branchparallel_threads_workspace();
+}
@@ -0,0 +1,121 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "testutil.h"
+
+static int test_gemm_weightquant(int M, int N, int K, const ncnn::Mat& C, float alpha, float beta, int transA, int output_transpose, int output_N1M, int bits, int group_size)
+{
+    int broadcast_type_C = 0;
+    if (C.dims == 1 && C.w == M)
+        broadcast_type_C = 1;
+    if (C.dims == 1 && C.w == N)
+        broadcast_type_C = 4;
+    if (C.dims == 2 && C.w == 1 && C.h == M)
+        broadcast_type_C = 2;
+    if (C.dims == 2 && C.w == N && C.h == M)
+        broadcast_type_C = 3;
+
+    ncnn::ParamDict pd;
+    pd.set(0, alpha);
+    pd.set(1, beta);
+    pd.set(2, transA);
+    pd.set(3, 1); // transB
+    pd.set(4, 0); // constantA
+    pd.set(5, 1); // constantB
+    pd.set(6, C.empty() ? 0 : 1);
+    pd.set(7, M);
+    pd.set(8, N);
+    pd.set(9, K);
+    pd.set(10, C.empty() ? -1 : broadcast_type_C);
+    pd.set(11, output_N1M);
+    pd.set(14, output_transpose);
+    pd.set(15, bits);
+    pd.set(16, group_size);
+
+    const int row_bytes = bits == 4 ? (K + 1) / 2 : K;
+    const int group_count = (K + group_size - 1) / group_size;
+
+    std::vector<ncnn::Mat> weights;
+    weights.push_back(RandomS8Mat(row_bytes * N));
+    weights.push_back(RandomMat(group_count * N, 0.001f, 0.02f));
+    if (!C.empty()) weights.push_back(C);
+
+    std::vector<ncnn::Mat> a(1);
+    a[0] = transA ? (output_N1M ? ncnn::Mat(M, 1, K) : ncnn::Mat(M, K)) : (output_N1M ? ncnn::Mat(K, 1, M) : ncnn::Mat(K, M));
+    Randomize(a[0]);
+
+    int flag = TEST_LAYER_DISABLE_GPU_TESTING;
+    int ret = test_layer("Gemm", pd, weights, a, 1, 0.001f, 0, flag);
+    if (ret != 0)
+    {
+        fprintf(stderr, "test_gemm_weightquant failed M=%d N=%d K=%d C.dims=%d C=(%d %d) alpha=%f beta=%f transA=%d output_transpose=%d output_N1M=%d bits=%d group_size=%d\n", M, N, K, C.dims, C.w, C.h, alpha, beta, transA, output_transpose, output_N1M, bits, group_size);
+    }
+
+    return ret;
+}
+
+static int test_gemm_0(int M, int N, int K, int bits, int group_size)
+{
+    return 0
+           || test_gemm_weightquant(M, N, K, ncnn::Mat(), 1.f, 1.f, 0, 0, 0, bits, group_size)
+           || test_gemm_weightquant(M, N, K, ncnn::Mat(), 2.1f, 1.f, 1, 0, 0, bits, group_size)
+           || test_gemm_weightquant(M, N, K, ncnn::Mat(), 1.f, 1.f, 0, 1, 0, bits, group_size)
+           || test_gemm_weightquant(M, N, K, ncnn::Mat(), 3.1f, 1.f, 1, 1, 1, bits, group_size)
+           || test_gemm_weightquant(M, N, K, RandomMat(N), 1.f, 0.5f, 0, 0, 0, bits, group_size)
+           || test_gemm_weightquant(M, N, K, RandomMat(1, M), 0.7f, 1.f, 1, 0, 0, bits, group_size)
+           || test_gemm_weightquant(M, N, K, RandomMat(N, M), 1.2f, -0.4f, 0, 1, 0, bits, group_size);
+}
+
+int main()
+{
+    SRAND(7767517);
+
+    int mnk[][3] = {
+        {1, 1, 1},
+        {1, 7, 33},
+        {1, 64, 64},
+        {2, 13, 100},
+        {3, 31, 48},
+        {4, 16, 64},
+        {5, 9, 17},
+        {8, 24, 127},
+        {16, 32, 256},
+        {31, 15, 40},
+        {40, 70, 600},
+        {128, 33, 96}
+    };
+
+    int group_sizes[] = {32, 16, 7};
+
+    int mnk_count = sizeof(mnk) / sizeof(int) / 3;
+
+    for (int i = 0; i < mnk_count; i++)
+    {
+        int M = mnk[i][0];
+        int N = mnk[i][1];
+        int K = mnk[i][2];
+
+        for (int j = 0; j < 3; j++)
+        {
+            int ret = 0
+                      || test_gemm_0(M, N, K, 4, group_sizes[j])
+                      || test_gemm_0(M, N, K, 8, group_sizes[j]);
+
+            if (ret != 0)
+                return ret;
+        }
+    }
+
+    return 0;
+}
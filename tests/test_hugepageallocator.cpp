@@ -0,0 +1,210 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "allocator.h"
+#include "datareader.h"
+#include "mat.h"
+#include "net.h"
+#include "testutil.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const char* g_hugepage_param = "7767517\n"
+                                      "5 5\n"
+                                      "Input data 0 1 data 0=24 1=24 2=16\n"
+                                      "Convolution conv1 1 1 data conv1 0=32 1=3 4=1 5=1 6=4608 9=1\n"
+                                      "Convolution conv2 1 1 conv1 conv2 0=32 1=1 5=1 6=1024\n"
+                                      "Pooling pool 1 1 conv2 pool 0=1 1=2 2=2\n"
+                                      "InnerProduct fc 1 1 pool fc 0=64 1=1 2=294912\n";
+
+static int check_block(const unsigned char* p, size_t size, unsigned char value)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        if (p[i] != value)
+            return -1;
+    }
+    return 0;
+}
+
+static int test_hugepageallocator_reuse()
+{
+    ncnn::HugePageAllocator allocator;
+
+    // small blocks share regions, large ones get their own
+    const size_t sizes[8] = {1, 100, 4000, 65536, 200000, 1000000, 3000000, 9000000};
+
+    size_t mapped = 0;
+    for (int k = 0; k < 3; k++)
+    {
+        void* ptrs[8];
+        for (int i = 0; i < 8; i++)
+        {
+            ptrs[i] = allocator.fastMalloc(sizes[i]);
+            if (!ptrs[i] || (size_t)ptrs[i] % NCNN_MALLOC_ALIGN != 0)
+            {
+                fprintf(stderr, "bad block %p\n", ptrs[i]);
+                return -1;
+            }
+
+            memset(ptrs[i], i + 1, sizes[i]);
+        }
+
+        for (int i = 0; i < 8; i++)
+        {
+            if (check_block((const unsigned char*)ptrs[i], sizes[i], (unsigned char)(i + 1)) != 0)
+            {
+                fprintf(stderr, "block %d overwritten\n", i);
+                return -1;
+            }
+
+            allocator.fastFree(ptrs[i]);
+        }
+
+        // later rounds reuse the regions of the first
+        if (k == 0)
+            mapped = allocator.bytes_mapped();
+
+        if (allocator.bytes_mapped() != mapped)
+        {
+            fprintf(stderr, "round %d mapped %d bytes, first round %d\n", k, (int)allocator.bytes_mapped(), (int)mapped);
+            return -1;
+        }
+    }
+
+    if (mapped == 0 || mapped % (2 * 1024 * 1024) != 0 || allocator.bytes_hugetlb() > mapped)
+    {
+        fprintf(stderr, "mapped = %d hugetlb = %d\n", (int)mapped, (int)allocator.bytes_hugetlb());
+        return -1;
+    }
+
+    // drop-in blob allocator
+    {
+        ncnn::Mat a = RandomMat(13, 11, 7);
+        ncnn::Mat b = a.clone(&allocator);
+        if (b.allocator != &allocator || CompareMat(a, b, 0.001) != 0)
+        {
+            fprintf(stderr, "mat clone mismatch\n");
+            return -1;
+        }
+    }
+
+    // only the shared region of small blocks stays
+    allocator.clear();
+    if (allocator.bytes_mapped() > 2 * 1024 * 1024)
+    {
+        fprintf(stderr, "clear left %d bytes\n", (int)allocator.bytes_mapped());
+        return -1;
+    }
+
+    return 0;
+}
+
+static int test_hugepageallocator_net(const ncnn::Option& opt)
+{
+    SRAND(7767517);
+    ncnn::Mat in = RandomMat(24, 24, 16);
+
+    ncnn::Mat out_ref;
+    {
+        ncnn::Net net;
+        net.opt = opt;
+
+        SRAND(7767517);
+        DataReaderFromRandom dr;
+        if (net.load_param_mem(g_hugepage_param) != 0 || net.load_model(dr) != 0)
+            return -1;
+
+        ncnn::Extractor ex = net.create_extractor();
+        ex.input("data", in);
+        if (ex.extract("fc", out_ref) != 0)
+            return -1;
+
+        out_ref = out_ref.clone();
+    }
+
+    ncnn::HugePageAllocator allocator;
+
+    ncnn::Mat out;
+    {
+        ncnn::Net net;
+        net.opt = opt;
+        net.opt.blob_allocator = &allocator;
+        net.opt.workspace_allocator = &allocator;
+        net.opt.weight_allocator = &allocator;
+
+        SRAND(7767517);
+        DataReaderFromRandom dr;
+        if (net.load_param_mem(g_hugepage_param) != 0 || net.load_model(dr) != 0)
+            return -1;
+
+        // transformed weights placed on huge pages
+        if (allocator.bytes_mapped() == 0)
+        {
+            fprintf(stderr, "no weights on huge pages\n");
+            return -1;
+        }
+
+        for (int i = 0; i < 2; i++)
+        {
+            ncnn::Extractor ex = net.create_extractor();
+            ex.input("data", in);
+            if (ex.extract("fc", out) != 0)
+                return -1;
+
+            out = out.clone();
+        }
+    }
+
+    if (CompareMat(out, out_ref, 0.001) != 0)
+    {
+        fprintf(stderr, "huge page output mismatch\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+int main()
+{
+    SRAND(7767517);
+
+    int ret = test_hugepageallocator_reuse();
+    if (ret != 0)
+        return ret;
+
+    ncnn::Option opts[3];
+    opts[0].num_threads = 1;
+    opts[0].use_packing_layout = false;
+
+    opts[1].num_threads = 1;
+    opts[1].use_packing_layout = true;
+
+    opts[2].num_threads = 2;
+    opts[2].use_packing_layout = true;
+    opts[2].use_static_memory_plan = true;
+
+    for (int i = 0; i < 3; i++)
+    {
+        ret = test_hugepageallocator_net(opts[i]);
+        if (ret != 0)
+        {
+            fprintf(stderr, "test_hugepageallocator_net failed num_threads=%d use_packing_layout=%d\n", opts[i].num_threads, opts[i].use_packing_layout);
+            return ret;
+        }
+    }
+
+    return 0;
+}
@@ -257,6 +257,71 @@ static int test_innerproduct_5()
 }
 #endif // NCNN_INT8
 
+static int test_innerproduct_weightquant(const ncnn::Mat& a, int outch, int bias, int bits, int group_size)
+{
+    const int k = a.dims == 2 ? a.w : a.w * a.h * a.c;
+
+    ncnn::ParamDict pd;
+    pd.set(0, outch); // num_output
+    pd.set(1, bias);  // bias_term
+    pd.set(2, outch * k);
+    pd.set(11, bits);
+    pd.set(12, group_size);
+
+    int activation_type = RAND() % 7; // 0 1 2 3 4 5 6
+    ncnn::Mat activation_params(2);
+    activation_params[0] = (activation_type == 6) ? RandomFloat(0, 1) : RandomFloat(-1, 0); // alpha
+    activation_params[1] = RandomFloat(0, 1);                                               // beta
+    pd.set(9, activation_type);
+    pd.set(10, activation_params);
+
+    const int row_bytes = bits == 4 ? (k + 1) / 2 : k;
+    const int group_count = (k + group_size - 1) / group_size;
+
+    std::vector<ncnn::Mat> weights(bias ? 3 : 2);
+    weights[0] = RandomS8Mat(outch * row_bytes);
+    weights[1] = RandomMat(outch * group_count, 0.001f, 0.02f);
+    if (bias)
+        weights[2] = RandomMat(outch);
+
+    int flag = TEST_LAYER_DISABLE_GPU_TESTING;
+    int ret = test_layer("InnerProduct", pd, weights, a, 0.001f, 0, flag);
+    if (ret != 0)
+    {
+        fprintf(stderr, "test_innerproduct_weightquant failed a.dims=%d a=(%d %d %d) outch=%d bias=%d bits=%d group_size=%d act=%d actparams=[%f,%f]\n", a.dims, a.w, a.h, a.c, outch, bias, bits, group_size, activation_type, activation_params[0], activation_params[1]);
+    }
+
+    return ret;
+}
+
+static int test_innerproduct_6()
+{
+    static const int bits[2] = {4, 8};
+
+    for (int i = 0; i < 2; i++)
+    {
+        int ret = 0
+                  || test_innerproduct_weightquant(RandomMat(1), 1, 1, bits[i], 32)
+                  || test_innerproduct_weightquant(RandomMat(15), 8, 1, bits[i], 4)
+                  || test_innerproduct_weightquant(RandomMat(33), 7, 0, bits[i], 7)
+                  || test_innerproduct_weightquant(RandomMat(64), 16, 1, bits[i], 32)
+                  || test_innerproduct_weightquant(RandomMat(200), 9, 1, bits[i], 64)
+                  || test_innerproduct_weightquant(RandomMat(4, 3, 15), 8, 1, bits[i], 16)
+                  || test_innerproduct_weightquant(RandomMat(6, 2, 16), 16, 0, bits[i], 32)
+                  || test_innerproduct_weightquant(RandomMat(77, 1), 5, 1, bits[i], 24)
+                  || test_innerproduct_weightquant(RandomMat(64, 3), 16, 1, bits[i], 32)
+                  || test_innerproduct_weightquant(RandomMat(48, 4), 7, 0, bits[i], 16)
+                  || test_innerproduct_weightquant(RandomMat(129, 13), 21, 1, bits[i], 128)
+                  || test_innerproduct_weightquant(RandomMat(100, 16), 32, 1, bits[i], 20)
+                  || test_innerproduct_weightquant(RandomMat(600, 40), 70, 1, bits[i], 32);
+
+        if (ret != 0)
+            return ret;
+    }
+
+    return 0;
+}
+
 int main()
 {
     SRAND(7767517);
@@ -268,12 +333,14 @@ int main()
            || test_innerproduct_2()
            || test_innerproduct_3()
            || test_innerproduct_4()
-           || test_innerproduct_5();
+           || test_innerproduct_5()
+           || test_innerproduct_6();
 #else
     return 0
            || test_innerproduct_0()
            || test_innerproduct_1()
            || test_innerproduct_2()
-           || test_innerproduct_4();
+           || test_innerproduct_4()
+           || test_innerproduct_6();
 #endif
 }
@@ -0,0 +1,246 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "datareader.h"
+#include "layer.h"
+#include "net.h"
+#include "testutil.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const char* g_lazypipeline_param = "7767517\n"
+                                          "8 9\n"
+                                          "Input data 0 1 data 0=16 1=16 2=8\n"
+                                          "Convolution conv1 1 1 data conv1 0=16 1=3 4=1 5=1 6=1152 9=1\n"
+                                          "Split splitncnn_0 1 2 conv1 a b\n"
+                                          "Convolution head_a 1 1 a ha 0=8 1=1 5=1 6=128\n"
+                                          "PipelineCounter count_a 1 1 ha ha_out\n"
+                                          "Convolution head_b 1 1 b hb 0=24 1=3 4=1 5=1 6=3456 9=1\n"
+                                          "Pooling head_b_pool 1 1 hb hb_pool 0=1 1=2 2=2\n"
+                                          "PipelineCounter count_b 1 1 hb_pool hb_out\n";
+
+static int g_pipeline_created = 0;
+static int g_pipeline_destroyed = 0;
+
+// identity layer counting pipeline creation
+class PipelineCounter : public ncnn::Layer
+{
+public:
+    PipelineCounter()
+    {
+        one_blob_only = true;
+        support_inplace = true;
+    }
+
+    virtual int create_pipeline(const ncnn::Option& /*opt*/)
+    {
+        NCNN_XADD(&g_pipeline_created, 1);
+        return 0;
+    }
+
+    virtual int destroy_pipeline(const ncnn::Option& /*opt*/)
+    {
+        NCNN_XADD(&g_pipeline_destroyed, 1);
+        return 0;
+    }
+
+    virtual int forward_inplace(ncnn::Mat& /*bottom_top_blob*/, const ncnn::Option& /*opt*/) const
+    {
+        return 0;
+    }
+};
+
+DEFINE_LAYER_CREATOR(PipelineCounter)
+
+static int load_lazypipeline_net(ncnn::Net& net, const ncnn::Option& opt)
+{
+    net.opt = opt;
+    net.register_custom_layer("PipelineCounter", PipelineCounter_layer_creator);
+
+    int ret = net.load_param_mem(g_lazypipeline_param);
+    if (ret != 0)
+        return ret;
+
+    SRAND(7767517);
+    DataReaderFromRandom dr;
+    return net.load_model(dr);
+}
+
+static int extract_head(const ncnn::Net& net, const ncnn::Mat& in, const char* name, ncnn::Mat& out)
+{
+    ncnn::Extractor ex = net.create_extractor();
+    ex.input("data", in);
+    return ex.extract(name, out);
+}
+
+#if NCNN_THREADS
+struct lazypipeline_thread_args
+{
+    const ncnn::Net* net;
+    const ncnn::Mat* in;
+    ncnn::Mat ha;
+    ncnn::Mat hb;
+    int ret;
+};
+
+static void* lazypipeline_worker(void* args)
+{
+    lazypipeline_thread_args* a = (lazypipeline_thread_args*)args;
+    a->ret = extract_head(*a->net, *a->in, "ha_out", a->ha) || extract_head(*a->net, *a->in, "hb_out", a->hb);
+    return 0;
+}
+#endif // NCNN_THREADS
+
+static int test_lazypipeline(const ncnn::Option& opt)
+{
+    ncnn::Option opt_ref = opt;
+    opt_ref.use_lazy_pipeline = false;
+
+    ncnn::Option opt_lazy = opt;
+    opt_lazy.use_lazy_pipeline = true;
+
+    ncnn::Mat in = RandomMat(16, 16, 8);
+
+    ncnn::Mat ha_ref;
+    ncnn::Mat hb_ref;
+    {
+        ncnn::Net net;
+        g_pipeline_created = 0;
+        if (load_lazypipeline_net(net, opt_ref) != 0 || g_pipeline_created != 2)
+        {
+            fprintf(stderr, "eager net created %d pipelines\n", g_pipeline_created);
+            return -1;
+        }
+
+        if (extract_head(net, in, "ha_out", ha_ref) != 0 || extract_head(net, in, "hb_out", hb_ref) != 0)
+        {
+            fprintf(stderr, "eager net extract failed\n");
+            return -1;
+        }
+    }
+
+    // pipelines are created by the first extraction needing them
+    {
+        g_pipeline_created = 0;
+        g_pipeline_destroyed = 0;
+
+        ncnn::Net net;
+        if (load_lazypipeline_net(net, opt_lazy) != 0 || g_pipeline_created != 0)
+        {
+            fprintf(stderr, "lazy net created %d pipelines at load\n", g_pipeline_created);
+            return -1;
+        }
+
+        ncnn::Mat ha;
+        for (int i = 0; i < 2; i++)
+        {
+            if (extract_head(net, in, "ha_out", ha) != 0 || g_pipeline_created != 1)
+            {
+                fprintf(stderr, "lazy net created %d pipelines for head a\n", g_pipeline_created);
+                return -1;
+            }
+        }
+
+        if (CompareMat(ha, ha_ref, 0.001) != 0)
+        {
+            fprintf(stderr, "lazy net head a mismatch\n");
+            return -1;
+        }
+
+        // head b is never run and never destroyed
+        net.clear();
+        if (g_pipeline_destroyed != 1)
+        {
+            fprintf(stderr, "lazy net destroyed %d pipelines\n", g_pipeline_destroyed);
+            return -1;
+        }
+    }
+
+#if NCNN_THREADS
+    // concurrent first use creates each pipeline once
+    {
+        g_pipeline_created = 0;
+
+        ncnn::Net net;
+        if (load_lazypipeline_net(net, opt_lazy) != 0)
+        {
+            fprintf(stderr, "lazy net load failed\n");
+            return -1;
+        }
+
+        const int thread_count = 4;
+        lazypipeline_thread_args args[thread_count];
+        ncnn::Thread* threads[thread_count];
+        for (int i = 0; i < thread_count; i++)
+        {
+            args[i].net = &net;
+            args[i].in = &in;
+            args[i].ret = -1;
+            threads[i] = new ncnn::Thread(lazypipeline_worker, &args[i]);
+        }
+
+        for (int i = 0; i < thread_count; i++)
+        {
+            threads[i]->join();
+            delete threads[i];
+        }
+
+        if (g_pipeline_created != 2)
+        {
+            fprintf(stderr, "concurrent lazy net created %d pipelines\n", g_pipeline_created);
+            return -1;
+        }
+
+        for (int i = 0; i < thread_count; i++)
+        {
+            if (args[i].ret != 0 || CompareMat(args[i].ha, ha_ref, 0.001) != 0 || CompareMat(args[i].hb, hb_ref, 0.001) != 0)
+            {
+                fprintf(stderr, "concurrent lazy net thread %d mismatch\n", i);
+                return -1;
+            }
+        }
+    }
+#endif // NCNN_THREADS
+
+    return 0;
+}
+
+int main()
+{
+    SRAND(7767517);
+
+    ncnn::Option opts[3];
+    opts[0].num_threads = 1;
+    opts[0].use_packing_layout = false;
+
+    opts[1].num_threads = 1;
+    opts[1].use_packing_layout = true;
+
+    opts[2].num_threads = 2;
+    opts[2].use_packing_layout = true;
+    opts[2].use_parallel_load = true;
+
+    for (int i = 0; i < 3; i++)
+    {
+        int ret = test_lazypipeline(opts[i]);
+        if (ret != 0)
+        {
+            fprintf(stderr, "test_lazypipeline failed num_threads=%d use_packing_layout=%d\n", opts[i].num_threads, opts[i].use_packing_layout);
+            return ret;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,177 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "datareader.h"
+#include "net.h"
+#include "testutil.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static int test_memoryplan(const ncnn::Option& opt, bool lightmode)
+{
+    ncnn::Option opt_ref = opt;
+    opt_ref.use_static_memory_plan = false;
+
+    ncnn::Option opt_plan = opt;
+    opt_plan.use_static_memory_plan = true;
+
+    ncnn::Net net_ref;
+    ncnn::Net net_plan;
+    if (load_random_net(net_ref, opt_ref, g_branch_param) != 0 || load_random_net(net_plan, opt_plan, g_branch_param) != 0)
+    {
+        fprintf(stderr, "load_random_net failed\n");
+        return -1;
+    }
+
+    ncnn::Mat inputs[2] = {RandomMat(16, 16, 3), RandomMat(23, 19, 3)};
+
+    for (int i = 0; i < 6; i++)
+    {
+        const ncnn::Mat& in = inputs[i % 2];
+
+        ncnn::Mat cat_ref;
+        ncnn::Mat prob_ref;
+        {
+            ncnn::Extractor ex = net_ref.create_extractor();
+            ex.set_light_mode(lightmode);
+            ex.input("data", in);
+            ex.extract("cat", cat_ref);
+            ex.extract("prob", prob_ref);
+        }
+
+        ncnn::Mat cat;
+        ncnn::Mat prob;
+        {
+            ncnn::Extractor ex = net_plan.create_extractor();
+            ex.set_light_mode(lightmode);
+            ex.input("data", in);
+
+            size_t plan_size = ex.memory_plan_size();
+            if (i >= 2 && plan_size == 0)
+            {
+                fprintf(stderr, "memory plan not made after run %d\n", i);
+                return -1;
+            }
+
+            ex.extract("cat", cat);
+            ex.extract("prob", prob);
+        }
+
+        if (CompareMat(cat, cat_ref, 0.001) != 0 || CompareMat(prob, prob_ref, 0.001) != 0)
+        {
+            fprintf(stderr, "test_memoryplan failed run %d lightmode=%d\n", i, lightmode);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+class CountingAllocator : public ncnn::Allocator
+{
+public:
+    CountingAllocator()
+        : live(0)
+    {
+    }
+
+    virtual void* fastMalloc(size_t size)
+    {
+        live++;
+        return ncnn::fastMalloc(size);
+    }
+
+    virtual void fastFree(void* ptr)
+    {
+        live--;
+        ncnn::fastFree(ptr);
+    }
+
+    int live;
+};
+
+static int test_memoryplan_switch_allocator()
+{
+    CountingAllocator allocator0;
+    CountingAllocator allocator1;
+
+    {
+        ncnn::Option opt;
+        opt.num_threads = 1;
+        opt.use_static_memory_plan = true;
+        opt.weight_allocator = &allocator0;
+
+        ncnn::Net net;
+        if (load_random_net(net, opt, g_branch_param) != 0)
+        {
+            fprintf(stderr, "load_random_net failed\n");
+            return -1;
+        }
+
+        ncnn::Mat in = RandomMat(16, 16, 3);
+
+        for (int i = 0; i < 6; i++)
+        {
+            // arenas pooled from the first allocator must go back to it
+            if (i == 3)
+                net.opt.weight_allocator = &allocator1;
+
+            ncnn::Extractor ex = net.create_extractor();
+            ex.input("data", in);
+
+            ncnn::Mat prob;
+            ex.extract("prob", prob);
+        }
+    }
+
+    if (allocator0.live != 0 || allocator1.live != 0)
+    {
+        fprintf(stderr, "test_memoryplan_switch_allocator failed live %d %d\n", allocator0.live, allocator1.live);
+        return -1;
+    }
+
+    return 0;
+}
+
+int main()
+{
+    SRAND(7767517);
+
+    ncnn::UnlockedPoolAllocator blob_pool_allocator;
+
+    ncnn::Option opts[3];
+    opts[0].num_threads = 1;
+    opts[0].use_packing_layout = false;
+
+    opts[1].num_threads = 1;
+    opts[1].use_packing_layout = true;
+    opts[1].blob_allocator = &blob_pool_allocator;
+
+    opts[2].num_threads = 2;
+    opts[2].use_packing_layout = true;
+    opts[2].use_local_pool_allocator = false;
+
+    for (int i = 0; i < 3; i++)
+    {
+        int ret = test_memoryplan(opts[i], true) || test_memoryplan(opts[i], false);
+        if (ret != 0)
+        {
+            fprintf(stderr, "test_memoryplan failed num_threads=%d use_packing_layout=%d\n", opts[i].num_threads, opts[i].use_packing_layout);
+            return ret;
+        }
+    }
+
+    return test_memoryplan_switch_allocator();
+}
@@ -0,0 +1,209 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "datareader.h"
+#include "net.h"
+#include "testutil.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static int test_memorytracker(const ncnn::Net& net, ncnn::Allocator* allocator, bool lightmode, size_t& peak)
+{
+    ncnn::Mat in = RandomMat(16, 16, 3);
+
+    ncnn::Mat prob_ref;
+    {
+        ncnn::Extractor ex = net.create_extractor();
+        ex.set_light_mode(lightmode);
+        ex.input("data", in);
+        ex.extract("prob", prob_ref);
+    }
+
+    ncnn::TrackingAllocator tracker(allocator);
+    {
+        ncnn::Mat prob;
+        {
+            ncnn::Extractor ex = net.create_extractor();
+            ex.set_light_mode(lightmode);
+            ex.set_memory_tracker(&tracker);
+            ex.input("data", in);
+            if (ex.extract("prob", prob) != 0)
+                return -1;
+        }
+
+        if (CompareMat(prob, prob_ref, 0.001) != 0)
+        {
+            fprintf(stderr, "tracked output mismatch\n");
+            return -1;
+        }
+    }
+
+    if (tracker.live_bytes() != 0)
+    {
+        fprintf(stderr, "%d bytes leaked\n", (int)tracker.live_bytes());
+        return -1;
+    }
+
+    peak = tracker.peak_bytes();
+
+    // every layer but input runs once
+    std::vector<ncnn::LayerMemory> timeline = tracker.timeline();
+    if ((int)timeline.size() != (int)net.layers().size() - 1)
+    {
+        fprintf(stderr, "timeline has %d layers\n", (int)timeline.size());
+        return -1;
+    }
+
+    std::vector<int> seen(net.layers().size(), 0);
+    for (size_t i = 0; i < timeline.size(); i++)
+    {
+        const ncnn::LayerMemory& m = timeline[i];
+        if (m.layer_index <= 0 || m.layer_index >= (int)net.layers().size() || seen[m.layer_index]++)
+        {
+            fprintf(stderr, "bad layer index %d\n", m.layer_index);
+            return -1;
+        }
+
+        if (m.peak_bytes > peak || m.live_bytes > m.peak_bytes)
+        {
+            fprintf(stderr, "layer %d bad stats peak=%d live=%d allocated=%d\n", m.layer_index, (int)m.peak_bytes, (int)m.live_bytes, (int)m.allocated_bytes);
+            return -1;
+        }
+    }
+
+    // conv1 allocates its output
+    if (timeline[0].layer_index != 1 || timeline[0].allocated_bytes < 16 * 16 * 16 * sizeof(float))
+    {
+        fprintf(stderr, "conv1 allocated %d bytes\n", (int)timeline[0].allocated_bytes);
+        return -1;
+    }
+
+    std::vector<std::pair<int, size_t> > contributors = tracker.peak_contributors();
+    size_t contributed = 0;
+    for (size_t i = 0; i < contributors.size(); i++)
+    {
+        if (i > 0 && contributors[i].second > contributors[i - 1].second)
+        {
+            fprintf(stderr, "contributors not sorted\n");
+            return -1;
+        }
+
+        contributed += contributors[i].second;
+    }
+
+    if (contributors.empty() || contributed != peak)
+    {
+        fprintf(stderr, "contributors sum %d != peak %d\n", (int)contributed, (int)peak);
+        return -1;
+    }
+
+    tracker.clear();
+    if (!tracker.timeline().empty() || tracker.peak_bytes() != 0)
+    {
+        fprintf(stderr, "clear failed\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+// unsetting the tracker gives back the allocators it replaced
+static int test_memorytracker_unset(const ncnn::Net& net)
+{
+    ncnn::TrackingAllocator blob_allocator;
+    ncnn::TrackingAllocator workspace_allocator;
+    ncnn::TrackingAllocator tracker;
+
+    {
+        ncnn::Mat prob;
+
+        ncnn::Extractor ex = net.create_extractor();
+        ex.set_blob_allocator(&blob_allocator);
+        ex.set_workspace_allocator(&workspace_allocator);
+        ex.set_memory_tracker(&tracker);
+        ex.set_memory_tracker(0);
+        ex.input("data", RandomMat(16, 16, 3));
+        if (ex.extract("prob", prob) != 0)
+            return -1;
+    }
+
+    if (tracker.peak_bytes() != 0 || blob_allocator.peak_bytes() == 0)
+    {
+        fprintf(stderr, "allocators not restored, tracker peak %d blob peak %d\n", (int)tracker.peak_bytes(), (int)blob_allocator.peak_bytes());
+        return -1;
+    }
+
+    return 0;
+}
+
+static int test_memorytracker(const ncnn::Option& opt, ncnn::Allocator* allocator)
+{
+    ncnn::Net net;
+    if (load_random_net(net, opt, g_branch_param) != 0)
+    {
+        fprintf(stderr, "load_random_net failed\n");
+        return -1;
+    }
+
+    size_t peak_light = 0;
+    size_t peak_full = 0;
+    if (test_memorytracker(net, allocator, true, peak_light) != 0 || test_memorytracker(net, allocator, false, peak_full) != 0 || test_memorytracker_unset(net) != 0)
+        return -1;
+
+    // light mode releases intermediate blobs early
+    if (peak_light > peak_full)
+    {
+        fprintf(stderr, "light mode peak %d > %d\n", (int)peak_light, (int)peak_full);
+        return -1;
+    }
+
+    return 0;
+}
+
+int main()
+{
+    SRAND(7767517);
+
+    ncnn::PoolAllocator pool_allocator;
+    ncnn::UnlockedPoolAllocator unlocked_pool_allocator;
+
+    ncnn::Option opts[3];
+    opts[0].num_threads = 1;
+    opts[0].use_packing_layout = false;
+
+    opts[1].num_threads = 1;
+    opts[1].use_packing_layout = true;
+
+    opts[2].num_threads = 2;
+    opts[2].use_packing_layout = true;
+    opts[2].use_branch_parallel = true;
+
+    ncnn::Allocator* allocators[3] = {0, &pool_allocator, &unlocked_pool_allocator};
+
+    for (int i = 0; i < 3; i++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            int ret = test_memorytracker(opts[i], allocators[j]);
+            if (ret != 0)
+            {
+                fprintf(stderr, "test_memorytracker failed num_threads=%d use_packing_layout=%d allocator=%d\n", opts[i].num_threads, opts[i].use_packing_layout, j);
+                return ret;
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,185 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "datareader.h"
+#include "net.h"
+#include "testutil.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const char* g_mmap_param = "7767517\n"
+                                  "6 6\n"
+                                  "Input data 0 1 data 0=16 1=16 2=8\n"
+                                  "Convolution conv1 1 1 data conv1 0=16 1=3 4=1 5=1 6=1152 9=1\n"
+                                  "ConvolutionDepthWise dw 1 1 conv1 dw 0=16 1=3 4=1 5=1 6=144 7=16\n"
+                                  "Convolution conv2 1 1 dw conv2 0=32 1=1 5=1 6=512\n"
+                                  "Pooling gap 1 1 conv2 gap 0=1 4=1\n"
+                                  "InnerProduct fc 1 1 gap fc 0=10 1=1 2=320\n";
+
+// raw float weights with zero flag, written to file as read
+class DataReaderFromRandomRecord : public DataReaderFromRandom
+{
+public:
+    DataReaderFromRandomRecord(FILE* _fp)
+        : fp(_fp)
+    {
+    }
+
+    virtual size_t read(void* buf, size_t size) const
+    {
+        DataReaderFromRandom::read(buf, size);
+
+        return fwrite(buf, 1, size, fp);
+    }
+
+    FILE* fp;
+};
+
+static int test_datareader_mmap(const char* binpath)
+{
+    FILE* fp = fopen(binpath, "rb");
+    fseek(fp, 0, SEEK_END);
+    size_t filesize = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    ncnn::DataReaderFromMmap dr(binpath);
+    if (dr.size() != filesize)
+    {
+        fprintf(stderr, "DataReaderFromMmap size %d while file size %d\n", (int)dr.size(), (int)filesize);
+        fclose(fp);
+        return -1;
+    }
+
+    unsigned int flag = 1;
+    float v0 = 0.f;
+    fread(&flag, 1, 4, fp);
+    fread(&v0, 1, 4, fp);
+    fclose(fp);
+
+    unsigned int flag_mmap = 1;
+    const void* refbuf = 0;
+    if (dr.read(&flag_mmap, 4) != 4 || dr.reference(4, &refbuf) != 4 || flag_mmap != flag || *(const float*)refbuf != v0 || ((size_t)refbuf & 3) != 0)
+    {
+        fprintf(stderr, "DataReaderFromMmap read reference mismatch\n");
+        return -1;
+    }
+
+    // no data beyond file end
+    if (dr.reference(filesize, &refbuf) != 0)
+    {
+        fprintf(stderr, "DataReaderFromMmap reference beyond file end\n");
+        return -1;
+    }
+
+    dr.release_pages();
+    if (*(const float*)((const unsigned char*)refbuf) != v0)
+    {
+        fprintf(stderr, "DataReaderFromMmap data mismatch after release_pages\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int test_mmap(const ncnn::Option& opt, const char* binpath)
+{
+    ncnn::Net net_ref;
+    net_ref.opt = opt;
+    net_ref.load_param_mem(g_mmap_param);
+    if (net_ref.load_model(binpath) != 0)
+    {
+        fprintf(stderr, "load_model %s failed\n", binpath);
+        return -1;
+    }
+
+    ncnn::Net net;
+    net.opt = opt;
+    net.load_param_mem(g_mmap_param);
+    if (net.load_model_mmap(binpath) != 0)
+    {
+        fprintf(stderr, "load_model_mmap %s failed\n", binpath);
+        return -1;
+    }
+
+    ncnn::Mat in = RandomMat(13, 17, 8);
+
+    ncnn::Mat out_ref;
+    ncnn::Mat out;
+    for (int i = 0; i < 2; i++)
+    {
+        {
+            ncnn::Extractor ex = net_ref.create_extractor();
+            ex.input("data", in);
+            ex.extract("fc", out_ref);
+        }
+        {
+            ncnn::Extractor ex = net.create_extractor();
+            ex.input("data", in);
+            ex.extract("fc", out);
+        }
+
+        if (CompareMat(out, out_ref, 0.001) != 0)
+        {
+            fprintf(stderr, "test_mmap failed lightmode=%d use_packing_layout=%d\n", opt.lightmode, opt.use_packing_layout);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int main()
+{
+    SRAND(7767517);
+
+    const char* binpath = "test_mmap.ncnn.bin";
+
+    {
+        ncnn::Net net;
+        net.load_param_mem(g_mmap_param);
+
+        FILE* fp = fopen(binpath, "wb");
+        if (!fp)
+        {
+            fprintf(stderr, "fopen %s failed\n", binpath);
+            return -1;
+        }
+
+        DataReaderFromRandomRecord dr(fp);
+        int ret = net.load_model(dr);
+        fclose(fp);
+        if (ret != 0)
+        {
+            fprintf(stderr, "record model failed\n");
+            return -1;
+        }
+    }
+
+    ncnn::Option opts[3];
+    opts[0].use_packing_layout = false;
+
+    opts[1].use_packing_layout = true;
+
+    opts[2].lightmode = false;
+    opts[2].use_packing_layout = true;
+    opts[2].use_sgemm_convolution = false;
+    opts[2].use_winograd_convolution = false;
+
+    int ret = test_datareader_mmap(binpath) || test_mmap(opts[0], binpath) || test_mmap(opts[1], binpath) || test_mmap(opts[2], binpath);
+
+    remove(binpath);
+
+    return ret;
+}
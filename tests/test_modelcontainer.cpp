@@ -0,0 +1,302 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "datareader.h"
+#include "modelcontainer.h"
+#include "net.h"
+#include "testutil.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const char* g_container_param = "7767517\n"
+                                       "6 7\n"
+                                       "Input data 0 1 data 0=16 1=16 2=8\n"
+                                       "Convolution conv1 1 1 data conv1 0=16 1=3 4=1 5=1 6=1152 9=1\n"
+                                       "Split splitncnn_0 1 2 conv1 a b\n"
+                                       "Convolution head_a 1 1 a ha 0=8 1=1 5=1 6=128\n"
+                                       "Convolution head_b 1 1 b hb 0=8 1=3 4=1 5=1 6=1152 9=1\n"
+                                       "Eltwise sum 2 1 ha hb out 0=1\n";
+
+// raw float weight, zero flag and bias of the convolution layers
+static void append_convolution_weight(std::vector<unsigned char>& bin, int weight_data_size, int num_output)
+{
+    const size_t offset = bin.size();
+    bin.resize(offset + 4 + (weight_data_size + num_output) * sizeof(float));
+
+    memset(&bin[offset], 0, 4);
+
+    float* p = (float*)&bin[offset + 4];
+    for (int i = 0; i < weight_data_size + num_output; i++)
+    {
+        p[i] = RandomFloat(-0.5f, 0.5f);
+    }
+}
+
+static int make_container(const char* path)
+{
+    std::vector<unsigned char> weights[3];
+    append_convolution_weight(weights[0], 1152, 16);
+    append_convolution_weight(weights[1], 128, 8);
+    append_convolution_weight(weights[2], 1152, 8);
+
+    // model bin stream as the old .bin
+    std::vector<unsigned char> bin;
+    for (int i = 0; i < 3; i++)
+    {
+        bin.insert(bin.end(), weights[i].begin(), weights[i].end());
+    }
+
+    ncnn::ModelContainerWriter writer;
+    writer.add_section(ncnn::MODEL_CONTAINER_PARAM, 0, g_container_param, strlen(g_container_param) + 1);
+    writer.add_section(ncnn::MODEL_CONTAINER_LAYER_WEIGHT, 1, weights[0].data(), weights[0].size());
+    writer.add_section(ncnn::MODEL_CONTAINER_LAYER_WEIGHT, 4, weights[2].data(), weights[2].size());
+    writer.add_section(ncnn::MODEL_CONTAINER_LAYER_WEIGHT, 3, weights[1].data(), weights[1].size());
+
+    if (writer.save(path) != 0)
+        return -1;
+
+    FILE* fp = fopen("test_modelcontainer.bin", "wb");
+    if (!fp)
+        return -1;
+
+    fwrite(bin.data(), 1, bin.size(), fp);
+    fclose(fp);
+
+    return 0;
+}
+
+static int read_file(const char* path, std::vector<unsigned char>& data)
+{
+    FILE* fp = fopen(path, "rb");
+    if (!fp)
+        return -1;
+
+    fseek(fp, 0, SEEK_END);
+    data.resize(ftell(fp));
+    fseek(fp, 0, SEEK_SET);
+
+    size_t nread = fread(data.data(), 1, data.size(), fp);
+    fclose(fp);
+
+    return nread == data.size() ? 0 : -1;
+}
+
+static int test_modelcontainer_format(const char* path)
+{
+    ncnn::ModelContainer container;
+    if (container.open(path) != 0 || container.verify() != 0)
+    {
+        fprintf(stderr, "open container failed\n");
+        return -1;
+    }
+
+    if (container.section_count() != 4)
+    {
+        fprintf(stderr, "section_count = %d\n", container.section_count());
+        return -1;
+    }
+
+    for (int i = 0; i < container.section_count(); i++)
+    {
+        int type = 0;
+        int index = 0;
+        const unsigned char* data = 0;
+        size_t size = 0;
+        if (container.section(i, &type, &index, &data, &size) != 0 || (size_t)data % 64 != 0)
+        {
+            fprintf(stderr, "section %d misaligned\n", i);
+            return -1;
+        }
+    }
+
+    // random access by layer index
+    const unsigned char* data = 0;
+    size_t size = 0;
+    if (container.find_section(ncnn::MODEL_CONTAINER_LAYER_WEIGHT, 3, &data, &size) != 0 || size != 4 + (128 + 8) * sizeof(float))
+    {
+        fprintf(stderr, "find_section failed\n");
+        return -1;
+    }
+
+    if (container.find_section(ncnn::MODEL_CONTAINER_LAYER_WEIGHT, 2, &data, &size) == 0)
+    {
+        fprintf(stderr, "found section of layer without weight\n");
+        return -1;
+    }
+
+    std::vector<unsigned char> mem;
+    if (read_file(path, mem) != 0)
+        return -1;
+
+    // flip one weight byte
+    {
+        std::vector<unsigned char> corrupted = mem;
+        corrupted[corrupted.size() - 64 - 8] ^= 0x40;
+
+        ncnn::ModelContainer c;
+        if (c.open(corrupted.data(), corrupted.size()) != 0 || c.verify() == 0)
+        {
+            fprintf(stderr, "corrupted container verified\n");
+            return -1;
+        }
+    }
+
+    // truncated file
+    {
+        ncnn::ModelContainer c;
+        if (c.open(mem.data(), mem.size() - 64) == 0)
+        {
+            fprintf(stderr, "truncated container opened\n");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int test_modelcontainer_net(const char* path, const ncnn::Option& opt)
+{
+    ncnn::Mat in = RandomMat(16, 16, 8);
+
+    ncnn::Mat out_ref;
+    {
+        ncnn::Net net;
+        net.opt = opt;
+
+        if (net.load_param_mem(g_container_param) != 0 || net.load_model("test_modelcontainer.bin") != 0)
+            return -1;
+
+        ncnn::Extractor ex = net.create_extractor();
+        ex.input("data", in);
+        if (ex.extract("out", out_ref) != 0)
+            return -1;
+
+        out_ref = out_ref.clone();
+    }
+
+    // mapped by net
+    ncnn::Mat out;
+    {
+        ncnn::Net net;
+        net.opt = opt;
+
+        if (net.load_container(path) != 0)
+        {
+            fprintf(stderr, "load_container failed\n");
+            return -1;
+        }
+
+        ncnn::Extractor ex = net.create_extractor();
+        ex.input("data", in);
+        if (ex.extract("out", out) != 0)
+            return -1;
+
+        out = out.clone();
+    }
+
+    if (CompareMat(out, out_ref, 0.001) != 0)
+    {
+        fprintf(stderr, "mapped container output mismatch\n");
+        return -1;
+    }
+
+    // referenced from caller memory
+    std::vector<unsigned char> mem;
+    if (read_file(path, mem) != 0)
+        return -1;
+
+    ncnn::ModelContainer container;
+    if (container.open(mem.data(), mem.size()) != 0)
+        return -1;
+
+    {
+        ncnn::Net net;
+        net.opt = opt;
+
+        if (net.load_container(container) != 0)
+        {
+            fprintf(stderr, "load_container from memory failed\n");
+            return -1;
+        }
+
+        ncnn::Extractor ex = net.create_extractor();
+        ex.input("data", in);
+        if (ex.extract("out", out) != 0)
+            return -1;
+    }
+
+    if (CompareMat(out, out_ref, 0.001) != 0)
+    {
+        fprintf(stderr, "container output mismatch\n");
+        return -1;
+    }
+
+    // flipped weight byte fails loading
+    {
+        std::vector<unsigned char> corrupted = mem;
+        corrupted[corrupted.size() - 64 - 8] ^= 0x40;
+
+        ncnn::ModelContainer c;
+        if (c.open(corrupted.data(), corrupted.size()) != 0)
+            return -1;
+
+        ncnn::Net net;
+        net.opt = opt;
+
+        if (net.load_container(c) == 0)
+        {
+            fprintf(stderr, "corrupted container loaded\n");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int main()
+{
+    SRAND(7767517);
+
+    const char* path = "test_modelcontainer.ncnnmodel";
+
+    int ret = make_container(path);
+    if (ret == 0)
+        ret = test_modelcontainer_format(path);
+
+    ncnn::Option opts[3];
+    opts[0].num_threads = 1;
+    opts[0].use_packing_layout = false;
+
+    opts[1].num_threads = 1;
+    opts[1].use_packing_layout = true;
+
+    opts[2].num_threads = 4;
+    opts[2].use_packing_layout = true;
+    opts[2].use_parallel_load = true;
+
+    for (int i = 0; ret == 0 && i < 3; i++)
+    {
+        ret = test_modelcontainer_net(path, opts[i]);
+        if (ret != 0)
+        {
+            fprintf(stderr, "test_modelcontainer_net failed num_threads=%d use_parallel_load=%d\n", opts[i].num_threads, opts[i].use_parallel_load);
+        }
+    }
+
+    remove(path);
+    remove("test_modelcontainer.bin");
+
+    return ret;
+}
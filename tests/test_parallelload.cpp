@@ -0,0 +1,199 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "datareader.h"
+#include "layer.h"
+#include "modelbin.h"
+#include "net.h"
+#include "testutil.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const char* g_parallelload_param = "7767517\n"
+                                          "12 14\n"
+                                          "Input data 0 1 data 0=24 1=24 2=16\n"
+                                          "Convolution conv1 1 1 data conv1 0=32 1=3 4=1 5=1 6=4608 9=1\n"
+                                          "Split splitncnn_0 1 3 conv1 b0 b1 b2\n"
+                                          "Convolution b0_conv 1 1 b0 b0_out 0=16 1=1 5=1 6=512\n"
+                                          "Convolution b1_conv 1 1 b1 b1_out 0=16 1=3 4=1 5=1 6=4608 9=2 -23310=1,0.1\n"
+                                          "ConvolutionDepthWise b2_dw 1 1 b2 b2_dw 0=32 1=3 4=1 5=1 6=288 7=32\n"
+                                          "Convolution b2_conv 1 1 b2_dw b2_out 0=16 1=1 5=1 6=512\n"
+                                          "Concat concat 3 1 b0_out b1_out b2_out cat\n"
+                                          "Convolution conv2 1 1 cat conv2 0=24 1=3 3=2 4=1 5=1 6=10368 9=1\n"
+                                          "Pooling gap 1 1 conv2 gap 0=1 4=1\n"
+                                          "InnerProduct fc 1 1 gap fc 0=10 1=1 2=240\n"
+                                          "Softmax prob 1 1 fc prob\n";
+
+static int load_parallelload_net(ncnn::Net& net, const ncnn::Option& opt)
+{
+    net.opt = opt;
+
+    int ret = net.load_param_mem(g_parallelload_param);
+    if (ret != 0)
+        return ret;
+
+    SRAND(7767517);
+    DataReaderFromRandom dr;
+    return net.load_model(dr);
+}
+
+static int test_parallelload(const ncnn::Option& opt)
+{
+    ncnn::Option opt_ref = opt;
+    opt_ref.use_parallel_load = false;
+
+    ncnn::Option opt_parallel = opt;
+    opt_parallel.use_parallel_load = true;
+
+    ncnn::Net net_ref;
+    ncnn::Net net;
+    if (load_parallelload_net(net_ref, opt_ref) != 0 || load_parallelload_net(net, opt_parallel) != 0)
+    {
+        fprintf(stderr, "load_parallelload_net failed\n");
+        return -1;
+    }
+
+    const size_t layer_count = net.layers().size();
+    if (net.layer_load_times().size() != layer_count || net.layer_pipeline_times().size() != layer_count)
+    {
+        fprintf(stderr, "layer times not reported for %d layers\n", (int)layer_count);
+        return -1;
+    }
+
+    for (size_t i = 0; i < layer_count; i++)
+    {
+        if (net.layer_load_times()[i] < 0 || net.layer_pipeline_times()[i] < 0)
+        {
+            fprintf(stderr, "layer %d negative times\n", (int)i);
+            return -1;
+        }
+    }
+
+    ncnn::Mat in = RandomMat(24, 24, 16);
+
+    ncnn::Mat out_ref;
+    {
+        ncnn::Extractor ex = net_ref.create_extractor();
+        ex.input("data", in);
+        ex.extract("prob", out_ref);
+    }
+
+    ncnn::Mat out;
+    {
+        ncnn::Extractor ex = net.create_extractor();
+        ex.input("data", in);
+        ex.extract("prob", out);
+    }
+
+    if (CompareMat(out, out_ref, 0.001) != 0)
+    {
+        fprintf(stderr, "test_parallelload failed num_threads=%d use_packing_layout=%d\n", opt.num_threads, opt.use_packing_layout);
+        return -1;
+    }
+
+    net.clear();
+    if (!net.layer_load_times().empty() || !net.layer_pipeline_times().empty())
+    {
+        fprintf(stderr, "layer times not cleared\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+// weights transformed on one thread with tiles planned for more threads
+static int test_parallelload_plan_num_threads()
+{
+    const int M = 64;
+    const int N = 48;
+    const int K = 80;
+
+    ncnn::Mat weights[1];
+    weights[0] = RandomMat(M, K);
+
+    ncnn::Mat b = RandomMat(N, K);
+
+    ncnn::Option opt;
+    opt.num_threads = 4;
+    opt.use_packing_layout = true;
+
+    ncnn::Option opt_plan = opt;
+    opt_plan.num_threads = 1;
+    opt_plan.plan_num_threads = 4;
+
+    std::vector<ncnn::Mat> tops[2];
+    for (int i = 0; i < 2; i++)
+    {
+        ncnn::Layer* op = ncnn::create_layer_cpu("Gemm");
+
+        ncnn::ParamDict pd;
+        pd.set(2, 1);  // transA
+        pd.set(4, 1);  // constantA
+        pd.set(7, M);  // constantM
+        pd.set(9, K);  // constantK
+        pd.set(14, 1); // output_transpose
+        op->load_param(pd);
+        op->load_model(ncnn::ModelBinFromMatArray(weights));
+        op->create_pipeline(i == 0 ? opt : opt_plan);
+
+        std::vector<ncnn::Mat> bottom_blobs(1, b);
+        tops[i].resize(1);
+        int ret = op->forward(bottom_blobs, tops[i], opt);
+
+        op->destroy_pipeline(opt);
+        delete op;
+
+        if (ret != 0)
+        {
+            fprintf(stderr, "test_parallelload_plan_num_threads forward failed\n");
+            return -1;
+        }
+    }
+
+    if (CompareMat(tops[1][0], tops[0][0], 0.001) != 0)
+    {
+        fprintf(stderr, "test_parallelload_plan_num_threads output mismatch\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+int main()
+{
+    SRAND(7767517);
+
+    ncnn::Option opts[4];
+    opts[0].num_threads = 1;
+    opts[0].use_packing_layout = true;
+
+    opts[1].num_threads = 2;
+    opts[1].use_packing_layout = false;
+
+    opts[2].num_threads = 4;
+    opts[2].use_packing_layout = true;
+
+    opts[3].num_threads = 16;
+    opts[3].use_packing_layout = true;
+
+    for (int i = 0; i < 4; i++)
+    {
+        int ret = test_parallelload(opts[i]);
+        if (ret != 0)
+            return ret;
+    }
+
+    return test_parallelload_plan_num_threads();
+}
@@ -0,0 +1,395 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "datareader.h"
+#include "layer_type.h"
+#include "net.h"
+#include "profiler.h"
+#include "testutil.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const char* g_profiler_param = "7767517\n"
+                                      "7 8\n"
+                                      "Input data 0 1 data 0=16 1=16 2=8\n"
+                                      "Convolution conv1 1 1 data conv1 0=16 1=3 4=1 5=1 6=1152 9=1\n"
+                                      "Split splitncnn_0 1 2 conv1 a b\n"
+                                      "Convolution head_a 1 1 a ha 0=8 1=1 5=1 6=128\n"
+                                      "ReLU head_a_relu 1 1 ha ha_out\n"
+                                      "Convolution head_b 1 1 b hb 0=24 1=3 4=1 5=1 6=3456 9=1\n"
+                                      "Pooling head_b_pool 1 1 hb hb_out 0=1 1=2 2=2\n";
+
+static int check_file_begins_with(const char* path, char c)
+{
+    FILE* fp = fopen(path, "rb");
+    if (!fp)
+        return -1;
+
+    int first = fgetc(fp);
+    fclose(fp);
+    remove(path);
+
+    return first == c ? 0 : -1;
+}
+
+static int test_profiler(const ncnn::Option& opt)
+{
+    ncnn::Net net;
+    net.opt = opt;
+
+    if (net.load_param_mem(g_profiler_param) != 0)
+        return -1;
+
+    SRAND(7767517);
+    DataReaderFromRandom dr;
+    if (net.load_model(dr) != 0)
+        return -1;
+
+    ncnn::Mat in = RandomMat(16, 16, 8);
+
+    ncnn::Profiler profiler;
+    net.set_profiler(&profiler);
+
+    // reference outputs without profiling
+    ncnn::Mat ha_ref;
+    ncnn::Mat hb_ref;
+    {
+        ncnn::Extractor ex = net.create_extractor();
+        ex.set_profiler(0);
+        ex.input("data", in);
+        if (ex.extract("ha_out", ha_ref) != 0 || ex.extract("hb_out", hb_ref) != 0)
+            return -1;
+    }
+
+    if (!profiler.records().empty())
+    {
+        fprintf(stderr, "extractor without profiler recorded %d layers\n", (int)profiler.records().size());
+        return -1;
+    }
+
+    ncnn::Mat ha;
+    ncnn::Mat hb;
+    {
+        ncnn::Extractor ex = net.create_extractor();
+        ex.input("data", in);
+        if (ex.extract("ha_out", ha) != 0 || ex.extract("hb_out", hb) != 0)
+            return -1;
+    }
+
+    if (CompareMat(ha, ha_ref, 0.001) != 0 || CompareMat(hb, hb_ref, 0.001) != 0)
+    {
+        fprintf(stderr, "profiled output mismatch\n");
+        return -1;
+    }
+
+    // every layer but input runs once
+    std::vector<ncnn::LayerProfile> records = profiler.records();
+    if ((int)records.size() != (int)net.layers().size() - 1)
+    {
+        fprintf(stderr, "recorded %d layers\n", (int)records.size());
+        return -1;
+    }
+
+    std::vector<int> seen(net.layers().size(), 0);
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        const ncnn::LayerProfile& r = records[i];
+        if (r.layer_index <= 0 || r.layer_index >= (int)net.layers().size() || seen[r.layer_index]++)
+        {
+            fprintf(stderr, "bad layer index %d\n", r.layer_index);
+            return -1;
+        }
+
+        const ncnn::Layer* layer = net.layers()[r.layer_index];
+        if (r.typeindex != layer->typeindex || r.bottom_shapes.size() != layer->bottoms.size() || r.top_shapes.size() != layer->tops.size())
+        {
+            fprintf(stderr, "layer %d record mismatch\n", r.layer_index);
+            return -1;
+        }
+
+        if (r.start > r.end || r.thread_id < 0 || r.num_threads != opt.num_threads)
+        {
+            fprintf(stderr, "layer %d bad timing %f %f thread %d\n", r.layer_index, r.start, r.end, r.thread_id);
+            return -1;
+        }
+
+        for (size_t j = 0; j < r.top_shapes.size(); j++)
+        {
+            if (r.top_shapes[j].data)
+            {
+                fprintf(stderr, "layer %d record holds blob data\n", r.layer_index);
+                return -1;
+            }
+        }
+    }
+
+    // conv1 output 16x16x16
+    const ncnn::LayerProfile& conv1 = records[0];
+    if (conv1.layer_index != 1 || conv1.top_shapes[0].w != 16 || conv1.top_shapes[0].h != 16 || conv1.top_shapes[0].c * conv1.top_shapes[0].elempack != 16 || conv1.bytes_allocated == 0)
+    {
+        fprintf(stderr, "conv1 record mismatch\n");
+        return -1;
+    }
+
+    // 16x16x16 outputs of 8x3x3 multiply-add, 1152 weights and 16 bias
+    if (conv1.cost.flops != 2 * 16 * 16 * 16 * 8 * 9 || conv1.cost.weight_bytes != (1152 + 16) * 4 || conv1.cost.bytes_written != 16 * 16 * 16 * conv1.top_shapes[0].elemsize / conv1.top_shapes[0].elempack)
+    {
+        fprintf(stderr, "conv1 cost mismatch flops=%.0f weight_bytes=%.0f bytes_written=%.0f\n", conv1.cost.flops, conv1.cost.weight_bytes, conv1.cost.bytes_written);
+        return -1;
+    }
+
+#if NCNN_STDIO
+    if (profiler.save_json("test_profiler.json") != 0 || check_file_begins_with("test_profiler.json", '[') != 0)
+    {
+        fprintf(stderr, "save_json failed\n");
+        return -1;
+    }
+
+    if (profiler.save_chrome_trace("test_profiler_trace.json") != 0 || check_file_begins_with("test_profiler_trace.json", '{') != 0)
+    {
+        fprintf(stderr, "save_chrome_trace failed\n");
+        return -1;
+    }
+#endif // NCNN_STDIO
+
+    profiler.clear();
+    if (!profiler.records().empty())
+    {
+        fprintf(stderr, "clear failed\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int test_profiler_hardware_counters()
+{
+    ncnn::Net net;
+    net.opt.num_threads = 1;
+
+    if (net.load_param_mem(g_profiler_param) != 0)
+        return -1;
+
+    DataReaderFromRandom dr;
+    if (net.load_model(dr) != 0)
+        return -1;
+
+    ncnn::Profiler profiler;
+    if (profiler.enable_hardware_counters() != 0)
+    {
+        // perf_event not permitted here
+        if (profiler.hardware_counters_enabled())
+        {
+            fprintf(stderr, "hardware counters enabled after failure\n");
+            return -1;
+        }
+
+        return 0;
+    }
+
+    net.set_profiler(&profiler);
+
+    ncnn::Mat in = RandomMat(16, 16, 8);
+    ncnn::Mat out;
+    {
+        ncnn::Extractor ex = net.create_extractor();
+        ex.input("data", in);
+        if (ex.extract("hb_out", out) != 0)
+            return -1;
+    }
+
+    std::vector<ncnn::LayerProfile> records = profiler.records();
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        const ncnn::HardwareCounters& c = records[i].counters;
+        if (c.cycles < -1 || c.instructions < -1 || c.l1d_read_misses < -1 || c.llc_misses < -1 || c.branch_misses < -1)
+        {
+            fprintf(stderr, "layer %d bad counters\n", records[i].layer_index);
+            return -1;
+        }
+    }
+
+    // conv1 retires instructions
+    if (!records.empty() && records[0].counters.instructions == 0)
+    {
+        fprintf(stderr, "conv1 counted no instructions\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+// no Convolution params behind it
+class CopyConvolution : public ncnn::Layer
+{
+public:
+    CopyConvolution()
+    {
+        one_blob_only = true;
+    }
+
+    virtual int forward(const ncnn::Mat& bottom_blob, ncnn::Mat& top_blob, const ncnn::Option& opt) const
+    {
+        top_blob = bottom_blob.clone(opt.blob_allocator);
+        return top_blob.empty() ? -100 : 0;
+    }
+};
+
+DEFINE_LAYER_CREATOR(CopyConvolution)
+
+static int test_profiler_overwritten_layer()
+{
+    ncnn::Net net;
+    net.opt.num_threads = 1;
+    net.register_custom_layer("Convolution", CopyConvolution_layer_creator);
+
+    if (net.load_param_mem(g_profiler_param) != 0)
+        return -1;
+
+    DataReaderFromRandom dr;
+    if (net.load_model(dr) != 0)
+        return -1;
+
+    ncnn::Profiler profiler;
+    net.set_profiler(&profiler);
+
+    ncnn::Mat in = RandomMat(16, 16, 8);
+    ncnn::Mat out;
+    {
+        ncnn::Extractor ex = net.create_extractor();
+        ex.input("data", in);
+        if (ex.extract("hb_out", out) != 0)
+            return -1;
+    }
+
+    // overwritten layers have unknown cost, builtin ones keep theirs
+    std::vector<ncnn::LayerProfile> records = profiler.records();
+    int overwritten_count = 0;
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        const ncnn::LayerProfile& r = records[i];
+        const bool overwritten = r.typeindex == ncnn::LayerType::Convolution;
+        if (overwritten && (r.cost.flops != -1 || r.cost.weight_bytes != -1))
+        {
+            fprintf(stderr, "overwritten layer %d cost flops=%.0f weight_bytes=%.0f\n", r.layer_index, r.cost.flops, r.cost.weight_bytes);
+            return -1;
+        }
+        if (!overwritten && r.cost.flops < 0)
+        {
+            fprintf(stderr, "builtin layer %d cost flops=%.0f\n", r.layer_index, r.cost.flops);
+            return -1;
+        }
+
+        overwritten_count += overwritten;
+    }
+
+    if (overwritten_count != 2)
+    {
+        fprintf(stderr, "recorded %d overwritten layers\n", overwritten_count);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int test_profiler_weight_storage_cost()
+{
+    std::vector<ncnn::Mat> shapes(1);
+    shapes[0] = ncnn::Mat(600, 4, (void*)0);
+
+    ncnn::Option opt;
+    opt.use_fp16_storage = false;
+
+    // int4 innerproduct, rows of 300 bytes and 19 group scales, plus bias
+    ncnn::Layer* innerproduct = ncnn::create_layer_cpu(ncnn::LayerType::InnerProduct);
+    ncnn::ParamDict pd;
+    pd.set(0, 70);
+    pd.set(1, 1);
+    pd.set(2, 70 * 600);
+    pd.set(11, 4);
+    pd.set(12, 32);
+    innerproduct->load_param(pd);
+
+    ncnn::LayerCost cost = ncnn::get_layer_cost(innerproduct, true, shapes, shapes, opt);
+    delete innerproduct;
+    if (cost.weight_bytes != 70 * (300 + 19 * 4) + 70 * 4)
+    {
+        fprintf(stderr, "int4 innerproduct weight_bytes=%.0f\n", cost.weight_bytes);
+        return -1;
+    }
+
+    // int8 gemm with constant B
+    ncnn::Layer* gemm = ncnn::create_layer_cpu(ncnn::LayerType::Gemm);
+    ncnn::ParamDict pd2;
+    pd2.set(3, 1);
+    pd2.set(5, 1);
+    pd2.set(8, 70);
+    pd2.set(9, 600);
+    pd2.set(15, 8);
+    pd2.set(16, 32);
+    gemm->load_param(pd2);
+
+    cost = ncnn::get_layer_cost(gemm, true, shapes, shapes, opt);
+    delete gemm;
+    if (cost.weight_bytes != 70 * (600 + 19 * 4))
+    {
+        fprintf(stderr, "int8 gemm weight_bytes=%.0f\n", cost.weight_bytes);
+        return -1;
+    }
+
+    // fp16 packed gemm weight
+    gemm = ncnn::create_layer_cpu(ncnn::LayerType::Gemm);
+    pd2.set(15, 0);
+    gemm->load_param(pd2);
+
+    opt.use_fp16_weight = true;
+    cost = ncnn::get_layer_cost(gemm, true, shapes, shapes, opt);
+    delete gemm;
+    if (cost.weight_bytes != 70 * 600 * (ncnn::cpu_support_x86_f16c() ? 2 : 4))
+    {
+        fprintf(stderr, "fp16 gemm weight_bytes=%.0f\n", cost.weight_bytes);
+        return -1;
+    }
+
+    return 0;
+}
+
+int main()
+{
+    SRAND(7767517);
+
+    ncnn::Option opts[3];
+    opts[0].num_threads = 1;
+    opts[0].use_packing_layout = false;
+
+    opts[1].num_threads = 1;
+    opts[1].use_packing_layout = true;
+
+    opts[2].num_threads = 2;
+    opts[2].use_packing_layout = true;
+    opts[2].use_branch_parallel = true;
+
+    for (int i = 0; i < 3; i++)
+    {
+        int ret = test_profiler(opts[i]);
+        if (ret != 0)
+        {
+            fprintf(stderr, "test_profiler failed num_threads=%d use_packing_layout=%d\n", opts[i].num_threads, opts[i].use_packing_layout);
+            return ret;
+        }
+    }
+
+    return test_profiler_hardware_counters() || test_profiler_overwritten_layer() || test_profiler_weight_storage_cost();
+}
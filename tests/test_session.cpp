@@ -0,0 +1,391 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "benchmark.h"
+#include "datareader.h"
+#include "net.h"
+#include "session.h"
+#include "testutil.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const char* g_session_param = "7767517\n"
+                                     "5 5\n"
+                                     "Input data 0 1 data 0=16 1=16 2=3\n"
+                                     "Convolution conv1 1 1 data conv1 0=8 1=3 4=1 5=1 6=216\n"
+                                     "ReLU relu1 1 1 conv1 conv1_relu\n"
+                                     "Pooling gap 1 1 conv1_relu gap 0=1 4=1\n"
+                                     "InnerProduct fc 1 1 gap fc 0=10 1=1 2=80\n";
+
+static void on_finished(int ret, const std::vector<ncnn::Mat>& outputs, void* userdata)
+{
+    int* count = (int*)userdata;
+    if (ret == 0 && outputs.size() == 2)
+    {
+        NCNN_XADD(count, 1);
+    }
+}
+
+static int test_session(int worker_count)
+{
+    ncnn::Net net;
+    net.opt.num_threads = 1;
+
+    if (net.load_param_mem(g_session_param) != 0)
+    {
+        fprintf(stderr, "load_param_mem failed\n");
+        return -1;
+    }
+
+    SRAND(7767517);
+    DataReaderFromRandom dr;
+    net.load_model(dr);
+
+    const int request_count = 16;
+
+    std::vector<ncnn::Mat> inputs(request_count);
+    std::vector<ncnn::Mat> fc_refs(request_count);
+    std::vector<ncnn::Mat> gap_refs(request_count);
+    for (int i = 0; i < request_count; i++)
+    {
+        inputs[i] = RandomMat(16 + i % 3, 16, 3);
+
+        ncnn::Extractor ex = net.create_extractor();
+        ex.input("data", inputs[i]);
+        ex.extract("gap", gap_refs[i]);
+        ex.extract("fc", fc_refs[i]);
+    }
+
+    std::vector<const char*> input_names(1, "data");
+    std::vector<const char*> output_names;
+    output_names.push_back("gap");
+    output_names.push_back("fc");
+
+    int callback_count = 0;
+
+    std::vector<ncnn::InferenceFuture> futures(request_count);
+    {
+        ncnn::InferenceSession session(&net, worker_count);
+
+        for (int i = 0; i < request_count; i++)
+        {
+            std::vector<ncnn::Mat> in(1, inputs[i]);
+            if (i % 2 == 0)
+                futures[i] = session.submit(input_names, in, output_names);
+            else
+                futures[i] = session.submit(input_names, in, output_names, on_finished, &callback_count);
+        }
+
+        for (int i = 0; i < request_count; i++)
+        {
+            int ret = futures[i].wait();
+            if (ret != 0 || !futures[i].ready())
+            {
+                fprintf(stderr, "request %d failed %d\n", i, ret);
+                return -1;
+            }
+
+            const std::vector<ncnn::Mat>& outputs = futures[i].outputs();
+            if (outputs.size() != 2 || CompareMat(outputs[0], gap_refs[i], 0.001) != 0 || CompareMat(outputs[1], fc_refs[i], 0.001) != 0)
+            {
+                fprintf(stderr, "request %d output mismatch\n", i);
+                return -1;
+            }
+        }
+
+        // unknown output blob fails the request only
+        std::vector<const char*> bad_names(1, "nonexistent");
+        std::vector<ncnn::Mat> in(1, inputs[0]);
+        ncnn::InferenceFuture bad = session.submit(input_names, in, bad_names);
+        if (bad.wait() == 0)
+        {
+            fprintf(stderr, "request with bad output should fail\n");
+            return -1;
+        }
+
+        ncnn::InferenceSessionStat stat = session.stat();
+        if (stat.submitted != request_count + 1 || stat.completed != request_count + 1 || stat.failed != 1 || stat.queue_depth != 0 || stat.running != 0)
+        {
+            fprintf(stderr, "stat mismatch submitted=%u completed=%u failed=%u queue_depth=%d running=%d\n", stat.submitted, stat.completed, stat.failed, stat.queue_depth, stat.running);
+            return -1;
+        }
+
+        if (stat.latency_min > stat.latency_avg || stat.latency_avg > stat.latency_max || stat.queue_time_avg > stat.latency_avg)
+        {
+            fprintf(stderr, "latency stat mismatch %f %f %f %f\n", stat.queue_time_avg, stat.latency_min, stat.latency_avg, stat.latency_max);
+            return -1;
+        }
+
+        session.reset_stat();
+        if (session.stat().submitted != 0)
+        {
+            fprintf(stderr, "reset_stat failed\n");
+            return -1;
+        }
+    }
+
+    if (callback_count != request_count / 2)
+    {
+        fprintf(stderr, "callback count %d\n", callback_count);
+        return -1;
+    }
+
+    // outputs outlive the session
+    for (int i = 0; i < request_count; i++)
+    {
+        if (CompareMat(futures[i].outputs()[1], fc_refs[i], 0.001) != 0)
+        {
+            fprintf(stderr, "request %d output lost after session destroyed\n", i);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int test_session_batching(int worker_count, int max_batch_size)
+{
+    ncnn::Net net;
+    net.opt.num_threads = 1;
+
+    if (net.load_param_mem(g_session_param) != 0)
+    {
+        fprintf(stderr, "load_param_mem failed\n");
+        return -1;
+    }
+
+    SRAND(7767517);
+    DataReaderFromRandom dr;
+    net.load_model(dr);
+
+    const int request_count = 24;
+
+    std::vector<ncnn::Mat> inputs(request_count);
+    std::vector<ncnn::Mat> fc_refs(request_count);
+    for (int i = 0; i < request_count; i++)
+    {
+        // two shapes interleaved, batches only take the same shape
+        inputs[i] = RandomMat(16 + i % 2, 16, 3);
+
+        ncnn::Extractor ex = net.create_extractor();
+        ex.input("data", inputs[i]);
+        ex.extract("fc", fc_refs[i]);
+    }
+
+    std::vector<const char*> input_names(1, "data");
+    std::vector<const char*> output_names;
+    output_names.push_back("gap");
+    output_names.push_back("fc");
+
+    ncnn::InferenceSession session(&net, worker_count);
+    session.set_batching(max_batch_size, 100);
+
+    std::vector<ncnn::InferenceFuture> futures(request_count);
+    for (int i = 0; i < request_count; i++)
+    {
+        futures[i] = session.submit(input_names, std::vector<ncnn::Mat>(1, inputs[i]), output_names);
+    }
+
+    for (int i = 0; i < request_count; i++)
+    {
+        int ret = futures[i].wait();
+        if (ret != 0)
+        {
+            fprintf(stderr, "batched request %d failed %d\n", i, ret);
+            return -1;
+        }
+
+        const std::vector<ncnn::Mat>& outputs = futures[i].outputs();
+        if (outputs.size() != 2 || outputs[0].w * outputs[0].h * outputs[0].c != 8 || CompareMat(outputs[1], fc_refs[i], 0.001) != 0)
+        {
+            fprintf(stderr, "batched request %d output mismatch\n", i);
+            return -1;
+        }
+    }
+
+    ncnn::InferenceSessionStat stat = session.stat();
+    if (stat.completed != request_count || stat.failed != 0 || stat.batches >= request_count || stat.batch_size_avg <= 1 || stat.batch_size_avg > max_batch_size)
+    {
+        fprintf(stderr, "batching stat mismatch completed=%u failed=%u batches=%u batch_size_avg=%f\n", stat.completed, stat.failed, stat.batches, stat.batch_size_avg);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int test_session_batching_wait()
+{
+    ncnn::Net net;
+    net.opt.num_threads = 1;
+
+    if (net.load_param_mem(g_session_param) != 0)
+    {
+        fprintf(stderr, "load_param_mem failed\n");
+        return -1;
+    }
+
+    SRAND(7767517);
+    DataReaderFromRandom dr;
+    net.load_model(dr);
+
+    std::vector<const char*> input_names(1, "data");
+    std::vector<const char*> output_names(1, "fc");
+    std::vector<ncnn::Mat> inputs(1, RandomMat(16, 16, 3));
+
+    ncnn::InferenceSession session(&net, 1);
+
+    // a lone request is released after max_batch_wait
+    session.set_batching(4, 50);
+    {
+        double start = ncnn::get_current_time();
+        ncnn::InferenceFuture future = session.submit(input_names, inputs, output_names);
+        int ret = future.wait();
+        double elapsed = ncnn::get_current_time() - start;
+        if (ret != 0 || elapsed < 40 || elapsed > 5000)
+        {
+            fprintf(stderr, "lone batched request ret=%d elapsed=%f\n", ret, elapsed);
+            return -1;
+        }
+    }
+
+    // the waiting worker wakes up on submit and a full batch runs at once
+    session.set_batching(4, 60000);
+    {
+        double start = ncnn::get_current_time();
+        std::vector<ncnn::InferenceFuture> futures(4);
+        for (int i = 0; i < 4; i++)
+        {
+            futures[i] = session.submit(input_names, inputs, output_names);
+            ncnn::sleep(5);
+        }
+        for (int i = 0; i < 4; i++)
+        {
+            if (futures[i].wait() != 0)
+            {
+                fprintf(stderr, "full batch request %d failed\n", i);
+                return -1;
+            }
+        }
+        double elapsed = ncnn::get_current_time() - start;
+        if (elapsed > 30000)
+        {
+            fprintf(stderr, "full batch waited for the timeout elapsed=%f\n", elapsed);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+// subtracts the mean of the whole blob, so stacked rows would affect each other
+class CenterInnerProduct : public ncnn::Layer
+{
+public:
+    CenterInnerProduct()
+    {
+        one_blob_only = true;
+    }
+
+    virtual int forward(const ncnn::Mat& bottom_blob, ncnn::Mat& top_blob, const ncnn::Option& opt) const
+    {
+        top_blob = bottom_blob.clone(opt.blob_allocator);
+        if (top_blob.empty())
+            return -100;
+
+        const int size = (int)top_blob.total();
+        float* ptr = top_blob;
+        float sum = 0.f;
+        for (int i = 0; i < size; i++)
+        {
+            sum += ptr[i];
+        }
+        for (int i = 0; i < size; i++)
+        {
+            ptr[i] -= sum / size;
+        }
+
+        return 0;
+    }
+};
+
+DEFINE_LAYER_CREATOR(CenterInnerProduct)
+
+static int test_session_batching_overwritten()
+{
+    ncnn::Net net;
+    net.opt.num_threads = 1;
+    net.register_custom_layer("InnerProduct", CenterInnerProduct_layer_creator);
+
+    if (net.load_param_mem(g_session_param) != 0)
+    {
+        fprintf(stderr, "load_param_mem failed\n");
+        return -1;
+    }
+
+    SRAND(7767517);
+    DataReaderFromRandom dr;
+    net.load_model(dr);
+
+    const int request_count = 8;
+
+    std::vector<ncnn::Mat> inputs(request_count);
+    std::vector<ncnn::Mat> fc_refs(request_count);
+    for (int i = 0; i < request_count; i++)
+    {
+        inputs[i] = RandomMat(16, 16, 3);
+
+        ncnn::Extractor ex = net.create_extractor();
+        ex.input("data", inputs[i]);
+        ex.extract("fc", fc_refs[i]);
+    }
+
+    std::vector<const char*> input_names(1, "data");
+    std::vector<const char*> output_names(1, "fc");
+
+    ncnn::InferenceSession session(&net, 1);
+    session.set_batching(4, 100);
+
+    std::vector<ncnn::InferenceFuture> futures(request_count);
+    for (int i = 0; i < request_count; i++)
+    {
+        futures[i] = session.submit(input_names, std::vector<ncnn::Mat>(1, inputs[i]), output_names);
+    }
+
+    for (int i = 0; i < request_count; i++)
+    {
+        if (futures[i].wait() != 0 || futures[i].outputs().size() != 1 || CompareMat(futures[i].outputs()[0], fc_refs[i], 0.001) != 0)
+        {
+            fprintf(stderr, "overwritten layer request %d mismatch\n", i);
+            return -1;
+        }
+    }
+
+    // the overwritten InnerProduct is never row batched
+    ncnn::InferenceSessionStat stat = session.stat();
+    if (stat.batches != request_count)
+    {
+        fprintf(stderr, "overwritten layer batched batches=%u\n", stat.batches);
+        return -1;
+    }
+
+    return 0;
+}
+
+int main()
+{
+    SRAND(7767517);
+
+    return test_session(1) || test_session(3) || test_session_batching(1, 4) || test_session_batching(2, 8) || test_session_batching_wait() || test_session_batching_overwritten();
+}
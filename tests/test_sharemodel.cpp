@@ -0,0 +1,207 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "datareader.h"
+#include "net.h"
+#include "testutil.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const char* g_share_param = "7767517\n"
+                                   "7 7\n"
+                                   "Input data 0 1 data 0=16 1=16 2=16\n"
+                                   "Convolution conv1 1 1 data conv1 0=16 1=3 4=1 5=1 6=2304\n"
+                                   "ReLU relu1 1 1 conv1 conv1_relu\n"
+                                   "ConvolutionDepthWise dw 1 1 conv1_relu dw 0=16 1=3 4=1 5=1 6=144 7=16\n"
+                                   "Convolution conv2 1 1 dw conv2 0=32 1=1 5=1 6=512\n"
+                                   "Pooling gap 1 1 conv2 gap 0=1 4=1\n"
+                                   "InnerProduct fc 1 1 gap fc 0=10 1=1 2=320\n";
+
+static int extract_fc(const ncnn::Net& net, const ncnn::Mat& in, ncnn::Mat& out)
+{
+    ncnn::Extractor ex = net.create_extractor();
+    ex.input("data", in);
+    return ex.extract("fc", out);
+}
+
+static int test_sharemodel(const ncnn::Option& opt)
+{
+    ncnn::Net net;
+    net.opt = opt;
+    if (net.load_param_mem(g_share_param) != 0)
+    {
+        fprintf(stderr, "load_param_mem failed\n");
+        return -1;
+    }
+
+    SRAND(7767517);
+    DataReaderFromRandom dr;
+    if (net.load_model(dr) != 0)
+    {
+        fprintf(stderr, "load_model failed\n");
+        return -1;
+    }
+
+    ncnn::Mat in = RandomMat(16, 16, 16);
+
+    ncnn::Mat ref;
+    extract_fc(net, in, ref);
+
+    ncnn::UnlockedPoolAllocator blob_pool_allocator;
+
+    {
+        ncnn::Net net1;
+        net1.opt.num_threads = 1;
+        net1.opt.lightmode = false;
+        net1.opt.blob_allocator = &blob_pool_allocator;
+
+        ncnn::Net net2;
+        net2.opt.num_threads = 2;
+
+        if (net1.share_model(net) != 0 || net2.share_model(net1) != 0)
+        {
+            fprintf(stderr, "share_model failed\n");
+            return -1;
+        }
+
+        // same layer instances
+        for (size_t i = 0; i < net.layers().size(); i++)
+        {
+            if (net1.layers()[i] != net.layers()[i] || net2.layers()[i] != net.layers()[i])
+            {
+                fprintf(stderr, "layer %d not shared\n", (int)i);
+                return -1;
+            }
+        }
+
+        // per net options are kept
+        if (net1.opt.num_threads != 1 || net1.opt.lightmode || net1.opt.blob_allocator != &blob_pool_allocator || net2.opt.num_threads != 2 || net1.opt.use_packing_layout != opt.use_packing_layout)
+        {
+            fprintf(stderr, "share_model options mismatch\n");
+            return -1;
+        }
+
+        if (net1.input_names().size() != 1 || strcmp(net1.input_names()[0], "data") != 0 || net2.output_names().size() != 1 || strcmp(net2.output_names()[0], "fc") != 0)
+        {
+            fprintf(stderr, "share_model input output names mismatch\n");
+            return -1;
+        }
+
+        ncnn::Mat out1;
+        ncnn::Mat out2;
+        if (extract_fc(net1, in, out1) != 0 || extract_fc(net2, in, out2) != 0)
+        {
+            fprintf(stderr, "extract from shared net failed\n");
+            return -1;
+        }
+
+        if (CompareMat(out1, ref, 0.001) != 0 || CompareMat(out2, ref, 0.001) != 0)
+        {
+            fprintf(stderr, "shared net output mismatch\n");
+            return -1;
+        }
+
+        // clearing one sharing net keeps the layers of others
+        net1.clear();
+        if (extract_fc(net2, in, out2) != 0 || CompareMat(out2, ref, 0.001) != 0)
+        {
+            fprintf(stderr, "shared net output mismatch after clear\n");
+            return -1;
+        }
+    }
+
+    ncnn::Mat out;
+    extract_fc(net, in, out);
+    if (CompareMat(out, ref, 0.001) != 0)
+    {
+        fprintf(stderr, "source net output mismatch after sharing nets destroyed\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+// the source net goes away before the nets sharing its layers run
+static int test_sharemodel_source_destroyed(const ncnn::Option& opt)
+{
+    ncnn::Net* net = new ncnn::Net;
+    net->opt = opt;
+    if (net->load_param_mem(g_share_param) != 0)
+    {
+        fprintf(stderr, "load_param_mem failed\n");
+        delete net;
+        return -1;
+    }
+
+    SRAND(7767517);
+    DataReaderFromRandom dr;
+    if (net->load_model(dr) != 0)
+    {
+        fprintf(stderr, "load_model failed\n");
+        delete net;
+        return -1;
+    }
+
+    ncnn::Net net1;
+    ncnn::Net net2;
+    if (net1.share_model(*net) != 0 || net2.share_model(*net) != 0)
+    {
+        fprintf(stderr, "share_model failed\n");
+        delete net;
+        return -1;
+    }
+
+    // the first sharing net never ran, pipelines may still be pending
+    ncnn::Mat in = RandomMat(16, 16, 16);
+
+    ncnn::Mat ref;
+    extract_fc(net2, in, ref);
+
+    delete net;
+
+    ncnn::Mat out1;
+    if (extract_fc(net1, in, out1) != 0 || CompareMat(out1, ref, 0.001) != 0)
+    {
+        fprintf(stderr, "shared net output mismatch after source destroyed\n");
+        return -1;
+    }
+
+    // layers pass on again when the new owner is cleared
+    net1.clear();
+
+    ncnn::Mat out2;
+    if (extract_fc(net2, in, out2) != 0 || CompareMat(out2, ref, 0.001) != 0)
+    {
+        fprintf(stderr, "shared net output mismatch after owner cleared\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+int main()
+{
+    SRAND(7767517);
+
+    ncnn::Option opts[2];
+    opts[0].num_threads = 1;
+    opts[0].use_packing_layout = false;
+
+    opts[1].num_threads = 4;
+    opts[1].use_packing_layout = true;
+    opts[1].use_lazy_pipeline = true;
+
+    return test_sharemodel(opts[0]) || test_sharemodel(opts[1]) || test_sharemodel_source_destroyed(opts[0]) || test_sharemodel_source_destroyed(opts[1]);
+}
@@ -0,0 +1,295 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "datareader.h"
+#include "net.h"
+#include "testutil.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const char* g_streaming_param = "7767517\n"
+                                       "5 5\n"
+                                       "Input data 0 1 data 0=16 1=16 2=8\n"
+                                       "Convolution conv1 1 1 data conv1 0=16 1=3 4=1 5=1 6=1152 9=1\n"
+                                       "Convolution conv2 1 1 conv1 conv2 0=16 1=1 5=1 6=256 9=1\n"
+                                       "Pooling pool 1 1 conv2 pool 0=1 1=2 2=2\n"
+                                       "Convolution conv3 1 1 pool out 0=8 1=3 4=1 5=1 6=1152\n";
+
+// raw float weight, zero flag and bias of the convolution layers
+static void append_convolution_weight(std::vector<unsigned char>& bin, int weight_data_size, int num_output)
+{
+    const size_t offset = bin.size();
+    bin.resize(offset + 4 + (weight_data_size + num_output) * sizeof(float));
+
+    memset(&bin[offset], 0, 4);
+
+    float* p = (float*)&bin[offset + 4];
+    for (int i = 0; i < weight_data_size + num_output; i++)
+    {
+        p[i] = RandomFloat(-0.5f, 0.5f);
+    }
+}
+
+// model data in memory, reading past gate blocks until opened
+// reading past size returns nothing, as a truncated file
+class DataReaderWithGate : public ncnn::DataReader
+{
+public:
+    DataReaderWithGate(const std::vector<unsigned char>& _bin, size_t _size, size_t _gate)
+        : bin(_bin), size(_size), gate(_gate), offset(0), blocked(false)
+    {
+    }
+
+    virtual size_t read(void* buf, size_t nbytes) const
+    {
+        lock.lock();
+        while (offset + nbytes > gate)
+        {
+            blocked = true;
+            cond.broadcast();
+            cond.wait(lock);
+        }
+        lock.unlock();
+
+        if (offset + nbytes > size)
+            return 0;
+
+        memcpy(buf, bin.data() + offset, nbytes);
+        offset += nbytes;
+        return nbytes;
+    }
+
+    void open_gate()
+    {
+        lock.lock();
+        gate = (size_t)-1;
+        cond.broadcast();
+        lock.unlock();
+    }
+
+    void wait_blocked() const
+    {
+        lock.lock();
+        while (!blocked)
+        {
+            cond.wait(lock);
+        }
+        lock.unlock();
+    }
+
+    const std::vector<unsigned char>& bin;
+    size_t size;
+    size_t gate;
+    mutable size_t offset;
+    mutable bool blocked;
+    mutable ncnn::Mutex lock;
+    mutable ncnn::ConditionVariable cond;
+};
+
+struct extract_thread_args
+{
+    const ncnn::Net* net;
+    const ncnn::Mat* in;
+    ncnn::Mat out;
+    int ret;
+};
+
+static void* extract_worker(void* p)
+{
+    extract_thread_args* args = (extract_thread_args*)p;
+
+    ncnn::Extractor ex = args->net->create_extractor();
+    ex.input("data", *args->in);
+    args->ret = ex.extract("out", args->out);
+    args->out = args->out.clone();
+
+    return 0;
+}
+
+static int test_streamingload(const ncnn::Option& opt)
+{
+    std::vector<unsigned char> bin;
+    append_convolution_weight(bin, 1152, 16);
+    append_convolution_weight(bin, 256, 16);
+
+    // weights of conv3 are held back
+    const size_t gate = bin.size();
+    append_convolution_weight(bin, 1152, 8);
+
+    ncnn::Mat in = RandomMat(16, 16, 8);
+
+    ncnn::Mat conv2_ref;
+    ncnn::Mat out_ref;
+    {
+        ncnn::Net net;
+        net.opt = opt;
+
+        const unsigned char* mem = bin.data();
+        ncnn::DataReaderFromMemory dr(mem);
+        if (net.load_param_mem(g_streaming_param) != 0 || net.load_model(dr) != 0)
+            return -1;
+
+        ncnn::Extractor ex = net.create_extractor();
+        ex.input("data", in);
+        if (ex.extract("conv2", conv2_ref) != 0 || ex.extract("out", out_ref) != 0)
+            return -1;
+
+        conv2_ref = conv2_ref.clone();
+        out_ref = out_ref.clone();
+    }
+
+    ncnn::Net net;
+    net.opt = opt;
+
+    if (net.load_param_mem(g_streaming_param) != 0)
+        return -1;
+
+    DataReaderWithGate dr(bin, bin.size(), gate);
+    if (net.load_model_async(dr) != 0)
+    {
+        fprintf(stderr, "load_model_async failed\n");
+        return -1;
+    }
+
+    // early layers run while later weights are not read yet
+    ncnn::Mat conv2;
+    int ret = 0;
+    {
+        ncnn::Extractor ex = net.create_extractor();
+        ex.input("data", in);
+        ret = ex.extract("conv2", conv2);
+    }
+
+    dr.wait_blocked();
+
+    if (ret != 0 || CompareMat(conv2, conv2_ref, 0.001) != 0)
+    {
+        fprintf(stderr, "early layer output mismatch\n");
+        dr.open_gate();
+        return -1;
+    }
+
+    // the last layer waits for its weights
+    extract_thread_args args;
+    args.net = &net;
+    args.in = &in;
+    args.ret = -1;
+    ncnn::Thread t(extract_worker, &args);
+
+    dr.open_gate();
+
+    t.join();
+
+    if (args.ret != 0 || CompareMat(args.out, out_ref, 0.001) != 0)
+    {
+        fprintf(stderr, "streaming output mismatch\n");
+        return -1;
+    }
+
+    if (net.wait_model_loaded() != 0)
+    {
+        fprintf(stderr, "wait_model_loaded failed\n");
+        return -1;
+    }
+
+    // everything loaded, extract at full speed
+    {
+        ncnn::Mat out;
+        ncnn::Extractor ex = net.create_extractor();
+        ex.input("data", in);
+        if (ex.extract("out", out) != 0 || CompareMat(out, out_ref, 0.001) != 0)
+        {
+            fprintf(stderr, "output after loading mismatch\n");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int test_streamingload_truncated(const ncnn::Option& opt)
+{
+    std::vector<unsigned char> bin;
+    append_convolution_weight(bin, 1152, 16);
+    append_convolution_weight(bin, 256, 16);
+
+    // conv3 weights missing
+    ncnn::Net net;
+    net.opt = opt;
+
+    if (net.load_param_mem(g_streaming_param) != 0)
+        return -1;
+
+    DataReaderWithGate dr(bin, bin.size(), (size_t)-1);
+    if (net.load_model_async(dr) != 0)
+        return -1;
+
+    ncnn::Mat in = RandomMat(16, 16, 8);
+
+    // layers never loaded do not hang extractor
+    ncnn::Mat out;
+    {
+        ncnn::Extractor ex = net.create_extractor();
+        ex.input("data", in);
+        if (ex.extract("out", out) == 0)
+        {
+            fprintf(stderr, "extract out of truncated model succeeded\n");
+            return -1;
+        }
+    }
+
+    if (net.wait_model_loaded() == 0)
+    {
+        fprintf(stderr, "truncated model loaded\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+int main()
+{
+    SRAND(7767517);
+
+    ncnn::Option opts[4];
+    opts[0].num_threads = 1;
+    opts[0].use_packing_layout = false;
+
+    opts[1].num_threads = 1;
+    opts[1].use_packing_layout = true;
+    opts[1].use_lazy_pipeline = true;
+
+    opts[2].num_threads = 2;
+    opts[2].use_packing_layout = true;
+
+    opts[3].num_threads = 2;
+    opts[3].use_packing_layout = true;
+    opts[3].use_static_memory_plan = true;
+
+    for (int i = 0; i < 4; i++)
+    {
+        int ret = test_streamingload(opts[i]);
+        if (ret == 0)
+            ret = test_streamingload_truncated(opts[i]);
+
+        if (ret != 0)
+        {
+            fprintf(stderr, "test_streamingload failed num_threads=%d use_packing_layout=%d use_lazy_pipeline=%d\n", opts[i].num_threads, opts[i].use_packing_layout, opts[i].use_lazy_pipeline);
+            return ret;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,226 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "datareader.h"
+#include "net.h"
+#include "testutil.h"
+#include "weightcache.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const char* g_weightcache_param = "7767517\n"
+                                         "6 6\n"
+                                         "Input data 0 1 data 0=24 1=24 2=16\n"
+                                         "Convolution conv1 1 1 data conv1 0=16 1=3 4=1 5=1 6=2304 9=1\n"
+                                         "Convolution conv2 1 1 conv1 conv2 0=32 1=1 5=1 6=512\n"
+                                         "Convolution conv3 1 1 conv2 conv3 0=24 1=3 3=2 4=1 5=1 6=6912 9=1\n"
+                                         "Pooling gap 1 1 conv3 gap 0=1 4=1\n"
+                                         "InnerProduct fc 1 1 gap fc 0=10 1=1 2=240\n";
+
+static int load_weightcache_net(ncnn::Net& net, const ncnn::Option& opt, ncnn::WeightCache* cache)
+{
+    net.opt = opt;
+    net.opt.weight_cache = cache;
+
+    int ret = net.load_param_mem(g_weightcache_param);
+    if (ret != 0)
+        return ret;
+
+    SRAND(7767517);
+    DataReaderFromRandom dr;
+    return net.load_model(dr);
+}
+
+static int forward_weightcache_net(const ncnn::Net& net, const ncnn::Mat& in, ncnn::Mat& out)
+{
+    ncnn::Extractor ex = net.create_extractor();
+    ex.input("data", in);
+    return ex.extract("fc", out);
+}
+
+static int test_weightcache(const ncnn::Option& opt, const char* cachepath)
+{
+    ncnn::Mat in = RandomMat(24, 24, 16);
+
+    ncnn::Mat out_ref;
+    {
+        ncnn::Net net;
+        if (load_weightcache_net(net, opt, 0) != 0 || forward_weightcache_net(net, in, out_ref) != 0)
+        {
+            fprintf(stderr, "reference net failed\n");
+            return -1;
+        }
+    }
+
+    // first run stores transformed weights
+    {
+        ncnn::WeightCache cache;
+
+        ncnn::Net net;
+        ncnn::Mat out;
+        if (load_weightcache_net(net, opt, &cache) != 0 || forward_weightcache_net(net, in, out) != 0)
+        {
+            fprintf(stderr, "weight cache store run failed\n");
+            return -1;
+        }
+
+        if (CompareMat(out, out_ref, 0.001) != 0)
+        {
+            fprintf(stderr, "weight cache store run mismatch\n");
+            return -1;
+        }
+
+        if (cache.hit_count() != 0)
+        {
+            fprintf(stderr, "empty weight cache hit %d\n", cache.hit_count());
+            return -1;
+        }
+
+        if (cache.save(cachepath) != 0)
+        {
+            fprintf(stderr, "weight cache save failed\n");
+            return -1;
+        }
+    }
+
+    // later run reuses transformed weights from the mapped file
+    {
+        ncnn::WeightCache cache;
+        if (cache.load(cachepath) != 0)
+        {
+            fprintf(stderr, "weight cache load failed\n");
+            return -1;
+        }
+
+        const int entry_count = cache.size();
+
+        ncnn::Net net;
+        ncnn::Mat out;
+        if (load_weightcache_net(net, opt, &cache) != 0 || forward_weightcache_net(net, in, out) != 0)
+        {
+            fprintf(stderr, "weight cache load run failed\n");
+            return -1;
+        }
+
+        if (CompareMat(out, out_ref, 0.001) != 0)
+        {
+            fprintf(stderr, "weight cache load run mismatch\n");
+            return -1;
+        }
+
+        // every transform stored before is answered from the cache
+        if (cache.hit_count() != entry_count || cache.size() != entry_count)
+        {
+            fprintf(stderr, "weight cache hit %d of %d entries, now %d entries\n", cache.hit_count(), entry_count, cache.size());
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int test_weightcache_corrupted(const char* cachepath)
+{
+    FILE* fp = fopen(cachepath, "rb");
+    if (!fp)
+        return -1;
+
+    fseek(fp, 0, SEEK_END);
+    std::vector<unsigned char> image(ftell(fp));
+    fseek(fp, 0, SEEK_SET);
+    size_t nread = fread(image.data(), 1, image.size(), fp);
+    fclose(fp);
+    if (nread != image.size())
+        return -1;
+
+    // header of 32 bytes, then records of 64 bytes
+    // dims w h d c elempack at 16 20 24 28 32 36, elemsize at 40, cstep at 48, offset at 56
+    const size_t record = 32;
+
+    struct
+    {
+        int field;
+        int size;
+        uint64_t value;
+    } corruptions[] = {
+        {16, 4, 0},                        // dims
+        {16, 4, 5},                        // dims
+        {20, 4, (uint32_t)-1},             // w
+        {32, 4, 0},                        // c
+        {36, 4, 0},                        // elempack
+        {40, 4, 0},                        // elemsize
+        {48, 8, 0},                        // cstep smaller than w * h * d
+        {48, 8, 0x4000000000000000ULL},    // cstep * elemsize overflows
+        {56, 8, (uint64_t)image.size()},   // offset at file end
+        {56, 8, 0xffffffffffffffc0ULL},    // offset beyond file
+    };
+
+    for (size_t i = 0; i < sizeof(corruptions) / sizeof(corruptions[0]); i++)
+    {
+        std::vector<unsigned char> corrupted = image;
+        memcpy(&corrupted[record + corruptions[i].field], &corruptions[i].value, corruptions[i].size);
+
+        ncnn::WeightCache cache;
+        if (cache.load(corrupted.data(), corrupted.size()) == 0 || cache.size() != 0)
+        {
+            fprintf(stderr, "weight cache corruption %d accepted\n", (int)i);
+            return -1;
+        }
+    }
+
+    ncnn::WeightCache cache;
+    if (cache.load(image.data(), image.size()) != 0 || cache.size() == 0)
+    {
+        fprintf(stderr, "weight cache image rejected\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+int main()
+{
+    SRAND(7767517);
+
+    const char* cachepath = "test_weightcache.ncnn.cache";
+
+    ncnn::Option opts[3];
+    opts[0].num_threads = 1;
+    opts[0].use_packing_layout = false;
+
+    opts[1].num_threads = 1;
+    opts[1].use_packing_layout = true;
+
+    opts[2].num_threads = 2;
+    opts[2].use_packing_layout = true;
+    opts[2].use_sgemm_convolution = false;
+
+    for (int i = 0; i < 3; i++)
+    {
+        int ret = test_weightcache(opts[i], cachepath);
+        if (ret != 0)
+        {
+            fprintf(stderr, "test_weightcache failed num_threads=%d use_packing_layout=%d use_sgemm_convolution=%d\n", opts[i].num_threads, opts[i].use_packing_layout, opts[i].use_sgemm_convolution);
+            remove(cachepath);
+            return ret;
+        }
+    }
+
+    int ret = test_weightcache_corrupted(cachepath);
+
+    remove(cachepath);
+
+    return ret;
+}
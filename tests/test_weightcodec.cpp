@@ -0,0 +1,388 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "datareader.h"
+#include "modelbin.h"
+#include "net.h"
+#include "testutil.h"
+#include "weightcodec.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static ncnn::Mat RandomWeight(int w, int elemsize)
+{
+    ncnn::Mat m = RandomMat(w, -0.1f, 0.1f);
+
+    // pruned weights
+    float* p = m;
+    for (int i = 0; i < w; i += 5)
+    {
+        p[i] = 0.f;
+    }
+
+    if (elemsize == 2)
+    {
+        ncnn::Mat m_fp16;
+        ncnn::cast_float32_to_float16(m, m_fp16);
+        return m_fp16;
+    }
+
+    if (elemsize == 1)
+    {
+        ncnn::Mat m_int8(w, (size_t)1u);
+        signed char* p_int8 = m_int8;
+        for (int i = 0; i < w; i++)
+        {
+            p_int8[i] = (signed char)(p[i] * 640);
+        }
+        return m_int8;
+    }
+
+    return m;
+}
+
+static int test_weightcodec_roundtrip(int w, int elemsize, int num_threads)
+{
+    ncnn::Mat a = RandomWeight(w, elemsize);
+
+    std::vector<unsigned char> stream;
+    if (ncnn::compress_weight(a.data, w, elemsize, stream) != 0)
+    {
+        fprintf(stderr, "compress_weight failed\n");
+        return -1;
+    }
+
+    // float weights of narrow range shrink
+    if (w >= 1024 && stream.size() >= (size_t)w * elemsize)
+    {
+        fprintf(stderr, "compressed %d bytes to %d\n", w * elemsize, (int)stream.size());
+        return -1;
+    }
+
+    std::vector<unsigned char> b(w * elemsize + 1, 0xcc);
+    if (ncnn::decompress_weight(stream.data(), stream.size(), b.data(), w, elemsize, num_threads) != 0)
+    {
+        fprintf(stderr, "decompress_weight failed\n");
+        return -1;
+    }
+
+    if (memcmp(a.data, b.data(), w * elemsize) != 0 || b[w * elemsize] != 0xcc)
+    {
+        fprintf(stderr, "decompressed weight mismatch\n");
+        return -1;
+    }
+
+    // truncated and mismatched streams are rejected
+    if (ncnn::decompress_weight(stream.data(), stream.size() - 1, b.data(), w, elemsize, num_threads) == 0)
+    {
+        fprintf(stderr, "truncated stream decoded\n");
+        return -1;
+    }
+
+    if (ncnn::decompress_weight(stream.data(), stream.size(), b.data(), w + 1, elemsize, num_threads) == 0)
+    {
+        fprintf(stderr, "stream decoded with wrong size\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int test_weightcodec_constant()
+{
+    const int w = 40000;
+    ncnn::Mat a(w);
+    a.fill(0.5f);
+
+    std::vector<unsigned char> stream;
+    if (ncnn::compress_weight(a.data, w, 4, stream) != 0 || stream.size() > 64)
+    {
+        fprintf(stderr, "constant weight compressed to %d\n", (int)stream.size());
+        return -1;
+    }
+
+    ncnn::Mat b(w);
+    if (ncnn::decompress_weight(stream.data(), stream.size(), b.data, w, 4, 2) != 0 || CompareMat(a, b, 0) != 0)
+    {
+        fprintf(stderr, "constant weight mismatch\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+static void append_tag_data(std::vector<unsigned char>& bin, const void* data, size_t size)
+{
+    bin.insert(bin.end(), (const unsigned char*)data, (const unsigned char*)data + size);
+    bin.resize(ncnn::alignSize(bin.size(), 4), 0);
+}
+
+static void append_compressed(std::vector<unsigned char>& bin, const ncnn::Mat& m)
+{
+    std::vector<unsigned char> stream;
+    ncnn::compress_weight(m.data, m.w, (int)m.elemsize, stream);
+
+    const unsigned int tag = NCNN_WEIGHT_COMPRESSED_TAG;
+    const unsigned int stream_size = (unsigned int)stream.size();
+    append_tag_data(bin, &tag, 4);
+    append_tag_data(bin, &stream_size, 4);
+    append_tag_data(bin, stream.data(), stream.size());
+}
+
+static int test_weightcodec_modelbin(int num_threads)
+{
+    const int w = 70001;
+    ncnn::Mat a32 = RandomWeight(w, 4);
+    ncnn::Mat a16 = RandomWeight(w, 2);
+    ncnn::Mat a8 = RandomWeight(w, 1);
+
+    std::vector<unsigned char> bin;
+    append_compressed(bin, a32);
+    append_compressed(bin, a16);
+    append_compressed(bin, a8);
+
+    ncnn::Mat a16_fp32;
+    ncnn::cast_float16_to_float32(a16, a16_fp32);
+
+    // referenced from memory and copied by reading
+    for (int r = 0; r < 2; r++)
+    {
+        const unsigned char* mem = bin.data();
+        ncnn::DataReaderFromMemory mdr(mem);
+
+        ncnn::Mat m32;
+        ncnn::Mat m16;
+        ncnn::Mat m8;
+        if (r == 0)
+        {
+            ncnn::ModelBinFromDataReader mb(mdr, num_threads);
+            m32 = mb.load(w, 0);
+            m16 = mb.load(w, 0);
+            m8 = mb.load(w, 0);
+        }
+        else
+        {
+            // reader without reference
+            class DataReaderFromMemoryCopy : public ncnn::DataReader
+            {
+            public:
+                DataReaderFromMemoryCopy(const ncnn::DataReader& _dr)
+                    : dr(_dr)
+                {
+                }
+                virtual size_t read(void* buf, size_t size) const
+                {
+                    return dr.read(buf, size);
+                }
+                const ncnn::DataReader& dr;
+            };
+
+            DataReaderFromMemoryCopy cdr(mdr);
+            ncnn::ModelBinFromDataReader mb(cdr, num_threads);
+            m32 = mb.load(w, 0);
+            m16 = mb.load(w, 0);
+            m8 = mb.load(w, 0);
+        }
+
+        if (mem != bin.data() + bin.size())
+        {
+            fprintf(stderr, "ModelBin consumed %d of %d bytes\n", (int)(mem - bin.data()), (int)bin.size());
+            return -1;
+        }
+
+        if (m32.elemsize != 4 || CompareMat(m32, a32, 0) != 0)
+        {
+            fprintf(stderr, "ModelBin fp32 mismatch\n");
+            return -1;
+        }
+
+        if (m16.elemsize != 4 || CompareMat(m16, a16_fp32, 0) != 0)
+        {
+            fprintf(stderr, "ModelBin fp16 mismatch\n");
+            return -1;
+        }
+
+        if (m8.elemsize != 1 || memcmp(m8.data, a8.data, w) != 0)
+        {
+            fprintf(stderr, "ModelBin int8 mismatch\n");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int test_weightcodec_corrupted_header()
+{
+    const int w = 1000;
+    ncnn::Mat a = RandomWeight(w, 4);
+
+    std::vector<unsigned char> bin;
+    append_compressed(bin, a);
+
+    // elemsize field right after tag and stream size
+    static const unsigned int bad_elemsizes[] = {0, 3, 8, 0xffffffff};
+    for (int i = 0; i < 4; i++)
+    {
+        std::vector<unsigned char> bad_bin = bin;
+        memcpy(bad_bin.data() + 8, &bad_elemsizes[i], 4);
+
+        const unsigned char* stream = bad_bin.data() + 8;
+        const size_t stream_size = bad_bin.size() - 8;
+        if (ncnn::compressed_weight_elemsize(stream, stream_size) != 0)
+        {
+            fprintf(stderr, "elemsize %u accepted\n", bad_elemsizes[i]);
+            return -1;
+        }
+
+        std::vector<unsigned char> out(w * 8);
+        if (ncnn::decompress_weight(stream, stream_size, out.data(), w, (int)bad_elemsizes[i]) == 0)
+        {
+            fprintf(stderr, "stream of elemsize %u decompressed\n", bad_elemsizes[i]);
+            return -1;
+        }
+
+        const unsigned char* mem = bad_bin.data();
+        ncnn::DataReaderFromMemory mdr(mem);
+        ncnn::ModelBinFromDataReader mb(mdr);
+        if (!mb.load(w, 0).empty())
+        {
+            fprintf(stderr, "ModelBin loaded stream of elemsize %u\n", bad_elemsizes[i]);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int test_weightcodec_net(const ncnn::Option& opt)
+{
+    const char* param = "7767517\n"
+                        "3 3\n"
+                        "Input data 0 1 data 0=16 1=16 2=8\n"
+                        "Convolution conv1 1 1 data conv1 0=16 1=3 4=1 5=1 6=1152 9=1\n"
+                        "InnerProduct fc 1 1 conv1 out 0=100 1=1 2=409600\n";
+
+    ncnn::Mat weights[4] = {RandomWeight(1152, 4), RandomMat(16), RandomWeight(409600, 2), RandomMat(100)};
+
+    std::vector<unsigned char> raw_bin;
+    std::vector<unsigned char> bin;
+    for (int i = 0; i < 4; i++)
+    {
+        if (i % 2 == 0)
+        {
+            const unsigned int tag = weights[i].elemsize == 2 ? 0x01306B47 : 0;
+            append_tag_data(raw_bin, &tag, 4);
+            append_compressed(bin, weights[i]);
+        }
+        else
+        {
+            append_tag_data(bin, weights[i].data, weights[i].w * weights[i].elemsize);
+        }
+
+        append_tag_data(raw_bin, weights[i].data, weights[i].w * weights[i].elemsize);
+    }
+
+    if (bin.size() >= raw_bin.size())
+    {
+        fprintf(stderr, "compressed bin %d not smaller than %d\n", (int)bin.size(), (int)raw_bin.size());
+        return -1;
+    }
+
+    ncnn::Mat in = RandomMat(16, 16, 8);
+
+    ncnn::Mat outs[2];
+    for (int i = 0; i < 2; i++)
+    {
+        ncnn::Net net;
+        net.opt = opt;
+
+        const unsigned char* mem = i == 0 ? raw_bin.data() : bin.data();
+        ncnn::DataReaderFromMemory dr(mem);
+        if (net.load_param_mem(param) != 0 || net.load_model(dr) != 0)
+        {
+            fprintf(stderr, "load_model failed\n");
+            return -1;
+        }
+
+        ncnn::Extractor ex = net.create_extractor();
+        ex.input("data", in);
+        if (ex.extract("out", outs[i]) != 0)
+            return -1;
+
+        outs[i] = outs[i].clone();
+    }
+
+    if (CompareMat(outs[0], outs[1], 0.001) != 0)
+    {
+        fprintf(stderr, "compressed model output mismatch\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+int main()
+{
+    SRAND(7767517);
+
+    static const int sizes[] = {1, 7, 1000, 32768, 32769, 100000};
+    static const int elemsizes[] = {1, 2, 4};
+
+    for (int i = 0; i < 6; i++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            int ret = test_weightcodec_roundtrip(sizes[i], elemsizes[j], 1)
+                      || test_weightcodec_roundtrip(sizes[i], elemsizes[j], 4);
+            if (ret != 0)
+            {
+                fprintf(stderr, "test_weightcodec_roundtrip failed w=%d elemsize=%d\n", sizes[i], elemsizes[j]);
+                return -1;
+            }
+        }
+    }
+
+    if (test_weightcodec_constant() != 0)
+        return -1;
+
+    if (test_weightcodec_corrupted_header() != 0)
+        return -1;
+
+    if (test_weightcodec_modelbin(1) != 0 || test_weightcodec_modelbin(4) != 0)
+    {
+        fprintf(stderr, "test_weightcodec_modelbin failed\n");
+        return -1;
+    }
+
+    ncnn::Option opts[2];
+    opts[0].num_threads = 1;
+    opts[0].use_packing_layout = false;
+
+    opts[1].num_threads = 4;
+    opts[1].use_packing_layout = true;
+    opts[1].use_parallel_load = true;
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (test_weightcodec_net(opts[i]) != 0)
+        {
+            fprintf(stderr, "test_weightcodec_net failed num_threads=%d\n", opts[i].num_threads);
+            return -1;
+        }
+    }
+
+    return 0;
+}
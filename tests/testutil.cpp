@@ -14,13 +14,16 @@
 
 #include "testutil.h"
 
+#include "benchmark.h"
 #include "cpu.h"
 #include "layer.h"
 #include "mat.h"
 #include "prng.h"
 
+#include <float.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #if NCNN_VULKAN
 #include "command.h"
@@ -382,6 +385,116 @@ int test_layer_naive(int typeindex, const ncnn::ParamDict& pd, const std::vector
     return 0;
 }
 
+// cast and pack one input as the layer consumes it in a net
+static void convert_layer_input_cpu(const ncnn::Layer* op, const ncnn::Mat& a, ncnn::Mat& b, const ncnn::Option& opt, int flag)
+{
+    // clang-format off
+    // *INDENT-OFF*
+#if NCNN_ARM82
+    if (opt.use_fp16_storage && ncnn::cpu_support_arm_asimdhp() && op->support_fp16_storage && !(flag & TEST_LAYER_DISABLE_AUTO_INPUT_CASTING))
+    {
+        ncnn::cast_float32_to_float16(a, b, opt);
+    }
+    else
+#endif // NCNN_ARM82
+#if NCNN_RVV
+    if (opt.use_fp16_storage && ncnn::cpu_support_riscv_v() && ncnn::cpu_support_riscv_zfh() && op->support_fp16_storage && !(flag & TEST_LAYER_DISABLE_AUTO_INPUT_CASTING))
+    {
+        ncnn::cast_float32_to_float16(a, b, opt);
+    }
+    else
+#endif // NCNN_RVV
+#if NCNN_BF16
+    if (opt.use_bf16_storage && op->support_bf16_storage && !(flag & TEST_LAYER_DISABLE_AUTO_INPUT_CASTING))
+    {
+        ncnn::cast_float32_to_bfloat16(a, b, opt);
+    }
+    else
+#endif // NCNN_BF16
+    if (opt.use_fp16_storage && op->support_fp16_storage && !(flag & TEST_LAYER_DISABLE_AUTO_INPUT_CASTING))
+    {
+        ncnn::cast_float32_to_float16(a, b, opt);
+    }
+    else
+    {
+        b = a;
+    }
+    // *INDENT-ON*
+    // clang-format on
+
+    if (opt.use_packing_layout && op->support_packing && !(flag & TEST_LAYER_DISABLE_AUTO_INPUT_PACKING))
+    {
+        // resolve dst_elempack
+        int dims = b.dims;
+        int elemcount = 0;
+        if (dims == 1) elemcount = b.elempack * b.w;
+        if (dims == 2) elemcount = b.elempack * b.h;
+        if (dims == 3 || dims == 4) elemcount = b.elempack * b.c;
+
+        int elembits = b.elembits();
+
+        int dst_elempack = 1;
+
+        if (elembits == 32)
+        {
+#if NCNN_AVX512
+            if (elemcount % 16 == 0 && ncnn::cpu_support_x86_avx512())
+                dst_elempack = 16;
+            else if (elemcount % 8 == 0 && ncnn::cpu_support_x86_avx())
+                dst_elempack = 8;
+            else if (elemcount % 4 == 0)
+                dst_elempack = 4;
+#elif NCNN_AVX
+            if (elemcount % 8 == 0 && ncnn::cpu_support_x86_avx())
+                dst_elempack = 8;
+            else if (elemcount % 4 == 0)
+                dst_elempack = 4;
+#elif NCNN_RVV
+            const int packn = ncnn::cpu_riscv_vlenb() / (elembits / 8);
+            if (elemcount % packn == 0)
+                dst_elempack = packn;
+#else
+            if (elemcount % 4 == 0)
+                dst_elempack = 4;
+#endif
+        }
+        if (elembits == 16)
+        {
+#if NCNN_ARM82
+            if (elemcount % 8 == 0 && ncnn::cpu_support_arm_asimdhp() && opt.use_fp16_arithmetic)
+                dst_elempack = 8;
+            else if (elemcount % 4 == 0)
+                dst_elempack = 4;
+#elif NCNN_RVV
+            const int packn = ncnn::cpu_riscv_vlenb() / 2;
+            if (elemcount % packn == 0)
+                dst_elempack = packn;
+#else
+            if (elemcount % 4 == 0)
+                dst_elempack = 4;
+#endif
+        }
+        if (elembits == 8)
+        {
+#if NCNN_RVV
+            const int packn = ncnn::cpu_riscv_vlenb() / 1;
+            if (elemcount % packn == 0)
+                dst_elempack = packn;
+#else
+            if (elemcount % 8 == 0)
+                dst_elempack = 8;
+#endif
+        }
+
+        if (flag & TEST_LAYER_ENABLE_FORCE_INPUT_PACK8)
+            dst_elempack = 8;
+
+        ncnn::Mat b_packed;
+        ncnn::convert_packing(b, b_packed, dst_elempack, opt);
+        b = b_packed;
+    }
+}
+
 int test_layer_cpu(int typeindex, const ncnn::ParamDict& pd, const std::vector<ncnn::Mat>& weights, const ncnn::Option& _opt, const std::vector<ncnn::Mat>& a, int top_blob_count, std::vector<ncnn::Mat>& c, const std::vector<ncnn::Mat>& top_shapes, void (*func)(ncnn::Layer*), int flag)
 {
     ncnn::Layer* op = ncnn::create_layer_cpu(typeindex);
@@ -444,111 +557,7 @@ int test_layer_cpu(int typeindex, const ncnn::ParamDict& pd, const std::vector<n
 
     for (size_t i = 0; i < a4.size(); i++)
     {
-        // clang-format off
-        // *INDENT-OFF*
-#if NCNN_ARM82
-        if (opt.use_fp16_storage && ncnn::cpu_support_arm_asimdhp() && op->support_fp16_storage && !(flag & TEST_LAYER_DISABLE_AUTO_INPUT_CASTING))
-        {
-            ncnn::cast_float32_to_float16(a[i], a4[i], opt);
-        }
-        else
-#endif // NCNN_ARM82
-#if NCNN_RVV
-        if (opt.use_fp16_storage && ncnn::cpu_support_riscv_v() && ncnn::cpu_support_riscv_zfh() && op->support_fp16_storage && !(flag & TEST_LAYER_DISABLE_AUTO_INPUT_CASTING))
-        {
-            ncnn::cast_float32_to_float16(a[i], a4[i], opt);
-        }
-        else
-#endif // NCNN_RVV
-#if NCNN_BF16
-        if (opt.use_bf16_storage && op->support_bf16_storage && !(flag & TEST_LAYER_DISABLE_AUTO_INPUT_CASTING))
-        {
-            ncnn::cast_float32_to_bfloat16(a[i], a4[i], opt);
-        }
-        else
-#endif // NCNN_BF16
-        if (opt.use_fp16_storage && op->support_fp16_storage && !(flag & TEST_LAYER_DISABLE_AUTO_INPUT_CASTING))
-        {
-            ncnn::cast_float32_to_float16(a[i], a4[i], opt);
-        }
-        else
-        {
-            a4[i] = a[i];
-        }
-        // *INDENT-ON*
-        // clang-format on
-
-        if (opt.use_packing_layout && op->support_packing && !(flag & TEST_LAYER_DISABLE_AUTO_INPUT_PACKING))
-        {
-            // resolve dst_elempack
-            int dims = a4[i].dims;
-            int elemcount = 0;
-            if (dims == 1) elemcount = a4[i].elempack * a4[i].w;
-            if (dims == 2) elemcount = a4[i].elempack * a4[i].h;
-            if (dims == 3 || dims == 4) elemcount = a4[i].elempack * a4[i].c;
-
-            int elembits = a4[i].elembits();
-
-            int dst_elempack = 1;
-
-            if (elembits == 32)
-            {
-#if NCNN_AVX512
-                if (elemcount % 16 == 0 && ncnn::cpu_support_x86_avx512())
-                    dst_elempack = 16;
-                else if (elemcount % 8 == 0 && ncnn::cpu_support_x86_avx())
-                    dst_elempack = 8;
-                else if (elemcount % 4 == 0)
-                    dst_elempack = 4;
-#elif NCNN_AVX
-                if (elemcount % 8 == 0 && ncnn::cpu_support_x86_avx())
-                    dst_elempack = 8;
-                else if (elemcount % 4 == 0)
-                    dst_elempack = 4;
-#elif NCNN_RVV
-                const int packn = ncnn::cpu_riscv_vlenb() / (elembits / 8);
-                if (elemcount % packn == 0)
-                    dst_elempack = packn;
-#else
-                if (elemcount % 4 == 0)
-                    dst_elempack = 4;
-#endif
-            }
-            if (elembits == 16)
-            {
-#if NCNN_ARM82
-                if (elemcount % 8 == 0 && ncnn::cpu_support_arm_asimdhp() && opt.use_fp16_arithmetic)
-                    dst_elempack = 8;
-                else if (elemcount % 4 == 0)
-                    dst_elempack = 4;
-#elif NCNN_RVV
-                const int packn = ncnn::cpu_riscv_vlenb() / 2;
-                if (elemcount % packn == 0)
-                    dst_elempack = packn;
-#else
-                if (elemcount % 4 == 0)
-                    dst_elempack = 4;
-#endif
-            }
-            if (elembits == 8)
-            {
-#if NCNN_RVV
-                const int packn = ncnn::cpu_riscv_vlenb() / 1;
-                if (elemcount % packn == 0)
-                    dst_elempack = packn;
-#else
-                if (elemcount % 8 == 0)
-                    dst_elempack = 8;
-#endif
-            }
-
-            if (flag & TEST_LAYER_ENABLE_FORCE_INPUT_PACK8)
-                dst_elempack = 8;
-
-            ncnn::Mat a4_packed;
-            ncnn::convert_packing(a4[i], a4_packed, dst_elempack, opt);
-            a4[i] = a4_packed;
-        }
+        convert_layer_input_cpu(op, a[i], a4[i], opt, flag);
     }
 
     c.resize(top_blob_count);
@@ -615,6 +624,93 @@ int test_layer_cpu(int typeindex, const ncnn::ParamDict& pd, const std::vector<n
     return 0;
 }
 
+int benchmark_layer_cpu(int typeindex, const ncnn::ParamDict& pd, const std::vector<ncnn::Mat>& weights, const ncnn::Option& opt, const std::vector<ncnn::Mat>& a, int top_blob_count, int warmup_loop_count, int loop_count, double& time_min, double& time_avg, int flag)
+{
+    ncnn::Layer* op = ncnn::create_layer_cpu(typeindex);
+
+    op->load_param(pd);
+
+    ncnn::ModelBinFromMatArray mb(weights.data());
+
+    op->load_model(mb);
+
+    op->create_pipeline(opt);
+
+    if ((!op->support_packing && opt.use_packing_layout) || (!op->support_bf16_storage && !op->support_fp16_storage && (opt.use_bf16_storage || opt.use_fp16_arithmetic)))
+    {
+        op->destroy_pipeline(opt);
+        delete op;
+        return 233;
+    }
+
+    std::vector<ncnn::Mat> a4(a.size());
+
+    for (size_t i = 0; i < a4.size(); i++)
+    {
+        convert_layer_input_cpu(op, a[i], a4[i], opt, flag);
+    }
+
+    time_min = DBL_MAX;
+    time_avg = 0;
+
+    for (int i = 0; i < warmup_loop_count + loop_count; i++)
+    {
+        std::vector<ncnn::Mat> c(top_blob_count);
+
+        // inplace input copy is not timed
+        if (op->support_inplace)
+        {
+            for (size_t j = 0; j < a4.size(); j++)
+            {
+                c[j] = a4[j].clone();
+            }
+        }
+
+        double start = ncnn::get_current_time();
+
+        int ret = 0;
+        if (op->one_blob_only && op->support_inplace)
+        {
+            ret = op->forward_inplace(c[0], opt);
+        }
+        else if (op->one_blob_only)
+        {
+            ret = op->forward(a4[0], c[0], opt);
+        }
+        else if (op->support_inplace)
+        {
+            ret = op->forward_inplace(c, opt);
+        }
+        else
+        {
+            ret = op->forward(a4, c, opt);
+        }
+
+        double end = ncnn::get_current_time();
+
+        if (ret != 0)
+        {
+            op->destroy_pipeline(opt);
+            delete op;
+            return ret;
+        }
+
+        if (i < warmup_loop_count)
+            continue;
+
+        time_min = end - start < time_min ? end - start : time_min;
+        time_avg += end - start;
+    }
+
+    time_avg /= loop_count;
+
+    op->destroy_pipeline(opt);
+
+    delete op;
+
+    return 0;
+}
+
 #if NCNN_VULKAN
 int test_layer_gpu(int typeindex, const ncnn::ParamDict& pd, const std::vector<ncnn::Mat>& weights, const ncnn::Option& _opt, const std::vector<ncnn::Mat>& a, int top_blob_count, std::vector<ncnn::Mat>& d, const std::vector<ncnn::Mat>& top_shapes, void (*func)(ncnn::Layer*), int flag)
 {
@@ -1380,6 +1476,13 @@ int test_layer_opt(const char* layer_type, const ncnn::ParamDict& pd, const std:
         weights_fp16.resize(weights.size());
         for (size_t j = 0; j < weights.size(); j++)
         {
+            if (weights[j].elemsize != 4)
+            {
+                // packed integer weight
+                weights_fp16[j] = weights[j];
+                continue;
+            }
+
             ncnn::Mat tmp;
             ncnn::cast_float32_to_bfloat16(weights[j], tmp, opt);
             ncnn::cast_bfloat16_to_float32(tmp, weights_fp16[j], opt);
@@ -1391,6 +1494,13 @@ int test_layer_opt(const char* layer_type, const ncnn::ParamDict& pd, const std:
         weights_fp16.resize(weights.size());
         for (size_t j = 0; j < weights.size(); j++)
         {
+            if (weights[j].elemsize != 4)
+            {
+                // packed integer weight
+                weights_fp16[j] = weights[j];
+                continue;
+            }
+
             ncnn::Mat tmp;
             ncnn::cast_float32_to_float16(weights[j], tmp, opt);
             ncnn::cast_float16_to_float32(tmp, weights_fp16[j], opt);
@@ -1447,6 +1557,13 @@ int test_layer_opt(const char* layer_type, const ncnn::ParamDict& pd, const std:
         weights_fp16.resize(weights.size());
         for (size_t j = 0; j < weights.size(); j++)
         {
+            if (weights[j].elemsize != 4)
+            {
+                // packed integer weight
+                weights_fp16[j] = weights[j];
+                continue;
+            }
+
             ncnn::Mat tmp;
             ncnn::cast_float32_to_bfloat16(weights[j], tmp, opt);
             ncnn::cast_bfloat16_to_float32(tmp, weights_fp16[j], opt);
@@ -1458,6 +1575,13 @@ int test_layer_opt(const char* layer_type, const ncnn::ParamDict& pd, const std:
         weights_fp16.resize(weights.size());
         for (size_t j = 0; j < weights.size(); j++)
         {
+            if (weights[j].elemsize != 4)
+            {
+                // packed integer weight
+                weights_fp16[j] = weights[j];
+                continue;
+            }
+
             ncnn::Mat tmp;
             ncnn::cast_float32_to_float16(weights[j], tmp, opt);
             ncnn::cast_float16_to_float32(tmp, weights_fp16[j], opt);
@@ -1509,6 +1633,7 @@ int test_layer(const char* layer_type, const ncnn::ParamDict& pd, const std::vec
         opt.use_packing_layout = options[i][0];
         opt.use_fp16_packed = options[i][1];
         opt.use_fp16_storage = options[i][2];
+        opt.use_fp16_weight = options[i][2]; // weights are fp16 rounded already
         opt.use_fp16_arithmetic = options[i][3];
         opt.use_bf16_storage = options[i][4];
         opt.use_shader_pack8 = options[i][5];
@@ -1545,6 +1670,7 @@ int test_layer(const char* layer_type, const ncnn::ParamDict& pd, const std::vec
         opt.use_packing_layout = options[i][0];
         opt.use_fp16_packed = options[i][1];
         opt.use_fp16_storage = options[i][2];
+        opt.use_fp16_weight = options[i][2]; // weights are fp16 rounded already
         opt.use_fp16_arithmetic = options[i][3];
         opt.use_bf16_storage = options[i][4];
         opt.use_shader_pack8 = options[i][5];
@@ -1557,3 +1683,84 @@ int test_layer(const char* layer_type, const ncnn::ParamDict& pd, const std::vec
 
     return 0;
 }
+
+DataReaderFromRandom::DataReaderFromRandom()
+    : state(0), flag_count(0)
+{
+}
+
+size_t DataReaderFromRandom::read(void* buf, size_t size) const
+{
+    if (state == 1)
+    {
+        // float16 data follows the float16 flag
+        unsigned short* p = (unsigned short*)buf;
+        for (size_t i = 0; i < size / sizeof(unsigned short); i++)
+        {
+            p[i] = ncnn::float32_to_float16(RandomFloat(-0.5f, 0.5f));
+        }
+        state = 0;
+        return size;
+    }
+
+    if (state == 3)
+    {
+        // table indexes follow the quantization table
+        unsigned char* p = (unsigned char*)buf;
+        for (size_t i = 0; i < size; i++)
+        {
+            p[i] = (unsigned char)RandomInt(0, 255);
+        }
+        state = 0;
+        return size;
+    }
+
+    if (state == 0 && size == 4)
+    {
+        // raw float, float16 and quantized flag in turn
+        const unsigned int flags[3] = {0, 0x01306B47, 0x00000001};
+        const int flag_type = flag_count % 3;
+        memcpy(buf, &flags[flag_type], size);
+        flag_count++;
+        state = flag_type;
+        return size;
+    }
+
+    float* p = (float*)buf;
+    for (size_t i = 0; i < size / sizeof(float); i++)
+    {
+        p[i] = RandomFloat(-0.5f, 0.5f);
+    }
+    if (state == 2)
+        state = 3;
+    return size;
+}
+
+const char* g_branch_param = "7767517\n"
+                             "13 15\n"
+                             "Input data 0 1 data 0=16 1=16 2=3\n"
+                             "Convolution conv1 1 1 data conv1 0=16 1=3 4=1 5=1 6=432\n"
+                             "ReLU relu1 1 1 conv1 conv1_relu\n"
+                             "Split splitncnn_0 1 3 conv1_relu b0 b1 b2\n"
+                             "Convolution b0_conv 1 1 b0 b0_out 0=8 1=1 5=1 6=128\n"
+                             "Convolution b1_conv 1 1 b1 b1_conv 0=8 1=3 4=1 5=1 6=1152\n"
+                             "ReLU b1_relu 1 1 b1_conv b1_out\n"
+                             "Pooling b2_pool 1 1 b2 b2_pool 0=0 1=3 2=1 3=1\n"
+                             "Convolution b2_conv 1 1 b2_pool b2_out 0=8 1=1 5=1 6=128\n"
+                             "Concat concat 3 1 b0_out b1_out b2_out cat\n"
+                             "Pooling gap 1 1 cat gap 0=1 4=1\n"
+                             "InnerProduct fc 1 1 gap fc 0=10 1=1 2=240\n"
+                             "Softmax prob 1 1 fc prob\n";
+
+int load_random_net(ncnn::Net& net, const ncnn::Option& opt, const char* param)
+{
+    net.opt = opt;
+
+    int ret = net.load_param_mem(param);
+    if (ret != 0)
+        return ret;
+
+    SRAND(7767517);
+    DataReaderFromRandom dr;
+    return net.load_model(dr);
+}
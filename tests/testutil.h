@@ -16,8 +16,10 @@
 #define TESTUTIL_H
 
 #include "cpu.h"
+#include "datareader.h"
 #include "layer.h"
 #include "mat.h"
+#include "net.h"
 
 #include <stdio.h>
 #include <stdint.h>
@@ -86,6 +88,10 @@ int test_layer_cpu(int typeindex, const ncnn::ParamDict& pd, const std::vector<n
 int test_layer_gpu(int typeindex, const ncnn::ParamDict& pd, const std::vector<ncnn::Mat>& weights, const ncnn::Option& _opt, const std::vector<ncnn::Mat>& a, int top_blob_count, std::vector<ncnn::Mat>& d, const std::vector<ncnn::Mat>& top_shapes, void (*func)(ncnn::Layer*), int flag);
 #endif // NCNN_VULKAN
 
+// time forward of the cpu layer in milliseconds, inputs cast and packed as test_layer_cpu does
+// return 0 if success, 233 if option is not supported by the layer
+int benchmark_layer_cpu(int typeindex, const ncnn::ParamDict& pd, const std::vector<ncnn::Mat>& weights, const ncnn::Option& opt, const std::vector<ncnn::Mat>& a, int top_blob_count, int warmup_loop_count, int loop_count, double& time_min, double& time_avg, int flag = 0);
+
 int test_layer(int typeindex, const ncnn::ParamDict& pd, const std::vector<ncnn::Mat>& weights, const ncnn::Option& _opt, const std::vector<ncnn::Mat>& a, int top_blob_count, const std::vector<ncnn::Mat>& top_shapes = std::vector<ncnn::Mat>(), float epsilon = 0.001, void (*func)(ncnn::Layer*) = 0, int flag = 0);
 
 int test_layer_naive(int typeindex, const ncnn::ParamDict& pd, const std::vector<ncnn::Mat>& weights, const ncnn::Mat& a, ncnn::Mat& b, void (*func)(ncnn::Layer*), int flag);
@@ -106,4 +112,27 @@ int test_layer(const char* layer_type, const ncnn::ParamDict& pd, const std::vec
 
 int test_layer(const char* layer_type, const ncnn::ParamDict& pd, const std::vector<ncnn::Mat>& weights, const ncnn::Mat& a, float epsilon = 0.001, void (*func)(ncnn::Layer*) = 0, int flag = 0);
 
+// random weights for a net loaded from param alone
+// weight blobs cycle through raw float, float16 and table quantized storage
+// so that every modelbin decoding path of a net level test runs
+// a 4 byte read outside of weight data is taken as a flag
+class DataReaderFromRandom : public ncnn::DataReader
+{
+public:
+    DataReaderFromRandom();
+    virtual size_t read(void* buf, size_t size) const;
+
+protected:
+    // 0 = flag, 1 = float16 data, 2 = quantization table, 3 = table indexes
+    mutable int state;
+    mutable int flag_count;
+};
+
+// three branches split from conv1 and joined by concat, for net level tests
+extern const char* g_branch_param;
+
+// load param from memory with random weights seeded by 7767517
+// return 0 if success
+int load_random_net(ncnn::Net& net, const ncnn::Option& opt, const char* param);
+
 #endif // TESTUTIL_H
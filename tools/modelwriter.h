@@ -17,16 +17,20 @@
 #endif
 
 #include <stdint.h>
+#include <string.h>
 #include <algorithm>
 #include <map>
 #include <set>
+#include <string>
 #include <vector>
 
 // ncnn public header
 #include "datareader.h"
 #include "layer.h"
 #include "layer_type.h"
+#include "modelcontainer.h"
 #include "net.h"
+#include "weightcodec.h"
 
 // ncnn private header
 #include "layer/batchnorm.h"
@@ -226,12 +230,18 @@ public:
     // 0=fp32 1=fp16
     int storage_type;
 
+    // 1=write tagged weights compressed where it saves space
+    int weight_compression;
+
     int gen_random_weight;
 
     // Cut param and bin -1=no cut
     int cutstart;
     int cutend;
 
+    // bin offset of each written layer and the bin end, filled by save
+    std::vector<long> layer_bin_offsets;
+
 public:
     int set_cutparam(const char* cutstartname, const char* cutendname);
 
@@ -243,9 +253,14 @@ public:
     int fprintf_param_float_array(int id, const ncnn::Mat& m, FILE* pp);
 
     int fwrite_weight_tag_data(const ncnn::Mat& data, FILE* bp, float a = -1.2f, float b = 1.2f);
+    int fwrite_weight_compressed_data(ncnn::Mat& data_flattened, FILE* bp);
     int fwrite_weight_data(const ncnn::Mat& data, FILE* bp, float a = -1.2f, float b = 1.2f);
 
     int save(const char* parampath, const char* binpath);
+
+    // write param and per-layer weights into single file model container
+    // int8 calibration table is embedded when given
+    int save_container(const char* path, const char* int8_table_path = 0);
 };
 
 ModelWriter::ModelWriter()
@@ -253,6 +268,7 @@ ModelWriter::ModelWriter()
 {
     opt.lightmode = false;
     has_custom_layer = false;
+    weight_compression = 0;
     gen_random_weight = false;
     cutstart = -1;
     cutend = -1;
@@ -619,7 +635,11 @@ int ModelWriter::fwrite_weight_tag_data(const ncnn::Mat& data, FILE* bp, float a
     if (gen_random_weight)
         Randomize(data_flattened, a, b);
 
-    if (data_flattened.elemsize == 4)
+    if (weight_compression && fwrite_weight_compressed_data(data_flattened, bp) == 0)
+    {
+        // compressed
+    }
+    else if (data_flattened.elemsize == 4)
     {
         if (storage_type == 1)
         {
@@ -663,6 +683,38 @@ int ModelWriter::fwrite_weight_tag_data(const ncnn::Mat& data, FILE* bp, float a
     return 0;
 }
 
+int ModelWriter::fwrite_weight_compressed_data(ncnn::Mat& data_flattened, FILE* bp)
+{
+    ncnn::Mat raw = data_flattened;
+    if (data_flattened.elemsize == 4)
+    {
+        if (storage_type == 1)
+        {
+            ncnn::cast_float32_to_float16(data_flattened, raw);
+        }
+        else
+        {
+            replace_denormals_with_zero(data_flattened, data_flattened.w);
+        }
+    }
+
+    std::vector<unsigned char> stream;
+    if (ncnn::compress_weight(raw.data, raw.w, (int)raw.elemsize, stream) != 0)
+        return -1;
+
+    // keep raw data when compression does not pay off
+    if (sizeof(int) + stream.size() >= raw.w * raw.elemsize)
+        return -1;
+
+    const int tag = NCNN_WEIGHT_COMPRESSED_TAG; // compressed magic
+    const unsigned int stream_size = (unsigned int)stream.size();
+    fwrite(&tag, sizeof(int), 1, bp);
+    fwrite(&stream_size, sizeof(unsigned int), 1, bp);
+    fwrite(stream.data(), 1, stream.size(), bp);
+
+    return 0;
+}
+
 int ModelWriter::fwrite_weight_data(const ncnn::Mat& data, FILE* bp, float a, float b)
 {
     int p0 = ftell(bp);
@@ -698,6 +750,8 @@ int ModelWriter::save(const char* parampath, const char* binpath)
 
     const size_t layer_count = layers.size();
 
+    layer_bin_offsets.clear();
+
     int layer_count_fused = 0;
     std::set<std::string> blob_names;
     for (size_t i = 0; i < layer_count; i++)
@@ -739,6 +793,8 @@ int ModelWriter::save(const char* parampath, const char* binpath)
         if (cutend > 0 && i > cutend)
             continue;
 
+        layer_bin_offsets.push_back(ftell(bp));
+
         size_t bottom_count = layer->bottoms.size();
         size_t top_count = layer->tops.size();
 
@@ -1715,9 +1771,26 @@ int ModelWriter::save(const char* parampath, const char* binpath)
             fprintf_param_value(" 12=%d", output_elempack)
             fprintf_param_value(" 13=%d", output_elemtype)
             fprintf_param_value(" 14=%d", output_transpose)
+            fprintf_param_value(" 15=%d", weight_quant_bits)
+            fprintf_param_value(" 16=%d", weight_quant_group_size)
             fprintf_param_value(" 20=%d", constant_TILE_M)
             fprintf_param_value(" 21=%d", constant_TILE_N)
             fprintf_param_value(" 22=%d", constant_TILE_K)
+
+            if (op->constantA)
+            {
+                fwrite_weight_tag_data(op->A_data, bp);
+            }
+            if (op->constantB)
+            {
+                fwrite_weight_tag_data(op->B_data, bp);
+                if (op->weight_quant_bits)
+                    fwrite_weight_data(op->B_quant_scales, bp, 0.001, 0.1);
+            }
+            if (op->constantC && op->constant_broadcast_type_C != -1)
+            {
+                fwrite_weight_tag_data(op->C_data, bp);
+            }
         }
         else if (layer->type == "GLU")
         {
@@ -1791,8 +1864,14 @@ int ModelWriter::save(const char* parampath, const char* binpath)
             {
                 if (!op->activation_params.empty()) fprintf_param_float_array(10, op->activation_params, pp);
             }
+            fprintf_param_value(" 11=%d", weight_quant_bits)
+            fprintf_param_value(" 12=%d", weight_quant_group_size)
 
             fwrite_weight_tag_data(op->weight_data, bp);
+            if (op->weight_quant_bits)
+            {
+                fwrite_weight_data(op->weight_quant_scales, bp, 0.001, 0.1);
+            }
             fwrite_weight_data(op->bias_data, bp);
 
 #if NCNN_INT8
@@ -2395,6 +2474,8 @@ int ModelWriter::save(const char* parampath, const char* binpath)
         delete layer_default;
     }
 
+    layer_bin_offsets.push_back(ftell(bp));
+
     fclose(pp);
     fclose(bp);
 
@@ -2405,3 +2486,76 @@ int ModelWriter::save(const char* parampath, const char* binpath)
 
     return 0;
 }
+
+static int read_whole_file(const char* path, std::vector<unsigned char>& data)
+{
+    FILE* fp = fopen(path, "rb");
+    if (!fp)
+    {
+        fprintf(stderr, "fopen %s failed\n", path);
+        return -1;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    data.resize(ftell(fp));
+    fseek(fp, 0, SEEK_SET);
+
+    size_t nread = data.empty() ? 0 : fread(data.data(), 1, data.size(), fp);
+    fclose(fp);
+
+    return nread == data.size() ? 0 : -1;
+}
+
+int ModelWriter::save_container(const char* path, const char* int8_table_path)
+{
+    // write the plain pair and split the bin by layer
+    const std::string parampath = std::string(path) + ".param.tmp";
+    const std::string binpath = std::string(path) + ".bin.tmp";
+
+    int ret = save(parampath.c_str(), binpath.c_str());
+
+    std::vector<unsigned char> param;
+    std::vector<unsigned char> bin;
+    if (ret == 0)
+        ret = read_whole_file(parampath.c_str(), param);
+    if (ret == 0)
+        ret = read_whole_file(binpath.c_str(), bin);
+
+    remove(parampath.c_str());
+    remove(binpath.c_str());
+
+    if (ret != 0)
+        return -1;
+
+    ncnn::ModelContainerWriter writer;
+
+    param.push_back('\0');
+    writer.add_section(ncnn::MODEL_CONTAINER_PARAM, 0, param.data(), param.size());
+
+    for (size_t i = 0; i + 1 < layer_bin_offsets.size(); i++)
+    {
+        const size_t size = layer_bin_offsets[i + 1] - layer_bin_offsets[i];
+        if (size == 0)
+            continue;
+
+        writer.add_section(ncnn::MODEL_CONTAINER_LAYER_WEIGHT, (int)i, bin.data() + layer_bin_offsets[i], size);
+    }
+
+    if (int8_table_path)
+    {
+        std::vector<unsigned char> table;
+        if (read_whole_file(int8_table_path, table) != 0)
+            return -1;
+
+        writer.add_section(ncnn::MODEL_CONTAINER_INT8_TABLE, 0, table.data(), table.size());
+    }
+
+    return writer.save(path);
+}
+
+// single file model container is written when output param ends with this
+static bool is_container_path(const char* path)
+{
+    const size_t len = strlen(path);
+    return len > 10 && strcmp(path + len - 10, ".ncnnmodel") == 0;
+}
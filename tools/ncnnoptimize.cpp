@@ -2758,6 +2758,8 @@ int main(int argc, char** argv)
     if (argc < 6)
     {
         fprintf(stderr, "usage: %s [inparam] [inbin] [outparam] [outbin] [flag] [cutstart] [cutend]\n", argv[0]);
+        fprintf(stderr, "  flag 0=fp32 1=fp16 2=fp32 compressed 3=fp16 compressed\n");
+        fprintf(stderr, "  outparam ending with .ncnnmodel writes single file model container, outbin is ignored\n");
         return -1;
     }
 
@@ -2781,7 +2783,7 @@ int main(int argc, char** argv)
 
     NetOptimize optimizer;
 
-    if (flag == 65536 || flag == 1)
+    if (flag == 65536 || flag == 1 || flag == 3)
     {
         optimizer.storage_type = 1;
     }
@@ -2790,6 +2792,8 @@ int main(int argc, char** argv)
         optimizer.storage_type = 0;
     }
 
+    optimizer.weight_compression = flag == 2 || flag == 3;
+
     optimizer.load_param(inparam);
 
     if (strcmp(inbin, "null") == 0)
@@ -2850,7 +2854,10 @@ int main(int argc, char** argv)
 
     optimizer.estimate_memory_footprint();
 
-    optimizer.save(outparam, outbin);
+    if (is_container_path(outparam))
+        optimizer.save_container(outparam);
+    else
+        optimizer.save(outparam, outbin);
 
     return 0;
 }
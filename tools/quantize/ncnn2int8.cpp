@@ -17,6 +17,7 @@
 #endif
 
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <map>
 #include <set>
@@ -30,6 +31,7 @@
 
 // ncnn private header
 #include "../modelwriter.h"
+#include "layer/weight_quant.h"
 
 class DataReaderFromEmpty : public ncnn::DataReader
 {
@@ -124,17 +126,46 @@ public:
     std::map<std::string, ncnn::Mat> blob_int8scale_table;
     std::map<std::string, ncnn::Mat> weight_int8scale_table;
 
+    // weight-only quantization, 4 or 8
+    int weight_quant_bits;
+    int weight_quant_group_size;
+
 public:
     int quantize_convolution();
     int quantize_convolutiondepthwise();
     int quantize_innerproduct();
 
+    int quantize_weight_only();
+
     int fuse_requantize();
 };
 
 NetQuantize::NetQuantize()
     : ModelWriter()
 {
+    weight_quant_bits = 0;
+    weight_quant_group_size = 32;
+}
+
+// quantize N rows of K fp32 weight, row n starts at n * n_step and advances by k_step
+static void quantize_weight_rows(const float* ptr, int n_step, int k_step, int N, int K, int bits, int group_size, ncnn::Mat& weight_data_quant, ncnn::Mat& scales)
+{
+    const int row_bytes = weight_quant_row_bytes(K, bits);
+    const int group_count = weight_quant_group_count(K, group_size);
+
+    weight_data_quant.create(row_bytes * N, (size_t)1u);
+    scales.create(group_count * N);
+
+    std::vector<float> row(K);
+    for (int n = 0; n < N; n++)
+    {
+        for (int k = 0; k < K; k++)
+        {
+            row[k] = ptr[n * n_step + k * k_step];
+        }
+
+        weight_quant_quantize_row(row.data(), (unsigned char*)weight_data_quant + n * row_bytes, (float*)scales + n * group_count, K, bits, group_size);
+    }
 }
 
 int NetQuantize::quantize_convolution()
@@ -312,6 +343,60 @@ int NetQuantize::quantize_innerproduct()
     return 0;
 }
 
+int NetQuantize::quantize_weight_only()
+{
+    const int layer_count = static_cast<int>(layers.size());
+    for (int i = 0; i < layer_count; i++)
+    {
+        if (layers[i]->type == "InnerProduct")
+        {
+            ncnn::InnerProduct* fc = (ncnn::InnerProduct*)layers[i];
+            if (fc->int8_scale_term || fc->weight_quant_bits || fc->weight_data.elemsize != 4)
+                continue;
+
+            fprintf(stderr, "quantize_weight_only %s\n", fc->name.c_str());
+
+            const int num_input = fc->weight_data_size / fc->num_output;
+
+            ncnn::Mat weight_data_quant;
+            ncnn::Mat weight_quant_scales;
+            quantize_weight_rows(fc->weight_data, num_input, 1, fc->num_output, num_input, weight_quant_bits, weight_quant_group_size, weight_data_quant, weight_quant_scales);
+
+            fc->weight_quant_bits = weight_quant_bits;
+            fc->weight_quant_group_size = weight_quant_group_size;
+            fc->weight_data = weight_data_quant;
+            fc->weight_quant_scales = weight_quant_scales;
+        }
+
+        if (layers[i]->type == "Gemm")
+        {
+            ncnn::Gemm* gemm = (ncnn::Gemm*)layers[i];
+            if (gemm->constantA || !gemm->constantB || gemm->weight_quant_bits || gemm->B_data.elemsize != 4)
+                continue;
+
+            fprintf(stderr, "quantize_weight_only %s\n", gemm->name.c_str());
+
+            const int N = gemm->constantN;
+            const int K = gemm->constantK;
+
+            // B is K x N, or N x K when transB
+            const int n_step = gemm->transB ? K : 1;
+            const int k_step = gemm->transB ? 1 : N;
+
+            ncnn::Mat B_data_quant;
+            ncnn::Mat B_quant_scales;
+            quantize_weight_rows(gemm->B_data, n_step, k_step, N, K, weight_quant_bits, weight_quant_group_size, B_data_quant, B_quant_scales);
+
+            gemm->weight_quant_bits = weight_quant_bits;
+            gemm->weight_quant_group_size = weight_quant_group_size;
+            gemm->B_data = B_data_quant;
+            gemm->B_quant_scales = B_quant_scales;
+        }
+    }
+
+    return 0;
+}
+
 int NetQuantize::fuse_requantize()
 {
     const size_t layer_count = layers.size();
@@ -517,9 +602,15 @@ int NetQuantize::fuse_requantize()
 
 int main(int argc, char** argv)
 {
-    if (argc != 6)
+    // weight-only mode keeps activations in fp32
+    const bool weight_only = argc >= 6 && (strcmp(argv[5], "int4") == 0 || strcmp(argv[5], "int8") == 0);
+
+    if ((!weight_only && argc != 6) || (weight_only && argc > 7))
     {
         fprintf(stderr, "usage: %s [inparam] [inbin] [outparam] [outbin] [calibration table]\n", argv[0]);
+        fprintf(stderr, "       %s [inparam] [inbin] [outparam] [outbin] int4/int8 [group size=32]\n", argv[0]);
+        fprintf(stderr, "  int4/int8 quantizes InnerProduct and constant B Gemm weight group-wise, no calibration table needed\n");
+        fprintf(stderr, "  outparam ending with .ncnnmodel writes single file model container, outbin is ignored\n");
         return -1;
     }
 
@@ -527,10 +618,22 @@ int main(int argc, char** argv)
     const char* inbin = argv[2];
     const char* outparam = argv[3];
     const char* outbin = argv[4];
-    const char* int8scale_table_path = argv[5];
+    const char* int8scale_table_path = weight_only ? 0 : argv[5];
 
     NetQuantize quantizer;
 
+    if (weight_only)
+    {
+        quantizer.weight_quant_bits = argv[5][3] == '4' ? 4 : 8;
+        quantizer.weight_quant_group_size = argc == 7 ? atoi(argv[6]) : 32;
+
+        if (quantizer.weight_quant_group_size <= 0)
+        {
+            fprintf(stderr, "invalid group size %s\n", argv[6]);
+            return -1;
+        }
+    }
+
     // parse the calibration scale table
     if (int8scale_table_path)
     {
@@ -542,6 +645,9 @@ int main(int argc, char** argv)
         }
     }
 
+    // keep the untransformed weights for rewriting
+    quantizer.opt.use_lazy_pipeline = true;
+
     quantizer.load_param(inparam);
     if (strcmp(inbin, "null") == 0)
     {
@@ -552,13 +658,23 @@ int main(int argc, char** argv)
     else
         quantizer.load_model(inbin);
 
-    quantizer.quantize_convolution();
-    quantizer.quantize_convolutiondepthwise();
-    quantizer.quantize_innerproduct();
+    if (weight_only)
+    {
+        quantizer.quantize_weight_only();
+    }
+    else
+    {
+        quantizer.quantize_convolution();
+        quantizer.quantize_convolutiondepthwise();
+        quantizer.quantize_innerproduct();
 
-    quantizer.fuse_requantize();
+        quantizer.fuse_requantize();
+    }
 
-    quantizer.save(outparam, outbin);
+    if (is_container_path(outparam))
+        quantizer.save_container(outparam, int8scale_table_path);
+    else
+        quantizer.save(outparam, outbin);
 
     return 0;
 }